@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __XVIWEB_COROUTINERESPONDER_H__
+#define __XVIWEB_COROUTINERESPONDER_H__
+
+#if __cplusplus < 202002L
+#error "xviweb/CoroutineResponder.h requires C++20"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "HttpClient.h"
+#include "Responder.h"
+
+// A coroutine responder's respondAsync is a coroutine returning a
+// ResponderTask. It can co_await the following:
+//
+//   ResponderWritable()        until the client socket is writable
+//   ResponderSleep(ms)         for the given number of milliseconds
+//   ResponderBodyChunk()       for the next chunk of the request body,
+//                              which is empty once the body has ended
+//   ResponderWork<T>(function) for the function to be run on a worker
+//                              thread; evaluates to its result
+//   ResponderHttpCalls(calls)  for HttpClient calls started with the
+//                              coroutine's response to all complete
+//
+// The coroutine is resumed by the server as soon as what it's waiting
+// for happens, and must end the response before it returns, just like
+// a ResponderContext.
+
+class ResponderTaskPromise;
+
+// recycles coroutine frames, which all have to be allocated and
+// freed on the server's thread, in 64 byte size classes
+class ResponderFramePool
+{
+	private:
+		static const size_t SIZE_CLASS = 64;
+		static const size_t MAX_SIZE = 4096;
+		static const size_t MAX_FREE_FRAMES = 1024;
+
+		std::vector <void *> m_freeLists[MAX_SIZE / SIZE_CLASS];
+
+	public:
+		~ResponderFramePool()
+		{
+			for(size_t i = 0; i < MAX_SIZE / SIZE_CLASS; ++i) {
+				for(size_t j = 0; j < m_freeLists[i].size(); ++j)
+					::operator delete(m_freeLists[i][j]);
+			}
+		}
+
+		static ResponderFramePool &
+		getInstance()
+		{
+			static thread_local ResponderFramePool pool;
+			return pool;
+		}
+
+		void *
+		allocate(size_t size)
+		{
+			if(size == 0 || size > MAX_SIZE)
+				return ::operator new(size);
+
+			std::vector <void *> &freeList = m_freeLists[(size - 1) / SIZE_CLASS];
+			if(freeList.empty())
+				return ::operator new(((size - 1) / SIZE_CLASS + 1) * SIZE_CLASS);
+
+			void *frame = freeList.back();
+			freeList.pop_back();
+			return frame;
+		}
+
+		void
+		deallocate(void *frame, size_t size)
+		{
+			if(size == 0 || size > MAX_SIZE) {
+				::operator delete(frame);
+				return;
+			}
+
+			std::vector <void *> &freeList = m_freeLists[(size - 1) / SIZE_CLASS];
+			if(freeList.size() < MAX_FREE_FRAMES)
+				freeList.push_back(frame);
+			else
+				::operator delete(frame);
+		}
+};
+
+// runs ResponderWork functions off of the server's thread
+class ResponderWorkerPool
+{
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque <std::function<void()> > m_queue;
+		std::vector <std::thread> m_threads;
+		bool m_stopping;
+
+		ResponderWorkerPool() : m_stopping(false) {}
+
+		void
+		run()
+		{
+			for(;;) {
+				std::function<void()> function;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_condition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+					if(m_queue.empty())
+						return;
+
+					function = std::move(m_queue.front());
+					m_queue.pop_front();
+				}
+
+				function();
+			}
+		}
+
+	public:
+		~ResponderWorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+
+			m_condition.notify_all();
+			for(size_t i = 0; i < m_threads.size(); ++i)
+				m_threads[i].join();
+		}
+
+		static ResponderWorkerPool &
+		getInstance()
+		{
+			static ResponderWorkerPool pool;
+			return pool;
+		}
+
+		void
+		submit(std::function<void()> function)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				// the threads are only started once there's work
+				if(m_threads.empty()) {
+					unsigned int count = std::thread::hardware_concurrency();
+					if(count == 0)
+						count = 4;
+
+					for(unsigned int i = 0; i < count; ++i)
+						m_threads.push_back(std::thread([this] { run(); }));
+				}
+
+				m_queue.push_back(std::move(function));
+			}
+
+			m_condition.notify_one();
+		}
+};
+
+// base class of the awaitables; the coroutine's context asks the one
+// it's waiting on whether it's ready each time it's woken, and has it
+// ask for the wakeup again if it isn't
+class ResponderAwaiter
+{
+	protected:
+		ResponderTaskPromise *m_promise;
+
+	public:
+		ResponderAwaiter() : m_promise(nullptr) {}
+		virtual ~ResponderAwaiter() {}
+
+		virtual bool isReady() const { return true; }
+		virtual void arm(HttpResponse *response) = 0;
+
+		bool await_ready() { return false; }
+		inline void await_suspend(std::coroutine_handle<ResponderTaskPromise> handle);
+		void await_resume() {}
+};
+
+class ResponderTask
+{
+	private:
+		std::coroutine_handle<ResponderTaskPromise> m_handle;
+
+	public:
+		typedef ResponderTaskPromise promise_type;
+
+		explicit ResponderTask(std::coroutine_handle<ResponderTaskPromise> handle) : m_handle(handle) {}
+		ResponderTask(ResponderTask &&task) : m_handle(task.m_handle) { task.m_handle = nullptr; }
+		ResponderTask(const ResponderTask &) = delete;
+		ResponderTask &operator=(const ResponderTask &) = delete;
+
+		~ResponderTask()
+		{
+			if(m_handle)
+				m_handle.destroy();
+		}
+
+		std::coroutine_handle<ResponderTaskPromise>
+		release()
+		{
+			std::coroutine_handle<ResponderTaskPromise> handle = m_handle;
+			m_handle = nullptr;
+			return handle;
+		}
+};
+
+class ResponderTaskPromise
+{
+	public:
+		HttpResponse *response;
+		ResponderAwaiter *awaiter;
+		std::exception_ptr exception;
+
+		// the request body as it's streamed to the context
+		std::string body;
+		bool bodyEnded;
+
+		ResponderTaskPromise() : response(nullptr), awaiter(nullptr), bodyEnded(false) {}
+
+		static void *
+		operator new(size_t size)
+		{
+			return ResponderFramePool::getInstance().allocate(size);
+		}
+
+		static void
+		operator delete(void *frame, size_t size)
+		{
+			ResponderFramePool::getInstance().deallocate(frame, size);
+		}
+
+		ResponderTask get_return_object() { return ResponderTask(std::coroutine_handle<ResponderTaskPromise>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		void return_void() {}
+		void unhandled_exception() { exception = std::current_exception(); }
+};
+
+inline void
+ResponderAwaiter::await_suspend(std::coroutine_handle<ResponderTaskPromise> handle)
+{
+	m_promise = &handle.promise();
+	m_promise->awaiter = this;
+	arm(m_promise->response);
+}
+
+class ResponderWritable : public ResponderAwaiter
+{
+	public:
+		// the context may be woken with the connection's output
+		// still full (e.g. as the request body's read)
+		bool isReady() const { return m_promise->response->getSendCapacity() != 0; }
+		void arm(HttpResponse *response) { response->wakeWhenWritable(); }
+};
+
+class ResponderSleep : public ResponderAwaiter
+{
+	private:
+		std::chrono::steady_clock::time_point m_wakeupTime;
+
+		long
+		getRemainingMilliseconds() const
+		{
+			std::chrono::steady_clock::duration remaining = m_wakeupTime - std::chrono::steady_clock::now();
+			return (long)std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+		}
+
+	public:
+		explicit ResponderSleep(long milliseconds)
+		 : m_wakeupTime(std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds)) {}
+
+		bool isReady() const { return getRemainingMilliseconds() <= 0; }
+		void arm(HttpResponse *response) { response->wakeAfter(getRemainingMilliseconds()); }
+};
+
+class ResponderBodyChunk : public ResponderAwaiter
+{
+	public:
+		bool await_ready() { return false; }
+
+		bool
+		await_suspend(std::coroutine_handle<ResponderTaskPromise> handle)
+		{
+			// don't suspend if there's already body data to return
+			ResponderTaskPromise &promise = handle.promise();
+			if(!promise.body.empty() || promise.bodyEnded) {
+				m_promise = &promise;
+				return false;
+			}
+
+			ResponderAwaiter::await_suspend(handle);
+			return true;
+		}
+
+		std::string
+		await_resume()
+		{
+			std::string chunk;
+			chunk.swap(m_promise->body);
+			return chunk;
+		}
+
+		bool isReady() const { return !m_promise->body.empty() || m_promise->bodyEnded; }
+		void arm(HttpResponse *response) { response->wakeWhenBodyRead(); }
+};
+
+class ResponderHttpCalls : public ResponderAwaiter
+{
+	private:
+		std::vector<HttpClientCall *> m_calls;
+
+	public:
+		explicit ResponderHttpCalls(HttpClientCall *call) : m_calls(1, call) {}
+		explicit ResponderHttpCalls(const std::vector<HttpClientCall *> &calls) : m_calls(calls) {}
+
+		bool
+		await_suspend(std::coroutine_handle<ResponderTaskPromise> handle)
+		{
+			// don't suspend if the calls have already completed
+			if(isReady()) {
+				m_promise = &handle.promise();
+				return false;
+			}
+
+			ResponderAwaiter::await_suspend(handle);
+			return true;
+		}
+
+		bool
+		isReady() const
+		{
+			for(size_t i = 0; i < m_calls.size(); ++i) {
+				if(!m_calls[i]->isDone())
+					return false;
+			}
+
+			return true;
+		}
+
+		// each call wakes the response as it completes
+		void arm(HttpResponse *response) { response->sleep(); }
+};
+
+template <typename T>
+class ResponderWork : public ResponderAwaiter
+{
+	private:
+		typedef typename std::conditional<std::is_void<T>::value, char, T>::type ResultType;
+
+		// shared with the worker thread, which may finish
+		// after the coroutine has been destroyed
+		class State
+		{
+			public:
+				std::function<T()> function;
+				ResultType result;
+				std::atomic<bool> done;
+				ResponderNotifier *notifier;
+
+				State() : result(), done(false), notifier(nullptr) {}
+
+				void
+				run()
+				{
+					if constexpr (std::is_void<T>::value)
+						function();
+					else
+						result = function();
+				}
+		};
+
+		std::shared_ptr<State> m_state;
+
+	public:
+		explicit ResponderWork(std::function<T()> function) : m_state(std::make_shared<State>())
+		{
+			m_state->function = std::move(function);
+		}
+
+		bool
+		await_suspend(std::coroutine_handle<ResponderTaskPromise> handle)
+		{
+			ResponderAwaiter::await_suspend(handle);
+
+			// run the function right away if
+			// the context can't be notified
+			ResponderNotifier *notifier = m_promise->response->getNotifier();
+			if(notifier == nullptr) {
+				m_promise->awaiter = nullptr;
+				m_state->run();
+				m_state->done = true;
+				return false;
+			}
+
+			notifier->retain();
+			m_state->notifier = notifier;
+
+			std::shared_ptr<State> state = m_state;
+			ResponderWorkerPool::getInstance().submit([state] {
+				state->run();
+				state->done = true;
+				state->notifier->notify();
+				state->notifier->release();
+			});
+
+			return true;
+		}
+
+		T
+		await_resume()
+		{
+			if constexpr (!std::is_void<T>::value)
+				return std::move(m_state->result);
+		}
+
+		bool isReady() const { return m_state->done; }
+
+		// the response's notifier wakes the context once the work is done
+		void arm(HttpResponse *) {}
+};
+
+class CoroutineResponderContext : public ResponderContext
+{
+	private:
+		std::coroutine_handle<ResponderTaskPromise> m_handle;
+
+		CoroutineResponderContext(std::coroutine_handle<ResponderTaskPromise> handle) : m_handle(handle) {}
+
+		// resumes the coroutine and returns false once it's done
+		static bool
+		resume(std::coroutine_handle<ResponderTaskPromise> handle)
+		{
+			handle.resume();
+			if(!handle.done())
+				return true;
+
+			// end the response of a coroutine that threw an exception
+			ResponderTaskPromise &promise = handle.promise();
+			if(promise.exception) {
+				try {
+					std::rethrow_exception(promise.exception);
+				} catch(const std::exception &ex) {
+					std::cerr << "Responder coroutine threw an exception: " << ex.what() << std::endl;
+				} catch(...) {
+					std::cerr << "Responder coroutine threw an exception" << std::endl;
+				}
+
+				promise.response->endResponse();
+			}
+
+			return false;
+		}
+
+	public:
+		~CoroutineResponderContext()
+		{
+			m_handle.destroy();
+		}
+
+		static ResponderContext *
+		start(ResponderTask &task, HttpResponse *response, bool bodyEnded)
+		{
+			std::coroutine_handle<ResponderTaskPromise> handle = task.release();
+			handle.promise().response = response;
+			handle.promise().bodyEnded = bodyEnded;
+
+			if(resume(handle))
+				return new CoroutineResponderContext(handle);
+
+			handle.destroy();
+			return nullptr;
+		}
+
+		ResponderContext *
+		continueResponse(const HttpRequest *, HttpResponse *response)
+		{
+			// the context may be woken by events other than the
+			// one the coroutine is waiting for
+			ResponderTaskPromise &promise = m_handle.promise();
+			if(promise.awaiter != nullptr && !promise.awaiter->isReady()) {
+				promise.awaiter->arm(response);
+				return this;
+			}
+
+			promise.awaiter = nullptr;
+			return resume(m_handle) ? this : nullptr;
+		}
+
+		void
+		requestBodyRead(const char *data, size_t length)
+		{
+			m_handle.promise().body.append(data, length);
+		}
+
+		void
+		requestBodyEnded()
+		{
+			m_handle.promise().bodyEnded = true;
+		}
+};
+
+class CoroutineResponder : public Responder
+{
+	public:
+		virtual ResponderTask respondAsync(const HttpRequest *request, HttpResponse *response) = 0;
+
+		ResponderContext *
+		respond(const HttpRequest *request, HttpResponse *response)
+		{
+			// a body that isn't streamed has already been read
+			ResponderTask task = respondAsync(request, response);
+			return CoroutineResponderContext::start(task, response, !streamsRequestBody(request));
+		}
+};
+
+#endif /* __XVIWEB_COROUTINERESPONDER_H__ */
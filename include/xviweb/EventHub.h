@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __XVIWEB_EVENTHUB_H__
+#define __XVIWEB_EVENTHUB_H__
+
+#include <string>
+#include "Responder.h"
+
+// fans events published to a channel out to every response subscribed
+// to it; each event is encoded once and the encoded event is shared by
+// all of the subscribers, which sleep until there's something to send.
+// it must only be used from the server's thread
+class EventHub
+{
+	public:
+		virtual ~EventHub() {}
+
+		static EventHub *getInstance();
+
+		// begins a Server-Sent Events (text/event-stream) response
+		// subscribed to the channel and returns the context that a
+		// responder should return from respond
+		virtual ResponderContext *subscribe(const std::string &channel, HttpResponse *response) = 0;
+
+		// responds with the data of the next event published to the
+		// channel, or with 204 No Content if there isn't one before
+		// the timeout; returns the context to return from respond
+		virtual ResponderContext *waitForEvent(const std::string &channel, HttpResponse *response, long timeout = 30000) = 0;
+
+		virtual void publish(const std::string &channel, const std::string &data, const std::string &event = "", const std::string &id = "") = 0;
+
+		virtual size_t getSubscriberCount(const std::string &channel) const = 0;
+};
+
+#endif /* __XVIWEB_EVENTHUB_H__ */
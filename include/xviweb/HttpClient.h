@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __XVIWEB_HTTPCLIENT_H__
+#define __XVIWEB_HTTPCLIENT_H__
+
+#include <map>
+#include <string>
+#include "HttpResponse.h"
+
+typedef std::map<std::string, std::string> HttpClientHeaderMap;
+
+// an outbound request made with HttpClient; deleting one that
+// hasn't completed cancels it, so a context must delete the calls
+// it started with its response before the response is deleted
+class HttpClientCall
+{
+	public:
+		virtual ~HttpClientCall() {}
+
+		virtual bool isDone() const = 0;
+
+		// describes why the call failed if it didn't get a response
+		// (e.g. the connection was refused or the call timed out)
+		virtual bool hasFailed() const = 0;
+		virtual std::string getError() const = 0;
+
+		virtual int getStatusCode() const = 0;
+		virtual std::string getStatusMessage() const = 0;
+		virtual std::string getHeaderValue(const std::string &headerName) const = 0;
+		virtual const std::string &getBody() const = 0;
+};
+
+class HttpClientHandler
+{
+	public:
+		virtual ~HttpClientHandler() {}
+
+		virtual void callCompleted(HttpClientCall *call) = 0;
+};
+
+// makes HTTP/1.1 requests to other servers from the server's loop
+// without blocking it, keeping connections to each destination alive
+// for later requests. any number of calls can be in progress at once,
+// so a context can start several and sleep until they've all completed.
+// it must only be used from the server's thread
+class HttpClient
+{
+	public:
+		virtual ~HttpClient() {}
+
+		static HttpClient *getInstance();
+
+		// starts a request to an http:// URL. once the call completes
+		// or fails, the given response (if any) is woken as if by its
+		// wake function and then the handler (if any) is called. the
+		// caller owns the returned call, which is never NULL; calls
+		// that can't be started fail on the next cycle
+		virtual HttpClientCall *request(const std::string &verb, const std::string &url, const HttpClientHeaderMap &headers, const std::string &body, HttpResponse *response, HttpClientHandler *handler = NULL) = 0;
+		virtual HttpClientCall *get(const std::string &url, HttpResponse *response, HttpClientHandler *handler = NULL) = 0;
+
+		// calls fail if they don't complete within the timeout
+		// (30 seconds by default) or if their response's body is
+		// larger than the maximum size (16 MB by default)
+		virtual void setTimeout(long timeout) = 0;
+		virtual void setMaxResponseSize(size_t maxResponseSize) = 0;
+
+		// how many idle connections are kept open
+		// to each destination (8 by default)
+		virtual void setMaxIdleConnections(unsigned int maxIdleConnections) = 0;
+};
+
+#endif /* __XVIWEB_HTTPCLIENT_H__ */
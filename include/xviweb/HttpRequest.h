@@ -27,6 +27,8 @@
 #define __XVIWEB_HTTPREQUEST_H__
 
 #include <string>
+#include <vector>
+#include "HttpRequestFile.h"
 
 class HttpRequest
 {
@@ -35,9 +37,25 @@ class HttpRequest
 		virtual std::string getPath() const = 0;
 		virtual std::string getVersion() const = 0;
 		virtual std::string getVHostRoot() const = 0;
+		virtual std::string getQueryString() const = 0;
 		virtual std::string getQueryStringValue(const std::string &name) const = 0;
+		virtual std::vector <std::string> getHeaderNames() const = 0;
 		virtual std::string getHeaderValue(const std::string &name) const = 0;
+
+		// trailers that follow a chunked or HTTP/2 body are kept
+		// apart from the headers, which they can't add to or change;
+		// they're only known once the whole body has been read
+		virtual std::vector <std::string> getTrailerNames() const = 0;
+		virtual std::string getTrailerValue(const std::string &name) const = 0;
+
 		virtual std::string getPostDataValue(const std::string &name) const = 0;
+		virtual std::string getBody() const = 0;
+		virtual const HttpRequestFile *getFile(const std::string &name) const = 0;
+		virtual std::vector <const HttpRequestFile *> getFiles() const = 0;
+
+		// returns the value of a parameter in the path of the
+		// responder route that the request matched
+		virtual std::string getPathParameter(const std::string &name) const = 0;
 };
 
 #endif /* __XVIWEB_HTTPREQUEST_H__ */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __XVIWEB_HTTPREQUESTFILE_H__
+#define __XVIWEB_HTTPREQUESTFILE_H__
+
+#include <string>
+#include <stdint.h>
+
+// a file uploaded with a multipart/form-data request; its data is
+// stored in a temporary file that's removed after the request has
+// been handled, unless a responder moves it elsewhere
+class HttpRequestFile
+{
+	public:
+		virtual ~HttpRequestFile() {}
+
+		virtual std::string getFieldName() const = 0;
+		virtual std::string getFileName() const = 0;
+		virtual std::string getContentType() const = 0;
+		virtual uint64_t getSize() const = 0;
+		virtual std::string getPath() const = 0;
+};
+
+#endif /* __XVIWEB_HTTPREQUESTFILE_H__ */
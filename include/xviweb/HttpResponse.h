@@ -27,10 +27,21 @@
 #define __XVIWEB_HTTPRESPONSE_H__
 
 #include <string>
+#include <stdint.h>
+#include "ResponderNotifier.h"
+
+// events that a context can wait for on its own descriptors
+enum HttpResponseDescriptorEvent
+{
+	HTTP_RESPONSE_READABLE = 1,
+	HTTP_RESPONSE_WRITABLE = 2
+};
 
 class HttpResponse
 {
 	public:
+		virtual ~HttpResponse() {}
+
 		virtual int getStatusCode() const = 0;
 		virtual std::string getStatusMessage() const = 0;
 		virtual void setStatus(int statusCode, const std::string &statusMessage) = 0;
@@ -41,9 +52,18 @@ class HttpResponse
 		virtual int getContentLength() const = 0;
 		virtual void setContentLength(int contentLength) = 0;
 
+		// for bodies that may be longer than an int can hold
+		virtual void setContentLength(uint64_t contentLength) = 0;
+
+		// setting a header to an empty value removes it
 		virtual std::string getHeaderValue(const std::string &headerName) const = 0;
 		virtual void setHeaderValue(const std::string &headerName, const std::string &headerValue) = 0;
 
+		// trailers are sent after the body of a chunked response;
+		// ones set before the body is started are also announced
+		// in a Trailer header
+		virtual void setTrailerValue(const std::string &trailerName, const std::string &trailerValue) = 0;
+
 		virtual void redirect(const std::string &location) = 0;
 
 		virtual void sendString(const char *s, size_t length) = 0;
@@ -52,10 +72,54 @@ class HttpResponse
 		virtual void sendLine(const char *line) = 0;
 		virtual void sendLine(const std::string &line) = 0;
 
+		// sends part of a file, which can be closed once this returns;
+		// where the server can read files asynchronously, the response
+		// goes on without waiting for the file to be read
+		virtual void sendFile(int fd, uint64_t offset, size_t length) = 0;
+
 		virtual void sendResponse(int statusCode, const char *statusMessage, const char *contentType, const char *content) = 0;
 		virtual void sendErrorResponse(int errorCode, const char *errorDesc, const char *errorMessage) = 0;
 
 		virtual void endResponse() = 0;
+
+		// closes the connection without ending the response, for
+		// when it can't be completed (e.g. its source has failed)
+		virtual void abortResponse() = 0;
+
+		// output the connection can't send right away is queued, so
+		// responses streaming a lot of data should only send as much
+		// as the send capacity allows and then wait for the connection
+		// to become writable (see wakeWhenWritable) before sending more
+		virtual size_t getSendCapacity() const = 0;
+
+		// limits how much unsent data the kernel holds for the
+		// connection (TCP_NOTSENT_LOWAT) for the rest of the response,
+		// which keeps latency down for streams of small updates
+		virtual void setNotSentLowWatermark(unsigned int bytes) = 0;
+
+		// wakeups for a responder context: after arming any of these,
+		// the context's continueResponse is called once one of them
+		// occurs rather than at its response interval; they're cleared
+		// before each call to continueResponse, and a context that arms
+		// none and has no notifier is polled at its response interval;
+		// a context waiting for the connection to be writable is woken
+		// once the connection's queued output has been sent
+		virtual void wakeWhenWritable() = 0;
+		virtual void wakeWhenBodyRead() = 0;
+		virtual void wakeAfter(long milliseconds) = 0;
+		virtual ResponderNotifier *getNotifier() = 0;
+
+		// wakes the context once a descriptor of its own (e.g. a
+		// nonblocking socket to another server) is readable and/or
+		// writable; errors and hangups count as readable, and the
+		// descriptor must stay open for as long as it's waited on
+		virtual void wakeWhenReady(int fd, int events) = 0;
+
+		// sleep has the context wait for nothing but wake, which can
+		// be called from the server's thread (e.g. by another response's
+		// context) without the cost of a notifier
+		virtual void sleep() = 0;
+		virtual void wake() = 0;
 };
 
 #endif /* __XVIWEB_HTTPRESPONSE_H__ */
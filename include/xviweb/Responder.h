@@ -26,6 +26,7 @@
 #ifndef __XVIWEB_RESPONDER_H__
 #define __XVIWEB_RESPONDER_H__
 
+#include <vector>
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 
@@ -35,8 +36,67 @@ class ResponderContext
 		ResponderContext();
 		virtual ~ResponderContext();
 
+		// returns the context itself to keep responding, another
+		// context to take over, or null once the response has
+		// ended; the server deletes a context once it's replaced
 		virtual ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response) = 0;
 		virtual long getResponseInterval() const;
+
+		// called with the request body as it arrives when the
+		// responder streams the body (see streamsRequestBody)
+		virtual void requestBodyRead(const char *data, size_t length);
+		virtual void requestBodyEnded();
+
+		// while false, the server stops reading the body (e.g. while
+		// the context can't pass on what it has); it's asked again
+		// each time the context has been continued
+		virtual bool isReadyForRequestBody() const;
+};
+
+// how long a responder's responses can be sent from the server's cache
+// without calling the responder (see Responder::getCachePolicy)
+class ResponderCachePolicy
+{
+	public:
+		// a response is fresh for maxAge milliseconds, and can be sent
+		// for staleTime milliseconds more while a request refreshes it
+		long maxAge;
+		long staleTime;
+
+		// responses are selected by the method, host, path and query
+		// string, or only by the values of these query parameters in
+		// place of the query string if any are listed, and by the
+		// request headers named by their Vary headers
+		std::vector <std::string> queryParameters;
+
+		// requests for a response that another request is already
+		// getting from the responder wait up to maxWaitTime
+		// milliseconds to be sent the same response, rather than
+		// calling the responder as well
+		long maxWaitTime;
+
+		ResponderCachePolicy();
+};
+
+// a request that's passed to a responder without its matchesRequest
+// method being called (see Responder::getRoutes)
+class ResponderRoute
+{
+	public:
+		// the path, in which a segment beginning with ':' matches any
+		// one segment and a '*' ends the path and matches the rest of
+		// the requested path (so "/api/*" matches any path below /api/);
+		// the values are available by the names following the ':' or
+		// '*' from HttpRequest::getPathParameter
+		std::string path;
+
+		// the method, or empty for any method (a GET route also
+		// matches HEAD requests), and the host (from the Host header),
+		// or empty for any host
+		std::string method;
+		std::string host;
+
+		ResponderRoute(const std::string &routePath, const std::string &routeMethod = "", const std::string &routeHost = "");
 };
 
 class Responder
@@ -49,6 +109,23 @@ class Responder
 
 		virtual bool matchesRequest(const HttpRequest *request) const = 0;
 		virtual ResponderContext *respond(const HttpRequest *request, HttpResponse *response) = 0;
+
+		// if true, respond is called as soon as the request's headers
+		// have been read, and the body is passed to the returned
+		// context instead of being buffered
+		virtual bool streamsRequestBody(const HttpRequest *request) const;
+
+		// if true, successful GET responses to the request are cached
+		// and sent to later requests for the same thing as described
+		// by the policy; responses that set cookies or whose
+		// Cache-Control forbids it are never cached
+		virtual bool getCachePolicy(const HttpRequest *request, ResponderCachePolicy *policy) const;
+
+		// adds the routes of the requests the responder handles when
+		// the server starts; the requests that match no responder's
+		// routes are passed to the first responder without routes
+		// whose matchesRequest method returns true
+		virtual void getRoutes(std::vector <ResponderRoute> *routes) const;
 };
 
 #define XVIWEB_RESPONDER(CLASSNAME) extern "C" { const char *getResponderName() { return #CLASSNAME; } Responder *createResponder() { return new CLASSNAME(); } void destroyResponder(Responder *p) { delete p; } }
@@ -28,15 +28,18 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 class String
 {
 	public:
 		static std::string fromInt(int n);
 		static std::string fromUInt(unsigned int n);
+		static std::string fromUInt64(uint64_t n);
 		static std::string hexFromUInt(unsigned int n);
 		static int toInt(const std::string &s);
 		static unsigned int toUInt(const std::string &s);
+		static uint64_t toUInt64(const std::string &s);
 		static unsigned int hexToUInt(const std::string &s, size_t index, size_t length);
 		static unsigned int hexToUInt(const std::string &s, size_t index);
 		static unsigned int hexToUInt(const std::string &s);
@@ -49,6 +52,9 @@ class String
 		static bool endsWith(const std::string &s1, const std::string &s2, bool ignoreCase);
 		static bool endsWith(const std::string &s1, const std::string &s2);
 		static std::vector <std::string> split(const std::string &s, const std::string &delimiter);
+		static bool containsToken(const std::string &list, const std::string &token);
+		static bool acceptsToken(const std::string &list, const std::string &token);
+		static std::string base64Encode(const char *data, size_t length);
 };
 
 #endif /* __XVIWEB_STRING_H__ */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __XVIWEB_WEBSOCKET_H__
+#define __XVIWEB_WEBSOCKET_H__
+
+#include <string>
+#include "Responder.h"
+
+#define WEBSOCKET_CLOSE_NORMAL 1000
+#define WEBSOCKET_CLOSE_GOING_AWAY 1001
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_ABNORMAL 1006
+#define WEBSOCKET_CLOSE_INVALID_DATA 1007
+#define WEBSOCKET_CLOSE_MESSAGE_TOO_BIG 1009
+
+// messages are buffered until they're complete, so their size is
+// always limited; this is the limit unless a responder sets another
+#define WEBSOCKET_DEFAULT_MAX_MESSAGE_SIZE (1024 * 1024)
+
+// one end of a WebSocket connection; messages that are sent are
+// queued on the connection, and the send capacity reports how much
+// more can be queued before a handler should wait to be writable.
+// it must only be used from the server's thread
+class WebSocket
+{
+	public:
+		virtual ~WebSocket() {}
+
+		virtual const HttpRequest *getRequest() const = 0;
+		virtual bool isOpen() const = 0;
+
+		virtual void sendText(const std::string &text) = 0;
+		virtual void sendText(const char *text, size_t length) = 0;
+		virtual void sendBinary(const char *data, size_t length) = 0;
+		virtual void sendPing(const char *data = "", size_t length = 0) = 0;
+
+		// starts the closing handshake; the connection is closed
+		// once the client replies or after a few seconds
+		virtual void close(unsigned short code = WEBSOCKET_CLOSE_NORMAL, const std::string &reason = "") = 0;
+
+		virtual size_t getSendCapacity() const = 0;
+
+		// calls the handler's writable function once
+		// everything that's been sent has been written
+		virtual void wakeWhenWritable() = 0;
+};
+
+class WebSocketHandler
+{
+	public:
+		WebSocketHandler();
+		virtual ~WebSocketHandler();
+
+		virtual void opened(WebSocket *socket);
+
+		// called with each complete message; the data is only
+		// valid until the function returns, and text messages
+		// have been checked to be valid UTF-8
+		virtual void messageReceived(WebSocket *socket, const char *data, size_t length, bool binary) = 0;
+
+		virtual void writable(WebSocket *socket);
+
+		// called once when the connection closes; the code is
+		// WEBSOCKET_CLOSE_ABNORMAL if it closed without a handshake
+		virtual void closed(WebSocket *socket, unsigned short code, const std::string &reason);
+};
+
+// accepts WebSocket upgrade requests, creating a handler for each
+// connection; the server deletes the handler once the connection has
+// closed. requests that aren't valid upgrades are answered with an error
+class WebSocketResponder : public Responder
+{
+	private:
+		size_t m_maxMessageSize;
+
+	public:
+		WebSocketResponder();
+		virtual ~WebSocketResponder();
+
+		virtual void addOption(const std::string &option, const std::string &value);
+
+		// a size of 0 restores the default
+		size_t getMaxMessageSize() const;
+		void setMaxMessageSize(size_t maxMessageSize);
+
+		virtual ResponderContext *respond(const HttpRequest *request, HttpResponse *response);
+
+		virtual WebSocketHandler *createHandler(const HttpRequest *request) = 0;
+};
+
+#endif /* __XVIWEB_WEBSOCKET_H__ */
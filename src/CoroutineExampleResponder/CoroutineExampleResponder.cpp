@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xviweb/CoroutineResponder.h>
+#include <xviweb/String.h>
+
+using namespace std;
+
+// an example of a coroutine responder, which is also built so that
+// CoroutineResponder.h is compiled along with the server; it counts
+// the words in the request body on a worker thread, then sends the
+// number of lines asked for by the "lines" query parameter, waiting
+// "delay" milliseconds before each
+class CoroutineExampleResponder : public CoroutineResponder
+{
+	private:
+		string m_path;
+
+	public:
+		CoroutineExampleResponder() : m_path("/coroutine") {}
+
+		void
+		addOption(const string &option, const string &value)
+		{
+			if(option == "path")
+				m_path = value;
+		}
+
+		bool matchesRequest(const HttpRequest *request) const { return request->getPath() == m_path; }
+		bool streamsRequestBody(const HttpRequest *) const { return true; }
+
+		ResponderTask respondAsync(const HttpRequest *request, HttpResponse *response);
+};
+
+static size_t
+countWords(const string &text)
+{
+	size_t count = 0;
+	bool inWord = false;
+	for(size_t i = 0; i < text.length(); ++i) {
+		bool space = (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n');
+		if(!space && !inWord)
+			++count;
+		inWord = !space;
+	}
+
+	return count;
+}
+
+ResponderTask
+CoroutineExampleResponder::respondAsync(const HttpRequest *request, HttpResponse *response)
+{
+	unsigned int lines = String::toUInt(request->getQueryStringValue("lines"));
+	long delay = String::toUInt(request->getQueryStringValue("delay"));
+
+	// read the body as it arrives; an empty chunk ends it
+	string body;
+	for(;;) {
+		string chunk = co_await ResponderBodyChunk();
+		if(chunk.empty())
+			break;
+		body += chunk;
+	}
+
+	// the work is declared before it's awaited, since GCC 12 frees
+	// what a lambda captures by value twice when the lambda is a
+	// temporary in a co_await expression
+	ResponderWork<size_t> work([body] { return countWords(body); });
+	size_t words = co_await work;
+
+	response->setContentType("text/plain");
+	response->sendString("words: " + String::fromUInt((unsigned int)words) + "\n");
+	for(unsigned int i = 0; i < lines; ++i) {
+		if(delay != 0)
+			co_await ResponderSleep(delay);
+
+		// only send while the connection can take more
+		if(response->getSendCapacity() == 0)
+			co_await ResponderWritable();
+		response->sendString("line " + String::fromUInt(i + 1) + "\n");
+	}
+
+	response->endResponse();
+}
+
+XVIWEB_RESPONDER(CoroutineExampleResponder);
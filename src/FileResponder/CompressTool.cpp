@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef XVIWEB_ZLIB
+#include <zlib.h>
+#endif
+#ifdef XVIWEB_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef XVIWEB_ZSTD
+#include <zstd.h>
+#endif
+#include <xviweb/String.h>
+#include "FileEncoding.h"
+
+using namespace std;
+
+// variants that don't save at least this many
+// percent of a file's size aren't worth keeping
+#define COMPRESS_TOOL_MIN_SAVING 10
+
+class CompressTool
+{
+	private:
+		vector <string> m_mimeTypes;
+		vector <string> m_mimeFileExtensions;
+		set <pair <dev_t, ino_t> > m_directories;
+		uint64_t m_minSize;
+
+		uint64_t m_fileCount;
+		uint64_t m_variantCount;
+		uint64_t m_originalLength;
+		uint64_t m_compressedLength;
+
+		string getMimeTypeForFile(const string &path) const;
+		bool isVariant(const string &path) const;
+		void compressFile(const string &path, const struct stat &status);
+		void writeVariant(const string &path, const struct stat &status, const string &data);
+
+	public:
+		CompressTool();
+
+		void addMimeType(const string &mimeType, const string &fileExtension);
+		void setMinSize(uint64_t size);
+		void compressDirectory(const string &directory);
+		void showSummary(ostream &stream) const;
+};
+
+static bool
+readFile(const string &path, string &data)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	char buffer[65536];
+	ssize_t result;
+	data.clear();
+	while((result = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result == -1) {
+			close(fd);
+			return false;
+		}
+
+		data.append(buffer, (size_t)result);
+	}
+
+	close(fd);
+	return true;
+}
+
+// returns the data compressed in the given encoding, or an
+// empty string if the tool wasn't built with its library
+static string
+compress(const string &data, FileEncodingType encoding)
+{
+	string output;
+
+	switch(encoding) {
+#ifdef XVIWEB_ZLIB
+		case FILE_ENCODING_GZIP: {
+			// a window of 15 bits plus 16 makes a gzip stream
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			if(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw "deflateInit2() failed";
+
+			output.resize(deflateBound(&stream, (uLong)data.length()));
+			stream.next_in = (Bytef *)data.data();
+			stream.avail_in = (uInt)data.length();
+			stream.next_out = (Bytef *)&output[0];
+			stream.avail_out = (uInt)output.length();
+			int result = deflate(&stream, Z_FINISH);
+			output.resize(stream.total_out);
+			deflateEnd(&stream);
+			if(result != Z_STREAM_END)
+				throw "deflate() failed";
+			break;
+		}
+#endif
+#ifdef XVIWEB_BROTLI
+		case FILE_ENCODING_BROTLI: {
+			size_t length = BrotliEncoderMaxCompressedSize(data.length());
+			output.resize(length);
+			if(BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+			                         data.length(), (const uint8_t *)data.data(), &length,
+			                         (uint8_t *)&output[0]) == BROTLI_FALSE)
+				throw "BrotliEncoderCompress() failed";
+			output.resize(length);
+			break;
+		}
+#endif
+#ifdef XVIWEB_ZSTD
+		case FILE_ENCODING_ZSTD: {
+			// level 19 keeps the window within
+			// the 8 MB that clients must accept
+			output.resize(ZSTD_compressBound(data.length()));
+			size_t length = ZSTD_compress(&output[0], output.length(), data.data(), data.length(), 19);
+			if(ZSTD_isError(length))
+				throw "ZSTD_compress() failed";
+			output.resize(length);
+			break;
+		}
+#endif
+		default:
+			break;
+	}
+
+	return output;
+}
+
+CompressTool::CompressTool()
+{
+	m_minSize = 256;
+	m_fileCount = 0;
+	m_variantCount = 0;
+	m_originalLength = 0;
+	m_compressedLength = 0;
+
+	// the same types that FileResponder serves by default
+	addMimeType("text/plain", "txt");
+	addMimeType("text/html", "html");
+	addMimeType("text/css", "css");
+	addMimeType("text/javascript", "js");
+	addMimeType("image/png", "png");
+	addMimeType("image/jpg", "jpeg");
+	addMimeType("image/jpg", "jpg");
+	addMimeType("image/gif", "gif");
+}
+
+void
+CompressTool::addMimeType(const string &mimeType, const string &fileExtension)
+{
+	m_mimeTypes.push_back(mimeType);
+	m_mimeFileExtensions.push_back(string(".") + fileExtension);
+}
+
+void
+CompressTool::setMinSize(uint64_t size)
+{
+	m_minSize = size;
+}
+
+string
+CompressTool::getMimeTypeForFile(const string &path) const
+{
+	for(unsigned int i = 0; i < m_mimeTypes.size(); ++i) {
+		if(String::endsWith(path, m_mimeFileExtensions[i], true))
+			return m_mimeTypes[i];
+	}
+
+	return string("");
+}
+
+bool
+CompressTool::isVariant(const string &path) const
+{
+	for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+		if(String::endsWith(path, FileEncoding::getFileExtension((FileEncodingType)i)))
+			return true;
+	}
+
+	return false;
+}
+
+void
+CompressTool::compressDirectory(const string &directory)
+{
+	struct stat status;
+	if(stat(directory.c_str(), &status) == -1 || S_ISDIR(status.st_mode) == false)
+		throw "not a directory";
+	if(m_directories.insert(make_pair(status.st_dev, status.st_ino)).second == false)
+		return;
+
+	DIR *dir = opendir(directory.c_str());
+	if(dir == NULL)
+		throw "opendir() failed";
+
+	vector <string> names;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		string name = ent->d_name;
+		if(name != "." && name != "..")
+			names.push_back(name);
+	}
+	closedir(dir);
+
+	for(unsigned int i = 0; i < names.size(); ++i) {
+		string path = directory + "/" + names[i];
+		if(stat(path.c_str(), &status) == -1)
+			continue;
+
+		if(S_ISDIR(status.st_mode))
+			compressDirectory(path);
+		else if(S_ISREG(status.st_mode) && isVariant(path) == false &&
+		        FileEncoding::isCompressible(getMimeTypeForFile(path)))
+			compressFile(path, status);
+	}
+}
+
+// brings the variants of a file up to date; variants
+// that are newer than the file are left alone
+void
+CompressTool::compressFile(const string &path, const struct stat &status)
+{
+	if((uint64_t)status.st_size < m_minSize)
+		return;
+
+	string data;
+	bool haveData = false;
+	++m_fileCount;
+	for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+		FileEncodingType encoding = (FileEncodingType)i;
+		string variantPath = path + FileEncoding::getFileExtension(encoding);
+		struct stat variantStatus;
+		if(stat(variantPath.c_str(), &variantStatus) == 0 && variantStatus.st_mtime >= status.st_mtime) {
+			m_originalLength += (uint64_t)status.st_size;
+			m_compressedLength += (uint64_t)variantStatus.st_size;
+			continue;
+		}
+
+		if(haveData == false) {
+			if(readFile(path, data) == false) {
+				cerr << path << ": " << strerror(errno) << endl;
+				return;
+			}
+			haveData = true;
+		}
+
+		string compressed = compress(data, encoding);
+		if(compressed.length() == 0)
+			continue;
+
+		// a variant that isn't worth sending is removed, so
+		// that an older one isn't sent in its place
+		if(compressed.length() * 100 > data.length() * (100 - COMPRESS_TOOL_MIN_SAVING)) {
+			unlink(variantPath.c_str());
+			continue;
+		}
+
+		writeVariant(variantPath, status, compressed);
+		m_originalLength += data.length();
+		m_compressedLength += compressed.length();
+	}
+}
+
+void
+CompressTool::writeVariant(const string &path, const struct stat &status, const string &data)
+{
+	// the variant is renamed into place once it's complete,
+	// so a server never sends part of one
+	string temporaryPath = path + ".tmp";
+	int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, status.st_mode & 0666);
+	if(fd == -1) {
+		cerr << path << ": " << strerror(errno) << endl;
+		return;
+	}
+
+	const char *p = data.data();
+	size_t length = data.length();
+	while(length != 0) {
+		ssize_t result = write(fd, p, length);
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result <= 0) {
+			cerr << path << ": " << strerror(errno) << endl;
+			close(fd);
+			unlink(temporaryPath.c_str());
+			return;
+		}
+
+		p += result;
+		length -= (size_t)result;
+	}
+
+	close(fd);
+	if(rename(temporaryPath.c_str(), path.c_str()) == -1) {
+		cerr << path << ": " << strerror(errno) << endl;
+		unlink(temporaryPath.c_str());
+		return;
+	}
+
+	cout << path << ": " << status.st_size << " -> " << data.length() << " bytes" << endl;
+	++m_variantCount;
+}
+
+void
+CompressTool::showSummary(ostream &stream) const
+{
+	stream << m_fileCount << " files, " << m_variantCount << " variants written";
+	if(m_originalLength != 0)
+		stream << ", variants are " << m_compressedLength * 100 / m_originalLength << "% of the files' size";
+	stream << endl;
+}
+
+static void
+showUsageMessage(ostream &stream, const char *executableName)
+{
+	stream << "Usage: " << executableName << " [--mimeType <type> <extension>]... [--minSize <bytes>] <directory>" << endl << endl;
+	stream << "Writes precompressed variants of the files of compressible types under a" << endl;
+	stream << "directory beside them, which FileResponder and xviweb-pack use. Variants" << endl;
+	stream << "are only written for files that are newer than them and at least" << endl;
+	stream << "--minSize bytes long (256 by default), and only kept if they're smaller" << endl;
+	stream << "than the file by " << COMPRESS_TOOL_MIN_SAVING << "% or more." << endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	CompressTool tool;
+	vector <string> paths;
+
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--help") == 0) {
+			showUsageMessage(cout, argv[0]);
+			return 0;
+		} else if(strcmp(argv[i], "--mimeType") == 0) {
+			if(i + 2 >= argc) {
+				cerr << "Error: Missing parameter(s) for option --mimeType" << endl << endl;
+				showUsageMessage(cerr, argv[0]);
+				return 1;
+			}
+			tool.addMimeType(argv[i + 1], argv[i + 2]);
+			i += 2;
+		} else if(strcmp(argv[i], "--minSize") == 0) {
+			if(i + 1 >= argc) {
+				cerr << "Error: Missing parameter(s) for option --minSize" << endl << endl;
+				showUsageMessage(cerr, argv[0]);
+				return 1;
+			}
+			tool.setMinSize(strtoull(argv[++i], NULL, 10));
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if(paths.size() != 1) {
+		showUsageMessage(cerr, argv[0]);
+		return 1;
+	}
+
+	try {
+		tool.compressDirectory(paths[0]);
+	} catch(const char *message) {
+		cerr << paths[0] << ": " << message << endl;
+		return 1;
+	}
+
+	tool.showSummary(cout);
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xviweb/String.h>
+#include "FileEncoding.h"
+
+using namespace std;
+
+const char *
+FileEncoding::getName(FileEncodingType encoding)
+{
+	switch(encoding) {
+		case FILE_ENCODING_BROTLI:
+			return "br";
+		case FILE_ENCODING_ZSTD:
+			return "zstd";
+		case FILE_ENCODING_GZIP:
+			return "gzip";
+		default:
+			return "";
+	}
+}
+
+const char *
+FileEncoding::getFileExtension(FileEncodingType encoding)
+{
+	switch(encoding) {
+		case FILE_ENCODING_BROTLI:
+			return ".br";
+		case FILE_ENCODING_ZSTD:
+			return ".zst";
+		case FILE_ENCODING_GZIP:
+			return ".gz";
+		default:
+			return "";
+	}
+}
+
+bool
+FileEncoding::isCompressible(const string &contentType)
+{
+	string type = String::toLower(String::trim(String::split(contentType, ";")[0]));
+	if(type.compare(0, 5, "text/") == 0)
+		return true;
+
+	return (type == "application/javascript" || type == "application/json" ||
+	        type == "application/xml" || type == "application/wasm" || type == "image/svg+xml" ||
+	        type == "image/x-icon" || String::endsWith(type, "+json") || String::endsWith(type, "+xml"));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FILEENCODING_H__
+#define __FILEENCODING_H__
+
+#include <string>
+
+// the encodings that files can have precompressed
+// variants in, from the most to the least preferred
+enum FileEncodingType
+{
+	FILE_ENCODING_BROTLI,
+	FILE_ENCODING_ZSTD,
+	FILE_ENCODING_GZIP,
+	FILE_ENCODING_COUNT
+};
+
+class FileEncoding
+{
+	public:
+		// the name used for the encoding in HTTP headers
+		static const char *getName(FileEncodingType encoding);
+
+		// what's appended to a file's name to name its variant
+		static const char *getFileExtension(FileEncodingType encoding);
+
+		// returns true if files of the given type are worth
+		// compressing; most images and archives already are
+		static bool isCompressible(const std::string &contentType);
+};
+
+#endif /* __FILEENCODING_H__ */
@@ -26,14 +26,76 @@
 #include <iostream>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <xviweb/String.h>
 #include "FileResponder.h"
 
 using namespace std;
 
+// the most that's sent at once
+#define FILE_RESPONDER_CHUNK_SIZE 65536
+
+// how much of a large file the kernel's asked to read ahead
+// of what's been sent; it's asked again halfway through
+#define FILE_RESPONDER_READAHEAD_SIZE (1024 * 1024)
+
+FileResponderContext::FileResponderContext(int fd, uint64_t offset, uint64_t length)
+{
+	m_fd = fd;
+	m_offset = offset;
+	m_length = length;
+	m_readaheadOffset = offset;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	// files that take more than one chunk are read in order
+	if(length > FILE_RESPONDER_CHUNK_SIZE)
+		posix_fadvise(fd, (off_t)offset, (off_t)length, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+FileResponderContext::~FileResponderContext()
+{
+	close(m_fd);
+}
+
+ResponderContext *
+FileResponderContext::continueResponse(const HttpRequest * /*request*/, HttpResponse *response)
+{
+#ifdef POSIX_FADV_WILLNEED
+	// start reading what's sent next so that reading it
+	// doesn't wait for the disk if it isn't cached
+	if(m_length > FILE_RESPONDER_CHUNK_SIZE && m_offset >= m_readaheadOffset) {
+		posix_fadvise(m_fd, (off_t)m_offset, FILE_RESPONDER_READAHEAD_SIZE, POSIX_FADV_WILLNEED);
+		m_readaheadOffset = m_offset + FILE_RESPONDER_READAHEAD_SIZE / 2;
+	}
+#endif
+
+	// send as much of the file as the connection can take,
+	// then wait for it to become writable again
+	size_t capacity;
+	while(m_length != 0 && (capacity = response->getSendCapacity()) != 0) {
+		size_t length = (capacity < FILE_RESPONDER_CHUNK_SIZE) ? capacity : FILE_RESPONDER_CHUNK_SIZE;
+		if(length > m_length)
+			length = (size_t)m_length;
+
+		response->sendFile(m_fd, m_offset, length);
+		m_offset += length;
+		m_length -= length;
+	}
+
+	if(m_length == 0) {
+		response->endResponse();
+		return NULL;
+	}
+
+	response->wakeWhenWritable();
+	return this;
+}
+
 FileResponder::FileResponder()
 {
 	m_rootDirectory = ".";
+	m_staticIndex = false;
 
 	// add some standard MIME types
 	addMimeType("text/plain", "txt");
@@ -48,6 +110,13 @@ FileResponder::FileResponder()
 
 FileResponder::~FileResponder()
 {
+	map <string, StaticSite *>::iterator iter;
+	for(iter = m_staticSites.begin(); iter != m_staticSites.end(); ++iter)
+		delete iter->second;
+
+	map <string, PackSite *>::iterator packIter;
+	for(packIter = m_packSites.begin(); packIter != m_packSites.end(); ++packIter)
+		delete packIter->second;
 }
 
 void
@@ -55,6 +124,20 @@ FileResponder::addOption(const string &option, const string &value)
 {
 	if(option == "rootDirectory") {
 		m_rootDirectory = value;
+	} else if(option == "staticIndex") {
+		m_staticIndex = (value == "true");
+	} else if(option == "staticIndexRoot") {
+		// the root's walked from now on, with the MIME
+		// types that have been added so far
+		m_staticIndex = true;
+		getStaticSite(value);
+	} else if(option == "packArchive") {
+		// either the archive that's served for every vhost,
+		// or a vhost's root and the archive served for it
+		vector <string> values = String::split(value, ";");
+		string root = (values.size() == 2) ? values[0] : string("");
+		delete m_packSites[root];
+		m_packSites[root] = new PackSite(values.back());
 	} else if(option == "mimeType") {
 		vector <string> values = String::split(value, ";");
 		if(values.size() == 2) {
@@ -121,12 +204,207 @@ mapPath(const string &path)
 	return newPath;
 }
 
+// returns true if the request's If-None-Match
+// header lists the tag of the file's contents
+static bool
+matchesETag(const HttpRequest *request, const string &etag)
+{
+	string ifNoneMatch = request->getHeaderValue("If-None-Match");
+	if(ifNoneMatch.length() == 0)
+		return false;
+
+	return (String::trim(ifNoneMatch) == "*" || String::containsToken(ifNoneMatch, etag) ||
+	        String::containsToken(ifNoneMatch, "W/" + etag));
+}
+
+// marks a response as being in an encoding, which
+// gives the variant a tag of its own
+static void
+setEncoding(HttpResponse *response, string &etag, FileEncodingType encoding)
+{
+	response->setHeaderValue("Content-Encoding", FileEncoding::getName(encoding));
+	etag.insert(etag.length() - 1, string("-") + FileEncoding::getName(encoding));
+}
+
+StaticSite *
+FileResponder::getStaticSite(const string &root)
+{
+	map <string, StaticSite *>::iterator iter = m_staticSites.find(root);
+	if(iter != m_staticSites.end())
+		return iter->second;
+
+	StaticSite *site = new StaticSite(root, m_mimeTypes, m_mimeFileExtensions);
+	m_staticSites[root] = site;
+	return site;
+}
+
+PackSite *
+FileResponder::getPackSite(const string &root) const
+{
+	map <string, PackSite *>::const_iterator iter = m_packSites.find(root);
+	if(iter == m_packSites.end())
+		iter = m_packSites.find("");
+
+	return (iter != m_packSites.end()) ? iter->second : NULL;
+}
+
 bool
 FileResponder::matchesRequest(const HttpRequest * /*request*/) const
 {
 	return true;
 }
 
+// answers the request with a single lookup in the index of
+// the site, which has what's found by respond below
+ResponderContext *
+FileResponder::respondFromIndex(const HttpRequest *request, HttpResponse *response,
+                                const StaticIndex *index, const string &path)
+{
+	const StaticIndexEntry *entry = index->find(path);
+	if(entry == NULL) {
+		response->sendErrorResponse(404, "File Not Found", "The file that you requested does not exist.");
+		return NULL;
+	}
+
+	switch(entry->type) {
+		case STATIC_INDEX_DIRECTORY:
+			response->redirect(request->getPath() + "/");
+			return NULL;
+		case STATIC_INDEX_NO_INDEX:
+			response->sendErrorResponse(403, "Forbidden", "You do not have access to directory listings.");
+			return NULL;
+		case STATIC_INDEX_FORBIDDEN:
+			response->sendErrorResponse(403, "Forbidden", "You do not have access to files of this type.");
+			return NULL;
+		case STATIC_INDEX_FILE:
+			break;
+	}
+
+	// the variants of a file are in the index beside it,
+	// so choosing one doesn't take a system call either
+	const StaticIndexEntry *file = entry;
+	string etag = entry->etag;
+	string acceptEncoding = request->getHeaderValue("Accept-Encoding");
+	if(FileEncoding::isCompressible(entry->contentType)) {
+		response->setHeaderValue("Vary", "Accept-Encoding");
+		string filePath = entry->path.substr(request->getVHostRoot().length());
+		for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+			FileEncodingType encoding = (FileEncodingType)i;
+			if(String::acceptsToken(acceptEncoding, FileEncoding::getName(encoding)) == false)
+				continue;
+
+			// variants older than the file are of what it used to be
+			const StaticIndexEntry *variant = index->find(filePath + FileEncoding::getFileExtension(encoding));
+			if(variant != NULL && (variant->type == STATIC_INDEX_FILE || variant->type == STATIC_INDEX_FORBIDDEN) &&
+			   variant->modificationTime >= entry->modificationTime) {
+				file = variant;
+				setEncoding(response, etag, encoding);
+				break;
+			}
+		}
+	}
+
+	// a file that's been removed since is noticed once it's opened
+	int fd = open(file->path.c_str(), O_RDONLY);
+	if(fd == -1) {
+		response->sendErrorResponse(404, "File Not Found", "The file that you requested does not exist.");
+		return NULL;
+	}
+
+	return respondWithFile(request, response, fd, 0, file->size, entry->contentType, etag);
+}
+
+// answers the request from an archive made by xviweb-pack,
+// choosing the most preferred variant of the file that the
+// client accepts; the file is read through a descriptor of its own,
+// so the archive can be replaced while it's being sent
+ResponderContext *
+FileResponder::respondFromPack(const HttpRequest *request, HttpResponse *response, PackSite *site,
+                               const string &path)
+{
+	PackArchive *archive = site->getArchive();
+	const PackEntry *entry = (archive != NULL) ? archive->find(path) : NULL;
+	if(entry == NULL) {
+		response->sendErrorResponse(404, "File Not Found", "The file that you requested does not exist.");
+		return NULL;
+	}
+
+	switch(entry->type) {
+		case STATIC_INDEX_DIRECTORY:
+			response->redirect(request->getPath() + "/");
+			return NULL;
+		case STATIC_INDEX_NO_INDEX:
+			response->sendErrorResponse(403, "Forbidden", "You do not have access to directory listings.");
+			return NULL;
+		case STATIC_INDEX_FORBIDDEN:
+			response->sendErrorResponse(403, "Forbidden", "You do not have access to files of this type.");
+			return NULL;
+		default:
+			break;
+	}
+
+	const PackData *data = &entry->data;
+	string etag = archive->getString(entry->etag);
+	bool hasVariants = false;
+	string acceptEncoding = request->getHeaderValue("Accept-Encoding");
+	for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+		if(entry->variants[i].length == 0)
+			continue;
+
+		FileEncodingType encoding = (FileEncodingType)i;
+		if(data == &entry->data && String::acceptsToken(acceptEncoding, FileEncoding::getName(encoding))) {
+			data = &entry->variants[i];
+			setEncoding(response, etag, encoding);
+		}
+		hasVariants = true;
+	}
+	if(hasVariants)
+		response->setHeaderValue("Vary", "Accept-Encoding");
+
+	int fd = dup(archive->getFileDescriptor());
+	if(fd == -1) {
+		response->sendErrorResponse(500, "Internal Server Error", "The file could not be read.");
+		return NULL;
+	}
+
+	return respondWithFile(request, response, fd, data->offset, data->length,
+	                       archive->getString(entry->contentType), etag);
+}
+
+ResponderContext *
+FileResponder::respondWithFile(const HttpRequest *request, HttpResponse *response, int fd,
+                               uint64_t offset, uint64_t size, const string &contentType,
+                               const string &etag)
+{
+	// clients that have the file already are told so
+	response->setHeaderValue("ETag", etag);
+	if(matchesETag(request, etag)) {
+		close(fd);
+		response->setStatus(304, "Not Modified");
+		response->endResponse();
+		return NULL;
+	}
+
+	response->setStatus(200, "OK");
+	response->setContentType(contentType);
+	response->setContentLength(size);
+
+	if(request->getVerb() == "HEAD") {
+		response->endResponse();
+		close(fd);
+		return NULL;
+	}
+
+	// send the file to the client
+	FileResponderContext *context = new FileResponderContext(fd, offset, size);
+	if(context->continueResponse(request, response) == NULL) {
+		delete context;
+		return NULL;
+	}
+
+	return context;
+}
+
 ResponderContext *
 FileResponder::respond(const HttpRequest *request, HttpResponse *response)
 {
@@ -138,6 +416,18 @@ FileResponder::respond(const HttpRequest *request, HttpResponse *response)
 		return NULL;
 	}
 
+	PackSite *packSite = getPackSite(request->getVHostRoot());
+	if(packSite != NULL)
+		return respondFromPack(request, response, packSite, path);
+
+	// until a site's been walked, its files are
+	// found the way they are without an index
+	if(m_staticIndex) {
+		const StaticIndex *index = getStaticSite(request->getVHostRoot())->getIndex();
+		if(index != NULL)
+			return respondFromIndex(request, response, index, path);
+	}
+
 	path = request->getVHostRoot() + path;
 
 	// open the file and get its status
@@ -184,22 +474,37 @@ FileResponder::respond(const HttpRequest *request, HttpResponse *response)
 		return NULL;
 	}
 
-	response->setStatus(200, "OK");
-	response->setContentType(contentType);
-	response->setContentLength((int)status.st_size);
+	// send a precompressed variant of the file instead,
+	// if there's one that the client accepts
+	string etag = StaticIndex::makeETag(status);
+	if(FileEncoding::isCompressible(contentType)) {
+		response->setHeaderValue("Vary", "Accept-Encoding");
+		string acceptEncoding = request->getHeaderValue("Accept-Encoding");
+		for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+			FileEncodingType encoding = (FileEncodingType)i;
+			if(String::acceptsToken(acceptEncoding, FileEncoding::getName(encoding)) == false)
+				continue;
 
-	if(request->getVerb() != "HEAD") {
-		// read the file and send it to the client
-		char buf[512];
-		ssize_t length;
-		while((length = read(fd, buf, sizeof(buf))) > 0)
-			response->sendString(buf, length);
-	}
+			// variants older than the file are of what it used to be
+			struct stat variantStatus;
+			int variantFd = open((path + FileEncoding::getFileExtension(encoding)).c_str(), O_RDONLY);
+			if(variantFd == -1)
+				continue;
+			if(fstat(variantFd, &variantStatus) == -1 || S_ISREG(variantStatus.st_mode) == false ||
+			   variantStatus.st_mtime < status.st_mtime) {
+				close(variantFd);
+				continue;
+			}
 
-	response->endResponse();
+			close(fd);
+			fd = variantFd;
+			status.st_size = variantStatus.st_size;
+			setEncoding(response, etag, encoding);
+			break;
+		}
+	}
 
-	close(fd);
-	return NULL;
+	return respondWithFile(request, response, fd, 0, (uint64_t)status.st_size, contentType, etag);
 }
 
 XVIWEB_RESPONDER(FileResponder);
@@ -26,9 +26,30 @@
 #ifndef __FILERESPONDER_H__
 #define __FILERESPONDER_H__
 
+#include <map>
 #include <string>
 #include <vector>
+#include <stdint.h>
 #include <xviweb/Responder.h>
+#include "FileEncoding.h"
+#include "PackArchive.h"
+#include "StaticIndex.h"
+
+// sends a file, or part of one, as fast as the connection takes it
+class FileResponderContext : public ResponderContext
+{
+	private:
+		int m_fd;
+		uint64_t m_offset;
+		uint64_t m_length;
+		uint64_t m_readaheadOffset;
+
+	public:
+		FileResponderContext(int fd, uint64_t offset, uint64_t length);
+		~FileResponderContext();
+
+		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
+};
 
 class FileResponder : public Responder
 {
@@ -38,6 +59,25 @@ class FileResponder : public Responder
 		std::vector <std::string> m_mimeTypes;
 		std::vector <std::string> m_mimeFileExtensions;
 
+		// sites are indexed as they're first requested, or
+		// when they're given with the staticIndexRoot option
+		bool m_staticIndex;
+		std::map <std::string, StaticSite *> m_staticSites;
+
+		// archives made by xviweb-pack, by the vhost roots that
+		// they're served for; one for every vhost has no root
+		std::map <std::string, PackSite *> m_packSites;
+
+		StaticSite *getStaticSite(const std::string &root);
+		PackSite *getPackSite(const std::string &root) const;
+		ResponderContext *respondFromIndex(const HttpRequest *request, HttpResponse *response,
+		                                   const StaticIndex *index, const std::string &path);
+		ResponderContext *respondFromPack(const HttpRequest *request, HttpResponse *response, PackSite *site,
+		                                  const std::string &path);
+		ResponderContext *respondWithFile(const HttpRequest *request, HttpResponse *response, int fd,
+		                                  uint64_t offset, uint64_t size, const std::string &contentType,
+		                                  const std::string &etag);
+
 	public:
 		FileResponder();
 		virtual ~FileResponder();
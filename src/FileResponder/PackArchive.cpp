@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "PackArchive.h"
+
+using namespace std;
+
+// returns true if a range lies within an archive of the given size
+static bool
+inArchive(uint64_t offset, uint64_t length, size_t size)
+{
+	return (offset <= size && length <= size - offset);
+}
+
+PackArchive::PackArchive(const string &path)
+{
+	m_data = MAP_FAILED;
+
+	m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(m_fd == -1)
+		throw "open() failed";
+
+	struct stat status;
+	if(fstat(m_fd, &status) == -1 || (uint64_t)status.st_size < sizeof(PackHeader)) {
+		destroy();
+		throw "the archive is too short";
+	}
+
+	// only the index is read through the mapping, so
+	// it's all that the kernel's asked to keep around
+	m_size = (size_t)status.st_size;
+	m_data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if(m_data == MAP_FAILED) {
+		destroy();
+		throw "mmap() failed";
+	}
+
+	m_header = (const PackHeader *)m_data;
+	if(memcmp(m_header->magic, PACK_MAGIC, sizeof(m_header->magic)) != 0 ||
+	   m_header->byteOrderMark != PACK_BYTE_ORDER_MARK) {
+		destroy();
+		throw "the archive isn't one made by xviweb-pack on this kind of machine";
+	}
+
+	// the slot count has to be a power of two for the
+	// table to be probed, and have an empty slot
+	if(m_header->slotCount == 0 || (m_header->slotCount & (m_header->slotCount - 1)) != 0 ||
+	   m_header->slotCount <= m_header->entryCount ||
+	   m_header->entriesOffset % sizeof(uint64_t) != 0 || m_header->slotsOffset % sizeof(uint32_t) != 0 ||
+	   inArchive(m_header->entriesOffset, (uint64_t)m_header->entryCount * sizeof(PackEntry), m_size) == false ||
+	   inArchive(m_header->slotsOffset, (uint64_t)m_header->slotCount * sizeof(uint32_t), m_size) == false ||
+	   inArchive(m_header->stringsOffset, m_header->stringsLength, m_size) == false) {
+		destroy();
+		throw "the archive's header is corrupt";
+	}
+
+	m_entries = (const PackEntry *)((const char *)m_data + m_header->entriesOffset);
+	m_slots = (const uint32_t *)((const char *)m_data + m_header->slotsOffset);
+	m_strings = (const char *)m_data + m_header->stringsOffset;
+
+	// everything an entry points to is checked once, here
+	for(uint32_t i = 0; i < m_header->entryCount; ++i) {
+		const PackEntry &entry = m_entries[i];
+		bool valid = (entry.type <= STATIC_INDEX_NO_INDEX &&
+		              inArchive(entry.path.offset, entry.path.length, m_header->stringsLength) &&
+		              inArchive(entry.contentType.offset, entry.contentType.length, m_header->stringsLength) &&
+		              inArchive(entry.etag.offset, entry.etag.length, m_header->stringsLength) &&
+		              inArchive(entry.data.offset, entry.data.length, m_size));
+		for(int j = 0; j < FILE_ENCODING_COUNT; ++j)
+			valid = valid && inArchive(entry.variants[j].offset, entry.variants[j].length, m_size);
+
+		if(valid == false) {
+			destroy();
+			throw "the archive's entries are corrupt";
+		}
+	}
+	for(uint32_t i = 0; i < m_header->slotCount; ++i) {
+		if(m_slots[i] != PACK_EMPTY_SLOT && m_slots[i] >= m_header->entryCount) {
+			destroy();
+			throw "the archive's table is corrupt";
+		}
+	}
+
+#ifdef POSIX_MADV_WILLNEED
+	posix_madvise(m_data, (size_t)(m_header->stringsOffset + m_header->stringsLength), POSIX_MADV_WILLNEED);
+#endif
+}
+
+PackArchive::~PackArchive()
+{
+	destroy();
+}
+
+void
+PackArchive::destroy()
+{
+	if(m_data != MAP_FAILED)
+		munmap(m_data, m_size);
+	m_data = MAP_FAILED;
+
+	if(m_fd != -1)
+		close(m_fd);
+	m_fd = -1;
+}
+
+int
+PackArchive::getFileDescriptor() const
+{
+	return m_fd;
+}
+
+string
+PackArchive::getString(const PackString &str) const
+{
+	return string(m_strings + str.offset, str.length);
+}
+
+const PackEntry *
+PackArchive::find(const string &path) const
+{
+	uint64_t hash = StaticIndex::hashPath(path);
+	uint32_t mask = m_header->slotCount - 1;
+	for(uint32_t slot = (uint32_t)hash & mask; m_slots[slot] != PACK_EMPTY_SLOT; slot = (slot + 1) & mask) {
+		const PackEntry *entry = &m_entries[m_slots[slot]];
+		if(entry->hash == hash && entry->path.length == path.length() &&
+		   memcmp(m_strings + entry->path.offset, path.data(), path.length()) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+PackSite::PackSite(const string &path)
+{
+	m_path = path;
+	m_archive = NULL;
+	m_device = 0;
+	m_inode = 0;
+	m_checkTime = 0;
+}
+
+PackSite::~PackSite()
+{
+	delete m_archive;
+}
+
+PackArchive *
+PackSite::getArchive()
+{
+	// a new archive is deployed by renaming it over the
+	// old one, which gives the path a different inode
+	time_t now = time(NULL);
+	if(now == m_checkTime)
+		return m_archive;
+	m_checkTime = now;
+
+	struct stat status;
+	if(stat(m_path.c_str(), &status) == -1) {
+		delete m_archive;
+		m_archive = NULL;
+		m_inode = 0;
+		return NULL;
+	}
+	if(status.st_dev == m_device && status.st_ino == m_inode)
+		return m_archive;
+	m_device = status.st_dev;
+	m_inode = status.st_ino;
+
+	// an archive that can't be read leaves the old one in place
+	// until it's replaced again; the responses being sent from
+	// the old one have descriptors of their own
+	try {
+		PackArchive *archive = new PackArchive(m_path);
+		delete m_archive;
+		m_archive = archive;
+	} catch(const char *message) {
+		cerr << "Unable to load " << m_path << ": " << message << endl;
+	}
+
+	return m_archive;
+}
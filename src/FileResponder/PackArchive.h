@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PACKARCHIVE_H__
+#define __PACKARCHIVE_H__
+
+#include <string>
+#include <ctime>
+#include <stdint.h>
+#include <sys/types.h>
+#include "FileEncoding.h"
+#include "StaticIndex.h"
+
+// an archive made by xviweb-pack starts with a header, followed by its
+// entries, a hash table of them (indexes of entries, by the hash of
+// their paths; see StaticIndex::hashPath) and the strings they refer
+// to; the data of the files follows, each starting at a multiple of
+// PACK_ALIGNMENT; archives are in the byte order of the machine that
+// made them, which the byte order mark tells apart
+#define PACK_MAGIC "XVIPACK1"
+#define PACK_BYTE_ORDER_MARK 0x01020304
+#define PACK_ALIGNMENT 4096
+#define PACK_EMPTY_SLOT 0xffffffff
+
+struct PackHeader
+{
+	char magic[8];
+	uint32_t byteOrderMark;
+	uint32_t entryCount;
+	uint32_t slotCount;
+	uint32_t reserved;
+	uint64_t entriesOffset;
+	uint64_t slotsOffset;
+	uint64_t stringsOffset;
+	uint64_t stringsLength;
+};
+
+// a range of the archive; variants that a file doesn't
+// have are empty, the rest are in FileEncodingType order
+struct PackData
+{
+	uint64_t offset;
+	uint64_t length;
+};
+
+struct PackString
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct PackEntry
+{
+	uint64_t hash;
+	PackString path;
+	PackString contentType;
+	PackString etag;
+
+	// a StaticIndexEntryType
+	uint32_t type;
+	uint32_t reserved;
+
+	PackData data;
+	PackData variants[FILE_ENCODING_COUNT];
+};
+
+// a mapping of an archive; its files are read through its descriptor
+class PackArchive
+{
+	private:
+		int m_fd;
+		void *m_data;
+		size_t m_size;
+		const PackHeader *m_header;
+		const PackEntry *m_entries;
+		const uint32_t *m_slots;
+		const char *m_strings;
+
+		PackArchive(const PackArchive &);
+		PackArchive &operator=(const PackArchive &);
+
+		void destroy();
+
+	public:
+		PackArchive(const std::string &path);
+		~PackArchive();
+
+		int getFileDescriptor() const;
+		std::string getString(const PackString &string) const;
+
+		// returns null if the path isn't in the archive
+		const PackEntry *find(const std::string &path) const;
+};
+
+// an archive that's replaced by the one at its path once one is
+// renamed there; its path is checked at most once a second
+class PackSite
+{
+	private:
+		std::string m_path;
+		PackArchive *m_archive;
+		dev_t m_device;
+		ino_t m_inode;
+		time_t m_checkTime;
+
+		PackSite(const PackSite &);
+		PackSite &operator=(const PackSite &);
+
+	public:
+		PackSite(const std::string &path);
+		~PackSite();
+
+		// returns null if there's no archive at the path
+		PackArchive *getArchive();
+};
+
+#endif /* __PACKARCHIVE_H__ */
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <xviweb/String.h>
+#include "PackArchive.h"
+
+using namespace std;
+
+class PackTool
+{
+	private:
+		string m_root;
+		vector <string> m_mimeTypes;
+		vector <string> m_mimeFileExtensions;
+		StaticIndexEntryMap m_entries;
+		set <pair <dev_t, ino_t> > m_directories;
+
+		// the files whose data is in the archive, by their paths,
+		// and where it is; a directory's index shares its data
+		map <string, PackData> m_data;
+		uint64_t m_dataLength;
+
+		string getMimeTypeForFile(const string &path) const;
+		bool scanDirectory(const string &directory);
+		uint64_t addData(const string &path, uint64_t size);
+		void writeArchive(int fd);
+		void writeData(int fd, const string &path, uint64_t length);
+
+	public:
+		PackTool();
+
+		void addMimeType(const string &mimeType, const string &fileExtension);
+		void pack(const string &root, const string &archivePath);
+};
+
+static void
+writeAll(int fd, const void *data, size_t length)
+{
+	const char *p = (const char *)data;
+	while(length != 0) {
+		ssize_t result = write(fd, p, length);
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			throw "write() failed";
+
+		p += result;
+		length -= (size_t)result;
+	}
+}
+
+static void
+writePadding(int fd, uint64_t offset, uint64_t alignment)
+{
+	static const char zeroes[PACK_ALIGNMENT] = { 0 };
+	uint64_t length = (alignment - offset % alignment) % alignment;
+	writeAll(fd, zeroes, (size_t)length);
+}
+
+static uint64_t
+align(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+PackTool::PackTool()
+{
+	m_dataLength = 0;
+
+	// the same types that FileResponder serves by default
+	addMimeType("text/plain", "txt");
+	addMimeType("text/html", "html");
+	addMimeType("text/css", "css");
+	addMimeType("text/javascript", "js");
+	addMimeType("image/png", "png");
+	addMimeType("image/jpg", "jpeg");
+	addMimeType("image/jpg", "jpg");
+	addMimeType("image/gif", "gif");
+}
+
+void
+PackTool::addMimeType(const string &mimeType, const string &fileExtension)
+{
+	m_mimeTypes.push_back(mimeType);
+	m_mimeFileExtensions.push_back(string(".") + fileExtension);
+}
+
+string
+PackTool::getMimeTypeForFile(const string &path) const
+{
+	for(unsigned int i = 0; i < m_mimeTypes.size(); ++i) {
+		if(String::endsWith(path, m_mimeFileExtensions[i], true))
+			return m_mimeTypes[i];
+	}
+
+	return string("");
+}
+
+// adds the entries of a directory and its subdirectories the same
+// way StaticSite does; returns false if the directory's already been
+// packed at another path
+bool
+PackTool::scanDirectory(const string &directory)
+{
+	struct stat status;
+	if(stat((m_root + directory).c_str(), &status) == -1 || S_ISDIR(status.st_mode) == false)
+		return false;
+	if(m_directories.insert(make_pair(status.st_dev, status.st_ino)).second == false)
+		return false;
+
+	DIR *dir = opendir((m_root + directory).c_str());
+	if(dir == NULL)
+		throw "opendir() failed";
+
+	vector <string> names;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		string name = ent->d_name;
+		if(name != "." && name != "..")
+			names.push_back(name);
+	}
+	closedir(dir);
+
+	for(unsigned int i = 0; i < names.size(); ++i) {
+		string path = directory + "/" + names[i];
+		if(stat((m_root + path).c_str(), &status) == -1)
+			continue;
+
+		if(S_ISDIR(status.st_mode)) {
+			if(scanDirectory(path))
+				m_entries[path].type = STATIC_INDEX_DIRECTORY;
+		} else if(S_ISREG(status.st_mode)) {
+			StaticIndexEntry &entry = m_entries[path];
+			entry.path = m_root + path;
+			entry.contentType = getMimeTypeForFile(path);
+			entry.type = (entry.contentType.length() != 0) ? STATIC_INDEX_FILE : STATIC_INDEX_FORBIDDEN;
+			entry.size = (uint64_t)status.st_size;
+			entry.modificationTime = status.st_mtime;
+			entry.etag = StaticIndex::makeETag(status);
+		}
+	}
+
+	// the directory itself is its index, if it has one
+	string prefix = directory + "/";
+	StaticIndexEntryMap::iterator iter = m_entries.find(prefix + "index.html");
+	if(iter != m_entries.end() && iter->second.type != STATIC_INDEX_DIRECTORY) {
+		m_entries[prefix] = iter->second;
+	} else {
+		StaticIndexEntry &entry = m_entries[prefix];
+		entry.type = STATIC_INDEX_NO_INDEX;
+		entry.size = 0;
+		entry.modificationTime = 0;
+	}
+
+	return true;
+}
+
+// returns the offset of a file's data in the archive,
+// which is given space the first time it's seen
+uint64_t
+PackTool::addData(const string &path, uint64_t size)
+{
+	map <string, PackData>::iterator iter = m_data.find(path);
+	if(iter != m_data.end())
+		return iter->second.offset;
+
+	PackData &data = m_data[path];
+	data.offset = m_dataLength;
+	data.length = size;
+	m_dataLength = align(m_dataLength + size, PACK_ALIGNMENT);
+	return data.offset;
+}
+
+void
+PackTool::pack(const string &root, const string &archivePath)
+{
+	m_root = root;
+	if(scanDirectory("") == false)
+		throw "the root isn't a directory";
+
+	// write the archive next to where it's going, then rename it
+	// there, so that servers only ever see a complete archive
+	string temporaryPath = archivePath + ".tmp";
+	int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1)
+		throw "unable to create the archive";
+
+	try {
+		writeArchive(fd);
+		if(fsync(fd) == -1)
+			throw "fsync() failed";
+	} catch(const char *) {
+		close(fd);
+		unlink(temporaryPath.c_str());
+		throw;
+	}
+
+	close(fd);
+	if(rename(temporaryPath.c_str(), archivePath.c_str()) == -1) {
+		unlink(temporaryPath.c_str());
+		throw "unable to rename the archive into place";
+	}
+}
+
+void
+PackTool::writeArchive(int fd)
+{
+	PackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.byteOrderMark = PACK_BYTE_ORDER_MARK;
+	header.entryCount = (uint32_t)m_entries.size();
+
+	// the table is kept at most half full
+	header.slotCount = 16;
+	while(header.slotCount < m_entries.size() * 2)
+		header.slotCount <<= 1;
+
+	vector <PackEntry> entries;
+	vector <uint32_t> slots(header.slotCount, PACK_EMPTY_SLOT);
+	string strings;
+	entries.reserve(m_entries.size());
+
+	StaticIndexEntryMap::const_iterator iter;
+	for(iter = m_entries.begin(); iter != m_entries.end(); ++iter) {
+		const StaticIndexEntry &source = iter->second;
+		PackEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.hash = StaticIndex::hashPath(iter->first);
+		entry.type = (uint32_t)source.type;
+
+		entry.path.offset = (uint32_t)strings.length();
+		entry.path.length = (uint32_t)iter->first.length();
+		strings += iter->first;
+		entry.contentType.offset = (uint32_t)strings.length();
+		entry.contentType.length = (uint32_t)source.contentType.length();
+		strings += source.contentType;
+		entry.etag.offset = (uint32_t)strings.length();
+		entry.etag.length = (uint32_t)source.etag.length();
+		strings += source.etag;
+
+		if(source.type == STATIC_INDEX_FILE) {
+			entry.data.offset = addData(source.path, source.size);
+			entry.data.length = source.size;
+
+			// variants older than the file are left out,
+			// since they're of what it used to be
+			for(int i = 0; i < FILE_ENCODING_COUNT; ++i) {
+				string variantPath = source.path + FileEncoding::getFileExtension((FileEncodingType)i);
+				struct stat status;
+				if(stat(variantPath.c_str(), &status) == 0 && S_ISREG(status.st_mode) &&
+				   status.st_mtime >= source.modificationTime) {
+					entry.variants[i].offset = addData(variantPath, (uint64_t)status.st_size);
+					entry.variants[i].length = (uint64_t)status.st_size;
+				}
+			}
+		}
+
+		size_t slot = entry.hash & (header.slotCount - 1);
+		while(slots[slot] != PACK_EMPTY_SLOT)
+			slot = (slot + 1) & (header.slotCount - 1);
+		slots[slot] = (uint32_t)entries.size();
+		entries.push_back(entry);
+	}
+
+	if(strings.length() > 0xffffffffUL)
+		throw "the paths are too long to be packed";
+
+	header.entriesOffset = align(sizeof(header), sizeof(uint64_t));
+	header.slotsOffset = header.entriesOffset + entries.size() * sizeof(PackEntry);
+	header.stringsOffset = header.slotsOffset + slots.size() * sizeof(uint32_t);
+	header.stringsLength = strings.length();
+
+	// the data follows the index, so offsets are made absolute
+	uint64_t dataOffset = align(header.stringsOffset + header.stringsLength, PACK_ALIGNMENT);
+	for(unsigned int i = 0; i < entries.size(); ++i) {
+		if(entries[i].type != STATIC_INDEX_FILE)
+			continue;
+
+		entries[i].data.offset += dataOffset;
+		for(int j = 0; j < FILE_ENCODING_COUNT; ++j) {
+			if(entries[i].variants[j].length != 0)
+				entries[i].variants[j].offset += dataOffset;
+		}
+	}
+
+	writeAll(fd, &header, sizeof(header));
+	writePadding(fd, sizeof(header), sizeof(uint64_t));
+	if(entries.size() != 0)
+		writeAll(fd, &entries[0], entries.size() * sizeof(PackEntry));
+	writeAll(fd, &slots[0], slots.size() * sizeof(uint32_t));
+	writeAll(fd, strings.data(), strings.length());
+	writePadding(fd, header.stringsOffset + header.stringsLength, PACK_ALIGNMENT);
+
+	// the data's written in the order that it was laid out in
+	vector <pair <uint64_t, string> > files;
+	for(map <string, PackData>::iterator dataIter = m_data.begin(); dataIter != m_data.end(); ++dataIter)
+		files.push_back(make_pair(dataIter->second.offset, dataIter->first));
+	sort(files.begin(), files.end());
+
+	for(unsigned int i = 0; i < files.size(); ++i) {
+		uint64_t length = m_data[files[i].second].length;
+		writeData(fd, files[i].second, length);
+		writePadding(fd, length, PACK_ALIGNMENT);
+	}
+}
+
+void
+PackTool::writeData(int fd, const string &path, uint64_t length)
+{
+	int fileFd = open(path.c_str(), O_RDONLY);
+	if(fileFd == -1) {
+		cerr << path << ": " << strerror(errno) << endl;
+		throw "unable to open a file";
+	}
+
+	char buffer[65536];
+	while(length != 0) {
+		ssize_t result = read(fileFd, buffer, (length < sizeof(buffer)) ? (size_t)length : sizeof(buffer));
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result <= 0) {
+			close(fileFd);
+			cerr << path << ": " << ((result == 0) ? "file shrank" : strerror(errno)) << endl;
+			throw "a file changed while it was being packed";
+		}
+
+		writeAll(fd, buffer, (size_t)result);
+		length -= (uint64_t)result;
+	}
+
+	close(fileFd);
+}
+
+static void
+showUsageMessage(ostream &stream, const char *executableName)
+{
+	stream << "Usage: " << executableName << " [--mimeType <type> <extension>]... <directory> <archive>" << endl << endl;
+	stream << "Packs the files under a directory into an archive that FileResponder can" << endl;
+	stream << "serve with its packArchive option. Files named after another with .br," << endl;
+	stream << ".zst or .gz appended are packed as its precompressed variants. The" << endl;
+	stream << "archive is replaced by renaming it into place." << endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	PackTool tool;
+	vector <string> paths;
+
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--help") == 0) {
+			showUsageMessage(cout, argv[0]);
+			return 0;
+		} else if(strcmp(argv[i], "--mimeType") == 0) {
+			if(i + 2 >= argc) {
+				cerr << "Error: Missing parameter(s) for option --mimeType" << endl << endl;
+				showUsageMessage(cerr, argv[0]);
+				return 1;
+			}
+			tool.addMimeType(argv[i + 1], argv[i + 2]);
+			i += 2;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if(paths.size() != 2) {
+		showUsageMessage(cerr, argv[0]);
+		return 1;
+	}
+
+	try {
+		tool.pack(paths[0], paths[1]);
+	} catch(const char *message) {
+		cerr << paths[1] << ": " << message << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#include <xviweb/String.h>
+#include "StaticIndex.h"
+
+using namespace std;
+
+// how long a site's thread waits for changes to stop
+// coming in before it rescans what's changed
+#define STATIC_SITE_SETTLE_TIME 50
+
+#ifdef __linux__
+#define STATIC_SITE_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                                  IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR)
+#endif
+
+uint64_t
+StaticIndex::hashPath(const string &path)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < path.length(); ++i) {
+		hash ^= (unsigned char)path[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+StaticIndex::StaticIndex(const StaticIndexEntryMap &entries)
+{
+	// the table is kept at most half full
+	size_t slotCount = 16;
+	while(slotCount < entries.size() * 2)
+		slotCount <<= 1;
+	m_slots.resize(slotCount, -1);
+
+	m_paths.reserve(entries.size());
+	m_entries.reserve(entries.size());
+	m_hashes.reserve(entries.size());
+	for(StaticIndexEntryMap::const_iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+		uint64_t hash = hashPath(iter->first);
+		size_t slot = hash & (slotCount - 1);
+		while(m_slots[slot] != -1)
+			slot = (slot + 1) & (slotCount - 1);
+
+		m_slots[slot] = (int)m_entries.size();
+		m_paths.push_back(iter->first);
+		m_entries.push_back(iter->second);
+		m_hashes.push_back(hash);
+	}
+}
+
+string
+StaticIndex::makeETag(const struct stat &status)
+{
+	char etag[64];
+	snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)status.st_mtime,
+	         (unsigned long long)status.st_size);
+	return string(etag);
+}
+
+size_t
+StaticIndex::getSize() const
+{
+	return m_entries.size();
+}
+
+const StaticIndexEntry *
+StaticIndex::find(const string &path) const
+{
+	uint64_t hash = hashPath(path);
+	size_t mask = m_slots.size() - 1;
+	for(size_t slot = hash & mask; m_slots[slot] != -1; slot = (slot + 1) & mask) {
+		int index = m_slots[slot];
+		if(m_hashes[index] == hash && m_paths[index] == path)
+			return &m_entries[index];
+	}
+
+	return NULL;
+}
+
+StaticSite::StaticSite(const string &root, const vector <string> &mimeTypes,
+                       const vector <string> &mimeFileExtensions)
+{
+	m_root = root;
+	m_mimeTypes = mimeTypes;
+	m_mimeFileExtensions = mimeFileExtensions;
+	m_index = NULL;
+	m_publishedIndex = NULL;
+	m_published = 0;
+	m_inotifyFd = -1;
+	m_stopFd = -1;
+
+#ifdef __linux__
+	// the site's thread is stopped by writing to this
+	m_stopFd = eventfd(0, EFD_CLOEXEC);
+	if(m_stopFd == -1)
+		throw "eventfd() failed";
+#endif
+
+	pthread_mutex_init(&m_mutex, NULL);
+	if(pthread_create(&m_thread, NULL, runThread, this) != 0) {
+		pthread_mutex_destroy(&m_mutex);
+		if(m_stopFd != -1)
+			close(m_stopFd);
+		throw "pthread_create() failed";
+	}
+}
+
+StaticSite::~StaticSite()
+{
+#ifdef __linux__
+	uint64_t value = 1;
+	ssize_t result = write(m_stopFd, &value, sizeof(value));
+	(void)result;
+#endif
+	pthread_join(m_thread, NULL);
+
+	if(m_stopFd != -1)
+		close(m_stopFd);
+	if(m_inotifyFd != -1)
+		close(m_inotifyFd);
+	pthread_mutex_destroy(&m_mutex);
+
+	delete m_publishedIndex;
+	delete m_index;
+}
+
+const StaticIndex *
+StaticSite::getIndex()
+{
+	// a new index is only looked for once the site's thread
+	// says it's published one, so finding the index doesn't
+	// take a system call; the server's thread never waits for
+	// the site to be walked, since a big one can take a while
+	if(__atomic_load_n(&m_published, __ATOMIC_ACQUIRE) != 0) {
+		pthread_mutex_lock(&m_mutex);
+		if(m_publishedIndex != NULL) {
+			delete m_index;
+			m_index = m_publishedIndex;
+			m_publishedIndex = NULL;
+		}
+		__atomic_store_n(&m_published, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	return m_index;
+}
+
+void *
+StaticSite::runThread(void *site)
+{
+	((StaticSite *)site)->run();
+	return NULL;
+}
+
+void
+StaticSite::run()
+{
+#ifdef __linux__
+	// without inotify, the index is never updated
+	m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(m_inotifyFd == -1)
+		cerr << "Unable to watch " << m_root << " for changes to its index" << endl;
+#endif
+
+	struct stat status;
+	if(stat(m_root.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+		scanDirectory("", true);
+	publish();
+
+#ifdef __linux__
+	if(m_inotifyFd != -1)
+		watch();
+#endif
+}
+
+void
+StaticSite::publish()
+{
+	StaticIndex *index = new StaticIndex(m_entries);
+
+	pthread_mutex_lock(&m_mutex);
+	delete m_publishedIndex;
+	m_publishedIndex = index;
+	__atomic_store_n(&m_published, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+#ifdef __linux__
+void
+StaticSite::watch()
+{
+	set <string> changedDirectories;
+	bool overflowed = false;
+	char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for(;;) {
+		// changes are collected until they stop for a moment
+		struct pollfd pfds[2];
+		pfds[0].fd = m_inotifyFd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = m_stopFd;
+		pfds[1].events = POLLIN;
+		bool changed = (changedDirectories.empty() == false || overflowed);
+		int count = poll(pfds, 2, changed ? STATIC_SITE_SETTLE_TIME : -1);
+		if(count == -1 && errno != EINTR)
+			return;
+		if(count > 0 && pfds[1].revents != 0)
+			return;
+
+		if(count == 0) {
+			// an overflowed queue may have lost any change,
+			// so everything is scanned again
+			if(overflowed) {
+				scanDirectory("", true);
+			} else {
+				set <string>::iterator iter;
+				for(iter = changedDirectories.begin(); iter != changedDirectories.end(); ++iter) {
+					if(*iter == "" || m_entries.find(*iter) != m_entries.end())
+						scanDirectory(*iter, false);
+				}
+			}
+
+			changedDirectories.clear();
+			overflowed = false;
+			publish();
+			continue;
+		}
+
+		ssize_t length;
+		while((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for(char *p = buffer; p < buffer + length; ) {
+				struct inotify_event *event = (struct inotify_event *)p;
+				p += sizeof(struct inotify_event) + event->len;
+
+				if(event->mask & IN_Q_OVERFLOW) {
+					overflowed = true;
+					continue;
+				}
+
+				map <int, string>::iterator iter = m_watches.find(event->wd);
+				if(iter == m_watches.end())
+					continue;
+
+				// watches that the kernel's removed are forgotten;
+				// the directories were removed from their parents
+				if(event->mask & IN_IGNORED) {
+					m_directoryWatches.erase(iter->second);
+					m_watches.erase(iter);
+					continue;
+				}
+
+				changedDirectories.insert(iter->second);
+			}
+		}
+	}
+}
+#endif
+
+string
+StaticSite::getMimeTypeForFile(const string &path) const
+{
+	for(unsigned int i = 0; i < m_mimeTypes.size(); ++i) {
+		if(String::endsWith(path, m_mimeFileExtensions[i], true))
+			return m_mimeTypes[i];
+	}
+
+	return string("");
+}
+
+void
+StaticSite::addFile(const string &path, const struct stat &status)
+{
+	StaticIndexEntry &entry = m_entries[path];
+	entry.path = m_root + path;
+	entry.contentType = getMimeTypeForFile(path);
+	entry.type = (entry.contentType.length() != 0) ? STATIC_INDEX_FILE : STATIC_INDEX_FORBIDDEN;
+	entry.size = (uint64_t)status.st_size;
+	entry.modificationTime = status.st_mtime;
+	entry.etag = StaticIndex::makeETag(status);
+}
+
+// returns false if the directory is already watched at another path
+bool
+StaticSite::watchDirectory(const string &directory, const struct stat &status)
+{
+#ifdef __linux__
+	if(m_inotifyFd == -1)
+		return true;
+
+	int wd = inotify_add_watch(m_inotifyFd, (m_root + directory).c_str(), STATIC_SITE_WATCH_EVENTS);
+	if(wd == -1)
+		return true;
+
+	// the same directory has the same watch, so it's either been
+	// moved here from where it was watched, or can be reached from
+	// both paths, in which case it's only indexed at the first one
+	map <int, string>::iterator iter = m_watches.find(wd);
+	if(iter != m_watches.end() && iter->second != directory) {
+		struct stat otherStatus;
+		if(stat((m_root + iter->second).c_str(), &otherStatus) == 0 &&
+		   otherStatus.st_dev == status.st_dev && otherStatus.st_ino == status.st_ino)
+			return false;
+
+		m_directoryWatches.erase(iter->second);
+	}
+
+	m_watches[wd] = directory;
+	m_directoryWatches[directory] = wd;
+#else
+	(void)directory;
+	(void)status;
+#endif
+	return true;
+}
+
+// brings the entries of a directory up to date, along with its
+// subdirectories if recursive is true or they're new
+void
+StaticSite::scanDirectory(const string &directory, bool recursive)
+{
+	struct stat status;
+	if(stat((m_root + directory).c_str(), &status) == -1 || S_ISDIR(status.st_mode) == false ||
+	   watchDirectory(directory, status) == false) {
+		if(directory.length() != 0)
+			removeDirectory(directory);
+		return;
+	}
+
+	DIR *dir = opendir((m_root + directory).c_str());
+	if(dir == NULL) {
+		if(directory.length() != 0)
+			removeDirectory(directory);
+		return;
+	}
+
+	set <string> names;
+	vector <string> subdirectories;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		string name = ent->d_name;
+		if(name == "." || name == "..")
+			continue;
+
+		string path = directory + "/" + name;
+		if(stat((m_root + path).c_str(), &status) == -1)
+			continue;
+
+		if(S_ISDIR(status.st_mode)) {
+			StaticIndexEntryMap::iterator iter = m_entries.find(path);
+			bool known = (iter != m_entries.end() && iter->second.type == STATIC_INDEX_DIRECTORY);
+			if(known == false || recursive)
+				subdirectories.push_back(path);
+			names.insert(name);
+		} else if(S_ISREG(status.st_mode)) {
+			if(m_entries.find(path + "/") != m_entries.end())
+				removeDirectory(path);
+			addFile(path, status);
+			names.insert(name);
+		}
+	}
+	closedir(dir);
+
+	// subdirectories are only indexed once they've been scanned
+	for(unsigned int i = 0; i < subdirectories.size(); ++i) {
+		StaticIndexEntryMap::iterator iter = m_entries.find(subdirectories[i]);
+		if(iter != m_entries.end() && iter->second.type != STATIC_INDEX_DIRECTORY)
+			m_entries.erase(iter);
+
+		scanDirectory(subdirectories[i], true);
+		if(m_entries.find(subdirectories[i] + "/") != m_entries.end())
+			m_entries[subdirectories[i]].type = STATIC_INDEX_DIRECTORY;
+		else
+			names.erase(subdirectories[i].substr(directory.length() + 1));
+	}
+
+	// remove what's no longer in the directory
+	string prefix = directory + "/";
+	vector <string> removed;
+	StaticIndexEntryMap::iterator iter = m_entries.lower_bound(prefix);
+	for(; iter != m_entries.end() && iter->first.compare(0, prefix.length(), prefix) == 0; ++iter) {
+		string name = iter->first.substr(prefix.length());
+		if(name.length() != 0 && name.find('/') == string::npos && names.find(name) == names.end())
+			removed.push_back(iter->first);
+	}
+	for(unsigned int i = 0; i < removed.size(); ++i) {
+		iter = m_entries.find(removed[i]);
+		if(iter == m_entries.end())
+			continue;
+		if(iter->second.type == STATIC_INDEX_DIRECTORY)
+			removeDirectory(removed[i]);
+		else
+			m_entries.erase(iter);
+	}
+
+	// the directory itself is its index, if it has one
+	iter = m_entries.find(prefix + "index.html");
+	if(iter != m_entries.end() && iter->second.type != STATIC_INDEX_DIRECTORY) {
+		m_entries[prefix] = iter->second;
+	} else {
+		StaticIndexEntry &entry = m_entries[prefix];
+		entry.type = STATIC_INDEX_NO_INDEX;
+		entry.path = "";
+		entry.contentType = "";
+		entry.size = 0;
+		entry.modificationTime = 0;
+		entry.etag = "";
+	}
+}
+
+// removes a directory and everything in it from the index
+void
+StaticSite::removeDirectory(const string &directory)
+{
+	m_entries.erase(directory);
+
+	string prefix = directory + "/";
+	StaticIndexEntryMap::iterator iter = m_entries.lower_bound(prefix);
+	while(iter != m_entries.end() && iter->first.compare(0, prefix.length(), prefix) == 0)
+		m_entries.erase(iter++);
+
+#ifdef __linux__
+	removeWatch(directory);
+	map <string, int>::iterator watchIter = m_directoryWatches.lower_bound(prefix);
+	while(watchIter != m_directoryWatches.end() && watchIter->first.compare(0, prefix.length(), prefix) == 0)
+		removeWatch((watchIter++)->first);
+#endif
+}
+
+#ifdef __linux__
+// watches that have moved to another directory since are kept
+void
+StaticSite::removeWatch(const string &directory)
+{
+	map <string, int>::iterator iter = m_directoryWatches.find(directory);
+	if(iter == m_directoryWatches.end())
+		return;
+
+	map <int, string>::iterator pathIter = m_watches.find(iter->second);
+	if(pathIter != m_watches.end() && pathIter->second == directory) {
+		inotify_rm_watch(m_inotifyFd, iter->second);
+		m_watches.erase(pathIter);
+	}
+	m_directoryWatches.erase(iter);
+}
+#endif
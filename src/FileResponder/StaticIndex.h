@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __STATICINDEX_H__
+#define __STATICINDEX_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+enum StaticIndexEntryType
+{
+	// a file that's served, which may be a directory's index
+	STATIC_INDEX_FILE,
+
+	// a file of a type that isn't served
+	STATIC_INDEX_FORBIDDEN,
+
+	// a directory asked for without a trailing slash
+	STATIC_INDEX_DIRECTORY,
+
+	// a directory that doesn't have an index
+	STATIC_INDEX_NO_INDEX
+};
+
+class StaticIndexEntry
+{
+	public:
+		StaticIndexEntryType type;
+
+		// for files: the path of the file that's served
+		std::string path;
+		std::string contentType;
+		uint64_t size;
+		time_t modificationTime;
+		std::string etag;
+};
+
+typedef std::map<std::string, StaticIndexEntry> StaticIndexEntryMap;
+
+// an immutable table of the URL paths of a site; a path's entry is
+// found by hashing it and probing the slots from there on
+class StaticIndex
+{
+	private:
+		std::vector <std::string> m_paths;
+		std::vector <StaticIndexEntry> m_entries;
+		std::vector <uint64_t> m_hashes;
+		std::vector <int> m_slots;
+
+	public:
+		StaticIndex(const StaticIndexEntryMap &entries);
+
+		// the tag of a file's current contents
+		static std::string makeETag(const struct stat &status);
+		static uint64_t hashPath(const std::string &path);
+
+		size_t getSize() const;
+
+		// returns null if the path isn't in the site
+		const StaticIndexEntry *find(const std::string &path) const;
+};
+
+// keeps an index of the files under a site's root; the root is walked
+// by a thread of its own, which then watches its directories with
+// inotify and rescans those that change, publishing a new index each
+// time; directories that can be reached by more than one path (through
+// symbolic links) are only indexed at the first path that's found
+class StaticSite
+{
+	private:
+		std::string m_root;
+		std::vector <std::string> m_mimeTypes;
+		std::vector <std::string> m_mimeFileExtensions;
+
+		// used by the server's thread
+		StaticIndex *m_index;
+
+		// handed from the site's thread to the server's
+		pthread_t m_thread;
+		pthread_mutex_t m_mutex;
+		StaticIndex *m_publishedIndex;
+		int m_published;
+
+		// used by the site's thread
+		StaticIndexEntryMap m_entries;
+		int m_inotifyFd;
+		int m_stopFd;
+		std::map <int, std::string> m_watches;
+		std::map <std::string, int> m_directoryWatches;
+
+		StaticSite(const StaticSite &);
+		StaticSite &operator=(const StaticSite &);
+
+		static void *runThread(void *site);
+		void run();
+		void watch();
+		void publish();
+
+		std::string getMimeTypeForFile(const std::string &path) const;
+		void addFile(const std::string &path, const struct stat &status);
+		bool watchDirectory(const std::string &directory, const struct stat &status);
+		void scanDirectory(const std::string &directory, bool recursive);
+		void removeDirectory(const std::string &directory);
+#ifdef __linux__
+		void removeWatch(const std::string &directory);
+#endif
+
+	public:
+		// the MIME types of the files are those set when it's created
+		StaticSite(const std::string &root, const std::vector <std::string> &mimeTypes,
+		           const std::vector <std::string> &mimeFileExtensions);
+		~StaticSite();
+
+		// returns null until the root has been walked the first time
+		const StaticIndex *getIndex();
+};
+
+#endif /* __STATICINDEX_H__ */
@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <xviweb/String.h>
+#include "ProxyContext.h"
+
+using namespace std;
+
+// limits on what's buffered from an upstream
+// before its response is considered invalid
+#define PROXY_MAX_HEAD_SIZE (64 * 1024)
+#define PROXY_MAX_LINE_SIZE 4096
+
+// the client's request body is only read while less than
+// this much is waiting to be sent to the upstream
+#define PROXY_MAX_OUTPUT_SIZE (64 * 1024)
+
+// hop-by-hop headers only apply to a single connection,
+// so they aren't passed along in either direction
+static bool
+isHopByHopHeader(const string &name, const string &connection)
+{
+	return (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+	        name == "te" || name == "trailer" || name == "transfer-encoding" ||
+	        name == "upgrade" || String::containsToken(connection, name));
+}
+
+// capitalizes each word of a header name (e.g. content-type
+// becomes Content-Type) so that it matches the server's own
+static string
+canonicalHeaderName(const string &name)
+{
+	string s = String::toLower(name);
+	for(size_t i = 0; i < s.length(); ++i) {
+		if((i == 0 || s[i - 1] == '-') && s[i] >= 'a' && s[i] <= 'z')
+			s[i] -= 'a' - 'A';
+	}
+
+	return s;
+}
+
+static bool
+parseLength(const string &value, uint64_t *length)
+{
+	string s = String::trim(value);
+	if(s.length() == 0 || s.length() > 18)
+		return false;
+
+	uint64_t n = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		if(s[i] < '0' || s[i] > '9')
+			return false;
+		n = (n * 10) + (uint64_t)(s[i] - '0');
+	}
+
+	*length = n;
+	return true;
+}
+
+static bool
+parseChunkSize(const string &line, uint64_t *size)
+{
+	// chunk extensions are ignored
+	size_t end = line.find(';');
+	string s = String::trim(line.substr(0, end));
+	if(s.length() == 0 || s.length() > 15)
+		return false;
+
+	uint64_t n = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		char c = s[i];
+		if(c >= '0' && c <= '9')
+			n = (n * 16) + (uint64_t)(c - '0');
+		else if(c >= 'a' && c <= 'f')
+			n = (n * 16) + (uint64_t)(c - 'a' + 10);
+		else if(c >= 'A' && c <= 'F')
+			n = (n * 16) + (uint64_t)(c - 'A' + 10);
+		else
+			return false;
+	}
+
+	*size = n;
+	return true;
+}
+
+ProxyContext::ProxyContext(ProxyResponder *responder, const HttpRequest *request)
+{
+	m_responder = responder;
+	m_upstream = NULL;
+	m_fd = -1;
+	m_reused = false;
+	m_connected = false;
+	m_attempts = 0;
+	m_deadline = 0;
+	m_headRequest = (request->getVerb() == "HEAD");
+	m_sendFailed = false;
+	m_requestEnded = false;
+	m_state = PROXY_CONTEXT_STATE_READING_HEAD;
+	m_responseStarted = false;
+	m_upstreamKeepAlive = false;
+	m_bodyType = PROXY_BODY_TYPE_NONE;
+	m_bodyRemaining = 0;
+	m_chunkState = PROXY_CHUNK_STATE_SIZE;
+
+	// build the request's head, passing along the client's
+	// headers other than the ones describing its connection
+	string target = request->getPath();
+	string queryString = request->getQueryString();
+	if(queryString.length() != 0)
+		target += "?" + queryString;
+	m_head = request->getVerb() + " " + target + " HTTP/1.1\r\n";
+
+	string connection = request->getHeaderValue("Connection");
+	vector <string> names = request->getHeaderNames();
+	for(unsigned int i = 0; i < names.size(); ++i) {
+		if(isHopByHopHeader(names[i], connection) || names[i] == "content-length" || names[i] == "expect")
+			continue;
+		m_head += canonicalHeaderName(names[i]) + ": " + request->getHeaderValue(names[i]) + "\r\n";
+	}
+
+	// the body is sent in chunks when its length isn't known
+	uint64_t contentLength = 0;
+	m_requestChunked = (request->getHeaderValue("Transfer-Encoding").length() != 0);
+	if(m_requestChunked)
+		m_head += "Transfer-Encoding: chunked\r\n";
+	else if(parseLength(request->getHeaderValue("Content-Length"), &contentLength) && contentLength != 0)
+		m_head += "Content-Length: " + String::trim(request->getHeaderValue("Content-Length")) + "\r\n";
+
+	m_requestHasBody = (m_requestChunked || contentLength != 0);
+	m_head += "\r\n";
+}
+
+ProxyContext::~ProxyContext()
+{
+	// the client went away before the response was finished
+	if(m_fd != -1)
+		m_upstream->releaseConnection(m_fd, false, 0);
+}
+
+bool
+ProxyContext::connect(ProxyUpstream *exclude)
+{
+	// try each upstream at most once
+	while(m_attempts < m_responder->getUpstreamCount()) {
+		++m_attempts;
+		m_upstream = m_responder->selectUpstream(exclude);
+		if(m_upstream == NULL)
+			return false;
+
+		m_fd = m_upstream->acquireConnection(&m_reused);
+		if(m_fd != -1)
+			break;
+
+		cerr << "Unable to connect to upstream " << m_upstream->getName() << endl;
+		m_upstream->failed(m_responder->getMaxFails(), m_responder->getFailTimeout());
+		exclude = m_upstream;
+	}
+
+	if(m_fd == -1)
+		return false;
+
+	m_connected = m_reused;
+	m_output = m_head;
+	m_deadline = getProxyMilliseconds() + m_responder->getTimeout();
+	return true;
+}
+
+ProxyResult
+ProxyContext::checkConnection()
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if(getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0)
+		return PROXY_RESULT_FAILED;
+
+	// the connection is still being established
+	// if it doesn't have a peer yet
+	struct sockaddr_storage address;
+	length = sizeof(address);
+	if(getpeername(m_fd, (struct sockaddr *)&address, &length) == -1)
+		return (errno == ENOTCONN) ? PROXY_RESULT_OK : PROXY_RESULT_FAILED;
+
+	m_connected = true;
+	return PROXY_RESULT_OK;
+}
+
+ProxyResult
+ProxyContext::sendRequest()
+{
+	while(m_output.length() != 0 && m_sendFailed == false) {
+		ssize_t length = send(m_fd, m_output.data(), m_output.length(), MSG_NOSIGNAL);
+		if(length == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			// an upstream may respond without reading the whole
+			// request; if it has, its response is still relayed
+			if(m_state == PROXY_CONTEXT_STATE_READING_HEAD && m_input.length() == 0)
+				return PROXY_RESULT_FAILED;
+			m_sendFailed = true;
+			m_output.clear();
+			break;
+		}
+
+		m_output.erase(0, (size_t)length);
+		m_deadline = getProxyMilliseconds() + m_responder->getTimeout();
+	}
+
+	return PROXY_RESULT_OK;
+}
+
+ProxyResult
+ProxyContext::readResponse(HttpResponse *response)
+{
+	char buf[16384];
+	while(m_state != PROXY_CONTEXT_STATE_DONE) {
+		// leave the rest of the body with the upstream
+		// until the client's connection can take it
+		if(m_state == PROXY_CONTEXT_STATE_READING_BODY && response->getSendCapacity() == 0)
+			break;
+
+		ssize_t length = recv(m_fd, buf, sizeof(buf), 0);
+		if(length == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return PROXY_RESULT_FAILED;
+		}
+
+		// a body without a length ends when
+		// the upstream closes the connection
+		if(length == 0) {
+			if(m_state == PROXY_CONTEXT_STATE_READING_BODY && m_bodyType == PROXY_BODY_TYPE_CLOSE) {
+				finish(response);
+				break;
+			}
+			return PROXY_RESULT_FAILED;
+		}
+
+		m_input.append(buf, (size_t)length);
+		m_deadline = getProxyMilliseconds() + m_responder->getTimeout();
+		if(processInput(response) == false) {
+			cerr << "Invalid response from upstream " << m_upstream->getName() << endl;
+			return PROXY_RESULT_FAILED;
+		}
+	}
+
+	return PROXY_RESULT_OK;
+}
+
+bool
+ProxyContext::processInput(HttpResponse *response)
+{
+	while(m_state == PROXY_CONTEXT_STATE_READING_HEAD) {
+		size_t end = m_input.find("\r\n\r\n");
+		if(end == string::npos)
+			return (m_input.length() <= PROXY_MAX_HEAD_SIZE);
+
+		string head = m_input.substr(0, end);
+		m_input.erase(0, end + 4);
+		if(relayHead(head, response) == false)
+			return false;
+	}
+
+	if(m_state == PROXY_CONTEXT_STATE_READING_BODY)
+		return relayBody(response);
+
+	return true;
+}
+
+bool
+ProxyContext::relayHead(const string &head, HttpResponse *response)
+{
+	// parse the status line
+	vector <string> lines = String::split(head, "\r\n");
+	const string &statusLine = lines[0];
+	if(statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.length() < 12 || statusLine[8] != ' ')
+		return false;
+
+	int statusCode = String::toInt(statusLine.substr(9, 3));
+	string statusMessage = (statusLine.length() > 13) ? statusLine.substr(13) : string("");
+	if(statusCode < 100 || statusCode > 999)
+		return false;
+
+	// interim responses aren't passed along
+	if(statusCode < 200)
+		return true;
+
+	// gather the headers, combining repeated ones
+	ProxyHeaderMap headers;
+	string connection;
+	string transferEncoding;
+	string contentLength;
+	for(unsigned int i = 1; i < lines.size(); ++i) {
+		size_t colon = lines[i].find(':');
+		if(colon == string::npos || colon == 0)
+			return false;
+
+		string name = String::toLower(lines[i].substr(0, colon));
+		string value = String::trim(lines[i].substr(colon + 1));
+		if(name == "connection")
+			connection += (connection.length() != 0) ? ", " + value : value;
+		else if(name == "transfer-encoding")
+			transferEncoding = String::toLower(value);
+		else if(name == "content-length")
+			contentLength = value;
+
+		ProxyHeaderMap::iterator iter = headers.find(name);
+		if(iter == headers.end())
+			headers.insert(make_pair(name, value));
+		else
+			iter->second += ", " + value;
+	}
+
+	// the upstream connection can be reused if the
+	// upstream keeps it open and the body has a length
+	if(statusLine.compare(0, 8, "HTTP/1.1") == 0)
+		m_upstreamKeepAlive = !String::containsToken(connection, "close");
+	else
+		m_upstreamKeepAlive = String::containsToken(connection, "keep-alive");
+
+	if(m_headRequest || statusCode == 204 || statusCode == 304) {
+		m_bodyType = PROXY_BODY_TYPE_NONE;
+	} else if(transferEncoding.length() != 0) {
+		if(String::endsWith(transferEncoding, "chunked") == false)
+			return false;
+		m_bodyType = PROXY_BODY_TYPE_CHUNKED;
+		m_chunkState = PROXY_CHUNK_STATE_SIZE;
+	} else if(contentLength.length() != 0) {
+		if(parseLength(contentLength, &m_bodyRemaining) == false)
+			return false;
+		m_bodyType = PROXY_BODY_TYPE_LENGTH;
+	} else {
+		m_bodyType = PROXY_BODY_TYPE_CLOSE;
+		m_upstreamKeepAlive = false;
+	}
+
+	// relay the status and the end-to-end headers; the server
+	// sends a chunked body in chunks of its own
+	response->setStatus(statusCode, statusMessage);
+	response->setContentType("");
+	ProxyHeaderMap::iterator iter = headers.begin();
+	while(iter != headers.end()) {
+		if(isHopByHopHeader(iter->first, connection) == false &&
+		   (iter->first != "content-length" || m_bodyType != PROXY_BODY_TYPE_CHUNKED))
+			response->setHeaderValue(canonicalHeaderName(iter->first), iter->second);
+		++iter;
+	}
+
+	m_responseStarted = true;
+	m_state = PROXY_CONTEXT_STATE_READING_BODY;
+	if(m_bodyType == PROXY_BODY_TYPE_NONE || (m_bodyType == PROXY_BODY_TYPE_LENGTH && m_bodyRemaining == 0))
+		finish(response);
+
+	return true;
+}
+
+bool
+ProxyContext::relayBody(HttpResponse *response)
+{
+	while(m_input.length() != 0 && m_state == PROXY_CONTEXT_STATE_READING_BODY) {
+		if(m_bodyType == PROXY_BODY_TYPE_CLOSE) {
+			response->sendString(m_input);
+			m_input.clear();
+			break;
+		}
+
+		if(m_bodyType == PROXY_BODY_TYPE_LENGTH) {
+			size_t length = m_input.length();
+			if(length > m_bodyRemaining)
+				length = (size_t)m_bodyRemaining;
+
+			response->sendString(m_input.data(), length);
+			m_input.erase(0, length);
+			m_bodyRemaining -= length;
+			if(m_bodyRemaining == 0)
+				finish(response);
+			continue;
+		}
+
+		// decode the chunked body, passing along the data
+		if(m_chunkState == PROXY_CHUNK_STATE_DATA) {
+			size_t length = m_input.length();
+			if(length > m_bodyRemaining)
+				length = (size_t)m_bodyRemaining;
+
+			response->sendString(m_input.data(), length);
+			m_input.erase(0, length);
+			m_bodyRemaining -= length;
+			if(m_bodyRemaining == 0)
+				m_chunkState = PROXY_CHUNK_STATE_DATA_END;
+			continue;
+		}
+
+		size_t end = m_input.find("\r\n");
+		if(end == string::npos)
+			return (m_input.length() <= PROXY_MAX_LINE_SIZE);
+
+		string line = m_input.substr(0, end);
+		m_input.erase(0, end + 2);
+		if(m_chunkState == PROXY_CHUNK_STATE_SIZE) {
+			if(parseChunkSize(line, &m_bodyRemaining) == false)
+				return false;
+			m_chunkState = (m_bodyRemaining != 0) ? PROXY_CHUNK_STATE_DATA : PROXY_CHUNK_STATE_TRAILERS;
+		} else if(m_chunkState == PROXY_CHUNK_STATE_DATA_END) {
+			if(line.length() != 0)
+				return false;
+			m_chunkState = PROXY_CHUNK_STATE_SIZE;
+		} else if(line.length() == 0) {
+			finish(response);
+		} else {
+			// pass trailers along as trailers
+			size_t colon = line.find(':');
+			if(colon == string::npos || colon == 0)
+				return false;
+			response->setTrailerValue(canonicalHeaderName(line.substr(0, colon)), String::trim(line.substr(colon + 1)));
+		}
+	}
+
+	return true;
+}
+
+void
+ProxyContext::finish(HttpResponse *response)
+{
+	// return the connection to the pool if nothing
+	// else is expected to be sent on it
+	bool reusable = (m_upstreamKeepAlive && m_requestEnded && m_output.length() == 0 &&
+	                 m_sendFailed == false && m_input.length() == 0);
+	m_upstream->releaseConnection(m_fd, reusable, m_responder->getMaxIdleConnections());
+	m_upstream->succeeded();
+	m_fd = -1;
+
+	m_state = PROXY_CONTEXT_STATE_DONE;
+	response->endResponse();
+}
+
+ResponderContext *
+ProxyContext::fail(const HttpRequest *request, HttpResponse *response, ProxyResult result)
+{
+	m_upstream->releaseConnection(m_fd, false, 0);
+	m_fd = -1;
+
+	// a keep-alive connection that the upstream closed before
+	// it could be reused isn't a failure of the upstream
+	bool stale = (m_reused && result == PROXY_RESULT_FAILED && m_responseStarted == false && m_input.length() == 0);
+	if(stale == false) {
+		cerr << "Upstream " << m_upstream->getName() << (result == PROXY_RESULT_TIMED_OUT ? " timed out" : " failed") << endl;
+		m_upstream->failed(m_responder->getMaxFails(), m_responder->getFailTimeout());
+	}
+
+	// a request without a body can be sent again, to
+	// another upstream unless the connection was stale
+	if(m_responseStarted == false && m_requestHasBody == false) {
+		if(stale)
+			--m_attempts;
+
+		m_input.clear();
+		m_state = PROXY_CONTEXT_STATE_READING_HEAD;
+		if(connect(stale ? NULL : m_upstream))
+			return continueResponse(request, response);
+	}
+
+	m_state = PROXY_CONTEXT_STATE_DONE;
+	if(m_responseStarted)
+		response->abortResponse();
+	else if(result == PROXY_RESULT_TIMED_OUT)
+		response->sendErrorResponse(504, "Gateway Timeout", "The upstream server didn't respond in time.");
+	else
+		response->sendErrorResponse(502, "Bad Gateway", "The upstream server couldn't handle the request.");
+
+	return NULL;
+}
+
+void
+ProxyContext::wait(HttpResponse *response)
+{
+	// wait for the upstream, or for the client's connection
+	// while the response can't be sent any faster
+	bool waitingForClient = (m_state == PROXY_CONTEXT_STATE_READING_BODY && response->getSendCapacity() == 0);
+	int events = 0;
+	if(m_connected == false || m_output.length() != 0)
+		events |= HTTP_RESPONSE_WRITABLE;
+	if(m_connected && waitingForClient == false)
+		events |= HTTP_RESPONSE_READABLE;
+
+	if(events != 0)
+		response->wakeWhenReady(m_fd, events);
+	if(waitingForClient) {
+		response->wakeWhenWritable();
+	} else {
+		long timeout = m_deadline - getProxyMilliseconds();
+		response->wakeAfter((timeout > 0) ? timeout : 0);
+	}
+}
+
+ResponderContext *
+ProxyContext::continueResponse(const HttpRequest *request, HttpResponse *response)
+{
+	if(m_state == PROXY_CONTEXT_STATE_DONE)
+		return NULL;
+
+	ProxyResult result = PROXY_RESULT_OK;
+	if(m_connected == false)
+		result = checkConnection();
+	if(result == PROXY_RESULT_OK && m_connected)
+		result = sendRequest();
+	if(result == PROXY_RESULT_OK && m_connected)
+		result = readResponse(response);
+
+	// the timeout applies while waiting for the upstream
+	if(result == PROXY_RESULT_OK && m_state != PROXY_CONTEXT_STATE_DONE &&
+	   (m_state != PROXY_CONTEXT_STATE_READING_BODY || response->getSendCapacity() != 0) &&
+	   getProxyMilliseconds() >= m_deadline)
+		result = PROXY_RESULT_TIMED_OUT;
+
+	if(result != PROXY_RESULT_OK)
+		return fail(request, response, result);
+	if(m_state == PROXY_CONTEXT_STATE_DONE)
+		return NULL;
+
+	wait(response);
+	return this;
+}
+
+void
+ProxyContext::requestBodyRead(const char *data, size_t length)
+{
+	if(m_sendFailed || m_state == PROXY_CONTEXT_STATE_DONE)
+		return;
+
+	// the body is sent by continueResponse, which is
+	// called once the data that's been read is handled
+	if(m_requestChunked) {
+		m_output += String::hexFromUInt((unsigned int)length) + "\r\n";
+		m_output.append(data, length);
+		m_output += "\r\n";
+	} else {
+		m_output.append(data, length);
+	}
+
+	m_deadline = getProxyMilliseconds() + m_responder->getTimeout();
+}
+
+void
+ProxyContext::requestBodyEnded()
+{
+	m_requestEnded = true;
+	if(m_requestChunked && m_sendFailed == false && m_state != PROXY_CONTEXT_STATE_DONE)
+		m_output += "0\r\n\r\n";
+}
+
+bool
+ProxyContext::isReadyForRequestBody() const
+{
+	return (m_output.length() < PROXY_MAX_OUTPUT_SIZE);
+}
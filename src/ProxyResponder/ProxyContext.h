@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PROXYCONTEXT_H__
+#define __PROXYCONTEXT_H__
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <xviweb/Responder.h>
+#include "ProxyResponder.h"
+
+typedef std::map<std::string, std::string> ProxyHeaderMap;
+
+enum ProxyContextState
+{
+	PROXY_CONTEXT_STATE_READING_HEAD = 0,
+	PROXY_CONTEXT_STATE_READING_BODY,
+	PROXY_CONTEXT_STATE_DONE
+};
+
+enum ProxyBodyType
+{
+	PROXY_BODY_TYPE_NONE = 0,
+	PROXY_BODY_TYPE_LENGTH,
+	PROXY_BODY_TYPE_CHUNKED,
+	PROXY_BODY_TYPE_CLOSE
+};
+
+enum ProxyChunkState
+{
+	PROXY_CHUNK_STATE_SIZE = 0,
+	PROXY_CHUNK_STATE_DATA,
+	PROXY_CHUNK_STATE_DATA_END,
+	PROXY_CHUNK_STATE_TRAILERS
+};
+
+enum ProxyResult
+{
+	PROXY_RESULT_OK = 0,
+	PROXY_RESULT_FAILED,
+	PROXY_RESULT_TIMED_OUT
+};
+
+// forwards a request to an upstream and relays its response; the
+// request body is sent as it's read, and only read while the upstream
+// takes it, and the response body is only read from the upstream
+// while the client's connection can take it
+class ProxyContext : public ResponderContext
+{
+	private:
+		ProxyResponder *m_responder;
+		ProxyUpstream *m_upstream;
+		int m_fd;
+		bool m_reused;
+		bool m_connected;
+		unsigned int m_attempts;
+		long m_deadline;
+
+		// the request's head is kept so that it can be sent
+		// again if a request without a body has to be retried
+		std::string m_head;
+		std::string m_output;
+		bool m_headRequest;
+		bool m_requestHasBody;
+		bool m_requestChunked;
+		bool m_requestEnded;
+		bool m_sendFailed;
+
+		std::string m_input;
+		ProxyContextState m_state;
+		bool m_responseStarted;
+		bool m_upstreamKeepAlive;
+		ProxyBodyType m_bodyType;
+		uint64_t m_bodyRemaining;
+		ProxyChunkState m_chunkState;
+
+		ProxyResult checkConnection();
+		ProxyResult sendRequest();
+		ProxyResult readResponse(HttpResponse *response);
+		bool processInput(HttpResponse *response);
+		bool relayHead(const std::string &head, HttpResponse *response);
+		bool relayBody(HttpResponse *response);
+		void finish(HttpResponse *response);
+		ResponderContext *fail(const HttpRequest *request, HttpResponse *response, ProxyResult result);
+		void wait(HttpResponse *response);
+
+	public:
+		ProxyContext(ProxyResponder *responder, const HttpRequest *request);
+		~ProxyContext();
+
+		bool connect(ProxyUpstream *exclude = NULL);
+
+		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
+		void requestBodyRead(const char *data, size_t length);
+		void requestBodyEnded();
+		bool isReadyForRequestBody() const;
+};
+
+#endif /* __PROXYCONTEXT_H__ */
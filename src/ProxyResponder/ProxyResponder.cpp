@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <xviweb/String.h>
+#include "ProxyResponder.h"
+#include "ProxyContext.h"
+
+using namespace std;
+
+// keep-alive connections that have been idle for
+// this long are closed instead of being reused
+#define PROXY_IDLE_TIMEOUT 30000
+
+long
+getProxyMilliseconds()
+{
+	struct timeval tv;
+	if(gettimeofday(&tv, NULL) == -1)
+		return 0;
+	return ((long)tv.tv_sec * 1000) + ((long)tv.tv_usec / 1000);
+}
+
+ProxyUpstream::ProxyUpstream(const string &name, const struct sockaddr *address,
+                             socklen_t addressLength)
+{
+	m_name = name;
+	memcpy(&m_address, address, addressLength);
+	m_addressLength = addressLength;
+	m_activeConnections = 0;
+	m_failures = 0;
+	m_downTime = 0;
+}
+
+ProxyUpstream::~ProxyUpstream()
+{
+	for(unsigned int i = 0; i < m_idleConnections.size(); ++i)
+		close(m_idleConnections[i].fd);
+}
+
+const string &
+ProxyUpstream::getName() const
+{
+	return m_name;
+}
+
+unsigned int
+ProxyUpstream::getActiveConnections() const
+{
+	return m_activeConnections;
+}
+
+bool
+ProxyUpstream::isDown(long currentTime) const
+{
+	return (currentTime < m_downTime);
+}
+
+int
+ProxyUpstream::acquireConnection(bool *reused)
+{
+	// reuse the connection that was idle for the shortest
+	// time, skipping ones that the upstream has closed
+	long currentTime = getProxyMilliseconds();
+	while(m_idleConnections.size() != 0) {
+		ProxyIdleConnection idle = m_idleConnections.back();
+		m_idleConnections.pop_back();
+
+		char c;
+		if(currentTime - idle.idleTime < PROXY_IDLE_TIMEOUT &&
+		   recv(idle.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+		   (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			++m_activeConnections;
+			*reused = true;
+			return idle.fd;
+		}
+
+		close(idle.fd);
+	}
+
+	// open a new connection without waiting for it
+	int fd = socket(m_address.ss_family, SOCK_STREAM, 0);
+	if(fd == -1)
+		return -1;
+
+	if(fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+	   (connect(fd, (struct sockaddr *)&m_address, m_addressLength) == -1 && errno != EINPROGRESS)) {
+		close(fd);
+		return -1;
+	}
+
+	++m_activeConnections;
+	*reused = false;
+	return fd;
+}
+
+void
+ProxyUpstream::releaseConnection(int fd, bool reusable, unsigned int maxIdleConnections)
+{
+	--m_activeConnections;
+	if(reusable == false || m_idleConnections.size() >= maxIdleConnections) {
+		close(fd);
+		return;
+	}
+
+	ProxyIdleConnection idle;
+	idle.fd = fd;
+	idle.idleTime = getProxyMilliseconds();
+	m_idleConnections.push_back(idle);
+}
+
+void
+ProxyUpstream::succeeded()
+{
+	m_failures = 0;
+}
+
+void
+ProxyUpstream::failed(unsigned int maxFails, long failTimeout)
+{
+	// stop sending requests to the upstream for a while
+	// once it has failed too many times in a row
+	if(++m_failures < maxFails)
+		return;
+
+	m_failures = 0;
+	m_downTime = getProxyMilliseconds() + failTimeout;
+	cerr << "Upstream " << m_name << " is down for " << failTimeout << " ms" << endl;
+
+	// its idle connections aren't likely to be any good
+	for(unsigned int i = 0; i < m_idleConnections.size(); ++i)
+		close(m_idleConnections[i].fd);
+	m_idleConnections.clear();
+}
+
+ProxyResponder::ProxyResponder()
+{
+	m_path = "/";
+	m_balance = PROXY_BALANCE_ROUND_ROBIN;
+	m_nextUpstream = 0;
+	m_maxIdleConnections = 32;
+	m_maxFails = 3;
+	m_failTimeout = 10000;
+	m_timeout = 30000;
+	m_cacheTime = 0;
+	m_cacheStaleTime = 0;
+	m_cacheWaitTime = 0;
+}
+
+ProxyResponder::~ProxyResponder()
+{
+	for(unsigned int i = 0; i < m_upstreams.size(); ++i)
+		delete m_upstreams[i];
+}
+
+void
+ProxyResponder::addUpstream(const string &upstream)
+{
+	// the upstream is given as host:port, with IPv6
+	// addresses enclosed in brackets
+	size_t colon = upstream.rfind(':');
+	if(colon == string::npos || colon == 0) {
+		cerr << "Invalid upstream " << upstream << endl;
+		return;
+	}
+
+	string host = upstream.substr(0, colon);
+	string port = upstream.substr(colon + 1);
+	if(host.length() > 2 && host[0] == '[' && host[host.length() - 1] == ']')
+		host = host.substr(1, host.length() - 2);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo *result;
+	int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+	if(error != 0) {
+		cerr << "Unable to resolve upstream " << upstream << ": " << gai_strerror(error) << endl;
+		return;
+	}
+
+	m_upstreams.push_back(new ProxyUpstream(upstream, result->ai_addr, result->ai_addrlen));
+	freeaddrinfo(result);
+}
+
+void
+ProxyResponder::addOption(const string &option, const string &value)
+{
+	if(option == "path")
+		m_path = value;
+	else if(option == "upstream")
+		addUpstream(value);
+	else if(option == "balance")
+		m_balance = (value == "leastConnections") ? PROXY_BALANCE_LEAST_CONNECTIONS : PROXY_BALANCE_ROUND_ROBIN;
+	else if(option == "maxIdleConnections")
+		m_maxIdleConnections = String::toUInt(value);
+	else if(option == "maxFails")
+		m_maxFails = String::toUInt(value);
+	else if(option == "failTimeout")
+		m_failTimeout = (long)String::toUInt(value);
+	else if(option == "timeout")
+		m_timeout = (long)String::toUInt(value);
+	else if(option == "cacheTime")
+		m_cacheTime = (long)String::toUInt(value);
+	else if(option == "cacheStaleTime")
+		m_cacheStaleTime = (long)String::toUInt(value);
+	else if(option == "cacheWaitTime")
+		m_cacheWaitTime = (long)String::toUInt(value);
+	else if(option == "cacheQueryParameter")
+		m_cacheQueryParameters.push_back(value);
+}
+
+ProxyUpstream *
+ProxyResponder::selectUpstream(ProxyUpstream *exclude)
+{
+	// pick the next upstream that isn't down; with least
+	// connections balancing, ties go to the next in turn
+	long currentTime = getProxyMilliseconds();
+	ProxyUpstream *selected = NULL;
+	unsigned int count = m_upstreams.size();
+	for(unsigned int i = 0; i < count; ++i) {
+		ProxyUpstream *upstream = m_upstreams[(m_nextUpstream + i) % count];
+		if(upstream == exclude || upstream->isDown(currentTime))
+			continue;
+
+		if(selected == NULL || (m_balance == PROXY_BALANCE_LEAST_CONNECTIONS &&
+		                        upstream->getActiveConnections() < selected->getActiveConnections()))
+			selected = upstream;
+		if(m_balance == PROXY_BALANCE_ROUND_ROBIN)
+			break;
+	}
+
+	if(count != 0)
+		m_nextUpstream = (m_nextUpstream + 1) % count;
+	return selected;
+}
+
+unsigned int
+ProxyResponder::getUpstreamCount() const
+{
+	return m_upstreams.size();
+}
+
+unsigned int
+ProxyResponder::getMaxIdleConnections() const
+{
+	return m_maxIdleConnections;
+}
+
+unsigned int
+ProxyResponder::getMaxFails() const
+{
+	return m_maxFails;
+}
+
+long
+ProxyResponder::getFailTimeout() const
+{
+	return m_failTimeout;
+}
+
+long
+ProxyResponder::getTimeout() const
+{
+	return m_timeout;
+}
+
+bool
+ProxyResponder::matchesRequest(const HttpRequest *request) const
+{
+	return (m_upstreams.size() != 0 && request->getPath().compare(0, m_path.length(), m_path) == 0);
+}
+
+void
+ProxyResponder::getRoutes(vector <ResponderRoute> *routes) const
+{
+	// requests for any path beginning with the proxied path
+	if(m_upstreams.size() != 0)
+		routes->push_back(ResponderRoute(m_path + "*"));
+}
+
+bool
+ProxyResponder::streamsRequestBody(const HttpRequest * /*request*/) const
+{
+	// request bodies are forwarded as they arrive
+	return true;
+}
+
+bool
+ProxyResponder::getCachePolicy(const HttpRequest * /*request*/, ResponderCachePolicy *policy) const
+{
+	if(m_cacheTime <= 0)
+		return false;
+
+	policy->maxAge = m_cacheTime;
+	policy->staleTime = m_cacheStaleTime;
+	policy->maxWaitTime = m_cacheWaitTime;
+	policy->queryParameters = m_cacheQueryParameters;
+	return true;
+}
+
+ResponderContext *
+ProxyResponder::respond(const HttpRequest *request, HttpResponse *response)
+{
+	ProxyContext *context = new ProxyContext(this, request);
+	if(context->connect() == false) {
+		delete context;
+		response->sendErrorResponse(503, "Service Unavailable", "There is no upstream server available to handle the request.");
+		return NULL;
+	}
+
+	// send as much of the request as possible right away
+	ResponderContext *next = context->continueResponse(request, response);
+	if(next != context)
+		delete context;
+	return next;
+}
+
+XVIWEB_RESPONDER(ProxyResponder);
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PROXYRESPONDER_H__
+#define __PROXYRESPONDER_H__
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <xviweb/Responder.h>
+
+// the current time in milliseconds
+long getProxyMilliseconds();
+
+enum ProxyBalance
+{
+	PROXY_BALANCE_ROUND_ROBIN = 0,
+	PROXY_BALANCE_LEAST_CONNECTIONS
+};
+
+class ProxyIdleConnection
+{
+	public:
+		int fd;
+		long idleTime;
+};
+
+// a server that requests are forwarded to, along with the keep-alive
+// connections to it that aren't in use; it's marked as down for a while
+// after failing a number of times in a row
+class ProxyUpstream
+{
+	private:
+		std::string m_name;
+		struct sockaddr_storage m_address;
+		socklen_t m_addressLength;
+
+		std::vector <ProxyIdleConnection> m_idleConnections;
+		unsigned int m_activeConnections;
+		unsigned int m_failures;
+		long m_downTime;
+
+	public:
+		ProxyUpstream(const std::string &name, const struct sockaddr *address, socklen_t addressLength);
+		~ProxyUpstream();
+
+		const std::string &getName() const;
+		unsigned int getActiveConnections() const;
+		bool isDown(long currentTime) const;
+
+		int acquireConnection(bool *reused);
+		void releaseConnection(int fd, bool reusable, unsigned int maxIdleConnections);
+
+		void succeeded();
+		void failed(unsigned int maxFails, long failTimeout);
+};
+
+class ProxyResponder : public Responder
+{
+	private:
+		std::string m_path;
+		std::vector <ProxyUpstream *> m_upstreams;
+		ProxyBalance m_balance;
+		unsigned int m_nextUpstream;
+		unsigned int m_maxIdleConnections;
+		unsigned int m_maxFails;
+		long m_failTimeout;
+		long m_timeout;
+
+		// responses are cached when the cache time is set
+		long m_cacheTime;
+		long m_cacheStaleTime;
+		long m_cacheWaitTime;
+		std::vector <std::string> m_cacheQueryParameters;
+
+		void addUpstream(const std::string &upstream);
+
+	public:
+		ProxyResponder();
+		~ProxyResponder();
+
+		void addOption(const std::string &option, const std::string &value);
+
+		ProxyUpstream *selectUpstream(ProxyUpstream *exclude);
+		unsigned int getUpstreamCount() const;
+		unsigned int getMaxIdleConnections() const;
+		unsigned int getMaxFails() const;
+		long getFailTimeout() const;
+		long getTimeout() const;
+
+		bool matchesRequest(const HttpRequest *request) const;
+		bool streamsRequestBody(const HttpRequest *request) const;
+		bool getCachePolicy(const HttpRequest *request, ResponderCachePolicy *policy) const;
+		void getRoutes(std::vector <ResponderRoute> *routes) const;
+		ResponderContext *respond(const HttpRequest *request, HttpResponse *response);
+};
+
+#endif /* __PROXYRESPONDER_H__ */
@@ -43,7 +43,7 @@ Address::Address(const char *hostName)
 	}
 
 	m_type = (host->h_addrtype == AF_INET) ? ADDRESS_TYPE_IPV4 : ADDRESS_TYPE_IPV6;
-	for(int i = 0; i < 16; ++i)
+	for(int i = 0; i < host->h_length && i < 16; ++i)
 		m_address[i] = host->h_addr_list[0][i];
 }
 
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include "ChunkedDecoder.h"
+
+using namespace std;
+
+// limits on the framing that has to be buffered
+// before it can be decoded
+static const size_t MAX_LINE_LENGTH = 4096;
+static const size_t MAX_TRAILER_LINES = 64;
+
+ChunkedDecoder::ChunkedDecoder()
+{
+	reset();
+}
+
+void
+ChunkedDecoder::reset()
+{
+	m_state = CHUNKED_DECODER_STATE_SIZE;
+	m_chunkRemaining = 0;
+	m_trailerLines.clear();
+}
+
+ChunkedDecoderState
+ChunkedDecoder::getState() const
+{
+	return m_state;
+}
+
+bool
+ChunkedDecoder::isDone() const
+{
+	return (m_state == CHUNKED_DECODER_STATE_DONE);
+}
+
+bool
+ChunkedDecoder::hasError() const
+{
+	return (m_state == CHUNKED_DECODER_STATE_ERROR);
+}
+
+const vector <string> &
+ChunkedDecoder::getTrailerLines() const
+{
+	return m_trailerLines;
+}
+
+static const char *
+findLineEnd(const char *data, size_t length)
+{
+	const char *end = data + length;
+	const char *p = data;
+
+	while((p = (const char *)memchr(p, '\r', (size_t)(end - p))) != NULL) {
+		if(p + 1 == end)
+			break;
+		if(p[1] == '\n')
+			return p;
+		++p;
+	}
+
+	return NULL;
+}
+
+static bool
+parseChunkSize(const char *data, const char *end, uint64_t *size)
+{
+	const uint64_t maxSize = (uint64_t)1 << 56;
+	uint64_t value = 0;
+	const char *p = data;
+
+	for(; p != end; ++p) {
+		char c = *p;
+		unsigned int digit;
+		if(c >= '0' && c <= '9')
+			digit = (unsigned int)(c - '0');
+		else if(c >= 'a' && c <= 'f')
+			digit = (unsigned int)(c - 'a' + 10);
+		else if(c >= 'A' && c <= 'F')
+			digit = (unsigned int)(c - 'A' + 10);
+		else
+			break;
+
+		value = (value << 4) | digit;
+		if(value > maxSize)
+			return false;
+	}
+
+	// there must be at least one digit, optionally
+	// followed by whitespace and chunk extensions
+	if(p == data || (p != end && *p != ';' && *p != ' ' && *p != '\t'))
+		return false;
+
+	*size = value;
+	return true;
+}
+
+size_t
+ChunkedDecoder::decode(const char *data, size_t length,
+                       const char **chunk, size_t *chunkLength)
+{
+	*chunk = NULL;
+	*chunkLength = 0;
+
+	switch(m_state) {
+		default:
+			return 0;
+
+		// read the line containing the size of the next chunk
+		case CHUNKED_DECODER_STATE_SIZE: {
+			const char *end = findLineEnd(data, length);
+			if(end == NULL) {
+				if(length > MAX_LINE_LENGTH)
+					m_state = CHUNKED_DECODER_STATE_ERROR;
+				return 0;
+			}
+
+			if(parseChunkSize(data, end, &m_chunkRemaining) == false) {
+				m_state = CHUNKED_DECODER_STATE_ERROR;
+				return 0;
+			}
+
+			// a chunk size of zero marks the last chunk
+			if(m_chunkRemaining == 0)
+				m_state = CHUNKED_DECODER_STATE_TRAILERS;
+			else
+				m_state = CHUNKED_DECODER_STATE_DATA;
+
+			return (size_t)(end - data) + 2;
+		}
+
+		// return as much of the chunk's data as is available
+		case CHUNKED_DECODER_STATE_DATA:
+			if(length > m_chunkRemaining)
+				length = (size_t)m_chunkRemaining;
+
+			*chunk = data;
+			*chunkLength = length;
+
+			m_chunkRemaining -= length;
+			if(m_chunkRemaining == 0)
+				m_state = CHUNKED_DECODER_STATE_DATA_END;
+
+			return length;
+
+		// skip the line break following the chunk's data
+		case CHUNKED_DECODER_STATE_DATA_END:
+			if(length < 2)
+				return 0;
+
+			if(data[0] != '\r' || data[1] != '\n') {
+				m_state = CHUNKED_DECODER_STATE_ERROR;
+				return 0;
+			}
+
+			m_state = CHUNKED_DECODER_STATE_SIZE;
+			return 2;
+
+		// read trailers until a blank line is received
+		case CHUNKED_DECODER_STATE_TRAILERS: {
+			const char *end = findLineEnd(data, length);
+			if(end == NULL) {
+				if(length > MAX_LINE_LENGTH)
+					m_state = CHUNKED_DECODER_STATE_ERROR;
+				return 0;
+			}
+
+			if(end == data) {
+				m_state = CHUNKED_DECODER_STATE_DONE;
+			} else if(m_trailerLines.size() == MAX_TRAILER_LINES) {
+				m_state = CHUNKED_DECODER_STATE_ERROR;
+				return 0;
+			} else {
+				m_trailerLines.push_back(string(data, (size_t)(end - data)));
+			}
+
+			return (size_t)(end - data) + 2;
+		}
+	}
+}
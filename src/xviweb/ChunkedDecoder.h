@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CHUNKEDDECODER_H__
+#define __CHUNKEDDECODER_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+enum ChunkedDecoderState
+{
+	CHUNKED_DECODER_STATE_SIZE = 0,
+	CHUNKED_DECODER_STATE_DATA,
+	CHUNKED_DECODER_STATE_DATA_END,
+	CHUNKED_DECODER_STATE_TRAILERS,
+	CHUNKED_DECODER_STATE_DONE,
+	CHUNKED_DECODER_STATE_ERROR
+};
+
+// decodes a chunked body in place; each call to decode() consumes
+// either framing or chunk data from the front of the given buffer,
+// and chunk data is returned as a pointer into that buffer
+class ChunkedDecoder
+{
+	private:
+		ChunkedDecoderState m_state;
+		uint64_t m_chunkRemaining;
+		std::vector <std::string> m_trailerLines;
+
+	public:
+		ChunkedDecoder();
+
+		void reset();
+		ChunkedDecoderState getState() const;
+		bool isDone() const;
+		bool hasError() const;
+		const std::vector <std::string> &getTrailerLines() const;
+
+		size_t decode(const char *data, size_t length, const char **chunk, size_t *chunkLength);
+};
+
+#endif /* __CHUNKEDDECODER_H__ */
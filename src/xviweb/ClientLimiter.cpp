@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <unistd.h>
+#include "ClientLimiter.h"
+#include "Util.h"
+
+using namespace std;
+
+// how many slots a client can be in
+#define CLIENT_LIMITER_SLOTS 8
+
+ClientLimiterEntry::ClientLimiterEntry()
+{
+	key = 0;
+	used = false;
+	connections = 0;
+	tokens = 0;
+	lastTime = 0;
+}
+
+ClientLimiter::ClientLimiter()
+{
+	// the seed keeps clients from picking addresses
+	// that all hash to the same slots
+	m_seed = ((uint64_t)getpid() << 32) ^ (uint64_t)getMilliseconds() ^ (uint64_t)(size_t)this;
+
+	m_tableSize = 16384;
+	m_maxConnections = 0;
+	m_requestRate = 0;
+	m_requestBurst = 0;
+}
+
+void
+ClientLimiter::setTableSize(unsigned int tableSize)
+{
+	m_tableSize = CLIENT_LIMITER_SLOTS;
+	while(m_tableSize < tableSize)
+		m_tableSize <<= 1;
+}
+
+void
+ClientLimiter::setMaxConnections(unsigned int maxConnections)
+{
+	m_maxConnections = maxConnections;
+}
+
+void
+ClientLimiter::setRequestRate(long requestRate)
+{
+	m_requestRate = requestRate;
+}
+
+void
+ClientLimiter::setRequestBurst(long requestBurst)
+{
+	m_requestBurst = requestBurst;
+}
+
+bool
+ClientLimiter::isEnabled() const
+{
+	return (m_maxConnections != 0 || m_requestRate > 0);
+}
+
+int64_t
+ClientLimiter::getMaxTokens() const
+{
+	long burst = (m_requestBurst > 0) ? m_requestBurst : m_requestRate;
+	return (int64_t)((burst > 0) ? burst : 1) * 1000;
+}
+
+static uint64_t
+getClientKey(const Address &address)
+{
+	const uint8_t *bytes = address.getAddress();
+	uint64_t key = 0;
+
+	// IPv4 clients of an IPv6 socket have IPv4-mapped addresses
+	static const uint8_t mappedPrefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	if(address.getType() == ADDRESS_TYPE_IPV6 && memcmp(bytes, mappedPrefix, 12) != 0) {
+		for(unsigned int i = 0; i < 8; ++i)
+			key = (key << 8) | bytes[i];
+	} else {
+		// IPv4 keys are in ::/32, which IPv6 clients can't be in
+		if(address.getType() == ADDRESS_TYPE_IPV6)
+			bytes += 12;
+		for(unsigned int i = 0; i < 4; ++i)
+			key = (key << 8) | bytes[i];
+	}
+
+	return key;
+}
+
+static uint64_t
+hashKey(uint64_t key)
+{
+	// the finalizer of splitmix64
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+ClientLimiterEntry *
+ClientLimiter::findEntry(const Address &address, long currentTime)
+{
+	// the table is only allocated once it's needed
+	if(m_entries.size() != m_tableSize)
+		m_entries.resize(m_tableSize);
+
+	uint64_t key = getClientKey(address);
+	size_t index = hashKey(key ^ m_seed) & (m_tableSize - 1);
+
+	ClientLimiterEntry *freeEntry = NULL;
+	for(unsigned int i = 0; i < CLIENT_LIMITER_SLOTS; ++i) {
+		ClientLimiterEntry *entry = &m_entries[(index + i) & (m_tableSize - 1)];
+		if(entry->used == false) {
+			if(freeEntry == NULL || freeEntry->used)
+				freeEntry = entry;
+			continue;
+		}
+
+		if(entry->key == key)
+			return entry;
+
+		if(entry->connections == 0 && (freeEntry == NULL || (freeEntry->used && entry->lastTime < freeEntry->lastTime)))
+			freeEntry = entry;
+	}
+
+	// clients that are new, or were forgotten,
+	// start with all of their requests available
+	if(freeEntry != NULL) {
+		freeEntry->key = key;
+		freeEntry->used = true;
+		freeEntry->connections = 0;
+		freeEntry->tokens = getMaxTokens();
+		freeEntry->lastTime = currentTime;
+	}
+
+	return freeEntry;
+}
+
+void
+ClientLimiter::refill(ClientLimiterEntry *entry, long currentTime)
+{
+	int64_t maxTokens = getMaxTokens();
+	if(currentTime > entry->lastTime && entry->tokens < maxTokens) {
+		entry->tokens += (int64_t)(currentTime - entry->lastTime) * m_requestRate;
+		if(entry->tokens > maxTokens)
+			entry->tokens = maxTokens;
+	}
+
+	entry->lastTime = currentTime;
+}
+
+bool
+ClientLimiter::connectionOpened(const Address &address, long currentTime, ClientLimiterEntry **entry)
+{
+	ClientLimiterEntry *clientEntry = findEntry(address, currentTime);
+	*entry = NULL;
+	if(clientEntry == NULL)
+		return true;
+
+	if(m_maxConnections != 0 && clientEntry->connections >= m_maxConnections)
+		return false;
+
+	refill(clientEntry, currentTime);
+	++clientEntry->connections;
+	*entry = clientEntry;
+	return true;
+}
+
+void
+ClientLimiter::connectionClosed(ClientLimiterEntry *entry)
+{
+	if(entry != NULL && entry->connections != 0)
+		--entry->connections;
+}
+
+bool
+ClientLimiter::requestReceived(ClientLimiterEntry *entry, long currentTime)
+{
+	if(entry == NULL || m_requestRate <= 0)
+		return true;
+
+	refill(entry, currentTime);
+	if(entry->tokens < 1000)
+		return false;
+
+	entry->tokens -= 1000;
+	return true;
+}
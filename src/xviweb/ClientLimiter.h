@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CLIENTLIMITER_H__
+#define __CLIENTLIMITER_H__
+
+#include <vector>
+#include "Address.h"
+
+// what's known about a client: IPv4 clients are keyed by their
+// address and IPv6 clients by their /64 network
+class ClientLimiterEntry
+{
+	public:
+		uint64_t key;
+		bool used;
+		unsigned int connections;
+
+		// the client's request tokens, in thousandths,
+		// as of the last time it was seen
+		int64_t tokens;
+		long lastTime;
+
+		ClientLimiterEntry();
+};
+
+// limits the connections and request rate of each client, using a
+// table of a fixed size so that any number of clients can be seen
+// without using more memory; a client that's looked up is in one of
+// a few slots picked by a seeded hash of its key, and a client
+// without a slot takes one from the client seen longest ago that has
+// no connections, or isn't limited if there's none
+class ClientLimiter
+{
+	private:
+		std::vector <ClientLimiterEntry> m_entries;
+		uint64_t m_seed;
+
+		unsigned int m_tableSize;
+		unsigned int m_maxConnections;
+		long m_requestRate;
+		long m_requestBurst;
+
+		int64_t getMaxTokens() const;
+		ClientLimiterEntry *findEntry(const Address &address, long currentTime);
+		void refill(ClientLimiterEntry *entry, long currentTime);
+
+	public:
+		ClientLimiter();
+
+		// the size is rounded up to a power of two
+		void setTableSize(unsigned int tableSize);
+		void setMaxConnections(unsigned int maxConnections);
+
+		// clients can make requestRate requests per second, and up
+		// to requestBurst at once (by default, as many as the rate);
+		// a rate of 0 disables the limit
+		void setRequestRate(long requestRate);
+		void setRequestBurst(long requestBurst);
+
+		bool isEnabled() const;
+
+		// returns false if the client has as many connections as it's
+		// allowed; otherwise, sets entry to the client's entry, which
+		// stays the client's until the connection is closed, or to
+		// null if there's no room for it
+		bool connectionOpened(const Address &address, long currentTime, ClientLimiterEntry **entry);
+		void connectionClosed(ClientLimiterEntry *entry);
+
+		// returns false if the client has used up its requests
+		bool requestReceived(ClientLimiterEntry *entry, long currentTime);
+};
+
+#endif /* __CLIENTLIMITER_H__ */
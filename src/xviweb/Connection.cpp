@@ -25,11 +25,19 @@
 
 #include <iostream>
 #include <cstring>
+#include <cerrno>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
+#ifdef XVIWEB_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
 #include <xviweb/String.h>
 #include "Connection.h"
+#include "Poller.h"
 #include "Util.h"
 
 using namespace std;
@@ -38,20 +46,49 @@ Connection::Connection(int fd, const Address &address, unsigned short port)
  : m_fd(fd), m_address(address), m_port(port)
 {
 	m_readMilliseconds = getMilliseconds();
+	m_outputSize = 0;
+	m_maxOutputSize = 64 * 1024;
+	m_writeFailed = false;
+	m_notSentLowWatermark = 0;
+	m_outputHeld = false;
+	m_ownsSocket = true;
+	m_poller = NULL;
+	m_sending = false;
+	m_sendingLength = 0;
+	m_ssl = NULL;
+	m_tlsHandshaking = false;
+	m_tlsWaitingForWritable = false;
+	m_kernelTlsSend = false;
 
 	cout << toString() << ": Connection opened" << endl;
 }
 
+// the connection is made in the background; its socket becomes
+// writable once it's been made or has failed (see isConnected)
 Connection::Connection(const Address &address, unsigned short port)
  : m_address(address), m_port(port)
 {
 	m_readMilliseconds = getMilliseconds();
+	m_outputSize = 0;
+	m_maxOutputSize = 64 * 1024;
+	m_writeFailed = false;
+	m_notSentLowWatermark = 0;
+	m_outputHeld = false;
+	m_ownsSocket = true;
+	m_poller = NULL;
+	m_sending = false;
+	m_sendingLength = 0;
+	m_ssl = NULL;
+	m_tlsHandshaking = false;
+	m_tlsWaitingForWritable = false;
+	m_kernelTlsSend = false;
 
 	if(address.getType() == ADDRESS_TYPE_IPV4) {
 		// open TCP connection over IPv4
 		m_fd = socket(AF_INET, SOCK_STREAM, 0);
 		if(m_fd == -1)
 			throw "socket() failed";
+		fcntl(m_fd, F_SETFL, O_NONBLOCK);
 
 		struct sockaddr_in sin;
 		bzero(&sin, sizeof(sin));
@@ -59,7 +96,7 @@ Connection::Connection(const Address &address, unsigned short port)
 		sin.sin_port = htons(port);
 		memcpy(&sin.sin_addr, address.getAddress(), 4);
 
-		if(connect(m_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		if(connect(m_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 && errno != EINPROGRESS) {
 			close(m_fd);
 			throw "connect() failed";
 		}
@@ -68,6 +105,7 @@ Connection::Connection(const Address &address, unsigned short port)
 		m_fd = socket(AF_INET6, SOCK_STREAM, 0);
 		if(m_fd == -1)
 			throw "socket() failed";
+		fcntl(m_fd, F_SETFL, O_NONBLOCK);
 
 		struct sockaddr_in6 sin;
 		bzero(&sin, sizeof(sin));
@@ -75,7 +113,7 @@ Connection::Connection(const Address &address, unsigned short port)
 		sin.sin6_port = htons(port);
 		memcpy(&sin.sin6_addr, address.getAddress(), 16);
 
-		if(connect(m_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		if(connect(m_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 && errno != EINPROGRESS) {
 			close(m_fd);
 			throw "connect() failed";
 		}
@@ -84,12 +122,62 @@ Connection::Connection(const Address &address, unsigned short port)
 	cout << toString() << ": Connection opened" << endl;
 }
 
+// a connection that's carried over another one reads and sends
+// through it, and its limits start out the same as the other's
+Connection::Connection(const Connection *carrier)
+ : m_fd(carrier->m_fd), m_address(carrier->m_address), m_port(carrier->m_port)
+{
+	m_readMilliseconds = getMilliseconds();
+	m_outputSize = 0;
+	m_maxOutputSize = carrier->m_maxOutputSize;
+	m_writeFailed = false;
+	m_notSentLowWatermark = 0;
+	m_outputHeld = false;
+	m_ownsSocket = false;
+	m_poller = NULL;
+	m_sending = false;
+	m_sendingLength = 0;
+	m_ssl = NULL;
+	m_tlsHandshaking = false;
+	m_tlsWaitingForWritable = false;
+	m_kernelTlsSend = false;
+}
+
 Connection::~Connection()
 {
+	clearOutput();
+	if(m_ownsSocket == false)
+		return;
+
+#ifdef XVIWEB_TLS
+	if(m_ssl != NULL) {
+		// tell the client the connection is being closed
+		// if it can be done without waiting
+		if(m_tlsHandshaking == false && m_writeFailed == false)
+			SSL_shutdown(m_ssl);
+		ERR_clear_error();
+		SSL_free(m_ssl);
+	}
+#endif
+
 	close(m_fd);
 	cout << toString() << ": Connection closed" << endl;
 }
 
+bool
+Connection::isConnected() const
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if(getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1 || error != 0)
+		return false;
+
+	// the socket has no peer while it's still connecting
+	struct sockaddr_storage address;
+	length = sizeof(address);
+	return (getpeername(m_fd, (struct sockaddr *)&address, &length) == 0);
+}
+
 int
 Connection::getFileDescriptor() const
 {
@@ -114,54 +202,616 @@ Connection::getMillisecondsSinceLastRead() const
 	return getMilliseconds() - m_readMilliseconds;
 }
 
+size_t
+Connection::getOutputSize() const
+{
+	return m_outputSize;
+}
+
+size_t
+Connection::getOutputCapacity() const
+{
+	size_t outputSize = getOutputSize();
+	return (outputSize < m_maxOutputSize) ? m_maxOutputSize - outputSize : 0;
+}
+
 void
-Connection::doRead()
+Connection::startTls(SSL *ssl)
 {
-	string s;
+	m_ssl = ssl;
+	m_tlsHandshaking = true;
+}
 
-	// read from the socket
-	char buf[512];
-	ssize_t length;
-	while((length = recv(m_fd, buf, sizeof(buf) - 1, 0)) > 0) {
-		buf[length] = '\0';
-		s += buf;
+bool
+Connection::isSecure() const
+{
+	return (m_ssl != NULL);
+}
+
+// returns true if the TLS handshake is waiting
+// for the socket to be writable to continue
+bool
+Connection::isWaitingForWritable() const
+{
+	return m_tlsWaitingForWritable;
+}
+
+void
+Connection::setPoller(Poller *poller)
+{
+	m_poller = poller;
+}
 
-		if(length != sizeof(buf) - 1)
+// output of secure connections is sent through their sessions
+bool
+Connection::sendsThroughPoller() const
+{
+	return (m_poller != NULL && m_poller->isAsynchronous() && m_ssl == NULL);
+}
+
+// returns true if there's output that's waiting for the socket to be
+// writable, rather than for a file to be read or the poller to send it
+bool
+Connection::isWaitingToSend() const
+{
+	return (m_output.empty() == false && m_output.front().ready && sendsThroughPoller() == false);
+}
+
+// continues the TLS handshake, returning true once it's done
+bool
+Connection::continueTlsHandshake()
+{
+#ifdef XVIWEB_TLS
+	m_tlsWaitingForWritable = false;
+	int result = SSL_do_handshake(m_ssl);
+	if(result == 1) {
+		m_tlsHandshaking = false;
+#ifndef OPENSSL_NO_KTLS
+		m_kernelTlsSend = (BIO_get_ktls_send(SSL_get_wbio(m_ssl)) != 0);
+#endif
+		return true;
+	}
+
+	switch(SSL_get_error(m_ssl, result)) {
+		case SSL_ERROR_WANT_READ:
+			break;
+		case SSL_ERROR_WANT_WRITE:
+			m_tlsWaitingForWritable = true;
+			break;
+		default:
+			// the handshake failed
+			ERR_clear_error();
+			m_writeFailed = true;
+			closed();
 			break;
 	}
+#endif
+	return false;
+}
+
+// reads from the socket or TLS session like recv
+ssize_t
+Connection::receive(char *buf, size_t length)
+{
+#ifdef XVIWEB_TLS
+	if(m_ssl != NULL) {
+		size_t readLength;
+		if(SSL_read_ex(m_ssl, buf, length, &readLength) == 1)
+			return (ssize_t)readLength;
+
+		switch(SSL_get_error(m_ssl, 0)) {
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE:
+				errno = EAGAIN;
+				return -1;
+			case SSL_ERROR_ZERO_RETURN:
+				return 0;
+			default:
+				ERR_clear_error();
+				errno = ECONNRESET;
+				return -1;
+		}
+	}
+#endif
+
+	return recv(m_fd, buf, length, 0);
+}
+
+// sends to the socket or TLS session like sendmsg
+ssize_t
+Connection::transmit(const struct iovec *buffers, int count)
+{
+#ifdef XVIWEB_TLS
+	if(m_ssl != NULL && m_kernelTlsSend == false) {
+		if(m_tlsHandshaking) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		// small buffers are gathered so they're sent in one
+		// record; a write that has to be retried is retried
+		// with the same data from the front of the output
+		// queue, or more of it, as OpenSSL requires
+		const void *data = buffers[0].iov_base;
+		size_t length = buffers[0].iov_len;
+		char record[16384];
+		if(count > 1 && length < sizeof(record)) {
+			length = 0;
+			for(int i = 0; i < count && length + buffers[i].iov_len <= sizeof(record); ++i) {
+				memcpy(record + length, buffers[i].iov_base, buffers[i].iov_len);
+				length += buffers[i].iov_len;
+			}
+			data = record;
+		}
+
+		size_t written;
+		if(SSL_write_ex(m_ssl, data, length, &written) == 1)
+			return (ssize_t)written;
+
+		int error = SSL_get_error(m_ssl, 0);
+		if(error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+			errno = EAGAIN;
+		} else {
+			ERR_clear_error();
+			errno = EPIPE;
+		}
+		return -1;
+	}
+#endif
+
+	struct msghdr msg;
+	bzero(&msg, sizeof(msg));
+	msg.msg_iov = (struct iovec *)buffers;
+	msg.msg_iovlen = count;
+	return sendmsg(m_fd, &msg, 0);
+}
+
+void
+Connection::setMaxOutputSize(size_t maxOutputSize)
+{
+	m_maxOutputSize = maxOutputSize;
+}
+
+void
+Connection::queueOutput(const struct iovec *buffers, int count)
+{
+	// copy the buffers to the end of the last queued
+	// buffer if nothing else is using it
+	ConnectionOutput *last = m_output.empty() ? NULL : &m_output.back();
+	if(last == NULL || last->buffer->isShared() ||
+	   last->offset + last->length != last->buffer->getLength()) {
+		ConnectionOutput output;
+		output.buffer = new SharedBuffer();
+		output.offset = 0;
+		output.length = 0;
+		output.ready = true;
+		m_output.push_back(output);
+		last = &m_output.back();
+	}
+
+	for(int i = 0; i < count; ++i) {
+		last->buffer->append((const char *)buffers[i].iov_base, buffers[i].iov_len);
+		last->length += buffers[i].iov_len;
+		m_outputSize += buffers[i].iov_len;
+	}
+}
+
+void
+Connection::queueOutput(SharedBuffer *buffer, size_t offset, size_t length)
+{
+	ConnectionOutput output;
+	output.buffer = buffer;
+	output.offset = offset;
+	output.length = length;
+	output.ready = true;
+	buffer->retain();
+
+	m_output.push_back(output);
+	m_outputSize += length;
+}
+
+// sends the given length from the front of the output queue
+// over another connection, without copying it
+void
+Connection::moveOutput(Connection *connection, size_t length)
+{
+	m_outputSize -= length;
+	while(length != 0) {
+		ConnectionOutput &output = m_output.front();
+		size_t n = (output.length < length) ? output.length : length;
+		connection->sendSharedBuffer(output.buffer, output.offset, n);
+
+		output.offset += n;
+		output.length -= n;
+		length -= n;
+		if(output.length == 0) {
+			output.buffer->release();
+			m_output.pop_front();
+		}
+	}
+}
+
+void
+Connection::clearOutput()
+{
+	for(unsigned int i = 0; i < m_output.size(); ++i)
+		m_output[i].buffer->release();
+
+	m_output.clear();
+	m_outputSize = 0;
+	m_sendingLength = 0;
+}
+
+// releases the buffers at the front of the output queue that have
+// been completely sent and adjusts the one that's partially sent
+void
+Connection::removeSentOutput(size_t length)
+{
+	m_outputSize -= length;
+	while(!m_output.empty() && length >= m_output.front().length) {
+		length -= m_output.front().length;
+		m_output.front().buffer->release();
+		m_output.pop_front();
+	}
+
+	if(length != 0) {
+		m_output.front().offset += length;
+		m_output.front().length -= length;
+	}
+}
+
+void
+Connection::flushOutput()
+{
+	// output waits until the TLS handshake is done
+	if(m_tlsHandshaking) {
+		if(m_tlsWaitingForWritable)
+			continueTlsHandshake();
+		if(m_tlsHandshaking)
+			return;
+	}
+
+	if(sendsThroughPoller()) {
+		sendThroughPoller();
+		return;
+	}
+
+	// output is sent up to the first that isn't ready
+	while(!m_output.empty() && m_output.front().ready) {
+		struct iovec iov[16];
+		int count = 0;
+		for(; count < 16 && count < (int)m_output.size() && m_output[count].ready; ++count) {
+			iov[count].iov_base = (void *)(m_output[count].buffer->getData() + m_output[count].offset);
+			iov[count].iov_len = m_output[count].length;
+		}
+
+		ssize_t length = transmit(iov, count);
+		if(length == -1) {
+			if(errno == EINTR)
+				continue;
+
+			// the output can never be sent if
+			// it's anything other than EAGAIN
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				m_writeFailed = true;
+				clearOutput();
+			}
+			return;
+		}
+
+		removeSentOutput((size_t)length);
+	}
+}
 
-	if(s.length() != 0) {
-		m_readMilliseconds = getMilliseconds();
+// hands the output that's ready to the poller to send,
+// once it's done sending what it was handed before
+void
+Connection::sendThroughPoller()
+{
+	if(m_sending)
+		return;
+
+	struct iovec iov[16];
+	SharedBuffer *owners[16];
+	int count = 0;
+	size_t length = 0;
+	for(; count < 16 && count < (int)m_output.size() && m_output[count].ready; ++count) {
+		iov[count].iov_base = (void *)(m_output[count].buffer->getData() + m_output[count].offset);
+		iov[count].iov_len = m_output[count].length;
+		owners[count] = m_output[count].buffer;
+		length += m_output[count].length;
+	}
 
-		stringRead(s);
+	if(count != 0) {
+		m_poller->send(m_fd, iov, owners, count);
+		m_sending = true;
+		m_sendingLength = length;
+	}
+}
+
+// completes a send by the poller, given the length sent or a
+// negated errno; the rest of the output is sent after it
+void
+Connection::outputSent(int length)
+{
+	m_sending = false;
+	if(length < 0 && length != -EAGAIN && length != -EINTR) {
+		m_writeFailed = true;
+		clearOutput();
+		return;
+	}
+
+	if(length > 0)
+		removeSentOutput(((size_t)length < m_sendingLength) ? (size_t)length : m_sendingLength);
+	m_sendingLength = 0;
+	flushOutput();
+}
 
-		// append the string to the buffered line and
-		// see if the line has been completely read
-		m_line += s;
-		size_t tmp;
-		while((tmp = m_line.find("\r\n")) != string::npos) {
-			s = m_line.substr(0, tmp);
-			m_line = m_line.substr(tmp + 2);
-			lineRead(s);
+// completes a file read by the poller, given the length read or a
+// negated errno; the output waiting for it is sent once it's ready
+void
+Connection::fileRead(SharedBuffer *buffer, int length)
+{
+	for(unsigned int i = 0; i < m_output.size(); ++i) {
+		ConnectionOutput &output = m_output[i];
+		if(output.buffer != buffer || output.ready)
+			continue;
+
+		if(length != (int)output.length) {
+			fileReadFailed();
+			return;
 		}
+
+		output.ready = true;
+		flushOutput();
+		return;
+	}
+}
+
+// a file that's been truncated or can't be read leaves what's
+// being sent unfinished, so the connection's closed without it
+void
+Connection::fileReadFailed()
+{
+	m_writeFailed = true;
+	clearOutput();
+	closed();
+}
+
+// queues what's sent until the output is released
+void
+Connection::holdOutput()
+{
+	m_outputHeld = true;
+}
+
+void
+Connection::releaseOutput()
+{
+	m_outputHeld = false;
+	flushOutput();
+}
+
+void
+Connection::setNotSentLowWatermark(unsigned int bytes)
+{
+	if(bytes == m_notSentLowWatermark)
+		return;
+
+	// a value of zero restores the system default
+#ifdef TCP_NOTSENT_LOWAT
+	setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes));
+#endif
+	m_notSentLowWatermark = bytes;
+}
+
+void
+Connection::doRead()
+{
+	// read from the socket, handing off the input as it's
+	// read so that large request bodies aren't buffered
+	if(m_tlsHandshaking && continueTlsHandshake() == false)
+		return;
+
+	char buf[16384];
+	ssize_t length;
+	while((length = receive(buf, sizeof(buf))) > 0) {
+		handleInput(buf, (size_t)length);
+
+		// leave the rest of the input unread while the output
+		// it caused can't be sent or it can't be handled yet
+		if((size_t)length != sizeof(buf) || getOutputCapacity() == 0 || isInputFull())
+			break;
 	}
 
-	// check if the connection was closed
-	if(length == 0)
+	// check if the connection was closed or reset
+	if(length == 0 || (length == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
 		closed();
 }
 
+// hands input received by the poller to the connection, given its
+// length, or 0 or a negated errno if the connection's been closed
 void
-Connection::sendString(const char *s, size_t size)
+Connection::inputReceived(const char *data, int length)
+{
+	if(length > 0)
+		handleInput(data, (size_t)length);
+	else
+		closed();
+}
+
+void
+Connection::handleInput(const char *data, size_t length)
+{
+	m_readMilliseconds = getMilliseconds();
+
+	m_line.append(data, length);
+	processInput();
+	inputRead();
+}
+
+void
+Connection::processInput()
 {
-	while(size != 0) {
-		ssize_t length = send(m_fd, s, size, 0);
-		if(length == -1)
+	while(m_line.length() != 0) {
+		if(isReadingLines()) {
+			// see if a line has been completely read
+			size_t tmp = m_line.find("\r\n");
+			if(tmp == string::npos)
+				break;
+
+			string line = m_line.substr(0, tmp);
+			m_line.erase(0, tmp + 2);
+			lineRead(line);
+		} else {
+			// pass raw data along; stop if none of
+			// it could be consumed. the data may be
+			// modified in place (e.g. to unmask it)
+			size_t length = dataRead(&m_line[0], m_line.length());
+			if(length == 0)
+				break;
+
+			m_line.erase(0, length);
+		}
+	}
+}
+
+void
+Connection::sendBuffers(const struct iovec *buffers, int count)
+{
+	if(m_writeFailed)
+		return;
+
+	// queue the buffers behind any output that's still
+	// waiting to be sent, or for the poller to send
+	if(m_outputSize != 0 || m_outputHeld || sendsThroughPoller()) {
+		queueOutput(buffers, count);
+		if(m_outputHeld == false)
+			flushOutput();
+		return;
+	}
+
+	struct iovec iov[16];
+	if(count > 16)
+		count = 16;
+	for(int i = 0; i < count; ++i)
+		iov[i] = buffers[i];
+
+	struct msghdr msg;
+	bzero(&msg, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+	while(msg.msg_iovlen != 0) {
+		ssize_t length = transmit(msg.msg_iov, (int)msg.msg_iovlen);
+		if(length == -1) {
+			if(errno == EINTR)
+				continue;
+
+			// queue what couldn't be sent until
+			// the socket becomes writable again
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				queueOutput(msg.msg_iov, (int)msg.msg_iovlen);
+			else
+				m_writeFailed = true;
 			break;
+		}
+
+		// skip past the buffers that were completely sent
+		// and adjust the one that was partially sent
+		while(msg.msg_iovlen != 0 && (size_t)length >= msg.msg_iov->iov_len) {
+			length -= (ssize_t)msg.msg_iov->iov_len;
+			++msg.msg_iov;
+			--msg.msg_iovlen;
+		}
+
+		if(msg.msg_iovlen != 0) {
+			msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + length;
+			msg.msg_iov->iov_len -= (size_t)length;
+		}
+	}
+}
+
+void
+Connection::sendSharedBuffer(SharedBuffer *buffer, size_t offset, size_t length)
+{
+	if(m_writeFailed || length == 0)
+		return;
+
+	// the buffer is only referenced by the output
+	// queue if it can't be sent right away
+	if(m_outputSize == 0 && m_outputHeld == false && sendsThroughPoller() == false) {
+		struct iovec iov;
+		iov.iov_base = (void *)(buffer->getData() + offset);
+		iov.iov_len = length;
+
+		ssize_t sent;
+		do {
+			sent = transmit(&iov, 1);
+		} while(sent == -1 && errno == EINTR);
+
+		if(sent == -1) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				m_writeFailed = true;
+				return;
+			}
+			sent = 0;
+		}
+
+		offset += (size_t)sent;
+		length -= (size_t)sent;
+		if(length != 0)
+			queueOutput(buffer, offset, length);
+	} else {
+		queueOutput(buffer, offset, length);
+		if(m_outputHeld == false)
+			flushOutput();
+	}
+}
 
-		s += length;
-		size -= (size_t)length;
+// sends part of a file; the poller reads it if the connection has
+// one, and the file can be closed as soon as this returns either way
+void
+Connection::sendFile(int fd, uint64_t offset, size_t length)
+{
+	if(m_writeFailed || length == 0)
+		return;
+
+	SharedBuffer *buffer = new SharedBuffer();
+	char *data = buffer->extend(length);
+	if(m_poller != NULL && m_poller->readsFiles()) {
+		// output behind the file waits for it to be read
+		ConnectionOutput output;
+		output.buffer = buffer;
+		output.offset = 0;
+		output.length = length;
+		output.ready = false;
+		m_output.push_back(output);
+		m_outputSize += length;
+
+		m_poller->readFile(m_fd, fd, buffer, data, offset, length);
+		return;
 	}
+
+	ssize_t readLength;
+	do {
+		readLength = pread(fd, data, length, (off_t)offset);
+	} while(readLength == -1 && errno == EINTR);
+
+	if(readLength == (ssize_t)length)
+		sendSharedBuffer(buffer, 0, length);
+	else
+		fileReadFailed();
+	buffer->release();
+}
+
+void
+Connection::sendString(const char *s, size_t size)
+{
+	struct iovec buffer;
+	buffer.iov_base = (void *)s;
+	buffer.iov_len = size;
+	sendBuffers(&buffer, 1);
 }
 
 void
@@ -194,13 +844,25 @@ Connection::toString() const
 	return m_address.toString() + " port " + String::fromUInt(m_port);
 }
 
+void
+Connection::resetReadTimer()
+{
+	m_readMilliseconds = getMilliseconds();
+}
+
 void
 Connection::closed()
 {
 }
 
+bool
+Connection::isInputFull() const
+{
+	return false;
+}
+
 void
-Connection::stringRead(const string &/*s*/)
+Connection::inputRead()
 {
 }
 
@@ -208,3 +870,15 @@ void
 Connection::lineRead(const string &/*line*/)
 {
 }
+
+bool
+Connection::isReadingLines() const
+{
+	return true;
+}
+
+size_t
+Connection::dataRead(char * /*data*/, size_t /*length*/)
+{
+	return 0;
+}
@@ -26,8 +26,25 @@
 #ifndef __CONNECTION_H__
 #define __CONNECTION_H__
 
+#include <deque>
 #include <string>
+#include <stdint.h>
+#include <sys/uio.h>
 #include "Address.h"
+#include "SharedBuffer.h"
+#include "TlsContext.h"
+
+class Poller;
+
+// output that isn't ready is waiting for a file to be read into it
+class ConnectionOutput
+{
+	public:
+		SharedBuffer *buffer;
+		size_t offset;
+		size_t length;
+		bool ready;
+};
 
 class Connection
 {
@@ -37,32 +54,114 @@ class Connection
 		unsigned short m_port;
 		long m_readMilliseconds;
 
+		// output that couldn't be sent without blocking
+		std::deque <ConnectionOutput> m_output;
+		size_t m_outputSize;
+		size_t m_maxOutputSize;
+		bool m_writeFailed;
+		unsigned int m_notSentLowWatermark;
+
+		// output is only queued while it's held, so that it
+		// can be sent all at once when it's released
+		bool m_outputHeld;
+
+		// connections carried over another connection's socket
+		// (e.g. HTTP/2 streams) don't close it
+		bool m_ownsSocket;
+
+		// an asynchronous poller reads files for the connection
+		// and, if it isn't secure, sends its output; the length
+		// being sent is 0 if the output's been cleared since
+		Poller *m_poller;
+		bool m_sending;
+		size_t m_sendingLength;
+
+		// the connection's TLS session, if it has one; once the
+		// kernel encrypts what's sent (kTLS), output is sent to
+		// the socket without going through the session
+		SSL *m_ssl;
+		bool m_tlsHandshaking;
+		bool m_tlsWaitingForWritable;
+		bool m_kernelTlsSend;
+
+		ssize_t receive(char *buf, size_t length);
+		ssize_t transmit(const struct iovec *buffers, int count);
+		bool continueTlsHandshake();
+		bool sendsThroughPoller() const;
+		void sendThroughPoller();
+		void removeSentOutput(size_t length);
+		void fileReadFailed();
+		void handleInput(const char *data, size_t length);
+
 	protected:
 		std::string m_line;
 
+		Connection(const Connection *carrier);
+
+		void queueOutput(const struct iovec *buffers, int count);
+		void queueOutput(SharedBuffer *buffer, size_t offset, size_t length);
+		void moveOutput(Connection *connection, size_t length);
+
 	public:
 		Connection(int fd, const Address &address, unsigned short port);
 		Connection(const Address &address, unsigned short port);
 		virtual ~Connection();
 
+		bool isConnected() const;
 		int getFileDescriptor() const;
 		const Address &getAddress() const;
 		unsigned short getPort() const;
 		long getMillisecondsSinceLastRead() const;
 
+		// the connection takes ownership of the session, which
+		// is used for everything read and sent from then on
+		void startTls(SSL *ssl);
+		bool isSecure() const;
+		bool isWaitingForWritable() const;
+
+		// the poller must be asynchronous or read files (see
+		// Poller::isAsynchronous and Poller::readsFiles); what
+		// it does for the connection is completed by outputSent,
+		// fileRead and inputReceived
+		void setPoller(Poller *poller);
+		bool isWaitingToSend() const;
+
+		size_t getOutputSize() const;
+		size_t getOutputCapacity() const;
+		void setMaxOutputSize(size_t maxOutputSize);
+		void flushOutput();
+		void clearOutput();
+		virtual void setNotSentLowWatermark(unsigned int bytes);
+		void holdOutput();
+		void releaseOutput();
+
+		// input that's buffered but can't be handled yet stops
+		// more from being read once there's too much of it
+		virtual bool isInputFull() const;
 		void doRead();
+		void inputReceived(const char *data, int length);
+		void outputSent(int length);
+		void fileRead(SharedBuffer *buffer, int length);
+		void processInput();
+		virtual void sendBuffers(const struct iovec *buffers, int count);
+		virtual void sendSharedBuffer(SharedBuffer *buffer, size_t offset, size_t length);
+		void sendFile(int fd, uint64_t offset, size_t length);
 		void sendString(const char *s, size_t size);
 		void sendString(const char *s);
 		void sendString(const std::string &s);
 		void sendLine(const std::string &line);
 		void sendLine(const char *line);
 
-		std::string toString() const;
+		virtual std::string toString() const;
 
 	protected:
+		void resetReadTimer();
+
 		virtual void closed();
-		virtual void stringRead(const std::string &s);
+		virtual void inputRead();
 		virtual void lineRead(const std::string &line);
+		virtual bool isReadingLines() const;
+		virtual size_t dataRead(char *data, size_t length);
 };
 
 #endif /* __CONNECTION_H__ */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zstd.h>
+#include <zdict.h>
+#include <xviweb/String.h>
+#include "ResponseCompressor.h"
+
+using namespace std;
+
+// the size that zstd's own tool trains dictionaries to
+#define DICTIONARY_TOOL_DEFAULT_SIZE 112640
+#define DICTIONARY_TOOL_DEFAULT_LEVEL 6
+
+// samples are compressed in pieces of this size,
+// as responses that are sent as they're made are
+#define DICTIONARY_TOOL_PIECE_SIZE 4096
+
+// the length of what comes before the Zstandard frame in a dcz body
+#define DICTIONARY_TOOL_DCZ_HEADER_LENGTH (8 + SHA256_DIGEST_LENGTH)
+
+class DictionaryTool
+{
+	private:
+		set <pair <dev_t, ino_t> > m_directories;
+		string m_samples;
+		vector <size_t> m_sampleLengths;
+		size_t m_size;
+		int m_level;
+		string m_dictionary;
+
+		void addFile(const string &path);
+
+	public:
+		DictionaryTool();
+
+		void setSize(size_t size);
+		void setLevel(int level);
+		void addSamples(const string &path);
+		void train();
+		void writeDictionary(const string &path) const;
+		void showSummary(ostream &stream, const string &path) const;
+};
+
+static bool
+readFile(const string &path, string &data)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	char buffer[65536];
+	ssize_t result;
+	while((result = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result == -1) {
+			int error = errno;
+			close(fd);
+			errno = error;
+			return false;
+		}
+
+		data.append(buffer, (size_t)result);
+	}
+
+	close(fd);
+	return true;
+}
+
+// compresses the data as the server compresses a response
+static string
+compress(const string &data, ResponseEncoding encoding, int level, const ResponseDictionary *dictionary)
+{
+	ResponseCompressor compressor(encoding, level, dictionary);
+	string output;
+	size_t offset = 0;
+	do {
+		size_t length = data.length() - offset;
+		if(length > DICTIONARY_TOOL_PIECE_SIZE)
+			length = DICTIONARY_TOOL_PIECE_SIZE;
+
+		offset += length;
+		compressor.compress(data.data() + offset - length, length, (offset == data.length()) ?
+		                    RESPONSE_COMPRESSOR_FINISH : RESPONSE_COMPRESSOR_NO_FLUSH, &output);
+	} while(offset != data.length());
+
+	return output;
+}
+
+// returns true if the dcz body decompresses to the data the way a
+// client would decompress it, with a window no bigger than clients
+// have to accept
+static bool
+decompressesTo(const string &body, const string &data, const ResponseDictionary &dictionary)
+{
+	static const char magic[8] = { 0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00 };
+	if(body.length() < DICTIONARY_TOOL_DCZ_HEADER_LENGTH || body.compare(0, sizeof(magic), magic, sizeof(magic)) != 0 ||
+	   memcmp(body.data() + sizeof(magic), dictionary.getHash(), SHA256_DIGEST_LENGTH) != 0)
+		return false;
+
+	ZSTD_DCtx *dctx = ZSTD_createDCtx();
+	if(dctx == NULL)
+		throw "ZSTD_createDCtx() failed";
+
+	ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, 23);
+	ZSTD_DCtx_refPrefix(dctx, dictionary.getData().data(), dictionary.getData().length());
+	string output(data.length() + 1, '\0');
+	size_t length = ZSTD_decompressDCtx(dctx, &output[0], output.length(), body.data() + DICTIONARY_TOOL_DCZ_HEADER_LENGTH,
+	                                    body.length() - DICTIONARY_TOOL_DCZ_HEADER_LENGTH);
+	ZSTD_freeDCtx(dctx);
+
+	return (ZSTD_isError(length) == 0 && output.compare(0, length, data) == 0 && length == data.length());
+}
+
+DictionaryTool::DictionaryTool()
+{
+	m_size = DICTIONARY_TOOL_DEFAULT_SIZE;
+	m_level = DICTIONARY_TOOL_DEFAULT_LEVEL;
+}
+
+void
+DictionaryTool::setSize(size_t size)
+{
+	m_size = size;
+}
+
+void
+DictionaryTool::setLevel(int level)
+{
+	m_level = level;
+}
+
+void
+DictionaryTool::addFile(const string &path)
+{
+	size_t length = m_samples.length();
+	if(readFile(path, m_samples) == false) {
+		cerr << path << ": " << strerror(errno) << endl;
+		m_samples.resize(length);
+		return;
+	}
+
+	if(m_samples.length() != length)
+		m_sampleLengths.push_back(m_samples.length() - length);
+}
+
+// adds the file, or the files under the directory, as samples
+void
+DictionaryTool::addSamples(const string &path)
+{
+	struct stat status;
+	if(stat(path.c_str(), &status) == -1)
+		throw "stat() failed";
+	if(S_ISREG(status.st_mode)) {
+		addFile(path);
+		return;
+	}
+	if(S_ISDIR(status.st_mode) == false)
+		return;
+	if(m_directories.insert(make_pair(status.st_dev, status.st_ino)).second == false)
+		return;
+
+	DIR *dir = opendir(path.c_str());
+	if(dir == NULL)
+		throw "opendir() failed";
+
+	vector <string> names;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		string name = ent->d_name;
+		if(name.length() != 0 && name[0] != '.')
+			names.push_back(name);
+	}
+	closedir(dir);
+
+	for(unsigned int i = 0; i < names.size(); ++i) {
+		string childPath = path + "/" + names[i];
+		try {
+			addSamples(childPath);
+		} catch(const char *message) {
+			cerr << childPath << ": " << message << endl;
+		}
+	}
+}
+
+// clients use dictionaries as raw content, so the header and
+// entropy tables that zstd puts before the content are left out
+void
+DictionaryTool::train()
+{
+	if(m_sampleLengths.empty())
+		throw "no samples to train the dictionary with";
+
+	string dictionary(m_size, '\0');
+	size_t length = ZDICT_trainFromBuffer(&dictionary[0], dictionary.length(), m_samples.data(),
+	                                      &m_sampleLengths[0], (unsigned int)m_sampleLengths.size());
+	if(ZDICT_isError(length))
+		throw ZDICT_getErrorName(length);
+
+	size_t headerLength = ZDICT_getDictHeaderSize(dictionary.data(), length);
+	if(ZDICT_isError(headerLength) || headerLength >= length)
+		throw "the trained dictionary has no content";
+
+	m_dictionary = dictionary.substr(headerLength, length - headerLength);
+}
+
+// a dictionary is written beside the file and moved
+// into place, so a server never loads part of one
+void
+DictionaryTool::writeDictionary(const string &path) const
+{
+	string tempPath = path + ".tmp";
+	int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1)
+		throw "unable to create the dictionary";
+
+	size_t offset = 0;
+	while(offset < m_dictionary.length()) {
+		ssize_t result = write(fd, m_dictionary.data() + offset, m_dictionary.length() - offset);
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result == -1) {
+			close(fd);
+			unlink(tempPath.c_str());
+			throw "unable to write the dictionary";
+		}
+
+		offset += (size_t)result;
+	}
+
+	if(close(fd) == -1 || rename(tempPath.c_str(), path.c_str()) == -1) {
+		unlink(tempPath.c_str());
+		throw "unable to write the dictionary";
+	}
+}
+
+// shows how much the samples shrink when each is compressed on its
+// own at the level the server uses, as responses are, and the value
+// of the Available-Dictionary header that clients send; the server's
+// compressor is used, and what it makes with the dictionary is
+// checked to decompress the way a client would decompress it
+void
+DictionaryTool::showSummary(ostream &stream, const string &path) const
+{
+	ResponseDictionary dictionary(path);
+	uint64_t totals[RESPONSE_ENCODING_COUNT] = { 0 };
+	size_t offset = 0;
+	for(unsigned int i = 0; i < m_sampleLengths.size(); ++i) {
+		string sample = m_samples.substr(offset, m_sampleLengths[i]);
+		offset += m_sampleLengths[i];
+
+		for(int j = 0; j < RESPONSE_ENCODING_COUNT; ++j) {
+			ResponseEncoding encoding = (ResponseEncoding)j;
+			if(ResponseCompressor::isSupported(encoding) == false)
+				continue;
+
+			string compressed = compress(sample, encoding, m_level, &dictionary);
+			if(encoding == RESPONSE_ENCODING_DCZ && decompressesTo(compressed, sample, dictionary) == false)
+				throw "a sample compressed with the dictionary doesn't decompress to itself";
+			totals[j] += compressed.length();
+		}
+	}
+
+	stream << m_sampleLengths.size() << " samples, " << m_samples.length() << " bytes" << endl;
+	for(int i = RESPONSE_ENCODING_COUNT - 1; i >= 0; --i) {
+		if(ResponseCompressor::isSupported((ResponseEncoding)i))
+			stream << ResponseCompressor::getName((ResponseEncoding)i) << ": " << totals[i] << " bytes" << endl;
+	}
+	stream << "Dictionary: " << dictionary.getData().length() << " bytes, Available-Dictionary: :";
+	stream << String::base64Encode((const char *)dictionary.getHash(), SHA256_DIGEST_LENGTH) << ":" << endl;
+}
+
+static void
+showUsageMessage(ostream &stream, const char *executableName)
+{
+	stream << "Usage: " << executableName << " [--size <bytes>] [--level <level>] <dictionary> <sample>..." << endl << endl;
+	stream << "Trains a compression dictionary with the sample files, or the files under" << endl;
+	stream << "the sample directories, for xviweb's --compressionDictionary option." << endl;
+	stream << "Samples should be responses like the ones the dictionary is for. The" << endl;
+	stream << "dictionary is at most --size bytes (" << DICTIONARY_TOOL_DEFAULT_SIZE << " by default), and the samples" << endl;
+	stream << "are compressed at --level (" << DICTIONARY_TOOL_DEFAULT_LEVEL << " by default) to show what it saves." << endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	DictionaryTool tool;
+	vector <string> paths;
+
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--help") == 0) {
+			showUsageMessage(cout, argv[0]);
+			return 0;
+		} else if(strcmp(argv[i], "--size") == 0) {
+			if(i + 1 >= argc) {
+				cerr << "Error: Missing parameter(s) for option --size" << endl << endl;
+				showUsageMessage(cerr, argv[0]);
+				return 1;
+			}
+			tool.setSize((size_t)strtoull(argv[++i], NULL, 10));
+		} else if(strcmp(argv[i], "--level") == 0) {
+			if(i + 1 >= argc) {
+				cerr << "Error: Missing parameter(s) for option --level" << endl << endl;
+				showUsageMessage(cerr, argv[0]);
+				return 1;
+			}
+			tool.setLevel(atoi(argv[++i]));
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if(paths.size() < 2) {
+		showUsageMessage(cerr, argv[0]);
+		return 1;
+	}
+
+	for(unsigned int i = 1; i < paths.size(); ++i) {
+		try {
+			tool.addSamples(paths[i]);
+		} catch(const char *message) {
+			cerr << paths[i] << ": " << message << endl;
+			return 1;
+		}
+	}
+
+	try {
+		tool.train();
+		tool.writeDictionary(paths[0]);
+		tool.showSummary(cout, paths[0]);
+	} catch(const char *message) {
+		cerr << paths[0] << ": " << message << endl;
+		return 1;
+	}
+
+	return 0;
+}
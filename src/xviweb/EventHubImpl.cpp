@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xviweb/String.h>
+#include "EventHubImpl.h"
+#include "Util.h"
+
+using namespace std;
+
+// subscribers that have this much output waiting to be
+// sent are too far behind and have their streams ended
+#define EVENT_HUB_MAX_BACKLOG (1024 * 1024)
+
+EventHubSubscription::EventHubSubscription(EventHubImpl *hub, EventHubChannel *channel,
+                                           HttpResponseImpl *response, bool longPoll, long timeout)
+{
+	m_hub = hub;
+	m_channel = channel;
+	m_iter = hub->addSubscription(channel, this);
+	m_response = response;
+	m_longPoll = longPoll;
+	m_timeoutTime = longPoll ? getMilliseconds() + timeout : -1;
+}
+
+EventHubSubscription::~EventHubSubscription()
+{
+	if(m_channel != NULL)
+		m_hub->removeSubscription(m_channel, m_iter);
+}
+
+void
+EventHubSubscription::end()
+{
+	// the context is woken so that it can
+	// return null now that the response has ended
+	m_hub->removeSubscription(m_channel, m_iter);
+	m_channel = NULL;
+	m_response->wake();
+}
+
+ResponderContext *
+EventHubSubscription::continueResponse(const HttpRequest * /*request*/, HttpResponse *response)
+{
+	if(m_channel == NULL)
+		return NULL;
+
+	// sleep until the next event, or until a long poll times out
+	if(m_longPoll) {
+		long remaining = m_timeoutTime - getMilliseconds();
+		if(remaining <= 0) {
+			m_hub->removeSubscription(m_channel, m_iter);
+			m_channel = NULL;
+			response->setStatus(204, "No Content");
+			response->endResponse();
+			return NULL;
+		}
+
+		response->wakeAfter(remaining);
+	}
+
+	response->sleep();
+	return this;
+}
+
+void
+EventHubSubscription::eventPublished(SharedBuffer *chunk, size_t dataOffset, size_t dataLength, const string &data)
+{
+	if(m_longPoll) {
+		m_response->setContentLength((int)data.length());
+		m_response->sendString(data);
+		m_response->endResponse();
+		end();
+	} else if(m_response->getOutputSize() >= EVENT_HUB_MAX_BACKLOG) {
+		// close the connection of a subscriber that isn't
+		// keeping up; it can reconnect and catch up
+		m_response->abortResponse();
+		end();
+	} else {
+		m_response->sendSharedChunk(chunk, dataOffset, dataLength);
+	}
+}
+
+EventHubImpl::EventHubImpl()
+{
+}
+
+EventHubImpl::~EventHubImpl()
+{
+	EventHubChannelMap::iterator iter = m_channels.begin();
+	while(iter != m_channels.end()) {
+		delete iter->second;
+		++iter;
+	}
+}
+
+EventHub *
+EventHub::getInstance()
+{
+	static EventHubImpl hub;
+	return &hub;
+}
+
+EventHubChannel *
+EventHubImpl::getChannel(const string &name)
+{
+	EventHubChannelMap::iterator iter = m_channels.find(name);
+	if(iter != m_channels.end())
+		return iter->second;
+
+	EventHubChannel *channel = new EventHubChannel();
+	channel->name = name;
+	m_channels.insert(make_pair(name, channel));
+	return channel;
+}
+
+EventHubSubscriptionList::iterator
+EventHubImpl::addSubscription(EventHubChannel *channel, EventHubSubscription *subscription)
+{
+	return channel->subscriptions.insert(channel->subscriptions.end(), subscription);
+}
+
+void
+EventHubImpl::removeSubscription(EventHubChannel *channel, EventHubSubscriptionList::iterator iter)
+{
+	channel->subscriptions.erase(iter);
+
+	// channels only exist while they have subscribers
+	if(channel->subscriptions.empty()) {
+		m_channels.erase(channel->name);
+		delete channel;
+	}
+}
+
+ResponderContext *
+EventHubImpl::subscribe(const string &channel, HttpResponse *response)
+{
+	response->setStatus(200, "OK");
+	response->setContentType("text/event-stream");
+	response->setHeaderValue("Cache-Control", "no-cache");
+
+	// events should reach the client as soon
+	// as possible rather than pile up unsent
+	response->setNotSentLowWatermark(16 * 1024);
+
+	// send a comment so that the headers are sent right away
+	response->sendString(":\n\n");
+	response->sleep();
+
+	return new EventHubSubscription(this, getChannel(channel), static_cast<HttpResponseImpl *>(response), false, 0);
+}
+
+ResponderContext *
+EventHubImpl::waitForEvent(const string &channel, HttpResponse *response, long timeout)
+{
+	response->setHeaderValue("Cache-Control", "no-cache");
+	response->wakeAfter(timeout);
+	response->sleep();
+
+	return new EventHubSubscription(this, getChannel(channel), static_cast<HttpResponseImpl *>(response), true, timeout);
+}
+
+void
+EventHubImpl::publish(const string &channel, const string &data, const string &event, const string &id)
+{
+	EventHubChannelMap::iterator channelIter = m_channels.find(channel);
+	if(channelIter == m_channels.end())
+		return;
+
+	// encode the event once, framed as a chunk, for all of the subscribers
+	string payload;
+	if(id.length() != 0)
+		payload += "id: " + id + "\n";
+	if(event.length() != 0)
+		payload += "event: " + event + "\n";
+
+	size_t start = 0;
+	for(;;) {
+		size_t end = data.find('\n', start);
+		string line = data.substr(start, (end == string::npos) ? string::npos : end - start);
+		if(line.length() != 0 && line[line.length() - 1] == '\r')
+			line.erase(line.length() - 1);
+
+		payload += "data: " + line + "\n";
+		if(end == string::npos)
+			break;
+		start = end + 1;
+	}
+	payload += "\n";
+
+	string header = String::hexFromUInt((unsigned int)payload.length()) + "\r\n";
+	SharedBuffer *chunk = new SharedBuffer(header + payload + "\r\n");
+
+	// subscriptions can remove themselves (and the
+	// channel along with the last of them) as they're
+	// sent the event
+	EventHubSubscriptionList &subscriptions = channelIter->second->subscriptions;
+	EventHubSubscriptionList::iterator iter = subscriptions.begin();
+	size_t count = subscriptions.size();
+	for(size_t i = 0; i < count; ++i) {
+		EventHubSubscription *subscription = *(iter++);
+		subscription->eventPublished(chunk, header.length(), payload.length(), data);
+	}
+
+	chunk->release();
+}
+
+size_t
+EventHubImpl::getSubscriberCount(const string &channel) const
+{
+	EventHubChannelMap::const_iterator iter = m_channels.find(channel);
+	if(iter == m_channels.end())
+		return 0;
+
+	return iter->second->subscriptions.size();
+}
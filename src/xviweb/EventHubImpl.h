@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __EVENTHUBIMPL_H__
+#define __EVENTHUBIMPL_H__
+
+#include <list>
+#include <map>
+#include <xviweb/EventHub.h>
+#include "HttpResponseImpl.h"
+#include "SharedBuffer.h"
+
+class EventHubImpl;
+class EventHubSubscription;
+
+typedef std::list<EventHubSubscription *> EventHubSubscriptionList;
+
+class EventHubChannel
+{
+	public:
+		std::string name;
+		EventHubSubscriptionList subscriptions;
+};
+
+typedef std::map<std::string, EventHubChannel *> EventHubChannelMap;
+
+class EventHubSubscription : public ResponderContext
+{
+	private:
+		EventHubImpl *m_hub;
+		EventHubChannel *m_channel;
+		EventHubSubscriptionList::iterator m_iter;
+		HttpResponseImpl *m_response;
+		bool m_longPoll;
+		long m_timeoutTime;
+
+		void end();
+
+	public:
+		EventHubSubscription(EventHubImpl *hub, EventHubChannel *channel, HttpResponseImpl *response, bool longPoll, long timeout);
+		~EventHubSubscription();
+
+		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
+
+		void eventPublished(SharedBuffer *chunk, size_t dataOffset, size_t dataLength, const std::string &data);
+};
+
+class EventHubImpl : public EventHub
+{
+	private:
+		EventHubChannelMap m_channels;
+
+		EventHubChannel *getChannel(const std::string &name);
+
+	public:
+		EventHubImpl();
+		~EventHubImpl();
+
+		ResponderContext *subscribe(const std::string &channel, HttpResponse *response);
+		ResponderContext *waitForEvent(const std::string &channel, HttpResponse *response, long timeout);
+
+		void publish(const std::string &channel, const std::string &data, const std::string &event, const std::string &id);
+
+		size_t getSubscriberCount(const std::string &channel) const;
+
+		EventHubSubscriptionList::iterator addSubscription(EventHubChannel *channel, EventHubSubscription *subscription);
+		void removeSubscription(EventHubChannel *channel, EventHubSubscriptionList::iterator iter);
+};
+
+#endif /* __EVENTHUBIMPL_H__ */
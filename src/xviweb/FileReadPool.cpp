@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "FileReadPool.h"
+#include "SharedBuffer.h"
+
+using namespace std;
+
+FileReadPool::FileReadPool(unsigned int threadCount)
+{
+#ifdef __linux__
+	m_readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_readFd == -1)
+		throw "eventfd() failed";
+	m_writeFd = m_readFd;
+#else
+	int fds[2];
+	if(pipe(fds) == -1)
+		throw "pipe() failed";
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	m_readFd = fds[0];
+	m_writeFd = fds[1];
+#endif
+
+	m_stopping = false;
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_condition, NULL);
+
+	for(unsigned int i = 0; i < threadCount; ++i) {
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, runThread, this) != 0)
+			break;
+		m_threads.push_back(thread);
+	}
+
+	if(m_threads.empty()) {
+		pthread_cond_destroy(&m_condition);
+		pthread_mutex_destroy(&m_mutex);
+		if(m_writeFd != m_readFd)
+			close(m_writeFd);
+		close(m_readFd);
+		throw "pthread_create() failed";
+	}
+}
+
+FileReadPool::~FileReadPool()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stopping = true;
+	pthread_cond_broadcast(&m_condition);
+	pthread_mutex_unlock(&m_mutex);
+
+	for(unsigned int i = 0; i < m_threads.size(); ++i)
+		pthread_join(m_threads[i], NULL);
+	m_threads.clear();
+
+	// reads that were never started or collected are dropped
+	for(unsigned int i = 0; i < m_reads.size(); ++i) {
+		close(m_reads[i].fileFd);
+		m_reads[i].buffer->release();
+	}
+	m_reads.clear();
+	for(unsigned int i = 0; i < m_completedReads.size(); ++i)
+		m_completedReads[i].buffer->release();
+	m_completedReads.clear();
+
+	if(m_writeFd != m_readFd)
+		close(m_writeFd);
+	close(m_readFd);
+
+	pthread_cond_destroy(&m_condition);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void *
+FileReadPool::runThread(void *pool)
+{
+	((FileReadPool *)pool)->run();
+	return NULL;
+}
+
+void
+FileReadPool::run()
+{
+	pthread_mutex_lock(&m_mutex);
+	for(;;) {
+		while(m_reads.empty() && m_stopping == false)
+			pthread_cond_wait(&m_condition, &m_mutex);
+		if(m_stopping)
+			break;
+
+		FileRead read = m_reads.front();
+		m_reads.pop_front();
+		pthread_mutex_unlock(&m_mutex);
+
+		readFile(read);
+
+		// the server's only woken for the first of the
+		// reads that complete before it collects them
+		pthread_mutex_lock(&m_mutex);
+		m_completedReads.push_back(read);
+		if(m_completedReads.size() == 1) {
+			uint64_t value = 1;
+			ssize_t result = write(m_writeFd, &value, (m_readFd == m_writeFd) ? sizeof(value) : 1);
+			(void)result;
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void
+FileReadPool::readFile(FileRead &read)
+{
+	size_t offset = 0;
+	while(offset < read.length) {
+		ssize_t length = pread(read.fileFd, read.data + offset, read.length - offset,
+		                       (off_t)(read.offset + offset));
+		if(length == -1 && errno == EINTR)
+			continue;
+		if(length == -1) {
+			read.result = -errno;
+			close(read.fileFd);
+			return;
+		}
+		if(length == 0)
+			break;
+		offset += (size_t)length;
+	}
+
+	read.result = (int)offset;
+	close(read.fileFd);
+}
+
+int
+FileReadPool::getFileDescriptor() const
+{
+	return m_readFd;
+}
+
+void
+FileReadPool::read(int fd, unsigned int generation, int fileFd, SharedBuffer *buffer, char *data,
+                   uint64_t offset, size_t length)
+{
+	FileRead read;
+	read.fd = fd;
+	read.generation = generation;
+	read.fileFd = dup(fileFd);
+	read.buffer = buffer;
+	read.data = data;
+	read.offset = offset;
+	read.length = length;
+	read.result = 0;
+
+	buffer->retain();
+	if(read.fileFd == -1) {
+		read.result = -errno;
+
+		// the read fails as soon as it's collected
+		pthread_mutex_lock(&m_mutex);
+		m_completedReads.push_back(read);
+		uint64_t value = 1;
+		ssize_t result = write(m_writeFd, &value, (m_readFd == m_writeFd) ? sizeof(value) : 1);
+		(void)result;
+		pthread_mutex_unlock(&m_mutex);
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_reads.push_back(read);
+	pthread_cond_signal(&m_condition);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void
+FileReadPool::collect(vector <FileRead> &reads)
+{
+	// the notification is cleared while the mutex is held
+	// so that one for a read completing meanwhile isn't lost
+	pthread_mutex_lock(&m_mutex);
+	char buffer[64];
+	while(::read(m_readFd, buffer, sizeof(buffer)) > 0 && m_readFd != m_writeFd)
+		;
+	reads.insert(reads.end(), m_completedReads.begin(), m_completedReads.end());
+	m_completedReads.clear();
+	pthread_mutex_unlock(&m_mutex);
+}
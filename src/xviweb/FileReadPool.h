@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FILEREADPOOL_H__
+#define __FILEREADPOOL_H__
+
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+
+class SharedBuffer;
+
+class FileRead
+{
+	public:
+		// the descriptor the read is for and its generation
+		// (see Poller), and the result: the number of bytes
+		// read or a negated errno
+		int fd;
+		unsigned int generation;
+		int fileFd;
+		SharedBuffer *buffer;
+		char *data;
+		uint64_t offset;
+		size_t length;
+		int result;
+};
+
+// reads files with a pool of threads so that the server's thread
+// doesn't wait for the disk when they aren't cached; the descriptor
+// returned by getFileDescriptor is readable while there are
+// completed reads to collect
+class FileReadPool
+{
+	private:
+		std::vector <pthread_t> m_threads;
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_condition;
+		bool m_stopping;
+		std::deque <FileRead> m_reads;
+		std::vector <FileRead> m_completedReads;
+		int m_readFd;
+		int m_writeFd;
+
+		FileReadPool(const FileReadPool &);
+		FileReadPool &operator=(const FileReadPool &);
+
+		static void *runThread(void *pool);
+		void run();
+		void readFile(FileRead &read);
+
+	public:
+		FileReadPool(unsigned int threadCount);
+		~FileReadPool();
+
+		int getFileDescriptor() const;
+
+		// the file is duplicated, so it may be closed as soon as
+		// this returns, and the buffer is kept until the read is
+		// collected; its data is written to by another thread
+		// meanwhile, so it mustn't be changed
+		void read(int fd, unsigned int generation, int fileFd, SharedBuffer *buffer, char *data,
+		          uint64_t offset, size_t length);
+
+		// moves the completed reads into the given vector; the
+		// caller releases their buffers once it's done with them
+		void collect(std::vector <FileRead> &reads);
+};
+
+#endif /* __FILEREADPOOL_H__ */
@@ -0,0 +1,619 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Hpack.h"
+
+using namespace std;
+
+// the size that's allowed for the tables of both ends
+// until they say otherwise, which is also the most that
+// the encoder uses however much the decoder allows
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+
+// fields that are always in the table, ahead of the ones
+// that are added to it (RFC 7541 appendix A)
+static const char *g_staticTable[][2] = {
+	{ ":authority", "" },
+	{ ":method", "GET" },
+	{ ":method", "POST" },
+	{ ":path", "/" },
+	{ ":path", "/index.html" },
+	{ ":scheme", "http" },
+	{ ":scheme", "https" },
+	{ ":status", "200" },
+	{ ":status", "204" },
+	{ ":status", "206" },
+	{ ":status", "304" },
+	{ ":status", "400" },
+	{ ":status", "404" },
+	{ ":status", "500" },
+	{ "accept-charset", "" },
+	{ "accept-encoding", "gzip, deflate" },
+	{ "accept-language", "" },
+	{ "accept-ranges", "" },
+	{ "accept", "" },
+	{ "access-control-allow-origin", "" },
+	{ "age", "" },
+	{ "allow", "" },
+	{ "authorization", "" },
+	{ "cache-control", "" },
+	{ "content-disposition", "" },
+	{ "content-encoding", "" },
+	{ "content-language", "" },
+	{ "content-length", "" },
+	{ "content-location", "" },
+	{ "content-range", "" },
+	{ "content-type", "" },
+	{ "cookie", "" },
+	{ "date", "" },
+	{ "etag", "" },
+	{ "expect", "" },
+	{ "expires", "" },
+	{ "from", "" },
+	{ "host", "" },
+	{ "if-match", "" },
+	{ "if-modified-since", "" },
+	{ "if-none-match", "" },
+	{ "if-range", "" },
+	{ "if-unmodified-since", "" },
+	{ "last-modified", "" },
+	{ "link", "" },
+	{ "location", "" },
+	{ "max-forwards", "" },
+	{ "proxy-authenticate", "" },
+	{ "proxy-authorization", "" },
+	{ "range", "" },
+	{ "referer", "" },
+	{ "refresh", "" },
+	{ "retry-after", "" },
+	{ "server", "" },
+	{ "set-cookie", "" },
+	{ "strict-transport-security", "" },
+	{ "transfer-encoding", "" },
+	{ "user-agent", "" },
+	{ "vary", "" },
+	{ "via", "" },
+	{ "www-authenticate", "" },
+};
+
+static const size_t STATIC_TABLE_LENGTH = sizeof(g_staticTable) / sizeof(g_staticTable[0]);
+
+// the code of each byte and of the end of string symbol
+// (RFC 7541 appendix B), and how many bits long it is
+static const uint32_t g_huffmanCodes[257] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+	0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+	0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+	0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+	0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+	0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+	0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+	0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+	0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+	0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+	0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+	0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+	0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+	0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+	0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+	0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+	0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+	0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+	0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+	0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+	0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+	0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+	0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+	0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+	0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+	0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+	0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+	0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+	0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+	0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+	0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+	0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee, 0x3fffffff
+};
+
+static const uint8_t g_huffmanLengths[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30
+};
+
+// the Huffman code as a binary tree, where a node's children
+// are other nodes or, if negative, the symbols they decode to
+static int16_t g_huffmanTree[512][2];
+static bool g_huffmanTreeBuilt = false;
+
+static void
+buildHuffmanTree()
+{
+	int nodeCount = 1;
+	for(int symbol = 0; symbol < 257; ++symbol) {
+		uint32_t code = g_huffmanCodes[symbol];
+		int node = 0;
+		for(int bit = g_huffmanLengths[symbol] - 1; bit > 0; --bit) {
+			int b = (code >> bit) & 1;
+			if(g_huffmanTree[node][b] == 0)
+				g_huffmanTree[node][b] = (int16_t)nodeCount++;
+			node = g_huffmanTree[node][b];
+		}
+
+		g_huffmanTree[node][code & 1] = (int16_t)-(symbol + 1);
+	}
+
+	g_huffmanTreeBuilt = true;
+}
+
+static bool
+huffmanDecode(const uint8_t *data, size_t length, string *s)
+{
+	if(g_huffmanTreeBuilt == false)
+		buildHuffmanTree();
+
+	// track the bits read since the last symbol, which
+	// at the end must be padding: fewer than eight bits
+	// of the end of string symbol, which is all ones
+	int node = 0;
+	unsigned int paddingBits = 0;
+	bool paddingOnes = true;
+	for(size_t i = 0; i < length; ++i) {
+		for(int bit = 7; bit >= 0; --bit) {
+			int b = (data[i] >> bit) & 1;
+			int child = g_huffmanTree[node][b];
+			if(child >= 0) {
+				node = child;
+				++paddingBits;
+				paddingOnes = (paddingOnes && b == 1);
+				continue;
+			}
+
+			// the end of string symbol can't be sent
+			if(child == -257)
+				return false;
+
+			s->push_back((char)(-child - 1));
+			node = 0;
+			paddingBits = 0;
+			paddingOnes = true;
+		}
+	}
+
+	return (paddingBits <= 7 && paddingOnes);
+}
+
+static size_t
+getHuffmanLength(const string &s)
+{
+	size_t bits = 0;
+	for(size_t i = 0; i < s.length(); ++i)
+		bits += g_huffmanLengths[(uint8_t)s[i]];
+
+	return (bits + 7) / 8;
+}
+
+static void
+huffmanEncode(const string &s, string *output)
+{
+	// bits are written out a byte at a time, so no
+	// more than a code's worth are held at once
+	uint64_t bits = 0;
+	unsigned int bitCount = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		uint8_t c = (uint8_t)s[i];
+		bits = (bits << g_huffmanLengths[c]) | g_huffmanCodes[c];
+		bitCount += g_huffmanLengths[c];
+		while(bitCount >= 8) {
+			bitCount -= 8;
+			output->push_back((char)(bits >> bitCount));
+		}
+	}
+
+	// pad the last byte with the start of the end of string symbol
+	if(bitCount != 0)
+		output->push_back((char)((bits << (8 - bitCount)) | (0xff >> bitCount)));
+}
+
+// integers fill the rest of a byte whose first bits are flags
+// and continue in the bytes after it if they don't fit
+static void
+encodeInteger(string *output, uint8_t flags, int prefixBits, size_t value)
+{
+	size_t prefixMax = ((size_t)1 << prefixBits) - 1;
+	if(value < prefixMax) {
+		output->push_back((char)(flags | value));
+		return;
+	}
+
+	output->push_back((char)(flags | prefixMax));
+	value -= prefixMax;
+	while(value >= 0x80) {
+		output->push_back((char)(0x80 | (value & 0x7f)));
+		value >>= 7;
+	}
+	output->push_back((char)value);
+}
+
+static bool
+decodeInteger(const uint8_t **p, const uint8_t *end, int prefixBits, size_t *value)
+{
+	size_t prefixMax = ((size_t)1 << prefixBits) - 1;
+	size_t n = *(*p)++ & prefixMax;
+	if(n == prefixMax) {
+		// nothing needs more than 28 bits
+		for(int shift = 0; ; shift += 7) {
+			if(*p == end || shift > 21)
+				return false;
+
+			uint8_t b = *(*p)++;
+			n += (size_t)(b & 0x7f) << shift;
+			if((b & 0x80) == 0)
+				break;
+		}
+	}
+
+	*value = n;
+	return true;
+}
+
+// strings are Huffman coded when that makes them shorter
+static void
+encodeString(string *output, const string &s)
+{
+	size_t huffmanLength = getHuffmanLength(s);
+	if(huffmanLength < s.length()) {
+		encodeInteger(output, 0x80, 7, huffmanLength);
+		huffmanEncode(s, output);
+	} else {
+		encodeInteger(output, 0x00, 7, s.length());
+		output->append(s);
+	}
+}
+
+static bool
+decodeString(const uint8_t **p, const uint8_t *end, string *s)
+{
+	if(*p == end)
+		return false;
+
+	bool huffman = ((**p & 0x80) != 0);
+	size_t length;
+	if(decodeInteger(p, end, 7, &length) == false || length > (size_t)(end - *p))
+		return false;
+
+	const uint8_t *data = *p;
+	*p += length;
+	if(huffman)
+		return huffmanDecode(data, length, s);
+
+	s->assign((const char *)data, length);
+	return true;
+}
+
+static size_t
+getFieldSize(const string &name, const string &value)
+{
+	return name.length() + value.length() + 32;
+}
+
+HpackTable::HpackTable()
+{
+	m_size = 0;
+	m_maxSize = HPACK_DEFAULT_TABLE_SIZE;
+}
+
+size_t
+HpackTable::getMaxSize() const
+{
+	return m_maxSize;
+}
+
+void
+HpackTable::setMaxSize(size_t maxSize)
+{
+	m_maxSize = maxSize;
+	evict(0);
+}
+
+size_t
+HpackTable::getLength() const
+{
+	return m_fields.size();
+}
+
+const HpackHeader &
+HpackTable::getField(size_t index) const
+{
+	return m_fields[index];
+}
+
+// evicts fields until there's room for one of the given size
+void
+HpackTable::evict(size_t size)
+{
+	while(m_size + size > m_maxSize && m_fields.empty() == false) {
+		m_size -= getFieldSize(m_fields.back().first, m_fields.back().second);
+		m_fields.pop_back();
+	}
+}
+
+void
+HpackTable::addField(const string &name, const string &value)
+{
+	// a field that's larger than the table just empties it
+	size_t size = getFieldSize(name, value);
+	if(size > m_maxSize) {
+		evict(m_maxSize + 1);
+		return;
+	}
+
+	evict(size);
+	m_fields.push_front(make_pair(name, value));
+	m_size += size;
+}
+
+size_t
+HpackTable::find(const string &name, const string &value, bool *valueMatched) const
+{
+	size_t nameIndex = 0;
+	for(size_t i = 0; i < m_fields.size(); ++i) {
+		if(m_fields[i].first != name)
+			continue;
+
+		if(m_fields[i].second == value) {
+			*valueMatched = true;
+			return i + 1;
+		}
+		if(nameIndex == 0)
+			nameIndex = i + 1;
+	}
+
+	*valueMatched = false;
+	return nameIndex;
+}
+
+static size_t
+findStaticField(const string &name, const string &value, bool *valueMatched)
+{
+	size_t nameIndex = 0;
+	for(size_t i = 0; i < STATIC_TABLE_LENGTH; ++i) {
+		if(name != g_staticTable[i][0])
+			continue;
+
+		if(value == g_staticTable[i][1]) {
+			*valueMatched = true;
+			return i + 1;
+		}
+		if(nameIndex == 0)
+			nameIndex = i + 1;
+	}
+
+	*valueMatched = false;
+	return nameIndex;
+}
+
+HpackDecoder::HpackDecoder()
+{
+	m_maxTableSize = HPACK_DEFAULT_TABLE_SIZE;
+}
+
+// gets a field by its index in the static table
+// followed by the decoder's table
+bool
+HpackDecoder::getField(size_t index, HpackHeader *field) const
+{
+	if(index == 0)
+		return false;
+
+	if(index <= STATIC_TABLE_LENGTH) {
+		field->first = g_staticTable[index - 1][0];
+		field->second = g_staticTable[index - 1][1];
+		return true;
+	}
+
+	index -= STATIC_TABLE_LENGTH + 1;
+	if(index >= m_table.getLength())
+		return false;
+
+	*field = m_table.getField(index);
+	return true;
+}
+
+bool
+HpackDecoder::decode(const char *data, size_t length, size_t maxListSize,
+                     HpackHeaderList *headers, bool *tooLarge)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *end = p + length;
+	bool fieldDecoded = false;
+	size_t listSize = 0;
+
+	*tooLarge = false;
+
+	while(p != end) {
+		uint8_t b = *p;
+		HpackHeader field;
+
+		if((b & 0x80) != 0) {
+			// a field from one of the tables
+			size_t index;
+			if(decodeInteger(&p, end, 7, &index) == false || getField(index, &field) == false)
+				return false;
+		} else if((b & 0xe0) == 0x20) {
+			// a change to the size of the table, which
+			// can only come before the block's fields
+			size_t maxSize;
+			if(fieldDecoded || decodeInteger(&p, end, 5, &maxSize) == false || maxSize > m_maxTableSize)
+				return false;
+
+			m_table.setMaxSize(maxSize);
+			continue;
+		} else {
+			// a literal field, which may be added to the
+			// table and whose name may be from one of them
+			bool indexed = ((b & 0xc0) == 0x40);
+			size_t index;
+			if(decodeInteger(&p, end, indexed ? 6 : 4, &index) == false)
+				return false;
+
+			if(index != 0) {
+				if(getField(index, &field) == false)
+					return false;
+				field.second.clear();
+			} else if(decodeString(&p, end, &field.first) == false) {
+				return false;
+			}
+
+			if(decodeString(&p, end, &field.second) == false)
+				return false;
+			if(indexed)
+				m_table.addField(field.first, field.second);
+		}
+
+		// a small block can refer to a large field in the table
+		// many times over, so only the fields that fit are kept
+		fieldDecoded = true;
+		listSize += field.first.length() + field.second.length() + 32;
+		if(listSize > maxListSize)
+			*tooLarge = true;
+		else
+			headers->push_back(field);
+	}
+
+	return true;
+}
+
+HpackEncoder::HpackEncoder()
+{
+	m_tableSizeChanged = false;
+	m_minTableSize = HPACK_DEFAULT_TABLE_SIZE;
+}
+
+void
+HpackEncoder::setMaxTableSize(size_t maxTableSize)
+{
+	if(maxTableSize > HPACK_DEFAULT_TABLE_SIZE)
+		maxTableSize = HPACK_DEFAULT_TABLE_SIZE;
+	if(maxTableSize == m_table.getMaxSize())
+		return;
+
+	if(m_tableSizeChanged == false || maxTableSize < m_minTableSize)
+		m_minTableSize = maxTableSize;
+	m_tableSizeChanged = true;
+	m_table.setMaxSize(maxTableSize);
+}
+
+// fields whose values differ from response to response aren't
+// worth adding to the table, and those that may be sensitive
+// are marked so that they're never added to any table
+static bool
+isVolatileField(const string &name)
+{
+	return (name == "content-length" || name == "content-range" || name == "etag" ||
+	        name == "last-modified" || name == "age" || name == "date" ||
+	        name == "expires" || name == "location");
+}
+
+static bool
+isSensitiveField(const string &name)
+{
+	return (name == "set-cookie" || name == "cookie" ||
+	        name == "authorization" || name == "proxy-authorization");
+}
+
+void
+HpackEncoder::encode(const HpackHeaderList &headers, string *block)
+{
+	// tell the decoder about changes to the table's size; if it
+	// shrank and then grew, it's told about the smallest size too
+	if(m_tableSizeChanged) {
+		if(m_minTableSize < m_table.getMaxSize())
+			encodeInteger(block, 0x20, 5, m_minTableSize);
+		encodeInteger(block, 0x20, 5, m_table.getMaxSize());
+		m_tableSizeChanged = false;
+	}
+
+	for(unsigned int i = 0; i < headers.size(); ++i) {
+		const string &name = headers[i].first;
+		const string &value = headers[i].second;
+
+		// send the field from a table if it's in one, otherwise
+		// refer to its name in a table if it can be
+		bool valueMatched;
+		size_t index = findStaticField(name, value, &valueMatched);
+		if(valueMatched == false) {
+			bool dynamicMatched;
+			size_t dynamicIndex = m_table.find(name, value, &dynamicMatched);
+			if(dynamicIndex != 0 && (dynamicMatched || index == 0)) {
+				index = STATIC_TABLE_LENGTH + dynamicIndex;
+				valueMatched = dynamicMatched;
+			}
+		}
+
+		if(valueMatched) {
+			encodeInteger(block, 0x80, 7, index);
+			continue;
+		}
+
+		if(isSensitiveField(name)) {
+			encodeInteger(block, 0x10, 4, index);
+		} else if(isVolatileField(name) || getFieldSize(name, value) > m_table.getMaxSize()) {
+			encodeInteger(block, 0x00, 4, index);
+		} else {
+			encodeInteger(block, 0x40, 6, index);
+			m_table.addField(name, value);
+		}
+
+		if(index == 0)
+			encodeString(block, name);
+		encodeString(block, value);
+	}
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// a header field as it's sent in an HTTP/2 header block, whose
+// name is in lowercase
+typedef std::pair<std::string, std::string> HpackHeader;
+typedef std::vector<HpackHeader> HpackHeaderList;
+
+// the fields that an encoder or decoder adds to as it goes,
+// which are evicted oldest first to stay within its maximum
+// size (RFC 7541 section 4); the newest field is at index 0
+class HpackTable
+{
+	private:
+		std::deque <HpackHeader> m_fields;
+		size_t m_size;
+		size_t m_maxSize;
+
+		void evict(size_t size);
+
+	public:
+		HpackTable();
+
+		size_t getMaxSize() const;
+		void setMaxSize(size_t maxSize);
+
+		size_t getLength() const;
+		const HpackHeader &getField(size_t index) const;
+		void addField(const std::string &name, const std::string &value);
+
+		// returns the index plus one of the field with the given
+		// name and value, or of one with the same name if there's
+		// none, setting valueMatched; returns 0 if there's neither
+		size_t find(const std::string &name, const std::string &value, bool *valueMatched) const;
+};
+
+// decodes the header blocks received on an HTTP/2 connection
+class HpackDecoder
+{
+	private:
+		HpackTable m_table;
+		size_t m_maxTableSize;
+
+		bool getField(size_t index, HpackHeader *field) const;
+
+	public:
+		HpackDecoder();
+
+		// returns false if the block can't be decoded, which
+		// leaves the decoder unusable (a connection error); the
+		// fields past maxListSize (counted as for the header list
+		// size setting) aren't kept, setting tooLarge, but the
+		// rest of the block still updates the table
+		bool decode(const char *data, size_t length, size_t maxListSize,
+		            HpackHeaderList *headers, bool *tooLarge);
+};
+
+// encodes the header blocks sent on an HTTP/2 connection
+class HpackEncoder
+{
+	private:
+		HpackTable m_table;
+
+		// changes to the table's size that the decoder
+		// is told about at the start of the next block
+		bool m_tableSizeChanged;
+		size_t m_minTableSize;
+
+	public:
+		HpackEncoder();
+
+		// limits the table to the size the decoder allows
+		void setMaxTableSize(size_t maxTableSize);
+
+		void encode(const HpackHeaderList &headers, std::string *block);
+};
+
+#endif /* __HPACK_H__ */
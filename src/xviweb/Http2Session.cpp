@@ -0,0 +1,890 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <cstring>
+#include "Http2Session.h"
+
+using namespace std;
+
+#define HTTP2_FLAG_END_STREAM 0x1
+#define HTTP2_FLAG_ACK 0x1
+#define HTTP2_FLAG_END_HEADERS 0x4
+#define HTTP2_FLAG_PADDED 0x8
+#define HTTP2_FLAG_PRIORITY 0x20
+
+#define HTTP2_SETTING_HEADER_TABLE_SIZE 0x1
+#define HTTP2_SETTING_ENABLE_PUSH 0x2
+#define HTTP2_SETTING_MAX_CONCURRENT_STREAMS 0x3
+#define HTTP2_SETTING_INITIAL_WINDOW_SIZE 0x4
+#define HTTP2_SETTING_MAX_FRAME_SIZE 0x5
+#define HTTP2_SETTING_MAX_HEADER_LIST_SIZE 0x6
+#define HTTP2_SETTING_NO_RFC7540_PRIORITIES 0x9
+
+#define HTTP2_FRAME_HEADER_SIZE 9
+#define HTTP2_DEFAULT_FRAME_SIZE 16384
+#define HTTP2_DEFAULT_WINDOW_SIZE 65535
+#define HTTP2_MAX_WINDOW_SIZE 0x7fffffff
+
+// the connection's receive window is larger than the default so
+// that a few streams' bodies can be sent at once; each stream's
+// is left at the default, which limits how much of a body that
+// hasn't been read yet is buffered
+#define HTTP2_CONNECTION_WINDOW_SIZE (1024 * 1024)
+
+// DATA frames are kept small enough to fit in a single TLS record
+#define HTTP2_MAX_DATA_LENGTH (HTTP2_DEFAULT_FRAME_SIZE - HTTP2_FRAME_HEADER_SIZE)
+
+// the size of the preface after the request line that starts it
+#define HTTP2_PREFACE_REMAINDER "\r\nSM\r\n\r\n"
+#define HTTP2_PREFACE_REMAINDER_LENGTH 8
+
+static void
+put32(char *p, uint32_t n)
+{
+	p[0] = (char)(n >> 24);
+	p[1] = (char)(n >> 16);
+	p[2] = (char)(n >> 8);
+	p[3] = (char)n;
+}
+
+static uint32_t
+get32(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+}
+
+static void
+putFrameHeader(char *p, size_t length, uint8_t type, uint8_t flags, uint32_t id)
+{
+	p[0] = (char)(length >> 16);
+	p[1] = (char)(length >> 8);
+	p[2] = (char)length;
+	p[3] = (char)type;
+	p[4] = (char)flags;
+	put32(p + 5, id);
+}
+
+static void
+putSetting(string *payload, uint16_t id, uint32_t value)
+{
+	char setting[6];
+	setting[0] = (char)(id >> 8);
+	setting[1] = (char)id;
+	put32(setting + 2, value);
+	payload->append(setting, sizeof(setting));
+}
+
+Http2Session::Http2Session(HttpConnection *conn, unsigned int maxConcurrentStreams,
+                           size_t maxHeaderListSize)
+{
+	m_conn = conn;
+	m_maxConcurrentStreams = maxConcurrentStreams;
+	m_maxHeaderListSize = maxHeaderListSize;
+	m_prefaceRemaining = HTTP2_PREFACE_REMAINDER_LENGTH;
+	m_settingsReceived = false;
+	m_goingAway = false;
+	m_closed = false;
+	m_lastStreamId = 0;
+	m_headerStreamId = 0;
+	m_headerEndStream = false;
+	m_headerSelfDependent = false;
+	m_sendWindow = HTTP2_DEFAULT_WINDOW_SIZE;
+	m_receiveWindow = HTTP2_CONNECTION_WINDOW_SIZE;
+	m_initialSendWindow = HTTP2_DEFAULT_WINDOW_SIZE;
+	m_maxFrameSize = HTTP2_DEFAULT_FRAME_SIZE;
+	m_lastIncrementalId = 0;
+
+	// the server's preface is its settings, which go out
+	// the next time the session is flushed; priorities are
+	// only taken from Priority headers and PRIORITY_UPDATE
+	// frames (RFC 9218), not from RFC 7540's dependency tree
+	string settings;
+	putSetting(&settings, HTTP2_SETTING_MAX_CONCURRENT_STREAMS, m_maxConcurrentStreams);
+	putSetting(&settings, HTTP2_SETTING_MAX_HEADER_LIST_SIZE, (uint32_t)m_maxHeaderListSize);
+	putSetting(&settings, HTTP2_SETTING_NO_RFC7540_PRIORITIES, 1);
+	queueFrame(HTTP2_FRAME_SETTINGS, 0, 0, settings.data(), settings.length());
+	queueWindowUpdate(0, HTTP2_CONNECTION_WINDOW_SIZE - HTTP2_DEFAULT_WINDOW_SIZE);
+}
+
+Http2Session::~Http2Session()
+{
+	Http2StreamMap::iterator iter;
+	for(iter = m_streams.begin(); iter != m_streams.end(); ++iter)
+		delete iter->second;
+}
+
+bool
+Http2Session::isClosed() const
+{
+	return m_closed;
+}
+
+Http2Stream *
+Http2Session::getOpenedStream()
+{
+	if(m_openedStreams.empty())
+		return NULL;
+
+	Http2Stream *stream = m_openedStreams.front();
+	m_openedStreams.pop_front();
+	return stream;
+}
+
+void
+Http2Session::releaseStream(Http2Stream *stream)
+{
+	stream->m_released = true;
+
+	// a response that was stopped before it ended is reset,
+	// and one that's ended is kept until it's been sent
+	if(m_closed || stream->m_reset)
+		deleteStream(stream);
+	else if(stream->m_ended == false)
+		resetStream(stream, HTTP2_ERROR_INTERNAL_ERROR);
+	else if(stream->m_endSent)
+		finishStream(stream);
+}
+
+void
+Http2Session::sendContinueResponse(Http2Stream *stream)
+{
+	HpackHeaderList headers;
+	headers.push_back(make_pair(string(":status"), string("100")));
+	queueHeaders(stream->m_id, headers, false);
+}
+
+void
+Http2Session::queueFrame(uint8_t type, uint8_t flags, uint32_t id,
+                         const char *payload, size_t length)
+{
+	char header[HTTP2_FRAME_HEADER_SIZE];
+	putFrameHeader(header, length, type, flags, id);
+	m_frames.append(header, sizeof(header));
+	m_frames.append(payload, length);
+}
+
+// encodes a header block, which is split into CONTINUATION frames
+// if it doesn't fit in a single frame; blocks are encoded in the
+// order they're sent, as the client's decoder expects
+void
+Http2Session::queueHeaders(uint32_t id, const HpackHeaderList &headers, bool endStream)
+{
+	string block;
+	m_encoder.encode(headers, &block);
+
+	size_t offset = 0;
+	uint8_t type = HTTP2_FRAME_HEADERS;
+	uint8_t flags = endStream ? HTTP2_FLAG_END_STREAM : 0;
+	do {
+		size_t length = block.length() - offset;
+		if(length > m_maxFrameSize)
+			length = m_maxFrameSize;
+		else
+			flags |= HTTP2_FLAG_END_HEADERS;
+
+		queueFrame(type, flags, id, block.data() + offset, length);
+		offset += length;
+		type = HTTP2_FRAME_CONTINUATION;
+		flags = 0;
+	} while(offset < block.length());
+}
+
+void
+Http2Session::queueReset(uint32_t id, Http2ErrorCode code)
+{
+	char payload[4];
+	put32(payload, code);
+	queueFrame(HTTP2_FRAME_RST_STREAM, 0, id, payload, sizeof(payload));
+}
+
+void
+Http2Session::queueWindowUpdate(uint32_t id, uint32_t increment)
+{
+	char payload[4];
+	put32(payload, increment);
+	queueFrame(HTTP2_FRAME_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
+
+void
+Http2Session::sendFrames()
+{
+	if(m_frames.length() != 0) {
+		m_conn->sendString(m_frames);
+		m_frames.clear();
+	}
+}
+
+// sends the frames that are waiting along with a GOAWAY, after
+// which the connection is closed once its output is sent
+void
+Http2Session::sendGoaway(Http2ErrorCode code)
+{
+	char payload[8];
+	put32(payload, m_lastStreamId);
+	put32(payload + 4, code);
+	queueFrame(HTTP2_FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+
+	sendFrames();
+	m_closed = true;
+	m_conn->endUpgrade();
+}
+
+// a connection error (RFC 9113 section 5.4.1)
+void
+Http2Session::fail(Http2ErrorCode code)
+{
+	if(m_closed)
+		return;
+
+	cerr << m_conn->toString() << ": HTTP/2 connection error " << code << endl;
+	sendGoaway(code);
+}
+
+void
+Http2Session::close()
+{
+	if(m_closed == false)
+		sendGoaway(HTTP2_ERROR_NO_ERROR);
+}
+
+// resets a stream, whose response is dropped; it's deleted
+// once the server's done with it
+void
+Http2Session::resetStream(Http2Stream *stream, Http2ErrorCode code)
+{
+	queueReset(stream->m_id, code);
+	stream->m_reset = true;
+	stream->clearOutput();
+	if(stream->m_released)
+		deleteStream(stream);
+}
+
+// deletes a stream whose response has been sent, first telling
+// the client to stop sending a request body that's no longer needed
+void
+Http2Session::finishStream(Http2Stream *stream)
+{
+	if(stream->m_remoteClosed == false)
+		queueReset(stream->m_id, HTTP2_ERROR_NO_ERROR);
+	deleteStream(stream);
+}
+
+void
+Http2Session::deleteStream(Http2Stream *stream)
+{
+	m_streams.erase(stream->m_id);
+	delete stream;
+}
+
+bool
+Http2Session::removePadding(uint8_t flags, const char **payload, size_t *length)
+{
+	if((flags & HTTP2_FLAG_PADDED) == 0)
+		return true;
+
+	size_t padLength = (*length != 0) ? (unsigned char)(*payload)[0] : 0;
+	if(*length == 0 || padLength >= *length) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return false;
+	}
+
+	++*payload;
+	*length -= padLength + 1;
+	return true;
+}
+
+size_t
+Http2Session::upgradedDataRead(char *data, size_t length)
+{
+	size_t consumed = 0;
+
+	// the rest of the client's preface
+	if(m_prefaceRemaining != 0) {
+		size_t n = (length < m_prefaceRemaining) ? length : m_prefaceRemaining;
+		const char *expected = HTTP2_PREFACE_REMAINDER + (HTTP2_PREFACE_REMAINDER_LENGTH - m_prefaceRemaining);
+		if(memcmp(data, expected, n) != 0) {
+			fail(HTTP2_ERROR_PROTOCOL_ERROR);
+			return length;
+		}
+
+		m_prefaceRemaining -= n;
+		consumed = n;
+	}
+
+	// handle each frame that's been completely read
+	while(m_closed == false && length - consumed >= HTTP2_FRAME_HEADER_SIZE) {
+		const unsigned char *header = (const unsigned char *)data + consumed;
+		size_t frameLength = ((size_t)header[0] << 16) | ((size_t)header[1] << 8) | (size_t)header[2];
+		if(frameLength > HTTP2_DEFAULT_FRAME_SIZE) {
+			fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+			return length;
+		}
+		if(length - consumed < HTTP2_FRAME_HEADER_SIZE + frameLength)
+			break;
+
+		uint32_t id = get32(data + consumed + 5) & 0x7fffffff;
+		frameReceived(header[3], header[4], id, data + consumed + HTTP2_FRAME_HEADER_SIZE, frameLength);
+		consumed += HTTP2_FRAME_HEADER_SIZE + frameLength;
+	}
+
+	// replies to the client's frames are sent as they pile up,
+	// so that reading stops while the client doesn't read them
+	if(m_frames.length() >= HTTP2_MAX_DATA_LENGTH)
+		sendFrames();
+
+	return m_closed ? length : consumed;
+}
+
+void
+Http2Session::frameReceived(uint8_t type, uint8_t flags, uint32_t id,
+                            const char *payload, size_t length)
+{
+	// the client's preface ends with its settings, and a header
+	// block can't be interrupted by anything but its continuation
+	if((m_settingsReceived == false && (type != HTTP2_FRAME_SETTINGS || (flags & HTTP2_FLAG_ACK))) ||
+	   (m_headerStreamId != 0 && type != HTTP2_FRAME_CONTINUATION)) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	switch(type) {
+		case HTTP2_FRAME_DATA:
+			dataFrameReceived(flags, id, payload, length);
+			break;
+		case HTTP2_FRAME_HEADERS:
+			headersFrameReceived(flags, id, payload, length);
+			break;
+		case HTTP2_FRAME_CONTINUATION:
+			continuationFrameReceived(flags, id, payload, length);
+			break;
+		case HTTP2_FRAME_SETTINGS:
+			settingsFrameReceived(flags, id, payload, length);
+			break;
+		case HTTP2_FRAME_WINDOW_UPDATE:
+			windowUpdateFrameReceived(id, payload, length);
+			break;
+		case HTTP2_FRAME_RST_STREAM:
+			resetFrameReceived(id, length);
+			break;
+		case HTTP2_FRAME_PRIORITY_UPDATE:
+			priorityUpdateFrameReceived(id, payload, length);
+			break;
+		case HTTP2_FRAME_PRIORITY:
+			// the dependencies of RFC 7540 aren't used
+			if(id == 0)
+				fail(HTTP2_ERROR_PROTOCOL_ERROR);
+			else if(length != 5)
+				queueReset(id, HTTP2_ERROR_FRAME_SIZE_ERROR);
+			break;
+		case HTTP2_FRAME_PING:
+			if(id != 0)
+				fail(HTTP2_ERROR_PROTOCOL_ERROR);
+			else if(length != 8)
+				fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+			else if((flags & HTTP2_FLAG_ACK) == 0)
+				queueFrame(HTTP2_FRAME_PING, HTTP2_FLAG_ACK, 0, payload, length);
+			break;
+		case HTTP2_FRAME_GOAWAY:
+			// streams that are open are finished first
+			if(id != 0)
+				fail(HTTP2_ERROR_PROTOCOL_ERROR);
+			else if(length < 8)
+				fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+			else
+				m_goingAway = true;
+			break;
+		case HTTP2_FRAME_PUSH_PROMISE:
+			// clients can't push
+			fail(HTTP2_ERROR_PROTOCOL_ERROR);
+			break;
+		default:
+			// frames of unknown types are ignored
+			break;
+	}
+}
+
+void
+Http2Session::dataFrameReceived(uint8_t flags, uint32_t id,
+                                const char *payload, size_t length)
+{
+	if(id == 0 || id > m_lastStreamId) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	// the whole frame counts against the windows, and
+	// the connection's is refilled as frames are read
+	size_t frameLength = length;
+	m_receiveWindow -= frameLength;
+	if(m_receiveWindow < 0) {
+		fail(HTTP2_ERROR_FLOW_CONTROL_ERROR);
+		return;
+	}
+	if(m_receiveWindow <= HTTP2_CONNECTION_WINDOW_SIZE / 2) {
+		queueWindowUpdate(0, HTTP2_CONNECTION_WINDOW_SIZE - m_receiveWindow);
+		m_receiveWindow = HTTP2_CONNECTION_WINDOW_SIZE;
+	}
+
+	if(removePadding(flags, &payload, &length) == false)
+		return;
+
+	// data for streams that have been closed is dropped
+	Http2StreamMap::iterator iter = m_streams.find(id);
+	if(iter == m_streams.end() || iter->second->m_reset)
+		return;
+
+	Http2Stream *stream = iter->second;
+	if(stream->m_remoteClosed) {
+		resetStream(stream, HTTP2_ERROR_STREAM_CLOSED);
+		return;
+	}
+
+	stream->m_receiveWindow -= frameLength;
+	if(stream->m_receiveWindow < 0)
+		resetStream(stream, HTTP2_ERROR_FLOW_CONTROL_ERROR);
+	else if(stream->dataReceived(payload, length, (flags & HTTP2_FLAG_END_STREAM) != 0) == false)
+		resetStream(stream, HTTP2_ERROR_PROTOCOL_ERROR);
+}
+
+void
+Http2Session::headersFrameReceived(uint8_t flags, uint32_t id,
+                                   const char *payload, size_t length)
+{
+	if(id == 0) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+	if(removePadding(flags, &payload, &length) == false)
+		return;
+
+	// the priority's dependency is ignored, but
+	// a stream can't depend on itself
+	m_headerSelfDependent = false;
+	if(flags & HTTP2_FLAG_PRIORITY) {
+		if(length < 5) {
+			fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+			return;
+		}
+
+		m_headerSelfDependent = ((get32(payload) & 0x7fffffff) == id);
+		payload += 5;
+		length -= 5;
+	}
+
+	m_headerStreamId = id;
+	m_headerEndStream = ((flags & HTTP2_FLAG_END_STREAM) != 0);
+	m_headerBlock.assign(payload, length);
+	if(flags & HTTP2_FLAG_END_HEADERS)
+		headerBlockReceived();
+}
+
+void
+Http2Session::continuationFrameReceived(uint8_t flags, uint32_t id,
+                                        const char *payload, size_t length)
+{
+	if(m_headerStreamId == 0 || id != m_headerStreamId) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	// a block is only buffered up to a few times the
+	// largest header list that's accepted
+	size_t maxBlockSize = m_maxHeaderListSize * 4;
+	if(maxBlockSize < 64 * 1024)
+		maxBlockSize = 64 * 1024;
+	if(m_headerBlock.length() + length > maxBlockSize) {
+		fail(HTTP2_ERROR_ENHANCE_YOUR_CALM);
+		return;
+	}
+
+	m_headerBlock.append(payload, length);
+	if(flags & HTTP2_FLAG_END_HEADERS)
+		headerBlockReceived();
+}
+
+void
+Http2Session::headerBlockReceived()
+{
+	uint32_t id = m_headerStreamId;
+	m_headerStreamId = 0;
+
+	// every block is decoded, even if it's for a stream that's
+	// been closed, to keep the decoder's table in sync
+	HpackHeaderList headers;
+	bool tooLarge;
+	bool decoded = m_decoder.decode(m_headerBlock.data(), m_headerBlock.length(),
+	                                m_maxHeaderListSize, &headers, &tooLarge);
+	string().swap(m_headerBlock);
+	if(decoded == false) {
+		fail(HTTP2_ERROR_COMPRESSION_ERROR);
+		return;
+	}
+
+	// a block on an open stream has the request's trailers
+	Http2StreamMap::iterator iter = m_streams.find(id);
+	if(iter != m_streams.end()) {
+		Http2Stream *stream = iter->second;
+		if(stream->m_reset)
+			return;
+
+		if(stream->m_remoteClosed)
+			resetStream(stream, HTTP2_ERROR_STREAM_CLOSED);
+		else if(tooLarge)
+			resetStream(stream, HTTP2_ERROR_ENHANCE_YOUR_CALM);
+		else if(m_headerEndStream == false || m_headerSelfDependent || stream->trailersReceived(headers) == false)
+			resetStream(stream, HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	// clients open streams with odd IDs, in increasing order
+	if((id & 1) == 0) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+	if(id <= m_lastStreamId)
+		return;
+
+	m_lastStreamId = id;
+	if(m_goingAway)
+		return;
+	if(m_streams.size() >= m_maxConcurrentStreams) {
+		queueReset(id, HTTP2_ERROR_REFUSED_STREAM);
+		return;
+	}
+
+	Http2Stream *stream = new Http2Stream(this, m_conn, id, m_initialSendWindow, HTTP2_DEFAULT_WINDOW_SIZE);
+	m_streams.insert(make_pair(id, stream));
+	if(m_headerSelfDependent ||
+	   stream->requestReceived(headers, m_headerEndStream, tooLarge) == false) {
+		cerr << stream->toString() << ": Malformed request" << endl;
+		stream->m_released = true;
+		resetStream(stream, HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	m_openedStreams.push_back(stream);
+}
+
+void
+Http2Session::settingsFrameReceived(uint8_t flags, uint32_t id,
+                                    const char *payload, size_t length)
+{
+	if(id != 0) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+	if(flags & HTTP2_FLAG_ACK) {
+		if(length != 0)
+			fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+		return;
+	}
+	if(length % 6 != 0) {
+		fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+		return;
+	}
+
+	for(size_t i = 0; i < length; i += 6) {
+		uint16_t setting = (uint16_t)(((unsigned char)payload[i] << 8) | (unsigned char)payload[i + 1]);
+		uint32_t value = get32(payload + i + 2);
+
+		switch(setting) {
+			case HTTP2_SETTING_HEADER_TABLE_SIZE:
+				m_encoder.setMaxTableSize(value);
+				break;
+			case HTTP2_SETTING_ENABLE_PUSH:
+				if(value > 1) {
+					fail(HTTP2_ERROR_PROTOCOL_ERROR);
+					return;
+				}
+				break;
+			case HTTP2_SETTING_INITIAL_WINDOW_SIZE: {
+				if(value > HTTP2_MAX_WINDOW_SIZE) {
+					fail(HTTP2_ERROR_FLOW_CONTROL_ERROR);
+					return;
+				}
+
+				// the change applies to the windows
+				// of the streams that are open
+				int64_t delta = (int64_t)value - m_initialSendWindow;
+				Http2StreamMap::iterator iter;
+				for(iter = m_streams.begin(); iter != m_streams.end(); ++iter) {
+					iter->second->m_sendWindow += delta;
+					if(iter->second->m_sendWindow > HTTP2_MAX_WINDOW_SIZE) {
+						fail(HTTP2_ERROR_FLOW_CONTROL_ERROR);
+						return;
+					}
+				}
+				m_initialSendWindow = value;
+				break;
+			}
+			case HTTP2_SETTING_MAX_FRAME_SIZE:
+				if(value < HTTP2_DEFAULT_FRAME_SIZE || value > 0xffffff) {
+					fail(HTTP2_ERROR_PROTOCOL_ERROR);
+					return;
+				}
+				m_maxFrameSize = value;
+				break;
+			default:
+				break;
+		}
+	}
+
+	m_settingsReceived = true;
+	queueFrame(HTTP2_FRAME_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+}
+
+void
+Http2Session::windowUpdateFrameReceived(uint32_t id, const char *payload, size_t length)
+{
+	if(length != 4) {
+		fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+		return;
+	}
+
+	uint32_t increment = get32(payload) & 0x7fffffff;
+	if(id == 0) {
+		m_sendWindow += increment;
+		if(increment == 0)
+			fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		else if(m_sendWindow > HTTP2_MAX_WINDOW_SIZE)
+			fail(HTTP2_ERROR_FLOW_CONTROL_ERROR);
+		return;
+	}
+
+	if(id > m_lastStreamId) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+
+	Http2StreamMap::iterator iter = m_streams.find(id);
+	if(iter == m_streams.end() || iter->second->m_reset)
+		return;
+
+	Http2Stream *stream = iter->second;
+	stream->m_sendWindow += increment;
+	if(increment == 0)
+		resetStream(stream, HTTP2_ERROR_PROTOCOL_ERROR);
+	else if(stream->m_sendWindow > HTTP2_MAX_WINDOW_SIZE)
+		resetStream(stream, HTTP2_ERROR_FLOW_CONTROL_ERROR);
+}
+
+void
+Http2Session::resetFrameReceived(uint32_t id, size_t length)
+{
+	if(id == 0 || id > m_lastStreamId) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+	if(length != 4) {
+		fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+		return;
+	}
+
+	// the response is dropped without resetting
+	// the stream again
+	Http2StreamMap::iterator iter = m_streams.find(id);
+	if(iter == m_streams.end() || iter->second->m_reset)
+		return;
+
+	Http2Stream *stream = iter->second;
+	stream->m_reset = true;
+	stream->m_remoteClosed = true;
+	stream->clearOutput();
+	if(stream->m_released)
+		deleteStream(stream);
+}
+
+void
+Http2Session::priorityUpdateFrameReceived(uint32_t id, const char *payload, size_t length)
+{
+	if(id != 0) {
+		fail(HTTP2_ERROR_PROTOCOL_ERROR);
+		return;
+	}
+	if(length < 4) {
+		fail(HTTP2_ERROR_FRAME_SIZE_ERROR);
+		return;
+	}
+
+	// updates for streams that aren't open are ignored
+	uint32_t streamId = get32(payload) & 0x7fffffff;
+	Http2StreamMap::iterator iter = m_streams.find(streamId);
+	if(iter != m_streams.end())
+		iter->second->setPriority(string(payload + 4, length - 4));
+}
+
+// lets the client send more of the request bodies that have been
+// read, once half of a stream's window has been
+void
+Http2Session::updateReceiveWindows()
+{
+	Http2StreamMap::iterator iter;
+	for(iter = m_streams.begin(); iter != m_streams.end(); ++iter) {
+		Http2Stream *stream = iter->second;
+		if(stream->m_remoteClosed || stream->m_reset)
+			continue;
+
+		int64_t consumed = HTTP2_DEFAULT_WINDOW_SIZE - stream->m_receiveWindow - (int64_t)stream->m_line.length();
+		if(consumed >= HTTP2_DEFAULT_WINDOW_SIZE / 2) {
+			queueWindowUpdate(stream->m_id, (uint32_t)consumed);
+			stream->m_receiveWindow += consumed;
+		}
+	}
+}
+
+// picks the stream whose data is sent next: one with the lowest
+// urgency, and of those, the first stream that isn't incremental
+// (which are sent one at a time, in the order they were opened),
+// or else the incremental stream after the one last sent (which
+// take turns)
+Http2Stream *
+Http2Session::getNextStreamToSend()
+{
+	int urgency = 8;
+	Http2Stream *sequential = NULL;
+	Http2Stream *firstIncremental = NULL;
+	Http2Stream *nextIncremental = NULL;
+
+	Http2StreamMap::iterator iter;
+	for(iter = m_streams.begin(); iter != m_streams.end(); ++iter) {
+		Http2Stream *stream = iter->second;
+		if(stream->m_urgency > urgency || stream->canSend(m_sendWindow) == false)
+			continue;
+
+		if(stream->m_urgency < urgency) {
+			urgency = stream->m_urgency;
+			sequential = NULL;
+			firstIncremental = NULL;
+			nextIncremental = NULL;
+		}
+
+		if(stream->m_incremental == false) {
+			if(sequential == NULL)
+				sequential = stream;
+		} else {
+			if(firstIncremental == NULL)
+				firstIncremental = stream;
+			if(nextIncremental == NULL && stream->m_id > m_lastIncrementalId)
+				nextIncremental = stream;
+		}
+	}
+
+	if(sequential != NULL)
+		return sequential;
+	return (nextIncremental != NULL) ? nextIncremental : firstIncremental;
+}
+
+// sends a DATA frame of as much of the stream's output as its
+// windows allow, ending the stream if that's the last of it
+void
+Http2Session::sendStreamData(Http2Stream *stream)
+{
+	size_t length = stream->getOutputSize();
+	if(length > HTTP2_MAX_DATA_LENGTH)
+		length = HTTP2_MAX_DATA_LENGTH;
+	if(length > m_maxFrameSize)
+		length = m_maxFrameSize;
+	if((int64_t)length > stream->m_sendWindow)
+		length = (size_t)stream->m_sendWindow;
+	if((int64_t)length > m_sendWindow)
+		length = (size_t)m_sendWindow;
+
+	bool lastData = (stream->m_ended && length == stream->getOutputSize());
+	bool endStream = (lastData && stream->m_trailers.empty());
+
+	// the payload is sent straight from the stream's output
+	char header[HTTP2_FRAME_HEADER_SIZE];
+	putFrameHeader(header, length, HTTP2_FRAME_DATA, endStream ? HTTP2_FLAG_END_STREAM : 0, stream->m_id);
+	sendFrames();
+	m_conn->sendString(header, sizeof(header));
+	stream->moveOutput(m_conn, length);
+
+	stream->m_sendWindow -= length;
+	m_sendWindow -= length;
+	if(stream->m_incremental)
+		m_lastIncrementalId = stream->m_id;
+
+	if(lastData) {
+		if(endStream == false)
+			queueHeaders(stream->m_id, stream->m_trailers, true);
+		stream->m_endSent = true;
+		if(stream->m_released)
+			finishStream(stream);
+	}
+}
+
+void
+Http2Session::flush()
+{
+	if(m_closed)
+		return;
+
+	updateReceiveWindows();
+	m_conn->holdOutput();
+
+	// headers aren't flow controlled, so they're sent as soon
+	// as they're ready, along with the end of streams that have
+	// no body
+	Http2StreamMap::iterator iter = m_streams.begin();
+	while(iter != m_streams.end()) {
+		Http2Stream *stream = (iter++)->second;
+		if(stream->m_headersReady == false || stream->m_reset)
+			continue;
+
+		bool endStream = (stream->m_ended && stream->getOutputSize() == 0 && stream->m_trailers.empty());
+		queueHeaders(stream->m_id, stream->m_headers, endStream);
+		stream->m_headers.clear();
+		stream->m_headersReady = false;
+		stream->m_headersSent = true;
+		if(endStream) {
+			stream->m_endSent = true;
+			if(stream->m_released)
+				finishStream(stream);
+		}
+	}
+
+	// then data is sent in order of priority for as long
+	// as the connection's output has room for it, which it
+	// may have again once what's been held has been sent
+	Http2Stream *stream;
+	for(;;) {
+		while(m_conn->getOutputCapacity() != 0 && (stream = getNextStreamToSend()) != NULL)
+			sendStreamData(stream);
+
+		sendFrames();
+		m_conn->releaseOutput();
+		if(m_conn->getOutputCapacity() == 0 || getNextStreamToSend() == NULL)
+			break;
+
+		m_conn->holdOutput();
+	}
+
+	// a client that's going away is disconnected
+	// once its streams are done
+	if(m_goingAway && m_streams.empty())
+		close();
+}
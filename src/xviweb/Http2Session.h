@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HTTP2SESSION_H__
+#define __HTTP2SESSION_H__
+
+#include <deque>
+#include <map>
+#include "Http2Stream.h"
+
+enum Http2FrameType
+{
+	HTTP2_FRAME_DATA = 0x0,
+	HTTP2_FRAME_HEADERS = 0x1,
+	HTTP2_FRAME_PRIORITY = 0x2,
+	HTTP2_FRAME_RST_STREAM = 0x3,
+	HTTP2_FRAME_SETTINGS = 0x4,
+	HTTP2_FRAME_PUSH_PROMISE = 0x5,
+	HTTP2_FRAME_PING = 0x6,
+	HTTP2_FRAME_GOAWAY = 0x7,
+	HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+	HTTP2_FRAME_CONTINUATION = 0x9,
+	HTTP2_FRAME_PRIORITY_UPDATE = 0x10
+};
+
+enum Http2ErrorCode
+{
+	HTTP2_ERROR_NO_ERROR = 0x0,
+	HTTP2_ERROR_PROTOCOL_ERROR = 0x1,
+	HTTP2_ERROR_INTERNAL_ERROR = 0x2,
+	HTTP2_ERROR_FLOW_CONTROL_ERROR = 0x3,
+	HTTP2_ERROR_SETTINGS_TIMEOUT = 0x4,
+	HTTP2_ERROR_STREAM_CLOSED = 0x5,
+	HTTP2_ERROR_FRAME_SIZE_ERROR = 0x6,
+	HTTP2_ERROR_REFUSED_STREAM = 0x7,
+	HTTP2_ERROR_CANCEL = 0x8,
+	HTTP2_ERROR_COMPRESSION_ERROR = 0x9,
+	HTTP2_ERROR_CONNECT_ERROR = 0xa,
+	HTTP2_ERROR_ENHANCE_YOUR_CALM = 0xb,
+	HTTP2_ERROR_INADEQUATE_SECURITY = 0xc,
+	HTTP2_ERROR_HTTP_1_1_REQUIRED = 0xd
+};
+
+typedef std::map<uint32_t, Http2Stream *> Http2StreamMap;
+
+// the server's end of an HTTP/2 connection (RFC 9113), which
+// takes over the connection's input once the client's preface
+// has been read; the streams it opens are handled by the server
+// like connections of their own, and their responses are sent
+// when the session is flushed, in order of their priority
+class Http2Session : public HttpConnectionUpgrade
+{
+	private:
+		HttpConnection *m_conn;
+		unsigned int m_maxConcurrentStreams;
+		size_t m_maxHeaderListSize;
+
+		size_t m_prefaceRemaining;
+		bool m_settingsReceived;
+		bool m_goingAway;
+		bool m_closed;
+		uint32_t m_lastStreamId;
+
+		Http2StreamMap m_streams;
+		std::deque <Http2Stream *> m_openedStreams;
+
+		// a header block that's continued
+		// in CONTINUATION frames
+		uint32_t m_headerStreamId;
+		bool m_headerEndStream;
+		bool m_headerSelfDependent;
+		std::string m_headerBlock;
+
+		HpackDecoder m_decoder;
+		HpackEncoder m_encoder;
+
+		// frames waiting to be sent, which go
+		// before any DATA frames
+		std::string m_frames;
+
+		// the connection's flow control windows, and
+		// the limits the client has set
+		int64_t m_sendWindow;
+		int64_t m_receiveWindow;
+		int64_t m_initialSendWindow;
+		size_t m_maxFrameSize;
+		uint32_t m_lastIncrementalId;
+
+		void queueFrame(uint8_t type, uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void queueHeaders(uint32_t id, const HpackHeaderList &headers, bool endStream);
+		void queueReset(uint32_t id, Http2ErrorCode code);
+		void queueWindowUpdate(uint32_t id, uint32_t increment);
+		void sendFrames();
+		void sendGoaway(Http2ErrorCode code);
+		void fail(Http2ErrorCode code);
+
+		bool removePadding(uint8_t flags, const char **payload, size_t *length);
+		void frameReceived(uint8_t type, uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void dataFrameReceived(uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void headersFrameReceived(uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void continuationFrameReceived(uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void headerBlockReceived();
+		void settingsFrameReceived(uint8_t flags, uint32_t id, const char *payload, size_t length);
+		void windowUpdateFrameReceived(uint32_t id, const char *payload, size_t length);
+		void resetFrameReceived(uint32_t id, size_t length);
+		void priorityUpdateFrameReceived(uint32_t id, const char *payload, size_t length);
+
+		void resetStream(Http2Stream *stream, Http2ErrorCode code);
+		void finishStream(Http2Stream *stream);
+		void deleteStream(Http2Stream *stream);
+		void updateReceiveWindows();
+		Http2Stream *getNextStreamToSend();
+		void sendStreamData(Http2Stream *stream);
+
+	public:
+		Http2Session(HttpConnection *conn, unsigned int maxConcurrentStreams, size_t maxHeaderListSize);
+		~Http2Session();
+
+		bool isClosed() const;
+
+		// returns the next stream the client has opened that
+		// hasn't been returned yet, or null if there's none
+		Http2Stream *getOpenedStream();
+
+		// called once the server is done with a stream that's
+		// been returned; it's deleted once its response is sent
+		void releaseStream(Http2Stream *stream);
+
+		void sendContinueResponse(Http2Stream *stream);
+
+		// sends what's ready to be sent
+		void flush();
+
+		// tells the client that the connection is being closed
+		void close();
+
+		size_t upgradedDataRead(char *data, size_t length);
+};
+
+#endif /* __HTTP2SESSION_H__ */
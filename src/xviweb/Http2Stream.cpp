@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <cstring>
+#include <xviweb/String.h>
+#include "Http2Session.h"
+
+using namespace std;
+
+Http2Stream::Http2Stream(Http2Session *session, const HttpConnection *carrier,
+                         uint32_t id, int64_t sendWindow, int64_t receiveWindow)
+ : HttpConnection(carrier)
+{
+	m_session = session;
+	m_id = id;
+	m_urgency = 3;
+	m_incremental = false;
+	m_sendWindow = sendWindow;
+	m_receiveWindow = receiveWindow;
+	m_bodyLength = 0;
+	m_declaredLength = -1;
+	m_remoteClosed = false;
+	m_inputRead = false;
+	m_reset = false;
+	m_released = false;
+	m_headersReady = false;
+	m_headersSent = false;
+	m_ended = false;
+	m_endSent = false;
+}
+
+Http2Stream::~Http2Stream()
+{
+}
+
+uint32_t
+Http2Stream::getStreamId() const
+{
+	return m_id;
+}
+
+string
+Http2Stream::toString() const
+{
+	return HttpConnection::toString() + " stream " + String::fromUInt(m_id);
+}
+
+bool
+Http2Stream::isReset() const
+{
+	return m_reset;
+}
+
+bool
+Http2Stream::wasInputRead()
+{
+	bool inputRead = m_inputRead;
+	m_inputRead = false;
+	return inputRead;
+}
+
+static bool
+isConnectionHeader(const string &name)
+{
+	return (name == "connection" || name == "keep-alive" ||
+	        name == "proxy-connection" || name == "transfer-encoding" ||
+	        name == "upgrade");
+}
+
+// returns false if the request is malformed (RFC 9113 section 8.1.1),
+// which resets the stream
+bool
+Http2Stream::requestReceived(const HpackHeaderList &headers, bool endStream,
+                             bool tooLarge)
+{
+	HttpRequestImpl *request = getRequest();
+	string method, scheme, path, authority;
+	bool regularHeaderSeen = false;
+
+	for(size_t i = 0; i < headers.size(); ++i) {
+		const string &name = headers[i].first;
+		const string &value = headers[i].second;
+		if(name.length() == 0)
+			return false;
+
+		// pseudo-headers come first, and only once each
+		if(name[0] == ':') {
+			string *field = NULL;
+			if(name == ":method")
+				field = &method;
+			else if(name == ":scheme")
+				field = &scheme;
+			else if(name == ":path")
+				field = &path;
+			else if(name == ":authority")
+				field = &authority;
+
+			if(regularHeaderSeen || field == NULL || field->length() != 0 || value.length() == 0)
+				return false;
+			*field = value;
+			continue;
+		}
+
+		// names are sent in lowercase, and headers that are
+		// about the connection are only used by HTTP/1.1
+		regularHeaderSeen = true;
+		if(name != String::toLower(name) || isConnectionHeader(name) ||
+		   (name == "te" && value != "trailers"))
+			return false;
+		request->addHeaderValue(name, value);
+	}
+
+	if(method.length() == 0 || scheme.length() == 0 || path.length() == 0)
+		return false;
+	if(authority.length() != 0 && request->getHeaderValue("Host").length() == 0)
+		request->addHeaderValue("host", authority);
+	if(request->setRequestTarget(method, path, "HTTP/2") == false)
+		return false;
+
+	// the body's length has to match the declared length
+	string contentLength = request->getHeaderValue("Content-Length");
+	if(contentLength.length() != 0) {
+		m_declaredLength = (int64_t)String::toUInt(contentLength);
+		if(endStream && m_declaredLength != 0)
+			return false;
+	}
+
+	cout << toString() << ": Received request: " << method << " " << path << " HTTP/2" << endl;
+	setPriority(request->getHeaderValue("Priority"));
+
+	m_remoteClosed = endStream;
+	requestHeadersReceived(endStream == false);
+	if(tooLarge)
+		sendErrorResponse(431, "Request Header Fields Too Large", "The request headers are too large.");
+
+	return true;
+}
+
+bool
+Http2Stream::trailersReceived(const HpackHeaderList &headers)
+{
+	HttpRequestImpl *request = getRequest();
+	for(size_t i = 0; i < headers.size(); ++i) {
+		const string &name = headers[i].first;
+		if(name.length() == 0 || name[0] == ':' || name != String::toLower(name) || isConnectionHeader(name))
+			return false;
+		request->addTrailerValue(name, headers[i].second);
+	}
+
+	return dataReceived(NULL, 0, true);
+}
+
+bool
+Http2Stream::dataReceived(const char *data, size_t length, bool endStream)
+{
+	m_bodyLength += length;
+	if(m_declaredLength >= 0 && ((int64_t)m_bodyLength > m_declaredLength ||
+	   (endStream && (int64_t)m_bodyLength != m_declaredLength)))
+		return false;
+
+	m_inputRead = true;
+	resetReadTimer();
+
+	// the body is dropped once there's no use for it
+	if(getState() != HTTP_CONNECTION_STATE_DONE && length != 0) {
+		m_line.append(data, length);
+		if(getState() == HTTP_CONNECTION_STATE_READING_BODY)
+			processInput();
+	}
+
+	if(endStream) {
+		m_remoteClosed = true;
+		requestInputEnded();
+	}
+
+	return true;
+}
+
+// parses a Priority header or PRIORITY_UPDATE frame's field value
+// (RFC 9218 section 4), ignoring parameters it doesn't know
+void
+Http2Stream::setPriority(const string &priority)
+{
+	vector <string> params = String::split(priority, ",");
+	for(size_t i = 0; i < params.size(); ++i) {
+		string param = String::trim(params[i]);
+		if(param.length() == 3 && param[0] == 'u' && param[1] == '=' && param[2] >= '0' && param[2] <= '7')
+			m_urgency = param[2] - '0';
+		else if(param == "i" || param == "i=?1")
+			m_incremental = true;
+		else if(param == "i=?0")
+			m_incremental = false;
+	}
+}
+
+// returns true if the stream has DATA to send that fits in the
+// flow control windows, or has ended without it being sent
+bool
+Http2Stream::canSend(int64_t connectionWindow) const
+{
+	if(m_headersSent == false || m_endSent || m_reset)
+		return false;
+	if(getOutputSize() == 0)
+		return m_ended;
+
+	return (m_sendWindow > 0 && connectionWindow > 0);
+}
+
+void
+Http2Stream::sendContinueResponse()
+{
+	if(m_headersReady == false && m_headersSent == false)
+		m_session->sendContinueResponse(this);
+}
+
+void
+Http2Stream::addResponseHeader(HpackHeaderList *headers, const string &name,
+                               const string &value)
+{
+	string lowerName = String::toLower(name);
+	if(isConnectionHeader(lowerName) == false && lowerName != "trailer")
+		headers->push_back(make_pair(lowerName, value));
+}
+
+void
+Http2Stream::sendHeaders(const HpackHeaderList &headers)
+{
+	if(m_reset || m_headersReady || m_headersSent)
+		return;
+
+	m_headers = headers;
+	m_headersReady = true;
+}
+
+void
+Http2Stream::sendHead(const char *head, size_t length,
+                      const HpackHeaderList &extraHeaders)
+{
+	string s(head, length);
+	HpackHeaderList headers;
+
+	// the status code follows the version in the status line
+	size_t end = s.find("\r\n");
+	size_t start = s.find(' ');
+	if(end == string::npos || start == string::npos || start > end)
+		return;
+	headers.push_back(make_pair(string(":status"), s.substr(start + 1, 3)));
+
+	// then there's a header on each line, up to an empty line
+	start = end + 2;
+	while((end = s.find("\r\n", start)) != string::npos && end != start) {
+		size_t colon = s.find(':', start);
+		if(colon != string::npos && colon < end)
+			addResponseHeader(&headers, s.substr(start, colon - start), String::trim(s.substr(colon + 1, end - colon - 1)));
+		start = end + 2;
+	}
+
+	headers.insert(headers.end(), extraHeaders.begin(), extraHeaders.end());
+	sendHeaders(headers);
+}
+
+void
+Http2Stream::endStream(const HpackHeaderList &trailers)
+{
+	m_trailers = trailers;
+	m_ended = true;
+}
+
+void
+Http2Stream::setNotSentLowWatermark(unsigned int)
+{
+	// the stream's output is sent by the session
+}
+
+void
+Http2Stream::sendBuffers(const struct iovec *buffers, int count)
+{
+	if(m_reset || m_ended || m_session->isClosed())
+		return;
+
+	queueOutput(buffers, count);
+}
+
+void
+Http2Stream::sendSharedBuffer(SharedBuffer *buffer, size_t offset, size_t length)
+{
+	if(m_reset || m_ended || m_session->isClosed() || length == 0)
+		return;
+
+	queueOutput(buffer, offset, length);
+}
+
+void
+Http2Stream::sendErrorResponse(int errorCode, const char *errorDesc,
+                               const char *errorMessage)
+{
+	// a response that's been started can only be stopped
+	if(m_headersReady || m_headersSent) {
+		abort();
+		return;
+	}
+
+	string message = errorMessage;
+	HpackHeaderList headers;
+	headers.push_back(make_pair(string(":status"), String::fromInt(errorCode)));
+	headers.push_back(make_pair(string("content-type"), string("text/plain")));
+	headers.push_back(make_pair(string("content-length"), String::fromInt(message.length())));
+	sendHeaders(headers);
+	sendString(message);
+	endStream(HpackHeaderList());
+
+	cout << toString() << ": " << errorDesc << endl;
+	endResponse();
+}
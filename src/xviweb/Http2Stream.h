@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HTTP2STREAM_H__
+#define __HTTP2STREAM_H__
+
+#include "Hpack.h"
+#include "HttpConnection.h"
+
+class Http2Session;
+
+// a request and its response on an HTTP/2 connection, which is
+// handled like a connection of its own; the request is given to
+// it by its session, and its response is queued until the
+// session sends it as frames
+class Http2Stream : public HttpConnection
+{
+	friend class Http2Session;
+
+	private:
+		Http2Session *m_session;
+		uint32_t m_id;
+
+		// the stream's priority (RFC 9218): streams with a lower
+		// urgency are sent first, and incremental streams share
+		// the connection with others of the same urgency
+		int m_urgency;
+		bool m_incremental;
+
+		// how much data the client is ready to receive,
+		// and how much it can send before it's told that
+		// what it's sent has been read
+		int64_t m_sendWindow;
+		int64_t m_receiveWindow;
+
+		uint64_t m_bodyLength;
+		int64_t m_declaredLength;
+		bool m_remoteClosed;
+		bool m_inputRead;
+		bool m_reset;
+		bool m_released;
+
+		// the response's headers, which are encoded
+		// when they're sent, and whether the stream has
+		// ended (with trailers, if it has any)
+		HpackHeaderList m_headers;
+		bool m_headersReady;
+		bool m_headersSent;
+		HpackHeaderList m_trailers;
+		bool m_ended;
+		bool m_endSent;
+
+		bool requestReceived(const HpackHeaderList &headers, bool endStream, bool tooLarge);
+		bool trailersReceived(const HpackHeaderList &headers);
+		bool dataReceived(const char *data, size_t length, bool endStream);
+		void setPriority(const std::string &priority);
+		bool canSend(int64_t connectionWindow) const;
+
+	protected:
+		void sendContinueResponse();
+
+	public:
+		Http2Stream(Http2Session *session, const HttpConnection *carrier, uint32_t id, int64_t sendWindow, int64_t receiveWindow);
+		~Http2Stream();
+
+		uint32_t getStreamId() const;
+		std::string toString() const;
+
+		// true if the stream was reset (by either end), in which
+		// case its response is dropped
+		bool isReset() const;
+
+		// returns true if input was read since the last call
+		bool wasInputRead();
+
+		// adds a response header, leaving out those that are
+		// only used by HTTP/1.1
+		static void addResponseHeader(HpackHeaderList *headers, const std::string &name, const std::string &value);
+
+		void sendHeaders(const HpackHeaderList &headers);
+
+		// sends the status and headers of a response serialized
+		// as HTTP/1.1 (e.g. one from the response cache), along
+		// with the given headers
+		void sendHead(const char *head, size_t length, const HpackHeaderList &extraHeaders);
+		void endStream(const HpackHeaderList &trailers);
+
+		void setNotSentLowWatermark(unsigned int bytes);
+		void sendBuffers(const struct iovec *buffers, int count);
+		void sendSharedBuffer(SharedBuffer *buffer, size_t offset, size_t length);
+		void sendErrorResponse(int errorCode, const char *errorDesc, const char *errorMessage);
+};
+
+#endif /* __HTTP2STREAM_H__ */
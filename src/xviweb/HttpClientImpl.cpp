@@ -0,0 +1,946 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <xviweb/String.h>
+#include "HttpClientImpl.h"
+#include "Poller.h"
+#include "Util.h"
+
+using namespace std;
+
+// responses with headers longer than this are rejected
+#define HTTP_CLIENT_MAX_HEADER_SIZE (64 * 1024)
+
+static bool
+parseLength(const string &value, uint64_t *length)
+{
+	string s = String::trim(value);
+	if(s.length() == 0 || s.length() > 18)
+		return false;
+
+	uint64_t n = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		if(s[i] < '0' || s[i] > '9')
+			return false;
+		n = (n * 10) + (uint64_t)(s[i] - '0');
+	}
+
+	*length = n;
+	return true;
+}
+
+// splits an http:// URL into the host and port to connect
+// to, the value of the Host header and the request target
+static bool
+parseUrl(const string &url, string *host, unsigned short *port, string *hostHeader, string *target)
+{
+	if(url.length() < 7 || String::toLower(url.substr(0, 7)) != "http://")
+		return false;
+
+	size_t end = url.find_first_of("/?#", 7);
+	string authority = url.substr(7, (end == string::npos) ? string::npos : end - 7);
+	if(authority.length() == 0 || authority.find('@') != string::npos)
+		return false;
+
+	*target = (end == string::npos) ? "/" : url.substr(end);
+	*target = target->substr(0, target->find('#'));
+	if(target->length() == 0 || (*target)[0] != '/')
+		*target = "/" + *target;
+
+	// IPv6 addresses are enclosed in brackets
+	size_t colon;
+	if(authority[0] == '[') {
+		size_t bracket = authority.find(']');
+		if(bracket == string::npos)
+			return false;
+
+		*host = authority.substr(1, bracket - 1);
+		colon = (bracket + 1 < authority.length() && authority[bracket + 1] == ':') ? bracket + 1 : string::npos;
+	} else {
+		colon = authority.find(':');
+		*host = authority.substr(0, colon);
+	}
+
+	*port = 80;
+	if(colon != string::npos) {
+		string s = authority.substr(colon + 1);
+		unsigned int n = String::toUInt(s);
+		if(s.length() == 0 || s.length() > 5 || n == 0 || n > 65535 ||
+		   s.find_first_not_of("0123456789") != string::npos)
+			return false;
+		*port = (unsigned short)n;
+	}
+
+	*hostHeader = authority;
+	return (host->length() != 0);
+}
+
+HttpClientPool::HttpClientPool(const string &hostValue, const Address &addressValue, unsigned short portValue)
+ : host(hostValue), address(addressValue), port(portValue)
+{
+}
+
+HttpClientConnection::HttpClientConnection(HttpClientPool *pool, size_t maxResponseSize)
+ : Connection(pool->address, pool->port)
+{
+	m_pool = pool;
+	m_call = NULL;
+	m_state = HTTP_CLIENT_CONNECTION_STATE_CONNECTING;
+	m_reused = false;
+	m_received = false;
+	m_keepAlive = false;
+	m_bodyType = HTTP_CLIENT_BODY_LENGTH;
+	m_bodyRemaining = 0;
+	m_maxResponseSize = maxResponseSize;
+}
+
+HttpClientPool *
+HttpClientConnection::getPool() const
+{
+	return m_pool;
+}
+
+HttpClientCallImpl *
+HttpClientConnection::getCall() const
+{
+	return m_call;
+}
+
+HttpClientConnectionState
+HttpClientConnection::getState() const
+{
+	return m_state;
+}
+
+const string &
+HttpClientConnection::getError() const
+{
+	return m_error;
+}
+
+bool
+HttpClientConnection::isReused() const
+{
+	return m_reused;
+}
+
+bool
+HttpClientConnection::hasReceived() const
+{
+	return m_received;
+}
+
+// a connection can be kept for another call once its
+// response has been completely received, as long as
+// nothing else was received or is left to be sent
+bool
+HttpClientConnection::isReusable() const
+{
+	return (m_state == HTTP_CLIENT_CONNECTION_STATE_DONE && m_keepAlive &&
+	        m_line.length() == 0 && getOutputSize() == 0);
+}
+
+int
+HttpClientConnection::getPollEvents() const
+{
+	if(m_state == HTTP_CLIENT_CONNECTION_STATE_CONNECTING)
+		return POLLER_EVENT_WRITE;
+
+	// idle connections are watched so that they're
+	// closed once the other server closes them
+	int events = POLLER_EVENT_READ;
+	if(getOutputSize() != 0)
+		events |= POLLER_EVENT_WRITE;
+	return events;
+}
+
+void
+HttpClientConnection::beginCall(HttpClientCallImpl *call)
+{
+	m_call = call;
+	m_received = false;
+	if(m_state == HTTP_CLIENT_CONNECTION_STATE_CONNECTING)
+		return;
+
+	m_state = HTTP_CLIENT_CONNECTION_STATE_STATUS;
+	sendString(call->getRequestData());
+}
+
+void
+HttpClientConnection::finishConnecting()
+{
+	if(isConnected() == false) {
+		fail("Unable to connect to " + m_pool->host);
+		return;
+	}
+
+	m_state = HTTP_CLIENT_CONNECTION_STATE_IDLE;
+	if(m_call != NULL)
+		beginCall(m_call);
+}
+
+void
+HttpClientConnection::endCall()
+{
+	m_call = NULL;
+	m_reused = true;
+	if(m_state == HTTP_CLIENT_CONNECTION_STATE_DONE)
+		m_state = HTTP_CLIENT_CONNECTION_STATE_IDLE;
+}
+
+void
+HttpClientConnection::fail(const string &error)
+{
+	m_state = HTTP_CLIENT_CONNECTION_STATE_FAILED;
+	m_error = error;
+	m_keepAlive = false;
+}
+
+void
+HttpClientConnection::headersRead()
+{
+	// interim responses are skipped
+	int statusCode = m_call->getStatusCode();
+	if(statusCode >= 100 && statusCode < 200) {
+		m_call->clearResponse();
+		m_state = HTTP_CLIENT_CONNECTION_STATE_STATUS;
+		return;
+	}
+
+	string connection = m_call->getHeaderValue("Connection");
+	if(String::containsToken(connection, "close"))
+		m_keepAlive = false;
+	else if(String::containsToken(connection, "keep-alive"))
+		m_keepAlive = true;
+
+	if(m_call->isHeadRequest() || statusCode == 204 || statusCode == 304) {
+		m_state = HTTP_CLIENT_CONNECTION_STATE_DONE;
+		return;
+	}
+
+	// the transfer coding takes precedence over the content
+	// length, and bodies delimited by neither end with the
+	// connection
+	string transferEncoding = String::trim(String::toLower(m_call->getHeaderValue("Transfer-Encoding")));
+	string contentLength = m_call->getHeaderValue("Content-Length");
+	if(transferEncoding.length() != 0) {
+		if(String::endsWith(transferEncoding, "chunked") == false) {
+			fail("The response's transfer coding is not supported");
+			return;
+		}
+
+		m_bodyType = HTTP_CLIENT_BODY_CHUNKED;
+		m_chunkedDecoder.reset();
+	} else if(contentLength.length() != 0) {
+		if(parseLength(contentLength, &m_bodyRemaining) == false) {
+			fail("The response has an invalid Content-Length");
+			return;
+		}
+		if(m_bodyRemaining > m_maxResponseSize) {
+			fail("The response is too large");
+			return;
+		}
+
+		m_bodyType = HTTP_CLIENT_BODY_LENGTH;
+		if(m_bodyRemaining == 0) {
+			m_state = HTTP_CLIENT_CONNECTION_STATE_DONE;
+			return;
+		}
+	} else {
+		m_bodyType = HTTP_CLIENT_BODY_UNTIL_CLOSED;
+		m_keepAlive = false;
+	}
+
+	m_state = HTTP_CLIENT_CONNECTION_STATE_BODY;
+}
+
+void
+HttpClientConnection::bodyRead(const char *data, size_t length)
+{
+	if(m_call->getBody().length() + length > m_maxResponseSize) {
+		fail("The response is too large");
+		return;
+	}
+
+	m_call->appendBody(data, length);
+}
+
+void
+HttpClientConnection::closed()
+{
+	switch(m_state) {
+		case HTTP_CLIENT_CONNECTION_STATE_BODY:
+			if(m_bodyType == HTTP_CLIENT_BODY_UNTIL_CLOSED) {
+				m_state = HTTP_CLIENT_CONNECTION_STATE_DONE;
+				break;
+			}
+			fail("The connection was closed before the response was received");
+			break;
+		case HTTP_CLIENT_CONNECTION_STATE_DONE:
+			m_keepAlive = false;
+			break;
+		case HTTP_CLIENT_CONNECTION_STATE_FAILED:
+			break;
+		default:
+			fail("The connection was closed before the response was received");
+			break;
+	}
+}
+
+void
+HttpClientConnection::inputRead()
+{
+	if(m_call != NULL)
+		m_received = true;
+
+	if(isReadingLines() && m_line.length() > HTTP_CLIENT_MAX_HEADER_SIZE)
+		fail("The response's headers are too large");
+}
+
+void
+HttpClientConnection::lineRead(const string &line)
+{
+	if(m_state == HTTP_CLIENT_CONNECTION_STATE_STATUS) {
+		// HTTP/1.1 200 OK
+		if(line.length() < 12 || line.compare(0, 7, "HTTP/1.") != 0 || line[8] != ' ') {
+			fail("The response is invalid");
+			return;
+		}
+
+		size_t space = line.find(' ', 9);
+		int statusCode = String::toInt(line.substr(9, (space == string::npos) ? string::npos : space - 9));
+		if(statusCode < 100 || statusCode > 999) {
+			fail("The response is invalid");
+			return;
+		}
+
+		m_call->setStatus(statusCode, (space == string::npos) ? "" : line.substr(space + 1));
+		m_keepAlive = (line[7] != '0');
+		m_state = HTTP_CLIENT_CONNECTION_STATE_HEADERS;
+	} else if(m_state == HTTP_CLIENT_CONNECTION_STATE_HEADERS) {
+		if(line.length() == 0) {
+			headersRead();
+			return;
+		}
+
+		size_t colon = line.find(':');
+		if(colon == string::npos || colon == 0) {
+			fail("The response has an invalid header");
+			return;
+		}
+
+		m_call->addHeaderValue(line.substr(0, colon), String::trim(line.substr(colon + 1)));
+	}
+}
+
+bool
+HttpClientConnection::isReadingLines() const
+{
+	return (m_state == HTTP_CLIENT_CONNECTION_STATE_STATUS ||
+	        m_state == HTTP_CLIENT_CONNECTION_STATE_HEADERS);
+}
+
+size_t
+HttpClientConnection::dataRead(char *data, size_t length)
+{
+	// anything received on an idle connection is unexpected,
+	// and anything after the response is left unread
+	if(m_state == HTTP_CLIENT_CONNECTION_STATE_IDLE) {
+		fail("Unexpected data was received");
+		return 0;
+	}
+	if(m_state != HTTP_CLIENT_CONNECTION_STATE_BODY)
+		return 0;
+
+	if(m_bodyType == HTTP_CLIENT_BODY_LENGTH) {
+		size_t n = (length < m_bodyRemaining) ? length : (size_t)m_bodyRemaining;
+		bodyRead(data, n);
+		m_bodyRemaining -= n;
+		if(m_bodyRemaining == 0 && m_state == HTTP_CLIENT_CONNECTION_STATE_BODY)
+			m_state = HTTP_CLIENT_CONNECTION_STATE_DONE;
+		return n;
+	}
+
+	if(m_bodyType == HTTP_CLIENT_BODY_UNTIL_CLOSED) {
+		bodyRead(data, length);
+		return length;
+	}
+
+	const char *chunk;
+	size_t chunkLength;
+	size_t used = m_chunkedDecoder.decode(data, length, &chunk, &chunkLength);
+	if(chunkLength != 0)
+		bodyRead(chunk, chunkLength);
+
+	if(m_chunkedDecoder.hasError()) {
+		fail("The response has an invalid chunked body");
+	} else if(m_chunkedDecoder.isDone() && m_state == HTTP_CLIENT_CONNECTION_STATE_BODY) {
+		// trailers are merged into the headers
+		const vector <string> &trailerLines = m_chunkedDecoder.getTrailerLines();
+		for(unsigned int i = 0; i < trailerLines.size(); ++i) {
+			size_t colon = trailerLines[i].find(':');
+			if(colon != string::npos && colon != 0)
+				m_call->addHeaderValue(trailerLines[i].substr(0, colon), String::trim(trailerLines[i].substr(colon + 1)));
+		}
+
+		m_state = HTTP_CLIENT_CONNECTION_STATE_DONE;
+	}
+
+	return used;
+}
+
+HttpClientCallImpl::HttpClientCallImpl(HttpClientImpl *client, HttpResponse *response, HttpClientHandler *handler)
+{
+	m_client = client;
+	m_response = response;
+	m_handler = handler;
+	m_pool = NULL;
+	m_headRequest = false;
+	m_retryable = false;
+	m_connection = NULL;
+	m_timerTime = -1;
+	m_done = false;
+	m_statusCode = 0;
+}
+
+HttpClientCallImpl::~HttpClientCallImpl()
+{
+	if(m_done == false)
+		m_client->cancelCall(this);
+}
+
+HttpResponse *
+HttpClientCallImpl::getResponse() const
+{
+	return m_response;
+}
+
+HttpClientHandler *
+HttpClientCallImpl::getHandler() const
+{
+	return m_handler;
+}
+
+HttpClientPool *
+HttpClientCallImpl::getPool() const
+{
+	return m_pool;
+}
+
+const string &
+HttpClientCallImpl::getRequestData() const
+{
+	return m_requestData;
+}
+
+bool
+HttpClientCallImpl::isHeadRequest() const
+{
+	return m_headRequest;
+}
+
+bool
+HttpClientCallImpl::isRetryable() const
+{
+	return m_retryable;
+}
+
+void
+HttpClientCallImpl::setRequest(HttpClientPool *pool, const string &requestData, bool headRequest, bool retryable)
+{
+	m_pool = pool;
+	m_requestData = requestData;
+	m_headRequest = headRequest;
+	m_retryable = retryable;
+}
+
+HttpClientConnection *
+HttpClientCallImpl::getConnection() const
+{
+	return m_connection;
+}
+
+void
+HttpClientCallImpl::setConnection(HttpClientConnection *connection)
+{
+	m_connection = connection;
+}
+
+long
+HttpClientCallImpl::getTimerTime() const
+{
+	return m_timerTime;
+}
+
+void
+HttpClientCallImpl::setTimerTime(long timerTime)
+{
+	m_timerTime = timerTime;
+}
+
+void
+HttpClientCallImpl::setStatus(int statusCode, const string &statusMessage)
+{
+	m_statusCode = statusCode;
+	m_statusMessage = statusMessage;
+}
+
+void
+HttpClientCallImpl::addHeaderValue(const string &headerName, const string &headerValue)
+{
+	// repeated headers are combined into a list
+	string &value = m_headerMap[String::toLower(headerName)];
+	if(value.length() != 0)
+		value += ", ";
+	value += headerValue;
+}
+
+void
+HttpClientCallImpl::appendBody(const char *data, size_t length)
+{
+	m_body.append(data, length);
+}
+
+void
+HttpClientCallImpl::clearResponse()
+{
+	m_statusCode = 0;
+	m_statusMessage.clear();
+	m_headerMap.clear();
+	m_body.clear();
+}
+
+void
+HttpClientCallImpl::setError(const string &error)
+{
+	m_error = error;
+}
+
+void
+HttpClientCallImpl::finish()
+{
+	m_done = true;
+	m_connection = NULL;
+	m_requestData.clear();
+
+	// a failed call has no response
+	if(m_error.length() != 0)
+		clearResponse();
+}
+
+bool
+HttpClientCallImpl::isDone() const
+{
+	return m_done;
+}
+
+bool
+HttpClientCallImpl::hasFailed() const
+{
+	return (m_done && m_error.length() != 0);
+}
+
+string
+HttpClientCallImpl::getError() const
+{
+	return m_error;
+}
+
+int
+HttpClientCallImpl::getStatusCode() const
+{
+	return m_statusCode;
+}
+
+string
+HttpClientCallImpl::getStatusMessage() const
+{
+	return m_statusMessage;
+}
+
+string
+HttpClientCallImpl::getHeaderValue(const string &headerName) const
+{
+	HttpClientHeaderMap::const_iterator iter = m_headerMap.find(String::toLower(headerName));
+	return (iter != m_headerMap.end()) ? iter->second : "";
+}
+
+const string &
+HttpClientCallImpl::getBody() const
+{
+	return m_body;
+}
+
+HttpClientImpl::HttpClientImpl()
+{
+	m_server = NULL;
+	m_timeout = 30000;
+	m_maxResponseSize = 16 * 1024 * 1024;
+	m_maxIdleConnections = 8;
+}
+
+HttpClientImpl::~HttpClientImpl()
+{
+	for(unsigned int i = 0; i < m_connections.size(); ++i)
+		delete m_connections[i];
+
+	HttpClientPoolMap::iterator iter = m_pools.begin();
+	while(iter != m_pools.end()) {
+		delete iter->second;
+		++iter;
+	}
+}
+
+HttpClient *
+HttpClient::getInstance()
+{
+	return HttpClientImpl::getInstance();
+}
+
+HttpClientImpl *
+HttpClientImpl::getInstance()
+{
+	static HttpClientImpl client;
+	return &client;
+}
+
+void
+HttpClientImpl::attach(Server *server)
+{
+	m_server = server;
+	server->addEventSource(this);
+}
+
+HttpClientPool *
+HttpClientImpl::getPool(const string &host, unsigned short port)
+{
+	string key = host + ":" + String::fromUInt(port);
+	HttpClientPoolMap::iterator iter = m_pools.find(key);
+	if(iter != m_pools.end())
+		return iter->second;
+
+	// resolving the name blocks, but only the
+	// first request to each destination does it
+	try {
+		HttpClientPool *pool = new HttpClientPool(host, Address(host.c_str()), port);
+		m_pools.insert(make_pair(key, pool));
+		return pool;
+	} catch(const char *) {
+		return NULL;
+	}
+}
+
+void
+HttpClientImpl::setTimer(HttpClientCallImpl *call, long timerTime)
+{
+	if(call->getTimerTime() != -1)
+		m_timers.erase(make_pair(call->getTimerTime(), call));
+
+	call->setTimerTime(timerTime);
+	if(timerTime != -1)
+		m_timers.insert(make_pair(timerTime, call));
+}
+
+// calls that fail before they're started are completed on the
+// next cycle, so that callers aren't called back from request
+void
+HttpClientImpl::failLater(HttpClientCallImpl *call, const string &error)
+{
+	call->setError(error);
+	setTimer(call, 0);
+}
+
+void
+HttpClientImpl::startCall(HttpClientCallImpl *call)
+{
+	HttpClientPool *pool = call->getPool();
+	HttpClientConnection *conn;
+	if(pool->idleConnections.empty() == false) {
+		conn = pool->idleConnections.back();
+		pool->idleConnections.pop_back();
+	} else {
+		try {
+			conn = new HttpClientConnection(pool, m_maxResponseSize);
+		} catch(const char *) {
+			failLater(call, "Unable to connect to " + pool->host);
+			return;
+		}
+
+		int fd = conn->getFileDescriptor();
+		if((int)m_connections.size() <= fd)
+			m_connections.resize(fd + 1, NULL);
+		m_connections[fd] = conn;
+	}
+
+	call->setConnection(conn);
+	conn->beginCall(call);
+	watchConnection(conn);
+}
+
+void
+HttpClientImpl::completeCall(HttpClientCallImpl *call, const string &error)
+{
+	setTimer(call, -1);
+	call->setError(error);
+	call->finish();
+
+	// the handler may delete the call
+	if(call->getResponse() != NULL)
+		call->getResponse()->wake();
+	if(call->getHandler() != NULL)
+		call->getHandler()->callCompleted(call);
+}
+
+void
+HttpClientImpl::cancelCall(HttpClientCallImpl *call)
+{
+	setTimer(call, -1);
+
+	// the response to the call is abandoned along with its connection
+	HttpClientConnection *conn = call->getConnection();
+	if(conn != NULL) {
+		conn->endCall();
+		deleteConnection(conn);
+	}
+}
+
+void
+HttpClientImpl::watchConnection(HttpClientConnection *conn)
+{
+	if(m_server != NULL)
+		m_server->watchDescriptor(conn->getFileDescriptor(), conn->getPollEvents(), this);
+}
+
+void
+HttpClientImpl::updateConnection(HttpClientConnection *conn)
+{
+	HttpClientCallImpl *call = conn->getCall();
+	HttpClientPool *pool = conn->getPool();
+
+	if(conn->getState() == HTTP_CLIENT_CONNECTION_STATE_DONE) {
+		// keep the connection for the next call to the
+		// same destination before completing this one
+		bool reusable = conn->isReusable();
+		conn->endCall();
+		if(reusable && pool->idleConnections.size() < m_maxIdleConnections) {
+			pool->idleConnections.push_back(conn);
+			watchConnection(conn);
+		} else {
+			deleteConnection(conn);
+		}
+
+		if(call != NULL)
+			completeCall(call, "");
+	} else if(conn->getState() == HTTP_CLIENT_CONNECTION_STATE_FAILED) {
+		// a reused connection may have been closed by the other
+		// server while it was idle, so requests that can be
+		// repeated are retried once on a new connection
+		string error = conn->getError();
+		bool retry = (call != NULL && conn->isReused() && conn->hasReceived() == false &&
+		              call->isRetryable());
+		if(call != NULL)
+			conn->endCall();
+		deleteConnection(conn);
+
+		if(retry) {
+			while(pool->idleConnections.empty() == false) {
+				deleteConnection(pool->idleConnections.back());
+			}
+			startCall(call);
+		} else if(call != NULL) {
+			completeCall(call, error);
+		}
+	} else {
+		watchConnection(conn);
+	}
+}
+
+void
+HttpClientImpl::deleteConnection(HttpClientConnection *conn)
+{
+	vector <HttpClientConnection *> &idleConnections = conn->getPool()->idleConnections;
+	for(unsigned int i = 0; i < idleConnections.size(); ++i) {
+		if(idleConnections[i] == conn) {
+			idleConnections.erase(idleConnections.begin() + i);
+			break;
+		}
+	}
+
+	int fd = conn->getFileDescriptor();
+	if(m_server != NULL)
+		m_server->unwatchDescriptor(fd);
+	m_connections[fd] = NULL;
+	delete conn;
+}
+
+HttpClientCall *
+HttpClientImpl::request(const string &verb, const string &url, const HttpClientHeaderMap &headers,
+                        const string &body, HttpResponse *response, HttpClientHandler *handler)
+{
+	HttpClientCallImpl *call = new HttpClientCallImpl(this, response, handler);
+	if(m_server == NULL) {
+		call->setError("The server isn't running");
+		call->finish();
+		return call;
+	}
+
+	string host, hostHeader, target;
+	unsigned short port;
+	if(parseUrl(url, &host, &port, &hostHeader, &target) == false) {
+		failLater(call, "The URL isn't supported: " + url);
+		return call;
+	}
+
+	string requestData = verb + " " + target + " HTTP/1.1\r\n";
+	bool hasHost = false;
+	bool hasLength = false;
+	HttpClientHeaderMap::const_iterator iter = headers.begin();
+	while(iter != headers.end()) {
+		if(iter->first.find_first_of("\r\n:") != string::npos ||
+		   iter->second.find_first_of("\r\n") != string::npos) {
+			failLater(call, "The request has an invalid header");
+			return call;
+		}
+
+		string name = String::toLower(iter->first);
+		if(name == "host")
+			hasHost = true;
+		else if(name == "content-length")
+			hasLength = true;
+
+		requestData += iter->first + ": " + iter->second + "\r\n";
+		++iter;
+	}
+
+	if(hasHost == false)
+		requestData += "Host: " + hostHeader + "\r\n";
+	if(hasLength == false && (body.length() != 0 || verb == "POST" || verb == "PUT" || verb == "PATCH"))
+		requestData += "Content-Length: " + String::fromUInt((unsigned int)body.length()) + "\r\n";
+	requestData += "\r\n";
+	requestData += body;
+
+	HttpClientPool *pool = getPool(host, port);
+	if(pool == NULL) {
+		failLater(call, "Unable to resolve " + host);
+		return call;
+	}
+
+	bool retryable = (verb == "GET" || verb == "HEAD" || verb == "OPTIONS" || verb == "PUT" || verb == "DELETE");
+	call->setRequest(pool, requestData, verb == "HEAD", retryable);
+	setTimer(call, getMilliseconds() + m_timeout);
+	startCall(call);
+	return call;
+}
+
+HttpClientCall *
+HttpClientImpl::get(const string &url, HttpResponse *response, HttpClientHandler *handler)
+{
+	return request("GET", url, HttpClientHeaderMap(), "", response, handler);
+}
+
+void
+HttpClientImpl::setTimeout(long timeout)
+{
+	m_timeout = timeout;
+}
+
+void
+HttpClientImpl::setMaxResponseSize(size_t maxResponseSize)
+{
+	m_maxResponseSize = maxResponseSize;
+}
+
+void
+HttpClientImpl::setMaxIdleConnections(unsigned int maxIdleConnections)
+{
+	m_maxIdleConnections = maxIdleConnections;
+}
+
+void
+HttpClientImpl::descriptorReady(int fd, int events)
+{
+	if(fd >= (int)m_connections.size() || m_connections[fd] == NULL)
+		return;
+
+	HttpClientConnection *conn = m_connections[fd];
+	if(conn->getState() == HTTP_CLIENT_CONNECTION_STATE_CONNECTING)
+		conn->finishConnecting();
+
+	if(conn->getState() != HTTP_CLIENT_CONNECTION_STATE_FAILED) {
+		if(events & POLLER_EVENT_WRITE)
+			conn->flushOutput();
+		if(events & POLLER_EVENT_READ)
+			conn->doRead();
+	}
+
+	updateConnection(conn);
+}
+
+long
+HttpClientImpl::getTimerTime() const
+{
+	return m_timers.empty() ? -1 : m_timers.begin()->first;
+}
+
+void
+HttpClientImpl::timerExpired(long currentTime)
+{
+	// completing a call may start or cancel others,
+	// so the earliest timer is checked each time
+	while(m_timers.empty() == false && m_timers.begin()->first <= currentTime) {
+		HttpClientCallImpl *call = m_timers.begin()->second;
+		setTimer(call, -1);
+
+		HttpClientConnection *conn = call->getConnection();
+		if(conn != NULL) {
+			conn->endCall();
+			deleteConnection(conn);
+		}
+
+		string error = call->getError();
+		completeCall(call, (error.length() != 0) ? error : "The request timed out");
+	}
+}
+
+void
+HttpClientImpl::detached()
+{
+	// calls still in progress fail without notice,
+	// since their responses are gone with the server
+	while(m_timers.empty() == false) {
+		HttpClientCallImpl *call = m_timers.begin()->second;
+		setTimer(call, -1);
+		call->setError("The server stopped");
+		call->finish();
+	}
+
+	for(unsigned int i = 0; i < m_connections.size(); ++i) {
+		if(m_connections[i] != NULL)
+			deleteConnection(m_connections[i]);
+	}
+
+	m_server = NULL;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HTTPCLIENTIMPL_H__
+#define __HTTPCLIENTIMPL_H__
+
+#include <map>
+#include <set>
+#include <vector>
+#include <xviweb/HttpClient.h>
+#include "ChunkedDecoder.h"
+#include "Connection.h"
+#include "Server.h"
+
+class HttpClientImpl;
+class HttpClientCallImpl;
+class HttpClientConnection;
+
+// the connections to a single destination (host and port); its address
+// is resolved once, when the first request is made to it
+class HttpClientPool
+{
+	public:
+		std::string host;
+		Address address;
+		unsigned short port;
+		std::vector <HttpClientConnection *> idleConnections;
+
+		HttpClientPool(const std::string &hostValue, const Address &addressValue, unsigned short portValue);
+};
+
+typedef std::map<std::string, HttpClientPool *> HttpClientPoolMap;
+
+enum HttpClientConnectionState
+{
+	HTTP_CLIENT_CONNECTION_STATE_CONNECTING = 0,
+	HTTP_CLIENT_CONNECTION_STATE_IDLE,
+	HTTP_CLIENT_CONNECTION_STATE_STATUS,
+	HTTP_CLIENT_CONNECTION_STATE_HEADERS,
+	HTTP_CLIENT_CONNECTION_STATE_BODY,
+	HTTP_CLIENT_CONNECTION_STATE_DONE,
+	HTTP_CLIENT_CONNECTION_STATE_FAILED
+};
+
+enum HttpClientBodyType
+{
+	HTTP_CLIENT_BODY_LENGTH = 0,
+	HTTP_CLIENT_BODY_CHUNKED,
+	HTTP_CLIENT_BODY_UNTIL_CLOSED
+};
+
+class HttpClientConnection : public Connection
+{
+	private:
+		HttpClientPool *m_pool;
+		HttpClientCallImpl *m_call;
+		HttpClientConnectionState m_state;
+		std::string m_error;
+
+		// whether a call has been completed on the connection
+		// before, and whether any of the current one's response
+		// has been received; a reused connection that's closed
+		// before anything's received may have timed out while idle
+		bool m_reused;
+		bool m_received;
+
+		bool m_keepAlive;
+		HttpClientBodyType m_bodyType;
+		uint64_t m_bodyRemaining;
+		ChunkedDecoder m_chunkedDecoder;
+		size_t m_maxResponseSize;
+
+		void fail(const std::string &error);
+		void headersRead();
+		void bodyRead(const char *data, size_t length);
+
+	protected:
+		void closed();
+		void inputRead();
+		void lineRead(const std::string &line);
+		bool isReadingLines() const;
+		size_t dataRead(char *data, size_t length);
+
+	public:
+		HttpClientConnection(HttpClientPool *pool, size_t maxResponseSize);
+
+		HttpClientPool *getPool() const;
+		HttpClientCallImpl *getCall() const;
+		HttpClientConnectionState getState() const;
+		const std::string &getError() const;
+		bool isReused() const;
+		bool hasReceived() const;
+		bool isReusable() const;
+		int getPollEvents() const;
+
+		void beginCall(HttpClientCallImpl *call);
+		void finishConnecting();
+		void endCall();
+};
+
+class HttpClientCallImpl : public HttpClientCall
+{
+	private:
+		HttpClientImpl *m_client;
+		HttpResponse *m_response;
+		HttpClientHandler *m_handler;
+
+		HttpClientPool *m_pool;
+		std::string m_requestData;
+		bool m_headRequest;
+		bool m_retryable;
+		HttpClientConnection *m_connection;
+		long m_timerTime;
+
+		bool m_done;
+		std::string m_error;
+		int m_statusCode;
+		std::string m_statusMessage;
+		HttpClientHeaderMap m_headerMap;
+		std::string m_body;
+
+	public:
+		HttpClientCallImpl(HttpClientImpl *client, HttpResponse *response, HttpClientHandler *handler);
+		~HttpClientCallImpl();
+
+		HttpResponse *getResponse() const;
+		HttpClientHandler *getHandler() const;
+
+		HttpClientPool *getPool() const;
+		const std::string &getRequestData() const;
+		bool isHeadRequest() const;
+		bool isRetryable() const;
+		void setRequest(HttpClientPool *pool, const std::string &requestData, bool headRequest, bool retryable);
+
+		HttpClientConnection *getConnection() const;
+		void setConnection(HttpClientConnection *connection);
+
+		long getTimerTime() const;
+		void setTimerTime(long timerTime);
+
+		void setStatus(int statusCode, const std::string &statusMessage);
+		void addHeaderValue(const std::string &headerName, const std::string &headerValue);
+		void appendBody(const char *data, size_t length);
+		void clearResponse();
+		void setError(const std::string &error);
+		void finish();
+
+		// HttpClientCall
+		bool isDone() const;
+		bool hasFailed() const;
+		std::string getError() const;
+		int getStatusCode() const;
+		std::string getStatusMessage() const;
+		std::string getHeaderValue(const std::string &headerName) const;
+		const std::string &getBody() const;
+};
+
+typedef std::set<std::pair<long, HttpClientCallImpl *> > HttpClientTimerSet;
+
+class HttpClientImpl : public HttpClient, public ServerEventSource
+{
+	private:
+		Server *m_server;
+		long m_timeout;
+		size_t m_maxResponseSize;
+		unsigned int m_maxIdleConnections;
+
+		HttpClientPoolMap m_pools;
+		std::vector <HttpClientConnection *> m_connections;
+		HttpClientTimerSet m_timers;
+
+		HttpClientPool *getPool(const std::string &host, unsigned short port);
+		void setTimer(HttpClientCallImpl *call, long timerTime);
+		void failLater(HttpClientCallImpl *call, const std::string &error);
+		void startCall(HttpClientCallImpl *call);
+		void completeCall(HttpClientCallImpl *call, const std::string &error);
+		void watchConnection(HttpClientConnection *conn);
+		void updateConnection(HttpClientConnection *conn);
+		void deleteConnection(HttpClientConnection *conn);
+
+	public:
+		HttpClientImpl();
+		~HttpClientImpl();
+
+		static HttpClientImpl *getInstance();
+		void attach(Server *server);
+		void cancelCall(HttpClientCallImpl *call);
+
+		// HttpClient
+		HttpClientCall *request(const std::string &verb, const std::string &url, const HttpClientHeaderMap &headers, const std::string &body, HttpResponse *response, HttpClientHandler *handler = NULL);
+		HttpClientCall *get(const std::string &url, HttpResponse *response, HttpClientHandler *handler = NULL);
+		void setTimeout(long timeout);
+		void setMaxResponseSize(size_t maxResponseSize);
+		void setMaxIdleConnections(unsigned int maxIdleConnections);
+
+		// ServerEventSource
+		void descriptorReady(int fd, int events);
+		long getTimerTime() const;
+		void timerExpired(long currentTime);
+		void detached();
+};
+
+#endif /* __HTTPCLIENTIMPL_H__ */
@@ -34,15 +34,43 @@ HttpConnection::HttpConnection(int fd, const Address &address,
                                unsigned short port)
  : Connection(fd, address, port)
 {
-	m_state = HTTP_CONNECTION_STATE_AWAITING_REQUEST;
-	m_bytesRead = 0;
-	m_contentLength = 0;
+	m_maxHeaderSize = 8 * 1024;
+	m_maxBodySize = 1024 * 1024;
+	m_uploadDirectory = "/tmp";
+	m_uploadMemoryThreshold = 64 * 1024;
+	m_bodyContext = NULL;
+	m_firstRequest = true;
+	m_upgrade = NULL;
+
+	resetRequest();
+}
+
+// a connection for a stream carried over the given connection,
+// whose requests are given to it rather than read from it
+HttpConnection::HttpConnection(const HttpConnection *carrier)
+ : Connection(carrier)
+{
+	m_maxHeaderSize = carrier->m_maxHeaderSize;
+	m_maxBodySize = carrier->m_maxBodySize;
+	m_uploadDirectory = carrier->m_uploadDirectory;
+	m_uploadMemoryThreshold = carrier->m_uploadMemoryThreshold;
+	m_bodyContext = NULL;
+	m_firstRequest = false;
+	m_upgrade = NULL;
+
+	resetRequest();
 }
 
 HttpConnection::~HttpConnection()
 {
 }
 
+uint32_t
+HttpConnection::getStreamId() const
+{
+	return 0;
+}
+
 HttpConnectionState
 HttpConnection::getState() const
 {
@@ -55,72 +83,324 @@ HttpConnection::getRequest()
 	return &m_request;
 }
 
+bool
+HttpConnection::isKeepAlive() const
+{
+	return m_keepAlive;
+}
+
+void
+HttpConnection::setKeepAlive(bool keepAlive)
+{
+	m_keepAlive = keepAlive;
+}
+
+void
+HttpConnection::setMaxHeaderSize(unsigned int maxHeaderSize)
+{
+	m_maxHeaderSize = maxHeaderSize;
+}
+
+void
+HttpConnection::setMaxBodySize(uint64_t maxBodySize)
+{
+	m_maxBodySize = maxBodySize;
+}
+
+void
+HttpConnection::setUploadDirectory(const string &uploadDirectory)
+{
+	m_uploadDirectory = uploadDirectory;
+}
+
+void
+HttpConnection::setUploadMemoryThreshold(size_t uploadMemoryThreshold)
+{
+	m_uploadMemoryThreshold = uploadMemoryThreshold;
+}
+
+void
+HttpConnection::resetRequest()
+{
+	m_state = HTTP_CONNECTION_STATE_AWAITING_REQUEST;
+	m_request.reset();
+	m_bytesRead = 0;
+	m_contentLength = 0;
+	m_bodyBytesRead = 0;
+	m_chunked = false;
+	m_streamBody = false;
+	m_inputEnded = false;
+	m_bodyContext = NULL;
+	m_keepAlive = false;
+	m_responding = false;
+
+	// a low watermark set for a response doesn't
+	// apply to the ones that follow it
+	setNotSentLowWatermark(0);
+
+	// the idle timeout applies from the end of the
+	// response rather than from the previous request
+	resetReadTimer();
+}
+
+bool
+HttpConnection::hasBody() const
+{
+	return (m_chunked || m_streamBody || m_contentLength != 0);
+}
+
 void
 HttpConnection::closed()
 {
 	m_state = HTTP_CONNECTION_STATE_DONE;
 }
 
+void
+HttpConnection::readBody(ResponderContext *bodyContext)
+{
+	m_bodyContext = bodyContext;
+	if(m_bodyContext == NULL)
+		m_request.beginBody(m_uploadDirectory, m_uploadMemoryThreshold);
+
+	if(hasBody() == false) {
+		bodyEnded();
+		return;
+	}
+
+	// let the client know that it can send the body
+	if(m_responding == false && String::containsToken(m_request.getHeaderValue("Expect"), "100-continue"))
+		sendContinueResponse();
+
+	m_state = HTTP_CONNECTION_STATE_READING_BODY;
+
+	// a stream's body may have ended with nothing left to read
+	if(m_streamBody && m_inputEnded && m_line.length() == 0)
+		bodyEnded();
+}
+
+void
+HttpConnection::sendContinueResponse()
+{
+	sendString("HTTP/1.1 100 Continue\r\n\r\n");
+}
+
+bool
+HttpConnection::isReadingBody() const
+{
+	return (m_state == HTTP_CONNECTION_STATE_READING_BODY);
+}
+
+void
+HttpConnection::setBodyContext(ResponderContext *bodyContext)
+{
+	m_bodyContext = bodyContext;
+}
+
+// the body that's arrived is left in the input buffer while the
+// context streaming it isn't ready for more, and the connection
+// isn't read from until it is
+bool
+HttpConnection::isBodyHeld() const
+{
+	return (m_bodyContext != NULL && m_bodyContext->isReadyForRequestBody() == false);
+}
+
+// passes along the body that was held, once the context is ready
+// for it; returns true if any of it was
+bool
+HttpConnection::resumeBody()
+{
+	size_t length = m_line.length();
+	if(m_state != HTTP_CONNECTION_STATE_READING_BODY || length == 0 || isBodyHeld())
+		return false;
+
+	processInput();
+	return (m_line.length() != length);
+}
+
 void
 HttpConnection::beginResponse()
 {
-	m_state = HTTP_CONNECTION_STATE_SENDING_RESPONSE;
+	m_responding = true;
+
+	// a responder that streams the request body may
+	// respond before all of the body has been read
+	if(m_state != HTTP_CONNECTION_STATE_RECEIVED_HEADERS &&
+	   m_state != HTTP_CONNECTION_STATE_READING_BODY)
+		m_state = HTTP_CONNECTION_STATE_SENDING_RESPONSE;
 }
 
 void
 HttpConnection::endResponse()
 {
+	// the connection can't be reused if the
+	// request body hasn't been read completely
+	if(m_state == HTTP_CONNECTION_STATE_READING_BODY ||
+	   (m_state == HTTP_CONNECTION_STATE_RECEIVED_HEADERS && hasBody()))
+		m_keepAlive = false;
+
+	// wait for another request if the connection
+	// is persistent, otherwise close it
+	if(m_keepAlive)
+		resetRequest();
+	else
+		m_state = HTTP_CONNECTION_STATE_DONE;
+}
+
+void
+HttpConnection::abort()
+{
+	// drop the connection without sending anything else
+	clearOutput();
 	m_state = HTTP_CONNECTION_STATE_DONE;
 }
 
 void
-HttpConnection::sendBadRequestResponse()
+HttpConnection::upgrade(HttpConnectionUpgrade *upgrade)
+{
+	// the rest of the input, including anything that
+	// arrived along with the request, belongs to the
+	// new protocol; it's handled by processInput
+	m_upgrade = upgrade;
+	m_keepAlive = false;
+	m_state = HTTP_CONNECTION_STATE_UPGRADED;
+}
+
+void
+HttpConnection::endUpgrade()
+{
+	// output that's still queued is sent before
+	// the connection is closed
+	m_upgrade = NULL;
+	m_state = HTTP_CONNECTION_STATE_DONE;
+}
+
+void
+HttpConnection::sendErrorResponse(int errorCode, const char *errorDesc,
+                                  const char *errorMessage)
 {
-	sendString("HTTP/1.1 400 Bad Request\r\n");
+	sendString("HTTP/1.1 " + String::fromInt(errorCode) + " " + errorDesc + "\r\n");
+	sendString("Connection: close\r\n");
 	sendString("Content-Type: text/plain\r\n");
 
-	string message = "Your request could not be understood.";
+	string message = errorMessage;
 	sendString("Content-Length: " + String::fromInt(message.length()) + "\r\n");
-	sendString("\r\n" + message + "\r\n");
+	sendString("\r\n" + message);
 
-	cout << toString() << ": Bad request" << endl;
+	cout << toString() << ": " << errorDesc << endl;
+	m_keepAlive = false;
 	endResponse();
 }
 
 void
-HttpConnection::postDataRead(const string &s)
+HttpConnection::sendBadRequestResponse()
 {
-	m_postData += s;
+	sendErrorResponse(400, "Bad Request", "Your request could not be understood.");
+}
 
-	// parse post data if all of it has been read
-	if(m_postData.length() == m_contentLength) {
-		if(m_request.parsePostData(m_postData) == false)
-			sendBadRequestResponse();
-		else
-			m_state = HTTP_CONNECTION_STATE_RECEIVED_REQUEST;
-	} else if(m_postData.length() > m_contentLength) {
+void
+HttpConnection::bodyDataRead(const char *data, size_t length)
+{
+	m_bodyBytesRead += length;
+	if(m_maxBodySize != 0 && m_bodyBytesRead > m_maxBodySize) {
+		// a response can only be sent if one hasn't
+		// already been started
+		if(m_responding) {
+			m_state = HTTP_CONNECTION_STATE_DONE;
+			cerr << toString() << ": Maximum request body size exceeded" << endl;
+		} else {
+			sendErrorResponse(413, "Request Entity Too Large", "The request body is too large.");
+		}
+		return;
+	}
+
+	if(m_bodyContext != NULL)
+		m_bodyContext->requestBodyRead(data, length);
+	else if(m_request.bodyDataRead(data, length) == false)
 		sendBadRequestResponse();
+}
+
+void
+HttpConnection::bodyEnded()
+{
+	// a context that streams the body is already responding
+	// to the request, so there's nothing left to dispatch
+	if(m_bodyContext != NULL) {
+		m_state = HTTP_CONNECTION_STATE_SENDING_RESPONSE;
+		m_bodyContext->requestBodyEnded();
+		return;
 	}
+
+	if(m_request.bodyEnded() == false)
+		sendBadRequestResponse();
+	else
+		m_state = HTTP_CONNECTION_STATE_RECEIVED_REQUEST;
 }
 
 void
-HttpConnection::stringRead(const string &s)
+HttpConnection::inputRead()
 {
-	const unsigned int maxRequestSize = 8 * 1024;
+	// make sure that an incomplete line isn't
+	// buffered past the maximum header size
+	if(isReadingLines() && m_bytesRead + m_line.length() > m_maxHeaderSize)
+		sendErrorResponse(431, "Request Header Fields Too Large", "The request headers are too large.");
+}
 
-	m_bytesRead += s.length();
-	if(m_bytesRead > maxRequestSize) {
-		m_state = HTTP_CONNECTION_STATE_DONE;
-		cerr << toString() << ": Maximum request size exceeded" << endl;
+static bool
+parseContentLength(const string &value, uint64_t *length)
+{
+	string s = String::trim(value);
+	if(s.length() == 0 || s.length() > 18)
+		return false;
+
+	uint64_t n = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		if(s[i] < '0' || s[i] > '9')
+			return false;
+		n = (n * 10) + (uint64_t)(s[i] - '0');
 	}
 
-	if(m_state == HTTP_CONNECTION_STATE_READING_POST_DATA)
-		postDataRead(s);
+	*length = n;
+	return true;
+}
+
+// called by a stream once its request's headers have been given
+// to it; the body, if there is one, ends with the stream's input
+void
+HttpConnection::requestHeadersReceived(bool hasBody)
+{
+	m_streamBody = hasBody;
+	m_inputEnded = (hasBody == false);
+	m_state = HTTP_CONNECTION_STATE_RECEIVED_HEADERS;
+
+	// the content length is only checked against the limit
+	string contentLength = m_request.getHeaderValue("Content-Length");
+	uint64_t length;
+	if(contentLength.length() != 0) {
+		if(parseContentLength(contentLength, &length) == false)
+			sendBadRequestResponse();
+		else if(m_maxBodySize != 0 && length > m_maxBodySize)
+			sendErrorResponse(413, "Request Entity Too Large", "The request body is too large.");
+	}
+}
+
+void
+HttpConnection::requestInputEnded()
+{
+	m_inputEnded = true;
+	if(m_state == HTTP_CONNECTION_STATE_READING_BODY && m_line.length() == 0)
+		bodyEnded();
 }
 
 void
 HttpConnection::lineRead(const string &line)
 {
+	m_bytesRead += line.length() + 2;
+	if(m_bytesRead > m_maxHeaderSize) {
+		sendErrorResponse(431, "Request Header Fields Too Large", "The request headers are too large.");
+		return;
+	}
+
 	// perform the appropriate action based on the current state
 	switch(m_state) {
 		default:
@@ -129,6 +409,21 @@ HttpConnection::lineRead(const string &line)
 		// parse the first line of the request containing
 		// the verb, path, and HTTP version
 		case HTTP_CONNECTION_STATE_AWAITING_REQUEST:
+			// ignore blank lines preceding the request
+			if(line.size() == 0) {
+				m_bytesRead = 0;
+				break;
+			}
+
+			// a client that knows the server speaks HTTP/2
+			// starts the connection with its preface, the rest
+			// of which is read by the server's HTTP/2 session
+			if(m_firstRequest && line == "PRI * HTTP/2.0") {
+				m_state = HTTP_CONNECTION_STATE_RECEIVED_PREFACE;
+				break;
+			}
+
+			m_firstRequest = false;
 			if(m_request.parseRequestLine(line) == false) {
 				sendBadRequestResponse();
 			} else {
@@ -140,14 +435,46 @@ HttpConnection::lineRead(const string &line)
 		// parse headers until a blank line is received
 		case HTTP_CONNECTION_STATE_READING_HEADERS:
 			if(line.size() == 0) {
-				if(m_request.getVerb() == "POST") {
-					// start reading post data
-					m_state = HTTP_CONNECTION_STATE_READING_POST_DATA;
-					m_contentLength = String::toUInt(m_request.getHeaderValue("Content-Length"));
-					postDataRead(m_line);
-				} else {
-					m_state = HTTP_CONNECTION_STATE_RECEIVED_REQUEST;
+				// HTTP/1.1 connections persist unless the client
+				// asks otherwise; HTTP/1.0 ones must ask to persist
+				string connection = m_request.getHeaderValue("Connection");
+				if(m_request.getVersion() == "HTTP/1.1")
+					m_keepAlive = !String::containsToken(connection, "close");
+				else
+					m_keepAlive = String::containsToken(connection, "keep-alive");
+
+				// determine how the body, if any, is delimited;
+				// the transfer coding takes precedence over the
+				// content length, and chunked is the only coding
+				// that's decoded, so a body in any other coding
+				// (even one that's chunked after it) is refused
+				string transferEncoding = String::trim(String::toLower(m_request.getHeaderValue("Transfer-Encoding")));
+				string contentLength = m_request.getHeaderValue("Content-Length");
+				if(transferEncoding.length() != 0) {
+					if(transferEncoding != "chunked") {
+						sendErrorResponse(501, "Not Implemented", "The request's transfer coding is not supported.");
+						break;
+					}
+
+					m_chunked = true;
+					m_chunkedDecoder.reset();
+					if(contentLength.length() != 0)
+						m_keepAlive = false;
+				} else if(contentLength.length() != 0) {
+					if(parseContentLength(contentLength, &m_contentLength) == false) {
+						sendBadRequestResponse();
+						break;
+					}
+
+					if(m_maxBodySize != 0 && m_contentLength > m_maxBodySize) {
+						sendErrorResponse(413, "Request Entity Too Large", "The request body is too large.");
+						break;
+					}
 				}
+
+				// the server decides how the body is read
+				// once it knows who's responding
+				m_state = HTTP_CONNECTION_STATE_RECEIVED_HEADERS;
 			} else {
 				if(m_request.parseHeaderLine(line) == false)
 					sendBadRequestResponse();
@@ -155,3 +482,92 @@ HttpConnection::lineRead(const string &line)
 			break;
 	}
 }
+
+// requests pipelined behind the one being responded to are
+// buffered until it's done, but no more than the maximum header
+// size of them, so that a client that sends requests without
+// reading the responses can't make the buffer grow without bound;
+// a body is read unless it's being held for its context
+bool
+HttpConnection::isInputFull() const
+{
+	if(m_state == HTTP_CONNECTION_STATE_READING_BODY)
+		return isBodyHeld();
+	if(isReadingLines() || m_state == HTTP_CONNECTION_STATE_UPGRADED)
+		return false;
+
+	return (m_line.length() >= m_maxHeaderSize);
+}
+
+bool
+HttpConnection::isReadingLines() const
+{
+	return (m_state == HTTP_CONNECTION_STATE_AWAITING_REQUEST ||
+	        m_state == HTTP_CONNECTION_STATE_READING_HEADERS);
+}
+
+size_t
+HttpConnection::dataRead(char *data, size_t length)
+{
+	if(m_state == HTTP_CONNECTION_STATE_UPGRADED)
+		return m_upgrade->upgradedDataRead(data, length);
+	if(m_state != HTTP_CONNECTION_STATE_READING_BODY || isBodyHeld())
+		return 0;
+
+	// a stream's input is all its request's body
+	if(m_streamBody) {
+		bodyDataRead(data, length);
+		if(m_inputEnded && m_state == HTTP_CONNECTION_STATE_READING_BODY)
+			bodyEnded();
+
+		return length;
+	}
+
+	// only consume the request's own data; anything
+	// after it belongs to the next request
+	if(m_chunked == false) {
+		uint64_t remaining = m_contentLength - m_bodyBytesRead;
+		if(length > remaining)
+			length = (size_t)remaining;
+
+		bodyDataRead(data, length);
+		if(m_state == HTTP_CONNECTION_STATE_READING_BODY && m_bodyBytesRead == m_contentLength)
+			bodyEnded();
+
+		return length;
+	}
+
+	// decode as much as possible of the chunked body;
+	// chunk data is passed along without being copied
+	size_t consumed = 0;
+	while(consumed < length && m_state == HTTP_CONNECTION_STATE_READING_BODY) {
+		const char *chunk;
+		size_t chunkLength;
+		size_t n = m_chunkedDecoder.decode(data + consumed, length - consumed, &chunk, &chunkLength);
+		if(m_chunkedDecoder.hasError()) {
+			if(m_responding)
+				m_state = HTTP_CONNECTION_STATE_DONE;
+			else
+				sendBadRequestResponse();
+			break;
+		}
+
+		if(n == 0)
+			break;
+		consumed += n;
+
+		if(chunkLength != 0)
+			bodyDataRead(chunk, chunkLength);
+
+		if(m_chunkedDecoder.isDone()) {
+			// trailers are kept apart from the request's headers
+			const vector <string> &trailers = m_chunkedDecoder.getTrailerLines();
+			for(unsigned int i = 0; i < trailers.size(); ++i)
+				m_request.parseTrailerLine(trailers[i]);
+
+			bodyEnded();
+		}
+	}
+
+	return consumed;
+}
@@ -26,46 +26,115 @@
 #ifndef __HTTPCONNECTION_H__
 #define __HTTPCONNECTION_H__
 
+#include <xviweb/Responder.h>
 #include "Connection.h"
+#include "ChunkedDecoder.h"
 #include "HttpRequestImpl.h"
 
 enum HttpConnectionState
 {
 	HTTP_CONNECTION_STATE_AWAITING_REQUEST = 0,
 	HTTP_CONNECTION_STATE_READING_HEADERS,
-	HTTP_CONNECTION_STATE_READING_POST_DATA,
+	HTTP_CONNECTION_STATE_RECEIVED_HEADERS,
+	HTTP_CONNECTION_STATE_READING_BODY,
 	HTTP_CONNECTION_STATE_RECEIVED_REQUEST,
 	HTTP_CONNECTION_STATE_SENDING_RESPONSE,
+	HTTP_CONNECTION_STATE_UPGRADED,
+	HTTP_CONNECTION_STATE_RECEIVED_PREFACE,
 	HTTP_CONNECTION_STATE_DONE
 };
 
+// takes over the input of a connection that has switched
+// from HTTP to another protocol; returns the number of bytes
+// consumed, which may be modified in place
+class HttpConnectionUpgrade
+{
+	public:
+		virtual ~HttpConnectionUpgrade() {}
+
+		virtual size_t upgradedDataRead(char *data, size_t length) = 0;
+};
+
 class HttpConnection : public Connection
 {
 	private:
 		HttpConnectionState m_state;
 		HttpRequestImpl m_request;
 		unsigned int m_bytesRead;
-		unsigned int m_contentLength;
-		std::string m_postData;
+		unsigned int m_maxHeaderSize;
+		uint64_t m_maxBodySize;
+		std::string m_uploadDirectory;
+		size_t m_uploadMemoryThreshold;
+		uint64_t m_contentLength;
+		uint64_t m_bodyBytesRead;
+		bool m_chunked;
+		ChunkedDecoder m_chunkedDecoder;
+
+		// the body of a request on a stream (e.g. HTTP/2) is
+		// everything read until the end of the stream
+		bool m_streamBody;
+		bool m_inputEnded;
+
+		ResponderContext *m_bodyContext;
+		bool m_keepAlive;
+		bool m_responding;
+		bool m_firstRequest;
+		HttpConnectionUpgrade *m_upgrade;
+
+		void resetRequest();
+		void bodyDataRead(const char *data, size_t length);
+		void bodyEnded();
+		bool isBodyHeld() const;
+
+	protected:
+		HttpConnection(const HttpConnection *carrier);
+
+		void requestHeadersReceived(bool hasBody);
+		void requestInputEnded();
+		virtual void sendContinueResponse();
 
 	public:
 		HttpConnection(int fd, const Address &address, unsigned short port);
 		virtual ~HttpConnection();
 
+		// the ID of the stream the connection is for, or 0
+		// if it's a connection of its own
+		virtual uint32_t getStreamId() const;
+
 		HttpConnectionState getState() const;
 		HttpRequestImpl *getRequest();
 
+		bool isKeepAlive() const;
+		void setKeepAlive(bool keepAlive);
+
+		void setMaxHeaderSize(unsigned int maxHeaderSize);
+		void setMaxBodySize(uint64_t maxBodySize);
+		void setUploadDirectory(const std::string &uploadDirectory);
+		void setUploadMemoryThreshold(size_t uploadMemoryThreshold);
+
+		bool hasBody() const;
+		void readBody(ResponderContext *bodyContext);
+		bool isReadingBody() const;
+		void setBodyContext(ResponderContext *bodyContext);
+		bool resumeBody();
+
 		void beginResponse();
 		void endResponse();
-		void sendResponse(int responseCode, const char *responseDesc, const char *contentType, const char *content);
-		void sendErrorResponse(int errorCode, const char *errorDesc, const char *errorMessage);
+		void abort();
+		virtual void sendErrorResponse(int errorCode, const char *errorDesc, const char *errorMessage);
 		void sendBadRequestResponse();
 
+		void upgrade(HttpConnectionUpgrade *upgrade);
+		void endUpgrade();
+
+		virtual bool isInputFull() const;
+
 	protected:
 		virtual void closed();
-		void postDataRead(const std::string &s);
-		virtual void stringRead(const std::string &s);
+		virtual void inputRead();
 		virtual void lineRead(const std::string &line);
+		virtual bool isReadingLines() const;
+		virtual size_t dataRead(char *data, size_t length);
 };
 
 #endif /* __HTTPCONNECTION_H__ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdlib>
+#include <unistd.h>
+#include "HttpRequestFileImpl.h"
+
+using namespace std;
+
+HttpRequestFileImpl::HttpRequestFileImpl(const string &fieldName,
+                                         const string &fileName,
+                                         const string &contentType)
+ : m_fieldName(fieldName), m_fileName(fileName), m_contentType(contentType)
+{
+	m_size = 0;
+	m_fd = -1;
+}
+
+HttpRequestFileImpl::~HttpRequestFileImpl()
+{
+	close();
+
+	// remove the temporary file; this fails harmlessly
+	// if a responder has already moved it
+	if(m_path.length() != 0)
+		unlink(m_path.c_str());
+}
+
+string
+HttpRequestFileImpl::getFieldName() const
+{
+	return m_fieldName;
+}
+
+string
+HttpRequestFileImpl::getFileName() const
+{
+	return m_fileName;
+}
+
+string
+HttpRequestFileImpl::getContentType() const
+{
+	return m_contentType;
+}
+
+uint64_t
+HttpRequestFileImpl::getSize() const
+{
+	return m_size;
+}
+
+string
+HttpRequestFileImpl::getPath() const
+{
+	return m_path;
+}
+
+bool
+HttpRequestFileImpl::create(const string &directory)
+{
+	string path = directory + "/xviweb-upload-XXXXXX";
+	char *tmp = new char[path.length() + 1];
+	path.copy(tmp, path.length());
+	tmp[path.length()] = '\0';
+
+	m_fd = mkstemp(tmp);
+	if(m_fd != -1)
+		m_path = tmp;
+
+	delete [] tmp;
+	return (m_fd != -1);
+}
+
+bool
+HttpRequestFileImpl::write(const char *data, size_t length)
+{
+	m_size += length;
+
+	while(length != 0) {
+		ssize_t n = ::write(m_fd, data, length);
+		if(n == -1)
+			return false;
+
+		data += n;
+		length -= (size_t)n;
+	}
+
+	return true;
+}
+
+void
+HttpRequestFileImpl::close()
+{
+	if(m_fd != -1) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
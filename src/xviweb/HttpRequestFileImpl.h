@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HTTPREQUESTFILEIMPL_H__
+#define __HTTPREQUESTFILEIMPL_H__
+
+#include <vector>
+#include <xviweb/HttpRequestFile.h>
+
+class HttpRequestFileImpl : public HttpRequestFile
+{
+	private:
+		std::string m_fieldName;
+		std::string m_fileName;
+		std::string m_contentType;
+		std::string m_path;
+		uint64_t m_size;
+		int m_fd;
+
+		HttpRequestFileImpl(const HttpRequestFileImpl &);
+		HttpRequestFileImpl &operator=(const HttpRequestFileImpl &);
+
+	public:
+		HttpRequestFileImpl(const std::string &fieldName, const std::string &fileName, const std::string &contentType);
+		virtual ~HttpRequestFileImpl();
+
+		std::string getFieldName() const;
+		std::string getFileName() const;
+		std::string getContentType() const;
+		uint64_t getSize() const;
+		std::string getPath() const;
+
+		bool create(const std::string &directory);
+		bool write(const char *data, size_t length);
+		void close();
+};
+
+typedef std::vector<HttpRequestFileImpl *> HttpRequestFileList;
+
+#endif /* __HTTPREQUESTFILEIMPL_H__ */
@@ -29,6 +29,44 @@
 
 using namespace std;
 
+HttpRequestImpl::HttpRequestImpl()
+{
+	m_multipartParser = NULL;
+}
+
+HttpRequestImpl::~HttpRequestImpl()
+{
+	reset();
+}
+
+void
+HttpRequestImpl::reset()
+{
+	m_verb.clear();
+	m_path.clear();
+	m_version.clear();
+	m_queryString.clear();
+	m_vhostRoot.clear();
+	m_body.clear();
+
+	m_queryStringMap.clear();
+	m_headerMap.clear();
+	m_trailerMap.clear();
+	m_postDataMap.clear();
+	m_pathParameterMap.clear();
+
+	if(m_multipartParser != NULL) {
+		delete m_multipartParser;
+		m_multipartParser = NULL;
+	}
+
+	// deleting the files removes any that are still
+	// stored in the upload directory
+	for(unsigned int i = 0; i < m_files.size(); ++i)
+		delete m_files[i];
+	m_files.clear();
+}
+
 string
 HttpRequestImpl::getVerb() const
 {
@@ -53,6 +91,12 @@ HttpRequestImpl::getVHostRoot() const
 	return m_vhostRoot;
 }
 
+string
+HttpRequestImpl::getQueryString() const
+{
+	return m_queryString;
+}
+
 string
 HttpRequestImpl::getQueryStringValue(const string &name) const
 {
@@ -60,6 +104,20 @@ HttpRequestImpl::getQueryStringValue(const string &name) const
 	return (iter != m_queryStringMap.end()) ? iter->second : string("");
 }
 
+vector <string>
+HttpRequestImpl::getHeaderNames() const
+{
+	// header names are stored in lowercase
+	vector <string> names;
+	HttpRequestMap::const_iterator iter = m_headerMap.begin();
+	while(iter != m_headerMap.end()) {
+		names.push_back(iter->first);
+		++iter;
+	}
+
+	return names;
+}
+
 string
 HttpRequestImpl::getHeaderValue(const string &name) const
 {
@@ -67,6 +125,27 @@ HttpRequestImpl::getHeaderValue(const string &name) const
 	return (iter != m_headerMap.end()) ? iter->second : string("");
 }
 
+vector <string>
+HttpRequestImpl::getTrailerNames() const
+{
+	// trailer names are stored in lowercase
+	vector <string> names;
+	HttpRequestMap::const_iterator iter = m_trailerMap.begin();
+	while(iter != m_trailerMap.end()) {
+		names.push_back(iter->first);
+		++iter;
+	}
+
+	return names;
+}
+
+string
+HttpRequestImpl::getTrailerValue(const string &name) const
+{
+	HttpRequestMap::const_iterator iter = m_trailerMap.find(String::toLower(name));
+	return (iter != m_trailerMap.end()) ? iter->second : string("");
+}
+
 string
 HttpRequestImpl::getPostDataValue(const string &name) const
 {
@@ -74,6 +153,37 @@ HttpRequestImpl::getPostDataValue(const string &name) const
 	return (iter != m_postDataMap.end()) ? iter->second : string("");
 }
 
+string
+HttpRequestImpl::getBody() const
+{
+	return m_body;
+}
+
+const HttpRequestFile *
+HttpRequestImpl::getFile(const string &name) const
+{
+	string lowerName = String::toLower(name);
+	for(unsigned int i = 0; i < m_files.size(); ++i) {
+		if(m_files[i]->getFieldName() == lowerName)
+			return m_files[i];
+	}
+
+	return NULL;
+}
+
+vector <const HttpRequestFile *>
+HttpRequestImpl::getFiles() const
+{
+	return vector <const HttpRequestFile *>(m_files.begin(), m_files.end());
+}
+
+string
+HttpRequestImpl::getPathParameter(const string &name) const
+{
+	HttpRequestMap::const_iterator iter = m_pathParameterMap.find(name);
+	return (iter != m_pathParameterMap.end()) ? iter->second : string("");
+}
+
 static void
 parseKeyValuePair(HttpRequestMap &map, const string &pair)
 {
@@ -106,28 +216,38 @@ HttpRequestImpl::parseRequestLine(const string &line)
 	size_t end = line.find(' ');
 	if(end == 0 || end == string::npos)
 		return false;
-	m_verb = line.substr(0, end);
+	string verb = line.substr(0, end);
 
 	// parse the path
 	size_t start = end + 1;
 	end = line.find(' ', start);
 	if(end == string::npos)
 		return false;
-	m_path = line.substr(start, end - start);
-	if(m_path[0] != '/')
-		return false;
+	string target = line.substr(start, end - start);
 
 	// parse the HTTP version
-	start = end + 1;
-	m_version = line.substr(start);
+	return setRequestTarget(verb, target, line.substr(end + 1));
+}
+
+// sets the parts of the request line, which for HTTP/2
+// requests are sent as separate fields
+bool
+HttpRequestImpl::setRequestTarget(const string &verb, const string &target,
+                                  const string &version)
+{
+	m_verb = verb;
+	m_path = target;
+	m_version = version;
+	if(m_path.length() == 0 || m_path[0] != '/')
+		return false;
 
 	// parse the query string from the path, if necessary
-	start = m_path.find('?');
+	size_t start = m_path.find('?');
 	if(start != string::npos) {
-		string queryString = m_path.substr(start + 1);
+		m_queryString = m_path.substr(start + 1);
 		m_path = m_path.substr(0, start);
 
-		parseKeyValueList(m_queryStringMap, queryString);
+		parseKeyValueList(m_queryStringMap, m_queryString);
 	}
 
 	return true;
@@ -146,12 +266,52 @@ HttpRequestImpl::parseHeaderLine(const string &line)
 	size_t start = end + 2;
 	string value = line.substr(start);
 
-	// add the name/value pair to the header map
-	m_headerMap.insert(make_pair(String::toLower(name), value));
+	// add the name/value pair to the header map; the codings of
+	// a body are combined, as they're all applied to it
+	name = String::toLower(name);
+	if(name == "transfer-encoding")
+		addHeaderValue(name, value);
+	else
+		m_headerMap.insert(make_pair(name, value));
 
 	return true;
 }
 
+// adds a header whose name is already in lowercase; fields with
+// the same name are combined, as cookies split across HTTP/2
+// fields are
+void
+HttpRequestImpl::addHeaderValue(const string &name, const string &value)
+{
+	HttpRequestMap::iterator iter = m_headerMap.find(name);
+	if(iter == m_headerMap.end())
+		m_headerMap.insert(make_pair(name, value));
+	else
+		iter->second += ((name == "cookie") ? "; " : ", ") + value;
+}
+
+bool
+HttpRequestImpl::parseTrailerLine(const string &line)
+{
+	size_t end = line.find(':');
+	if(end == 0 || end == string::npos)
+		return false;
+
+	addTrailerValue(String::toLower(line.substr(0, end)), String::trim(line.substr(end + 1)));
+	return true;
+}
+
+// adds a trailer whose name is already in lowercase
+void
+HttpRequestImpl::addTrailerValue(const string &name, const string &value)
+{
+	HttpRequestMap::iterator iter = m_trailerMap.find(name);
+	if(iter == m_trailerMap.end())
+		m_trailerMap.insert(make_pair(name, value));
+	else
+		iter->second += ", " + value;
+}
+
 bool
 HttpRequestImpl::parsePostData(const string &line)
 {
@@ -159,8 +319,51 @@ HttpRequestImpl::parsePostData(const string &line)
 	return true;
 }
 
+void
+HttpRequestImpl::beginBody(const string &uploadDirectory,
+                           size_t uploadMemoryThreshold)
+{
+	// multipart bodies are parsed as they arrive rather than
+	// being buffered, since they may contain large files
+	string boundary;
+	if(MultipartParser::getBoundary(getHeaderValue("Content-Type"), &boundary))
+		m_multipartParser = new MultipartParser(boundary, uploadDirectory, uploadMemoryThreshold, m_postDataMap, m_files);
+}
+
+bool
+HttpRequestImpl::bodyDataRead(const char *data, size_t length)
+{
+	if(m_multipartParser != NULL)
+		return m_multipartParser->parse(data, length);
+
+	m_body.append(data, length);
+	return true;
+}
+
+bool
+HttpRequestImpl::bodyEnded()
+{
+	if(m_multipartParser != NULL) {
+		bool complete = m_multipartParser->finish();
+		delete m_multipartParser;
+		m_multipartParser = NULL;
+		return complete;
+	}
+
+	if(m_verb == "POST")
+		return parsePostData(m_body);
+
+	return true;
+}
+
 void
 HttpRequestImpl::setVHostRoot(const string &root)
 {
 	m_vhostRoot = root;
 }
+
+void
+HttpRequestImpl::setPathParameter(const string &name, const string &value)
+{
+	m_pathParameterMap[name] = value;
+}
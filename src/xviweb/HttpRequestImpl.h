@@ -28,6 +28,8 @@
 
 #include <map>
 #include <xviweb/HttpRequest.h>
+#include "HttpRequestFileImpl.h"
+#include "MultipartParser.h"
 
 typedef std::map<std::string, std::string> HttpRequestMap;
 
@@ -37,25 +39,56 @@ class HttpRequestImpl : public HttpRequest
 		std::string m_verb;
 		std::string m_path;
 		std::string m_version;
+		std::string m_queryString;
 		std::string m_vhostRoot;
+		std::string m_body;
 
 		HttpRequestMap m_queryStringMap;
 		HttpRequestMap m_headerMap;
+		HttpRequestMap m_trailerMap;
 		HttpRequestMap m_postDataMap;
+		HttpRequestMap m_pathParameterMap;
+		HttpRequestFileList m_files;
+		MultipartParser *m_multipartParser;
+
+		HttpRequestImpl(const HttpRequestImpl &);
+		HttpRequestImpl &operator=(const HttpRequestImpl &);
 
 	public:
+		HttpRequestImpl();
+		virtual ~HttpRequestImpl();
+
+		void reset();
+
 		std::string getVerb() const;
 		std::string getPath() const;
 		std::string getVersion() const;
 		std::string getVHostRoot() const;
+		std::string getQueryString() const;
 		std::string getQueryStringValue(const std::string &name) const;
+		std::vector <std::string> getHeaderNames() const;
 		std::string getHeaderValue(const std::string &name) const;
+		std::vector <std::string> getTrailerNames() const;
+		std::string getTrailerValue(const std::string &name) const;
 		std::string getPostDataValue(const std::string &name) const;
+		std::string getBody() const;
+		const HttpRequestFile *getFile(const std::string &name) const;
+		std::vector <const HttpRequestFile *> getFiles() const;
+		std::string getPathParameter(const std::string &name) const;
 
 		bool parseRequestLine(const std::string &line);
 		bool parseHeaderLine(const std::string &line);
+		bool setRequestTarget(const std::string &verb, const std::string &target, const std::string &version);
+		void addHeaderValue(const std::string &name, const std::string &value);
+		bool parseTrailerLine(const std::string &line);
+		void addTrailerValue(const std::string &name, const std::string &value);
 		bool parsePostData(const std::string &line);
+
+		void beginBody(const std::string &uploadDirectory, size_t uploadMemoryThreshold);
+		bool bodyDataRead(const char *data, size_t length);
+		bool bodyEnded();
 		void setVHostRoot(const std::string &root);
+		void setPathParameter(const std::string &name, const std::string &value);
 };
 
 #endif /* __HTTPREQUESTIMPL_H__ */
@@ -23,16 +23,43 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cerrno>
 #include <cstring>
+#include <unistd.h>
 #include <xviweb/String.h>
+#include "Http2Session.h"
 #include "HttpResponseImpl.h"
+#include "Util.h"
 
 using namespace std;
 
-HttpResponseImpl::HttpResponseImpl(HttpConnection *conn)
+HttpResponseImpl::HttpResponseImpl(HttpConnection *conn, HttpResponseWakeList *wakeList)
 {
 	m_conn = conn;
+	m_stream = (conn->getStreamId() != 0) ? static_cast<Http2Stream *>(conn) : NULL;
 	m_responding = false;
+	m_chunked = false;
+	m_sendBody = true;
+
+	m_cacheFill = NULL;
+	m_capturing = false;
+	m_captureComplete = false;
+	m_captureLimit = 0;
+
+	m_compressionLevel = 0;
+	m_compressionMinSize = 0;
+	m_compressionDictionary = NULL;
+	m_compressor = NULL;
+	m_flushList = NULL;
+	m_flushPending = false;
+
+	m_wakeWhenWritable = false;
+	m_wakeWhenBodyRead = false;
+	m_sleeping = false;
+	m_wakeupTime = -1;
+	m_notifier = NULL;
+	m_wakeList = wakeList;
+	m_woken = false;
 
 	// set some default values
 	setStatus(200, "OK");
@@ -40,6 +67,18 @@ HttpResponseImpl::HttpResponseImpl(HttpConnection *conn)
 	setContentType("text/html");
 }
 
+HttpResponseImpl::~HttpResponseImpl()
+{
+	delete m_compressor;
+
+	// other threads may still hold the notifier, so it's only
+	// detached from its descriptor here and freed once released
+	if(m_notifier != NULL) {
+		m_notifier->detach();
+		m_notifier->release();
+	}
+}
+
 int
 HttpResponseImpl::getStatusCode() const
 {
@@ -83,6 +122,12 @@ HttpResponseImpl::setContentLength(int contentLength)
 	setHeaderValue("Content-Length", String::fromInt(contentLength));
 }
 
+void
+HttpResponseImpl::setContentLength(uint64_t contentLength)
+{
+	setHeaderValue("Content-Length", String::fromUInt64(contentLength));
+}
+
 string
 HttpResponseImpl::getHeaderValue(const string &headerName) const
 {
@@ -101,7 +146,19 @@ HttpResponseImpl::setHeaderValue(const string &headerName,
 		m_headerMap.erase(iter);
 
 	// insert the new header value
-	m_headerMap.insert(make_pair(headerName, headerValue));
+	if(headerValue.length() != 0)
+		m_headerMap.insert(make_pair(headerName, headerValue));
+}
+
+void
+HttpResponseImpl::setTrailerValue(const string &trailerName,
+                                  const string &trailerValue)
+{
+	HttpResponseMap::iterator iter = m_trailerMap.find(trailerName);
+	if(iter != m_trailerMap.end())
+		m_trailerMap.erase(iter);
+
+	m_trailerMap.insert(make_pair(trailerName, trailerValue));
 }
 
 void
@@ -116,35 +173,244 @@ HttpResponseImpl::redirect(const string &location)
 	endResponse();
 }
 
+bool
+HttpResponseImpl::statusAllowsBody() const
+{
+	return !((m_statusCode >= 100 && m_statusCode < 200) ||
+	         m_statusCode == 204 || m_statusCode == 304);
+}
+
+// responses that say they're for a single client, that set cookies
+// or that can't be told apart from errors aren't cached
+bool
+HttpResponseImpl::isCacheable() const
+{
+	if(m_statusCode != 200 && m_statusCode != 203 && m_statusCode != 300 &&
+	   m_statusCode != 301 && m_statusCode != 404 && m_statusCode != 410)
+		return false;
+
+	string cacheControl = String::toLower(getHeaderValue("Cache-Control"));
+	return (getHeaderValue("Set-Cookie").length() == 0 &&
+	        String::containsToken(cacheControl, "no-store") == false &&
+	        String::containsToken(cacheControl, "no-cache") == false &&
+	        String::containsToken(cacheControl, "private") == false &&
+	        String::trim(getHeaderValue("Vary")) != "*" && m_trailerMap.empty());
+}
+
+void
+HttpResponseImpl::captureBody(const char *data, size_t length)
+{
+	if(m_capturedBody.length() + length > m_captureLimit) {
+		m_capturing = false;
+		string().swap(m_capturedBody);
+		return;
+	}
+
+	m_capturedBody.append(data, length);
+}
+
+// adds a request header to those the response depends on
 void
-HttpResponseImpl::beginResponse()
+HttpResponseImpl::addVary(const string &name)
+{
+	string vary = String::trim(getHeaderValue("Vary"));
+	if(vary.length() == 0)
+		setHeaderValue("Vary", name);
+	else if(vary != "*" && String::containsToken(vary, name) == false)
+		setHeaderValue("Vary", vary + ", " + name);
+}
+
+// compresses the body if the response and the client allow it
+void
+HttpResponseImpl::startCompression()
+{
+	// bodies that are already encoded or that are
+	// asked not to be transformed are sent as they are
+	if(m_compressionLevel <= 0 || m_sendBody == false ||
+	   m_headerMap.find("Content-Encoding") != m_headerMap.end() ||
+	   ResponseCompressor::isCompressible(getContentType()) == false ||
+	   String::containsToken(getHeaderValue("Cache-Control"), "no-transform"))
+		return;
+
+	HttpResponseMap::iterator iter = m_headerMap.find("Content-Length");
+	if(iter != m_headerMap.end() && String::toUInt64(iter->second) < m_compressionMinSize)
+		return;
+
+	// the body depends on what the client accepts and on the
+	// dictionaries it has, whether or not this one's compressed
+	addVary("Accept-Encoding");
+	if(m_compressionDictionary != NULL)
+		addVary("Available-Dictionary");
+
+	const HttpRequest *request = m_conn->getRequest();
+	string acceptEncoding = request->getHeaderValue("Accept-Encoding");
+	for(int i = 0; i < RESPONSE_ENCODING_COUNT && m_compressor == NULL; ++i) {
+		ResponseEncoding encoding = (ResponseEncoding)i;
+		if(ResponseCompressor::isSupported(encoding) == false ||
+		   String::acceptsToken(acceptEncoding, ResponseCompressor::getName(encoding)) == false)
+			continue;
+		if(encoding == RESPONSE_ENCODING_DCZ && (m_compressionDictionary == NULL ||
+		   m_compressionDictionary->isAvailable(request->getHeaderValue("Available-Dictionary")) == false))
+			continue;
+
+		try {
+			m_compressor = new ResponseCompressor(encoding, m_compressionLevel, m_compressionDictionary);
+		} catch(const char *) {
+			return;
+		}
+	}
+
+	if(m_compressor == NULL)
+		return;
+
+	// the body's length isn't known until it's been compressed,
+	// and its bytes are no longer the ones that its tag is for
+	setHeaderValue("Content-Length", "");
+	setHeaderValue("Content-Encoding", ResponseCompressor::getName(m_compressor->getEncoding()));
+	string etag = getHeaderValue("ETag");
+	if(etag.length() != 0 && etag[0] == '"')
+		setHeaderValue("ETag", "W/" + etag);
+}
+
+void
+HttpResponseImpl::beginResponse(bool compress)
 {
 	m_responding = true;
 	m_conn->beginResponse();
 
-	// send status code/message
-	string status = "HTTP/1.1 " + String::fromInt(m_statusCode) + " " + m_statusMessage + "\r\n";
-	sendString(status);
+	const HttpRequestImpl *request = m_conn->getRequest();
+	m_sendBody = (request->getVerb() != "HEAD" && statusAllowsBody());
+	if(m_capturing && isCacheable() == false)
+		m_capturing = false;
+
+	// only bodies that are sent as strings are compressed; files
+	// are sent as they are, in precompressed variants if they have them
+	if(compress)
+		startCompression();
+
+	if(m_stream != NULL) {
+		HpackHeaderList headers;
+		headers.push_back(make_pair(string(":status"), String::fromInt(m_statusCode)));
+		HttpResponseMap::iterator iter = m_headerMap.begin();
+		while(iter != m_headerMap.end()) {
+			Http2Stream::addResponseHeader(&headers, iter->first, iter->second);
+			++iter;
+		}
+
+		m_stream->sendHeaders(headers);
+		return;
+	}
+
+	// a responder may ask for the connection to be closed
+	string connection = String::toLower(getHeaderValue("Connection"));
+	if(connection.find("close") != string::npos)
+		m_conn->setKeepAlive(false);
+
+	// a body of unknown length is sent in chunks if the client
+	// supports it; otherwise, its end is marked by closing the
+	// connection, so the connection can't be kept alive
+	if(m_sendBody && m_headerMap.find("Content-Length") == m_headerMap.end()) {
+		if(request->getVersion() == "HTTP/1.1") {
+			m_chunked = true;
+			setHeaderValue("Transfer-Encoding", "chunked");
+
+			// announce the trailers that are already known
+			string trailers;
+			HttpResponseMap::iterator iter = m_trailerMap.begin();
+			while(iter != m_trailerMap.end()) {
+				if(trailers.length() != 0)
+					trailers += ", ";
+				trailers += iter->first;
+				++iter;
+			}
+			if(trailers.length() != 0)
+				setHeaderValue("Trailer", trailers);
+		} else {
+			m_conn->setKeepAlive(false);
+		}
+	}
+
+	if(m_conn->isKeepAlive() == false)
+		setHeaderValue("Connection", "close");
+	else if(request->getVersion() != "HTTP/1.1")
+		setHeaderValue("Connection", "keep-alive");
 
-	// send headers
+	// build the status line and headers so that
+	// they can be sent all at once
+	string head = "HTTP/1.1 " + String::fromInt(m_statusCode) + " " + m_statusMessage + "\r\n";
 	HttpResponseMap::iterator iter = m_headerMap.begin();
 	while(iter != m_headerMap.end()) {
-		string header = iter->first + ": " + iter->second + "\r\n";
-		sendString(header);
+		head += iter->first + ": " + iter->second + "\r\n";
 		++iter;
 	}
 
-	// send empty line between headers and response body
-	sendString("\r\n");
+	// add empty line between headers and response body
+	head += "\r\n";
+	m_conn->sendString(head);
+}
+
+void
+HttpResponseImpl::compress(const char *data, size_t length, ResponseCompressorFlush flush)
+{
+	string output;
+	try {
+		m_compressor->compress(data, length, flush, &output);
+	} catch(const char *) {
+		abortResponse();
+		return;
+	}
+
+	sendBody(output.data(), output.length());
+
+	// what the compressor's holding back is sent
+	// before the server next waits for events
+	if(flush == RESPONSE_COMPRESSOR_NO_FLUSH && m_flushPending == false && m_flushList != NULL) {
+		m_flushPending = true;
+		m_flushList->push_back(make_pair(m_conn->getFileDescriptor(), m_conn->getStreamId()));
+	}
 }
 
 void
 HttpResponseImpl::sendString(const char *s, size_t length)
 {
 	if(m_responding == false)
-		beginResponse();
+		beginResponse(true);
+
+	if(m_sendBody == false || length == 0)
+		return;
+
+	if(m_compressor != NULL)
+		compress(s, length, RESPONSE_COMPRESSOR_NO_FLUSH);
+	else
+		sendBody(s, length);
+}
 
-	m_conn->sendString(s, length);
+void
+HttpResponseImpl::sendBody(const char *s, size_t length)
+{
+	// a zero-length chunk would end the response early
+	if(length == 0)
+		return;
+
+	if(m_capturing)
+		captureBody(s, length);
+
+	if(m_chunked) {
+		// frame the data as a chunk; the data itself is
+		// passed to the connection without being copied
+		string size = String::hexFromUInt((unsigned int)length) + "\r\n";
+
+		struct iovec buffers[3];
+		buffers[0].iov_base = (void *)size.data();
+		buffers[0].iov_len = size.length();
+		buffers[1].iov_base = (void *)s;
+		buffers[1].iov_len = length;
+		buffers[2].iov_base = (void *)"\r\n";
+		buffers[2].iov_len = 2;
+		m_conn->sendBuffers(buffers, 3);
+	} else {
+		m_conn->sendString(s, length);
+	}
 }
 
 void
@@ -171,6 +437,40 @@ HttpResponseImpl::sendLine(const string &line)
 	sendString(line + "\r\n");
 }
 
+void
+HttpResponseImpl::sendFile(int fd, uint64_t offset, size_t length)
+{
+	if(m_responding == false)
+		beginResponse();
+
+	if(m_sendBody == false || length == 0)
+		return;
+
+	// the body of a response that's kept for the cache or
+	// compressed is needed right away, so the file's read for it
+	if(m_capturing || m_compressor != NULL) {
+		string data(length, '\0');
+		ssize_t readLength;
+		do {
+			readLength = pread(fd, &data[0], length, (off_t)offset);
+		} while(readLength == -1 && errno == EINTR);
+
+		if(readLength == (ssize_t)length)
+			sendString(data);
+		else
+			abortResponse();
+		return;
+	}
+
+	if(m_chunked) {
+		m_conn->sendString(String::hexFromUInt((unsigned int)length) + "\r\n");
+		m_conn->sendFile(fd, offset, length);
+		m_conn->sendString("\r\n", 2);
+	} else {
+		m_conn->sendFile(fd, offset, length);
+	}
+}
+
 void
 HttpResponseImpl::sendResponse(int statusCode, const char *statusMessage,
                                const char *contentType, const char *content)
@@ -180,11 +480,11 @@ HttpResponseImpl::sendResponse(int statusCode, const char *statusMessage,
 	// set the status, content type, and content length
 	setStatus(statusCode, statusMessage);
 	setContentType(contentType);
-	setContentLength(strlen(content));
+	setContentLength((int)strlen(content));
 
 	// send content
 	sendString(content);
-	m_conn->endResponse();
+	endResponse();
 }
 
 void
@@ -222,5 +522,340 @@ HttpResponseImpl::endResponse()
 	if(m_responding == false)
 		beginResponse();
 
+	if(m_compressor != NULL) {
+		compress(NULL, 0, RESPONSE_COMPRESSOR_FINISH);
+		delete m_compressor;
+		m_compressor = NULL;
+	}
+
+	if(m_stream != NULL) {
+		// the trailers end the stream
+		HpackHeaderList trailers;
+		HttpResponseMap::iterator iter = m_trailerMap.begin();
+		while(m_sendBody && iter != m_trailerMap.end()) {
+			Http2Stream::addResponseHeader(&trailers, iter->first, iter->second);
+			++iter;
+		}
+
+		m_stream->endStream(trailers);
+	} else if(m_chunked) {
+		// send the last chunk followed by the trailers
+		string last = "0\r\n";
+		HttpResponseMap::iterator iter = m_trailerMap.begin();
+		while(iter != m_trailerMap.end()) {
+			last += iter->first + ": " + iter->second + "\r\n";
+			++iter;
+		}
+
+		last += "\r\n";
+		m_conn->sendString(last);
+		m_chunked = false;
+	}
+
+	if(m_capturing && m_trailerMap.empty())
+		m_captureComplete = true;
+	m_conn->endResponse();
+}
+
+size_t
+HttpResponseImpl::getSendCapacity() const
+{
+	return m_conn->getOutputCapacity();
+}
+
+void
+HttpResponseImpl::setNotSentLowWatermark(unsigned int bytes)
+{
+	m_conn->setNotSentLowWatermark(bytes);
+}
+
+void
+HttpResponseImpl::wakeWhenWritable()
+{
+	m_wakeWhenWritable = true;
+}
+
+void
+HttpResponseImpl::wakeWhenBodyRead()
+{
+	m_wakeWhenBodyRead = true;
+}
+
+void
+HttpResponseImpl::wakeAfter(long milliseconds)
+{
+	long wakeupTime = getMilliseconds() + milliseconds;
+	if(m_wakeupTime == -1 || wakeupTime < m_wakeupTime)
+		m_wakeupTime = wakeupTime;
+}
+
+void
+HttpResponseImpl::wakeWhenReady(int fd, int events)
+{
+	// merge the events of a descriptor that's
+	// already being waited on
+	for(unsigned int i = 0; i < m_descriptors.size(); ++i) {
+		if(m_descriptors[i].first == fd) {
+			m_descriptors[i].second |= events;
+			return;
+		}
+	}
+
+	m_descriptors.push_back(make_pair(fd, events));
+}
+
+void
+HttpResponseImpl::sleep()
+{
+	m_sleeping = true;
+}
+
+void
+HttpResponseImpl::wake()
+{
+	if(m_woken || m_wakeList == NULL)
+		return;
+
+	m_woken = true;
+	m_wakeList->push_back(make_pair(m_conn->getFileDescriptor(), m_conn->getStreamId()));
+}
+
+ResponderNotifier *
+HttpResponseImpl::getNotifier()
+{
+	if(m_notifier == NULL) {
+		try {
+			m_notifier = new ResponderNotifierImpl();
+		} catch(const char *) {
+			return NULL;
+		}
+	}
+
+	return m_notifier;
+}
+
+bool
+HttpResponseImpl::isWaitingForEvents() const
+{
+	return (m_wakeWhenWritable || m_wakeWhenBodyRead || m_sleeping || m_wakeupTime != -1 ||
+	        m_notifier != NULL || !m_descriptors.empty());
+}
+
+bool
+HttpResponseImpl::isWaitingForWritable() const
+{
+	return m_wakeWhenWritable;
+}
+
+long
+HttpResponseImpl::getWakeupTime() const
+{
+	return m_wakeupTime;
+}
+
+const HttpResponseDescriptorList &
+HttpResponseImpl::getDescriptors() const
+{
+	return m_descriptors;
+}
+
+int
+HttpResponseImpl::getNotifierFileDescriptor() const
+{
+	if(m_notifier == NULL)
+		return -1;
+
+	return m_notifier->getFileDescriptor();
+}
+
+void
+HttpResponseImpl::clearNotifications()
+{
+	if(m_notifier != NULL)
+		m_notifier->clearNotifications();
+}
+
+void
+HttpResponseImpl::clearWakeups()
+{
+	m_wakeWhenWritable = false;
+	m_wakeWhenBodyRead = false;
+	m_sleeping = false;
+	m_wakeupTime = -1;
+	m_descriptors.clear();
+}
+
+bool
+HttpResponseImpl::isWoken() const
+{
+	return m_woken;
+}
+
+void
+HttpResponseImpl::clearWoken()
+{
+	m_woken = false;
+}
+
+void
+HttpResponseImpl::sendSharedChunk(SharedBuffer *chunk, size_t dataOffset, size_t dataLength)
+{
+	if(m_responding == false)
+		beginResponse(true);
+
+	// the buffer holds the data already framed as
+	// a chunk, which is only sent as is when the
+	// response is chunked and isn't compressed
+	if(m_compressor != NULL) {
+		if(m_sendBody)
+			compress(chunk->getData() + dataOffset, dataLength, RESPONSE_COMPRESSOR_NO_FLUSH);
+		return;
+	}
+
+	if(m_capturing && m_sendBody)
+		captureBody(chunk->getData() + dataOffset, dataLength);
+
+	if(m_chunked)
+		m_conn->sendSharedBuffer(chunk, 0, chunk->getLength());
+	else if(m_sendBody)
+		m_conn->sendSharedBuffer(chunk, dataOffset, dataLength);
+}
+
+// sends a response from the response cache; the buffer holds its
+// status line and headers, including its Content-Length, followed
+// by its body, and is shared with every response sending it
+void
+HttpResponseImpl::sendCachedResponse(SharedBuffer *buffer, size_t headLength, long age)
+{
+	m_responding = true;
+	m_conn->beginResponse();
+
+	const HttpRequestImpl *request = m_conn->getRequest();
+	if(m_stream != NULL) {
+		HpackHeaderList headers;
+		headers.push_back(make_pair(string("age"), String::fromInt((int)age)));
+		m_stream->sendHead(buffer->getData(), headLength, headers);
+		if(request->getVerb() != "HEAD")
+			m_conn->sendSharedBuffer(buffer, headLength, buffer->getLength() - headLength);
+
+		m_stream->endStream(HpackHeaderList());
+		m_conn->endResponse();
+		return;
+	}
+
+	string head = "Age: " + String::fromInt((int)age) + "\r\n";
+	if(m_conn->isKeepAlive() == false)
+		head += "Connection: close\r\n";
+	else if(request->getVersion() != "HTTP/1.1")
+		head += "Connection: keep-alive\r\n";
+	head += "\r\n";
+
+	m_conn->sendSharedBuffer(buffer, 0, headLength);
+	m_conn->sendString(head);
+	if(request->getVerb() != "HEAD")
+		m_conn->sendSharedBuffer(buffer, headLength, buffer->getLength() - headLength);
+
+	m_conn->endResponse();
+}
+
+// sends a complete response that's shared by every connection
+// it's sent on, and closes the connection once it's been sent
+// (or just ends the stream, for HTTP/2)
+void
+HttpResponseImpl::sendPrebuiltResponse(SharedBuffer *buffer, size_t headLength)
+{
+	m_responding = true;
+	if(m_stream != NULL) {
+		m_conn->beginResponse();
+		m_stream->sendHead(buffer->getData(), headLength, HpackHeaderList());
+		if(m_conn->getRequest()->getVerb() != "HEAD")
+			m_conn->sendSharedBuffer(buffer, headLength, buffer->getLength() - headLength);
+
+		m_stream->endStream(HpackHeaderList());
+		m_conn->endResponse();
+		return;
+	}
+
+	m_conn->setKeepAlive(false);
+	m_conn->beginResponse();
+
+	size_t length = buffer->getLength();
+	if(m_conn->getRequest()->getVerb() == "HEAD")
+		length = headLength;
+	m_conn->sendSharedBuffer(buffer, 0, length);
+
 	m_conn->endResponse();
 }
+
+void
+HttpResponseImpl::setCompression(int level, size_t minSize, const ResponseDictionary *dictionary, HttpResponseWakeList *flushList)
+{
+	m_compressionLevel = level;
+	m_compressionMinSize = minSize;
+	m_compressionDictionary = dictionary;
+	m_flushList = flushList;
+}
+
+// sends what the compressor's been holding back, so
+// that the client has all that's been sent so far
+void
+HttpResponseImpl::flush()
+{
+	m_flushPending = false;
+	if(m_compressor != NULL)
+		compress(NULL, 0, RESPONSE_COMPRESSOR_SYNC_FLUSH);
+}
+
+const HttpResponseMap &
+HttpResponseImpl::getHeaders() const
+{
+	return m_headerMap;
+}
+
+// keeps a copy of the response's body for the response cache
+// until it's larger than the limit or turns out not to be
+// cacheable; the fill is handed back to the cache once the
+// response is deleted
+void
+HttpResponseImpl::startCapture(ResponseCacheFill *cacheFill, size_t captureLimit)
+{
+	m_cacheFill = cacheFill;
+	m_capturing = true;
+	m_captureLimit = captureLimit;
+}
+
+ResponseCacheFill *
+HttpResponseImpl::getCacheFill() const
+{
+	return m_cacheFill;
+}
+
+bool
+HttpResponseImpl::isCaptureComplete() const
+{
+	return m_captureComplete;
+}
+
+const string &
+HttpResponseImpl::getCapturedBody() const
+{
+	return m_capturedBody;
+}
+
+void
+HttpResponseImpl::abortResponse()
+{
+	m_conn->abort();
+}
+
+size_t
+HttpResponseImpl::getOutputSize() const
+{
+	return m_conn->getOutputSize();
+}
+
+HttpConnection *
+HttpResponseImpl::getConnection()
+{
+	return m_conn;
+}
@@ -27,26 +27,83 @@
 #define __HTTPRESPONSEIMPL_H__
 
 #include <map>
+#include <vector>
 #include <xviweb/HttpResponse.h>
 #include "HttpConnection.h"
+#include "ResponderNotifierImpl.h"
+#include "ResponseCompressor.h"
+
+class Http2Stream;
+class ResponseCacheFill;
 
 typedef std::map<std::string, std::string> HttpResponseMap;
 
+// descriptors and stream IDs (0 if they aren't streams) of the
+// connections whose responses have been woken
+typedef std::vector<std::pair<int, uint32_t> > HttpResponseWakeList;
+
+// descriptors that a context is waiting on and the events it's
+// waiting for (see HttpResponseDescriptorEvent)
+typedef std::vector<std::pair<int, int> > HttpResponseDescriptorList;
+
 class HttpResponseImpl : public HttpResponse
 {
 	private:
 		HttpConnection *m_conn;
+
+		// HTTP/2 streams frame the response themselves
+		Http2Stream *m_stream;
 		bool m_responding;
+		bool m_chunked;
+		bool m_sendBody;
 
 		int m_statusCode;
 		std::string m_statusMessage;
 
 		HttpResponseMap m_headerMap;
-
-		void beginResponse();
+		HttpResponseMap m_trailerMap;
+
+		// the body of a response being kept for the response cache
+		ResponseCacheFill *m_cacheFill;
+		bool m_capturing;
+		bool m_captureComplete;
+		size_t m_captureLimit;
+		std::string m_capturedBody;
+
+		// the body's compressed as it's sent if it's of a type worth
+		// compressing, the client accepts an encoding it can be in
+		// and it isn't known to be shorter than the minimum size;
+		// what the compressor holds back is flushed before the
+		// server next waits for events; clients that have the
+		// dictionary are sent bodies compressed with it
+		int m_compressionLevel;
+		size_t m_compressionMinSize;
+		const ResponseDictionary *m_compressionDictionary;
+		ResponseCompressor *m_compressor;
+		HttpResponseWakeList *m_flushList;
+		bool m_flushPending;
+
+		bool m_wakeWhenWritable;
+		bool m_wakeWhenBodyRead;
+		bool m_sleeping;
+		long m_wakeupTime;
+		HttpResponseDescriptorList m_descriptors;
+		ResponderNotifierImpl *m_notifier;
+		HttpResponseWakeList *m_wakeList;
+		bool m_woken;
+
+		void beginResponse(bool compress = false);
+		bool statusAllowsBody() const;
+		bool isCacheable() const;
+		void captureBody(const char *data, size_t length);
+		void addVary(const std::string &name);
+		void startCompression();
+		void compress(const char *data, size_t length, ResponseCompressorFlush flush);
+		void sendBody(const char *data, size_t length);
 
 	public:
-		HttpResponseImpl(HttpConnection *conn);
+		HttpResponseImpl(HttpConnection *conn, HttpResponseWakeList *wakeList = NULL);
+		~HttpResponseImpl();
 
 		int getStatusCode() const;
 		std::string getStatusMessage() const;
@@ -57,9 +114,11 @@ class HttpResponseImpl : public HttpResponse
 
 		int getContentLength() const;
 		void setContentLength(int contentLength);
+		void setContentLength(uint64_t contentLength);
 
 		std::string getHeaderValue(const std::string &headerName) const;
 		void setHeaderValue(const std::string &headerName, const std::string &headerValue);
+		void setTrailerValue(const std::string &trailerName, const std::string &trailerValue);
 
 		void redirect(const std::string &location);
 
@@ -68,11 +127,49 @@ class HttpResponseImpl : public HttpResponse
 		void sendString(const std::string &s);
 		void sendLine(const char *line);
 		void sendLine(const std::string &line);
+		void sendFile(int fd, uint64_t offset, size_t length);
 
 		void sendResponse(int statusCode, const char *statusMessage, const char *contentType, const char *content);
 		void sendErrorResponse(int errorCode, const char *errorDesc, const char *errorMessage);
 
 		void endResponse();
+		void abortResponse();
+
+		size_t getSendCapacity() const;
+		void setNotSentLowWatermark(unsigned int bytes);
+
+		void wakeWhenWritable();
+		void wakeWhenBodyRead();
+		void wakeAfter(long milliseconds);
+		ResponderNotifier *getNotifier();
+		void wakeWhenReady(int fd, int events);
+		void sleep();
+		void wake();
+
+		bool isWaitingForEvents() const;
+		bool isWaitingForWritable() const;
+		long getWakeupTime() const;
+		const HttpResponseDescriptorList &getDescriptors() const;
+		int getNotifierFileDescriptor() const;
+		void clearNotifications();
+		void clearWakeups();
+		bool isWoken() const;
+		void clearWoken();
+
+		void sendSharedChunk(SharedBuffer *chunk, size_t dataOffset, size_t dataLength);
+		void sendCachedResponse(SharedBuffer *buffer, size_t headLength, long age);
+		void sendPrebuiltResponse(SharedBuffer *buffer, size_t headLength);
+
+		void setCompression(int level, size_t minSize, const ResponseDictionary *dictionary, HttpResponseWakeList *flushList);
+		void flush();
+
+		const HttpResponseMap &getHeaders() const;
+		void startCapture(ResponseCacheFill *cacheFill, size_t captureLimit);
+		ResponseCacheFill *getCacheFill() const;
+		bool isCaptureComplete() const;
+		const std::string &getCapturedBody() const;
+		size_t getOutputSize() const;
+		HttpConnection *getConnection();
 };
 
 #endif /* __HTTPRESPONSEIMPL_H__ */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef XVIWEB_IO_URING
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "IoRing.h"
+
+using namespace std;
+
+IoRing::IoRing(unsigned int entries)
+{
+	m_sqRing = MAP_FAILED;
+	m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+	m_cqRing = MAP_FAILED;
+	m_bufferRing = NULL;
+	m_buffers = NULL;
+
+	// everything is submitted from the server's thread, which also
+	// waits for the completions, so the kernel can put off its part
+	// of completing them until then; older kernels don't allow that
+	struct io_uring_params params;
+	bzero(&params, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = entries * 8;
+	m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if(m_fd == -1 && errno == EINVAL) {
+		bzero(&params, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = entries * 8;
+		m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	}
+	if(m_fd == -1)
+		throw "io_uring_setup() failed";
+	m_features = params.features;
+
+	// waiting with a timeout needs the extended arguments, and
+	// completions mustn't be dropped when the queue overflows
+	if((params.features & IORING_FEAT_EXT_ARG) == 0 || (params.features & IORING_FEAT_NODROP) == 0) {
+		destroy();
+		throw "io_uring is missing required features";
+	}
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool singleMap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+	if(singleMap && m_cqRingSize > m_sqRingSize)
+		m_sqRingSize = m_cqRingSize;
+
+	m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if(m_sqRing != MAP_FAILED && singleMap == false)
+		m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                                     m_fd, IORING_OFF_SQES);
+	if(m_sqRing == MAP_FAILED || (singleMap == false && m_cqRing == MAP_FAILED) ||
+	   m_sqes == (struct io_uring_sqe *)MAP_FAILED) {
+		destroy();
+		throw "mmap() failed";
+	}
+
+	char *sqRing = (char *)m_sqRing;
+	m_sqHead = (unsigned int *)(sqRing + params.sq_off.head);
+	m_sqTail = (unsigned int *)(sqRing + params.sq_off.tail);
+	m_sqMask = *(unsigned int *)(sqRing + params.sq_off.ring_mask);
+	m_sqEntries = params.sq_entries;
+	m_sqLocalTail = *m_sqTail;
+
+	// submissions are always used in order, so each slot
+	// of the submission array refers to its own entry
+	unsigned int *array = (unsigned int *)(sqRing + params.sq_off.array);
+	for(unsigned int i = 0; i < m_sqEntries; ++i)
+		array[i] = i;
+
+	char *cqRing = singleMap ? sqRing : (char *)m_cqRing;
+	m_cqHead = (unsigned int *)(cqRing + params.cq_off.head);
+	m_cqTail = (unsigned int *)(cqRing + params.cq_off.tail);
+	m_cqMask = *(unsigned int *)(cqRing + params.cq_off.ring_mask);
+	m_cqes = (struct io_uring_cqe *)(cqRing + params.cq_off.cqes);
+
+	// find out which operations the kernel supports
+	m_supportedOperations.resize(256, false);
+	size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probeSize);
+	if(probe != NULL && syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+		for(unsigned int i = 0; i <= probe->last_op && i < 256; ++i)
+			m_supportedOperations[i] = ((probe->ops[i].flags & IO_URING_OP_SUPPORTED) != 0);
+	}
+	free(probe);
+}
+
+IoRing::~IoRing()
+{
+	destroy();
+}
+
+void
+IoRing::destroy()
+{
+	// closing the ring cancels whatever it's still doing
+	// before the memory it's using is unmapped
+	close(m_fd);
+
+	if(m_sqes != (struct io_uring_sqe *)MAP_FAILED)
+		munmap(m_sqes, m_sqesSize);
+	if(m_cqRing != MAP_FAILED)
+		munmap(m_cqRing, m_cqRingSize);
+	if(m_sqRing != MAP_FAILED)
+		munmap(m_sqRing, m_sqRingSize);
+
+	if(m_bufferRing != NULL) {
+		munmap(m_bufferRing, m_bufferRingSize);
+		free(m_buffers);
+	}
+}
+
+bool
+IoRing::hasFeature(unsigned int feature) const
+{
+	return ((m_features & feature) != 0);
+}
+
+bool
+IoRing::supportsOperation(int opcode) const
+{
+	return (opcode >= 0 && opcode < (int)m_supportedOperations.size() && m_supportedOperations[opcode]);
+}
+
+void
+IoRing::enter(unsigned int waitCount, unsigned int flags, void *arg, size_t argSize)
+{
+	// publish the queued submissions before entering
+	__atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+	unsigned int submitCount = m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+	if(submitCount == 0 && (flags & IORING_ENTER_GETEVENTS) == 0)
+		return;
+
+	// errors other than a timeout or an interruption are
+	// reported by the completions of what was submitted
+	syscall(__NR_io_uring_enter, m_fd, submitCount, waitCount, flags, arg, argSize);
+}
+
+struct io_uring_sqe *
+IoRing::getSubmission()
+{
+	if(m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+		submit();
+		if(m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+			throw "io_uring submission queue is full";
+	}
+
+	struct io_uring_sqe *sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+	++m_sqLocalTail;
+	bzero(sqe, sizeof(*sqe));
+	return sqe;
+}
+
+void
+IoRing::submit()
+{
+	enter(0, 0, NULL, 0);
+}
+
+void
+IoRing::submitAndWait(long timeout)
+{
+	struct __kernel_timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	struct io_uring_getevents_arg arg;
+	bzero(&arg, sizeof(arg));
+	if(timeout >= 0)
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+
+	// a timeout of zero just collects what's already completed
+	enter((timeout == 0) ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+bool
+IoRing::getCompletion(struct io_uring_cqe *cqe)
+{
+	unsigned int head = *m_cqHead;
+	if(head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+		return false;
+
+	*cqe = m_cqes[head & m_cqMask];
+	__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// the count must be a power of two
+bool
+IoRing::addBuffers(unsigned short groupId, unsigned int count, size_t size)
+{
+	if(m_bufferRing != NULL)
+		return false;
+
+	m_bufferRingSize = count * sizeof(struct io_uring_buf);
+	void *bufferRing = mmap(NULL, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(bufferRing == MAP_FAILED)
+		return false;
+
+	char *buffers = (char *)malloc(count * size);
+	if(buffers == NULL) {
+		munmap(bufferRing, m_bufferRingSize);
+		return false;
+	}
+
+	struct io_uring_buf_reg reg;
+	bzero(&reg, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+	reg.ring_entries = count;
+	reg.bgid = groupId;
+	if(syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+		free(buffers);
+		munmap(bufferRing, m_bufferRingSize);
+		return false;
+	}
+
+	m_bufferRing = (struct io_uring_buf_ring *)bufferRing;
+	m_buffers = buffers;
+	m_bufferCount = count;
+	m_bufferSize = size;
+	m_bufferTail = 0;
+	for(unsigned int i = 0; i < count; ++i)
+		recycleBuffer((unsigned short)i);
+
+	return true;
+}
+
+const char *
+IoRing::getBuffer(unsigned short bufferId) const
+{
+	return m_buffers + bufferId * m_bufferSize;
+}
+
+void
+IoRing::recycleBuffer(unsigned short bufferId)
+{
+	// the ring's entries are indexed directly, since in C++ the
+	// header's flexible array doesn't start at the beginning
+	struct io_uring_buf *buffer = (struct io_uring_buf *)m_bufferRing + (m_bufferTail & (m_bufferCount - 1));
+	buffer->addr = (uint64_t)(uintptr_t)(m_buffers + bufferId * m_bufferSize);
+	buffer->len = (uint32_t)m_bufferSize;
+	buffer->bid = bufferId;
+
+	++m_bufferTail;
+	__atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+}
+
+#endif /* XVIWEB_IO_URING */
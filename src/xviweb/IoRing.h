@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __IORING_H__
+#define __IORING_H__
+
+#ifdef XVIWEB_IO_URING
+
+#include <cstddef>
+#include <vector>
+#include <linux/io_uring.h>
+
+// an io_uring instance, set up through the system calls themselves
+// so that nothing but the kernel's headers is needed; submissions
+// are only handed to the kernel when the ring is entered
+class IoRing
+{
+	private:
+		int m_fd;
+		unsigned int m_features;
+		std::vector <bool> m_supportedOperations;
+
+		void *m_sqRing;
+		size_t m_sqRingSize;
+		unsigned int *m_sqHead;
+		unsigned int *m_sqTail;
+		unsigned int m_sqMask;
+		unsigned int m_sqEntries;
+		unsigned int m_sqLocalTail;
+		struct io_uring_sqe *m_sqes;
+		size_t m_sqesSize;
+
+		void *m_cqRing;
+		size_t m_cqRingSize;
+		unsigned int *m_cqHead;
+		unsigned int *m_cqTail;
+		unsigned int m_cqMask;
+		struct io_uring_cqe *m_cqes;
+
+		// buffers the kernel picks from to receive into
+		struct io_uring_buf_ring *m_bufferRing;
+		size_t m_bufferRingSize;
+		char *m_buffers;
+		unsigned int m_bufferCount;
+		size_t m_bufferSize;
+		unsigned short m_bufferTail;
+
+		void destroy();
+		void enter(unsigned int waitCount, unsigned int flags, void *arg, size_t argSize);
+
+	public:
+		IoRing(unsigned int entries);
+		~IoRing();
+
+		bool hasFeature(unsigned int feature) const;
+		bool supportsOperation(int opcode) const;
+
+		// returns a cleared submission, entering the ring to
+		// make room for it if the submission queue is full
+		struct io_uring_sqe *getSubmission();
+		void submit();
+
+		// submits what's queued and waits up to the timeout
+		// (in milliseconds) for at least one completion
+		void submitAndWait(long timeout);
+		bool getCompletion(struct io_uring_cqe *cqe);
+
+		// registers a group of buffers that receives select from;
+		// buffers are handed back to the kernel once they're used
+		bool addBuffers(unsigned short groupId, unsigned int count, size_t size);
+		const char *getBuffer(unsigned short bufferId) const;
+		void recycleBuffer(unsigned short bufferId);
+};
+
+#endif /* XVIWEB_IO_URING */
+
+#endif /* __IORING_H__ */
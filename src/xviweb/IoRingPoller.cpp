@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef XVIWEB_IO_URING
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include "IoRingPoller.h"
+#include "SharedBuffer.h"
+
+using namespace std;
+
+#define IO_RING_ENTRIES 1024
+
+// buffers that sockets are received into
+#define IO_RING_BUFFER_GROUP 0
+#define IO_RING_BUFFER_COUNT 256
+#define IO_RING_BUFFER_SIZE 16384
+
+// the user data of submissions whose completions aren't needed
+#define IO_RING_IGNORED ((uint64_t)-1)
+
+IoRingDescriptor::IoRingDescriptor()
+{
+	generation = 0;
+	events = 0;
+	receiver = false;
+	listener = false;
+	changed = false;
+	pollOperation = -1;
+	receiveOperation = -1;
+	acceptOperation = -1;
+	pollEvents = 0;
+}
+
+IoRingPoller::IoRingPoller()
+ : Poller(false), m_ring(IO_RING_ENTRIES)
+{
+	m_operationCount = 0;
+
+	// polling, cancelling, sending and reading files are needed;
+	// sockets are polled for when the kernel can't accept or
+	// receive from them itself
+	if(m_ring.supportsOperation(IORING_OP_POLL_ADD) == false ||
+	   m_ring.supportsOperation(IORING_OP_POLL_REMOVE) == false ||
+	   m_ring.supportsOperation(IORING_OP_ASYNC_CANCEL) == false ||
+	   m_ring.supportsOperation(IORING_OP_SENDMSG) == false ||
+	   m_ring.supportsOperation(IORING_OP_READ) == false)
+		throw "io_uring is missing required operations";
+
+	m_canAccept = m_ring.supportsOperation(IORING_OP_ACCEPT);
+	m_canReceive = (m_ring.supportsOperation(IORING_OP_RECV) &&
+	                m_ring.addBuffers(IO_RING_BUFFER_GROUP, IO_RING_BUFFER_COUNT, IO_RING_BUFFER_SIZE));
+
+	// cancellations and changes to polls that succeed don't
+	// need completions, which would only end waits early
+	m_controlFlags = 0;
+	if(m_ring.hasFeature(IORING_FEAT_CQE_SKIP))
+		m_controlFlags = IOSQE_CQE_SKIP_SUCCESS;
+}
+
+IoRingPoller::~IoRingPoller()
+{
+	// the kernel may be using the buffers of what's in progress
+	// until it's finished, so it's cancelled and waited for; the
+	// buffers of anything that still hasn't finished are leaked
+	for(unsigned int i = 0; i < m_operations.size(); ++i) {
+		if(m_operations[i]->active && m_operations[i]->cancelled == false)
+			cancelOperation((int)i);
+	}
+
+	for(int i = 0; i < 10 && m_operationCount != 0; ++i) {
+		m_ring.submitAndWait(100);
+
+		struct io_uring_cqe cqe;
+		while(m_ring.getCompletion(&cqe)) {
+			if(cqe.user_data != IO_RING_IGNORED && (cqe.flags & IORING_CQE_F_MORE) == 0)
+				finishOperation((int)cqe.user_data);
+		}
+	}
+
+	for(unsigned int i = 0; i < m_completedBuffers.size(); ++i)
+		m_completedBuffers[i]->release();
+	for(unsigned int i = 0; i < m_operations.size(); ++i) {
+		if(m_operations[i]->active == false)
+			delete m_operations[i];
+	}
+}
+
+IoRingDescriptor &
+IoRingPoller::getDescriptor(int fd)
+{
+	if((int)m_descriptors.size() <= fd)
+		m_descriptors.resize(fd + 1);
+
+	return m_descriptors[fd];
+}
+
+// descriptors that have changed are updated when the poller waits
+void
+IoRingPoller::setChanged(int fd)
+{
+	IoRingDescriptor &descriptor = m_descriptors[fd];
+	if(descriptor.changed == false) {
+		descriptor.changed = true;
+		m_changedDescriptors.push_back(fd);
+	}
+}
+
+// submits what's needed for the operations in progress for
+// a descriptor to match what it's waiting for
+void
+IoRingPoller::update(int fd)
+{
+	IoRingDescriptor &descriptor = m_descriptors[fd];
+	descriptor.changed = false;
+
+	// listening sockets accept connections for as long as they're added
+	if(descriptor.listener && m_canAccept) {
+		if(descriptor.acceptOperation == -1) {
+			int index = startOperation(IO_RING_OPERATION_ACCEPT, fd);
+			struct io_uring_sqe *sqe = m_ring.getSubmission();
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->fd = fd;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+			sqe->user_data = (uint64_t)index;
+			descriptor.acceptOperation = index;
+		}
+		return;
+	}
+
+	// sockets that are received from are read from that way for as long
+	// as they're waited on to be readable; an operation that's cancelled
+	// is replaced once it's finished, if it's still needed
+	bool receiving = (descriptor.receiver && m_canReceive && (descriptor.events & POLLER_EVENT_READ));
+	if(receiving && descriptor.receiveOperation == -1) {
+		int index = startOperation(IO_RING_OPERATION_RECEIVE, fd);
+		struct io_uring_sqe *sqe = m_ring.getSubmission();
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = fd;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = IO_RING_BUFFER_GROUP;
+		sqe->user_data = (uint64_t)index;
+		descriptor.receiveOperation = index;
+	} else if(receiving == false && descriptor.receiveOperation != -1 &&
+	          m_operations[descriptor.receiveOperation]->cancelled == false) {
+		cancelOperation(descriptor.receiveOperation);
+	}
+
+	// polls only report one event, after which they're started again
+	short pollEvents = 0;
+	if((descriptor.events & POLLER_EVENT_READ) && receiving == false)
+		pollEvents |= POLLIN;
+	if(descriptor.events & POLLER_EVENT_WRITE)
+		pollEvents |= POLLOUT;
+
+	if(descriptor.pollOperation == -1) {
+		if(pollEvents != 0) {
+			int index = startOperation(IO_RING_OPERATION_POLL, fd);
+			struct io_uring_sqe *sqe = m_ring.getSubmission();
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = fd;
+			sqe->poll32_events = (uint32_t)pollEvents;
+			sqe->user_data = (uint64_t)index;
+			descriptor.pollOperation = index;
+			descriptor.pollEvents = pollEvents;
+		}
+	} else if(m_operations[descriptor.pollOperation]->cancelled == false) {
+		if(pollEvents == 0) {
+			cancelOperation(descriptor.pollOperation);
+		} else if(pollEvents != descriptor.pollEvents) {
+			// a poll that's completed before it's changed
+			// is started again with the new events
+			struct io_uring_sqe *sqe = getControlSubmission();
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = (uint64_t)descriptor.pollOperation;
+			sqe->len = IORING_POLL_UPDATE_EVENTS;
+			sqe->poll32_events = (uint32_t)pollEvents;
+			descriptor.pollEvents = pollEvents;
+		}
+	}
+}
+
+struct io_uring_sqe *
+IoRingPoller::getControlSubmission()
+{
+	struct io_uring_sqe *sqe = m_ring.getSubmission();
+	sqe->flags = m_controlFlags;
+	sqe->user_data = IO_RING_IGNORED;
+	return sqe;
+}
+
+int
+IoRingPoller::startOperation(IoRingOperationType type, int fd)
+{
+	int index;
+	if(m_freeOperations.empty()) {
+		index = (int)m_operations.size();
+		m_operations.push_back(new IoRingOperation());
+	} else {
+		index = m_freeOperations.back();
+		m_freeOperations.pop_back();
+	}
+
+	IoRingOperation *operation = m_operations[index];
+	operation->active = true;
+	operation->type = type;
+	operation->fd = fd;
+	operation->generation = getDescriptor(fd).generation;
+	operation->cancelled = false;
+	++m_operationCount;
+
+	return index;
+}
+
+void
+IoRingPoller::finishOperation(int index)
+{
+	IoRingOperation *operation = m_operations[index];
+	for(unsigned int i = 0; i < operation->buffers.size(); ++i)
+		operation->buffers[i]->release();
+	operation->buffers.clear();
+
+	operation->active = false;
+	m_freeOperations.push_back(index);
+	--m_operationCount;
+}
+
+// the operation is finished once its last completion is reported
+void
+IoRingPoller::cancelOperation(int index)
+{
+	m_operations[index]->cancelled = true;
+
+	struct io_uring_sqe *sqe = getControlSubmission();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)index;
+}
+
+void
+IoRingPoller::addEvent(int fd, int events, int result)
+{
+	PollerEvent event;
+	event.fd = fd;
+	event.events = events;
+	event.result = result;
+	event.data = NULL;
+	event.buffer = NULL;
+	m_events.push_back(event);
+}
+
+void
+IoRingPoller::completeOperation(const struct io_uring_cqe &cqe)
+{
+	int index = (int)cqe.user_data;
+	IoRingOperation *operation = m_operations[index];
+	bool finished = ((cqe.flags & IORING_CQE_F_MORE) == 0);
+
+	// completions for descriptors that have been
+	// removed since are only cleaned up after
+	int fd = operation->fd;
+	IoRingDescriptor *descriptor = NULL;
+	if(fd < (int)m_descriptors.size() && m_descriptors[fd].generation == operation->generation)
+		descriptor = &m_descriptors[fd];
+
+	switch(operation->type) {
+		case IO_RING_OPERATION_POLL:
+			if(descriptor != NULL) {
+				descriptor->pollOperation = -1;
+				setChanged(fd);
+
+				// errors and hangups are reported as readable,
+				// like epoll does, and events the descriptor
+				// stopped waiting for after the poll was
+				// started aren't reported
+				int events = 0;
+				if(cqe.res > 0) {
+					if((cqe.res & (POLLERR | POLLHUP)) ||
+					   ((cqe.res & POLLIN) && (descriptor->events & POLLER_EVENT_READ)))
+						events |= POLLER_EVENT_READ;
+					if((cqe.res & POLLOUT) && (descriptor->events & POLLER_EVENT_WRITE))
+						events |= POLLER_EVENT_WRITE;
+				}
+
+				if(events != 0)
+					addEvent(fd, events, 0);
+			}
+			break;
+
+		case IO_RING_OPERATION_RECEIVE:
+			// the buffers received into are handed back to
+			// the kernel once the server's done with them
+			if(cqe.flags & IORING_CQE_F_BUFFER) {
+				unsigned short bufferId = (unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+				m_receiveBuffers.push_back(bufferId);
+				if(descriptor != NULL && cqe.res > 0) {
+					addEvent(fd, POLLER_EVENT_RECEIVED, cqe.res);
+					m_events.back().data = m_ring.getBuffer(bufferId);
+				}
+			} else if(descriptor != NULL) {
+				// kernels that can't receive more than once from
+				// a submission have their sockets polled instead;
+				// receives that run out of buffers are started
+				// again, and anything else ends the input
+				if(cqe.res == -EINVAL)
+					m_canReceive = false;
+				else if(cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+					addEvent(fd, POLLER_EVENT_RECEIVED, cqe.res);
+			}
+
+			if(finished && descriptor != NULL) {
+				descriptor->receiveOperation = -1;
+				setChanged(fd);
+			}
+			break;
+
+		case IO_RING_OPERATION_ACCEPT:
+			if(cqe.res >= 0) {
+				if(descriptor != NULL)
+					addEvent(fd, POLLER_EVENT_ACCEPTED, cqe.res);
+				else
+					close(cqe.res);
+			} else if(descriptor != NULL) {
+				if(cqe.res == -EINVAL)
+					m_canAccept = false;
+				else if(cqe.res != -ECANCELED)
+					addEvent(fd, POLLER_EVENT_ACCEPTED, cqe.res);
+			}
+
+			if(finished && descriptor != NULL) {
+				descriptor->acceptOperation = -1;
+				setChanged(fd);
+			}
+			break;
+
+		case IO_RING_OPERATION_SEND:
+		case IO_RING_OPERATION_READ:
+			if(descriptor != NULL) {
+				addEvent(fd, (operation->type == IO_RING_OPERATION_SEND) ? POLLER_EVENT_SENT : POLLER_EVENT_FILE_READ,
+				         cqe.res);
+				m_events.back().buffer = operation->buffers.front();
+
+				// the buffers are kept until the next wait, so that
+				// one that's reported can't be replaced in the
+				// meantime by a new one at the same address
+				m_completedBuffers.insert(m_completedBuffers.end(), operation->buffers.begin(),
+				                          operation->buffers.end());
+				operation->buffers.clear();
+			}
+			break;
+	}
+
+	if(finished)
+		finishOperation(index);
+}
+
+void
+IoRingPoller::add(int fd, int events)
+{
+	IoRingDescriptor &descriptor = getDescriptor(fd);
+	descriptor.events = events;
+	descriptor.receiver = false;
+	descriptor.listener = false;
+	setChanged(fd);
+}
+
+void
+IoRingPoller::modify(int fd, int events)
+{
+	IoRingDescriptor &descriptor = getDescriptor(fd);
+	if(descriptor.events != events) {
+		descriptor.events = events;
+		setChanged(fd);
+	}
+}
+
+void
+IoRingPoller::remove(int fd)
+{
+	if(fd >= (int)m_descriptors.size())
+		return;
+
+	// the descriptor may be closed and reused before anything
+	// in progress for it is finished, which is then ignored
+	IoRingDescriptor &descriptor = m_descriptors[fd];
+	int operations[3] = { descriptor.pollOperation, descriptor.receiveOperation, descriptor.acceptOperation };
+	for(int i = 0; i < 3; ++i) {
+		if(operations[i] != -1 && m_operations[operations[i]]->cancelled == false)
+			cancelOperation(operations[i]);
+	}
+
+	++descriptor.generation;
+	descriptor.events = 0;
+	descriptor.receiver = false;
+	descriptor.listener = false;
+	descriptor.pollOperation = -1;
+	descriptor.receiveOperation = -1;
+	descriptor.acceptOperation = -1;
+}
+
+void
+IoRingPoller::addListener(int fd)
+{
+	add(fd, POLLER_EVENT_READ);
+	m_descriptors[fd].listener = true;
+}
+
+void
+IoRingPoller::addReceiver(int fd, int events)
+{
+	add(fd, events);
+	m_descriptors[fd].receiver = true;
+}
+
+bool
+IoRingPoller::isAsynchronous() const
+{
+	return true;
+}
+
+bool
+IoRingPoller::readsFiles() const
+{
+	return true;
+}
+
+void
+IoRingPoller::send(int fd, const struct iovec *buffers, SharedBuffer *const *owners, int count)
+{
+	int index = startOperation(IO_RING_OPERATION_SEND, fd);
+	IoRingOperation *operation = m_operations[index];
+	if(count > 16)
+		count = 16;
+	for(int i = 0; i < count; ++i) {
+		operation->iov[i] = buffers[i];
+		owners[i]->retain();
+		operation->buffers.push_back(owners[i]);
+	}
+
+	bzero(&operation->message, sizeof(operation->message));
+	operation->message.msg_iov = operation->iov;
+	operation->message.msg_iovlen = count;
+
+	struct io_uring_sqe *sqe = m_ring.getSubmission();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)&operation->message;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = (uint64_t)index;
+}
+
+void
+IoRingPoller::readFile(int fd, int fileFd, SharedBuffer *buffer, char *data, uint64_t offset, size_t length)
+{
+	int index = startOperation(IO_RING_OPERATION_READ, fd);
+	buffer->retain();
+	m_operations[index]->buffers.push_back(buffer);
+
+	struct io_uring_sqe *sqe = m_ring.getSubmission();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fileFd;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = (uint32_t)length;
+	sqe->off = offset;
+	sqe->user_data = (uint64_t)index;
+
+	// the file may be closed as soon as this returns
+	m_ring.submit();
+}
+
+int
+IoRingPoller::wait(long timeout)
+{
+	m_events.clear();
+
+	// hand back what was reported by the last wait
+	for(unsigned int i = 0; i < m_receiveBuffers.size(); ++i)
+		m_ring.recycleBuffer(m_receiveBuffers[i]);
+	m_receiveBuffers.clear();
+	for(unsigned int i = 0; i < m_completedBuffers.size(); ++i)
+		m_completedBuffers[i]->release();
+	m_completedBuffers.clear();
+
+	// what's changed is submitted along with the wait
+	for(unsigned int i = 0; i < m_changedDescriptors.size(); ++i)
+		update(m_changedDescriptors[i]);
+	m_changedDescriptors.clear();
+
+	m_ring.submitAndWait(timeout);
+
+	struct io_uring_cqe cqe;
+	while(m_ring.getCompletion(&cqe)) {
+		if(cqe.user_data != IO_RING_IGNORED)
+			completeOperation(cqe);
+	}
+
+	return (int)m_events.size();
+}
+
+#endif /* XVIWEB_IO_URING */
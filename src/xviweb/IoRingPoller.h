@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __IORINGPOLLER_H__
+#define __IORINGPOLLER_H__
+
+#ifdef XVIWEB_IO_URING
+
+#include <sys/socket.h>
+#include "IoRing.h"
+#include "Poller.h"
+
+enum IoRingOperationType
+{
+	IO_RING_OPERATION_POLL,
+	IO_RING_OPERATION_RECEIVE,
+	IO_RING_OPERATION_ACCEPT,
+	IO_RING_OPERATION_SEND,
+	IO_RING_OPERATION_READ
+};
+
+// something submitted to the ring for a descriptor; it's only
+// reported to the descriptor if it hasn't been removed since
+class IoRingOperation
+{
+	public:
+		bool active;
+		IoRingOperationType type;
+		int fd;
+		unsigned int generation;
+		bool cancelled;
+
+		std::vector <SharedBuffer *> buffers;
+		struct msghdr message;
+		struct iovec iov[16];
+};
+
+class IoRingDescriptor
+{
+	public:
+		unsigned int generation;
+		int events;
+		bool receiver;
+		bool listener;
+		bool changed;
+
+		// operations in progress (-1 for none), and
+		// the events the poll in progress waits for
+		int pollOperation;
+		int receiveOperation;
+		int acceptOperation;
+		int pollEvents;
+
+		IoRingDescriptor();
+};
+
+// a poller that has everything it waits for done through io_uring:
+// readiness is polled for, sockets are received from into buffers
+// the kernel picks, listening sockets accept connections and output
+// and files are sent and read; what's changed is submitted all at
+// once when the poller waits, so a cycle of the server's loop takes
+// a single system call
+class IoRingPoller : public Poller
+{
+	private:
+		IoRing m_ring;
+		unsigned char m_controlFlags;
+		bool m_canReceive;
+		bool m_canAccept;
+
+		std::vector <IoRingDescriptor> m_descriptors;
+		std::vector <int> m_changedDescriptors;
+
+		std::vector <IoRingOperation *> m_operations;
+		std::vector <int> m_freeOperations;
+		unsigned int m_operationCount;
+
+		// buffers reported by the last wait, which are kept
+		// until the next one
+		std::vector <unsigned short> m_receiveBuffers;
+		std::vector <SharedBuffer *> m_completedBuffers;
+
+		IoRingDescriptor &getDescriptor(int fd);
+		void setChanged(int fd);
+		void update(int fd);
+
+		struct io_uring_sqe *getControlSubmission();
+		int startOperation(IoRingOperationType type, int fd);
+		void finishOperation(int index);
+		void cancelOperation(int index);
+		void completeOperation(const struct io_uring_cqe &cqe);
+		void addEvent(int fd, int events, int result);
+
+	public:
+		IoRingPoller();
+		~IoRingPoller();
+
+		void add(int fd, int events);
+		void modify(int fd, int events);
+		void remove(int fd);
+		void addListener(int fd);
+		void addReceiver(int fd, int events);
+
+		bool isAsynchronous() const;
+		void send(int fd, const struct iovec *buffers, SharedBuffer *const *owners, int count);
+		void readFile(int fd, int fileFd, SharedBuffer *buffer, char *data, uint64_t offset, size_t length);
+		bool readsFiles() const;
+
+		int wait(long timeout);
+};
+
+#endif /* XVIWEB_IO_URING */
+
+#endif /* __IORINGPOLLER_H__ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "LoadShedder.h"
+
+LoadShedder::LoadShedder()
+{
+	m_target = 50;
+	m_interval = 500;
+	m_intervalEnd = 0;
+	m_minDelay = -1;
+	m_overloaded = false;
+}
+
+void
+LoadShedder::setTarget(long target)
+{
+	m_target = target;
+}
+
+void
+LoadShedder::setInterval(long interval)
+{
+	m_interval = interval;
+}
+
+bool
+LoadShedder::isOverloaded() const
+{
+	return m_overloaded;
+}
+
+bool
+LoadShedder::shouldShed(long delay, long currentTime)
+{
+	if(m_target <= 0)
+		return false;
+
+	// the shortest delay of the interval that's
+	// ended decides how the next one is handled
+	if(currentTime >= m_intervalEnd) {
+		m_overloaded = (m_minDelay > m_target && currentTime - m_intervalEnd < m_interval);
+		m_intervalEnd = currentTime + m_interval;
+		m_minDelay = -1;
+	}
+
+	if(m_minDelay == -1 || delay < m_minDelay)
+		m_minDelay = delay;
+
+	return (delay > (m_overloaded ? m_target : m_interval));
+}
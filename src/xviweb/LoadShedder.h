@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LOADSHEDDER_H__
+#define __LOADSHEDDER_H__
+
+// decides which requests to turn away when the server can't keep up,
+// going by how long they waited to be handled, in the way CoDel does
+// for packets: while no request has waited less than the target for a
+// whole interval, the server is overloaded and requests that waited
+// longer than the target are shed; otherwise only requests that waited
+// longer than the interval are, so that bursts are still absorbed
+class LoadShedder
+{
+	private:
+		long m_target;
+		long m_interval;
+
+		long m_intervalEnd;
+		long m_minDelay;
+		bool m_overloaded;
+
+	public:
+		LoadShedder();
+
+		// a target of 0 disables shedding
+		void setTarget(long target);
+		void setInterval(long interval);
+
+		bool isOverloaded() const;
+
+		// returns true if a request that waited for the
+		// given number of milliseconds should be shed
+		bool shouldShed(long delay, long currentTime);
+};
+
+#endif /* __LOADSHEDDER_H__ */
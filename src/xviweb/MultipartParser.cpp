@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <xviweb/String.h>
+#include "MultipartParser.h"
+
+using namespace std;
+
+// limits on what has to be buffered or created per request
+static const size_t MAX_PART_HEADER_SIZE = 8 * 1024;
+static const unsigned int MAX_PARTS = 1024;
+
+MultipartParser::MultipartParser(const string &boundary,
+                                 const string &uploadDirectory,
+                                 size_t memoryThreshold,
+                                 map<string, string> &fields,
+                                 HttpRequestFileList &files)
+ : m_uploadDirectory(uploadDirectory), m_memoryThreshold(memoryThreshold),
+   m_fields(fields), m_files(files)
+{
+	m_state = MULTIPART_PARSER_STATE_PREAMBLE;
+	m_delimiter = "\r\n--" + boundary;
+	m_partCount = 0;
+	m_headerBytes = 0;
+	m_partIsFile = false;
+	m_partFile = NULL;
+
+	// the first delimiter may be at the very start of the
+	// body, so act as if the body begins with a line break
+	m_buffer = "\r\n";
+
+	// build the Boyer-Moore-Horspool skip table
+	size_t length = m_delimiter.length();
+	for(unsigned int i = 0; i < 256; ++i)
+		m_skip[i] = length;
+	for(size_t i = 0; i < length - 1; ++i)
+		m_skip[(unsigned char)m_delimiter[i]] = length - 1 - i;
+}
+
+MultipartParser::~MultipartParser()
+{
+}
+
+bool
+MultipartParser::getBoundary(const string &contentType, string *boundary)
+{
+	vector <string> params = String::split(contentType, ";");
+	if(String::toLower(String::trim(params[0])) != "multipart/form-data")
+		return false;
+
+	for(unsigned int i = 1; i < params.size(); ++i) {
+		string param = String::trim(params[i]);
+		if(String::toLower(param.substr(0, 9)) != "boundary=")
+			continue;
+
+		string value = param.substr(9);
+		if(value.length() >= 2 && value[0] == '"' && value[value.length() - 1] == '"')
+			value = value.substr(1, value.length() - 2);
+
+		if(value.length() == 0 || value.length() > 70)
+			return false;
+
+		*boundary = value;
+		return true;
+	}
+
+	return false;
+}
+
+const char *
+MultipartParser::findDelimiter(const char *p, const char *end) const
+{
+	const char *delimiter = m_delimiter.data();
+	size_t length = m_delimiter.length();
+	unsigned char last = (unsigned char)delimiter[length - 1];
+
+	while((size_t)(end - p) >= length) {
+		unsigned char c = (unsigned char)p[length - 1];
+		if(c == last && memcmp(p, delimiter, length - 1) == 0)
+			return p;
+		p += m_skip[c];
+	}
+
+	return NULL;
+}
+
+const char *
+MultipartParser::findPartialDelimiter(const char *p, const char *end) const
+{
+	// find the first position near the end of the data
+	// where the rest of the data begins a delimiter
+	size_t length = m_delimiter.length();
+	if((size_t)(end - p) >= length)
+		p = end - (length - 1);
+
+	while((p = (const char *)memchr(p, '\r', (size_t)(end - p))) != NULL) {
+		if(memcmp(p, m_delimiter.data(), (size_t)(end - p)) == 0)
+			return p;
+		++p;
+	}
+
+	return end;
+}
+
+static const char *
+findLineEnd(const char *p, const char *end)
+{
+	while((p = (const char *)memchr(p, '\r', (size_t)(end - p))) != NULL) {
+		if(p + 1 == end)
+			break;
+		if(p[1] == '\n')
+			return p;
+		++p;
+	}
+
+	return NULL;
+}
+
+size_t
+MultipartParser::process(const char *data, size_t length)
+{
+	const char *p = data;
+	const char *end = data + length;
+
+	while(p != end) {
+		switch(m_state) {
+			default:
+				return length;
+
+			// look for the next delimiter; anything before it
+			// is part data, or is ignored if it's the preamble
+			case MULTIPART_PARSER_STATE_PREAMBLE:
+			case MULTIPART_PARSER_STATE_DATA: {
+				const char *delimiter = findDelimiter(p, end);
+				const char *dataEnd = (delimiter != NULL) ? delimiter : findPartialDelimiter(p, end);
+
+				if(m_state == MULTIPART_PARSER_STATE_DATA && dataEnd != p) {
+					if(partDataRead(p, (size_t)(dataEnd - p)) == false) {
+						m_state = MULTIPART_PARSER_STATE_ERROR;
+						return length;
+					}
+				}
+
+				// keep anything that may begin a delimiter
+				// until more data has been read
+				if(delimiter == NULL)
+					return (size_t)(dataEnd - data);
+
+				if(m_state == MULTIPART_PARSER_STATE_DATA)
+					endPart();
+
+				p = delimiter + m_delimiter.length();
+				m_state = MULTIPART_PARSER_STATE_DELIMITER_END;
+				break;
+			}
+
+			// a delimiter is followed by -- if it's the last one,
+			// otherwise by optional whitespace and a line break
+			case MULTIPART_PARSER_STATE_DELIMITER_END: {
+				if(end - p < 2)
+					return (size_t)(p - data);
+
+				if(p[0] == '-' && p[1] == '-') {
+					m_state = MULTIPART_PARSER_STATE_EPILOGUE;
+					return length;
+				}
+
+				const char *q = p;
+				while(q != end && (*q == ' ' || *q == '\t'))
+					++q;
+				if(q - p > 64) {
+					m_state = MULTIPART_PARSER_STATE_ERROR;
+					return length;
+				}
+				if(end - q < 2)
+					return (size_t)(p - data);
+
+				if(q[0] != '\r' || q[1] != '\n') {
+					m_state = MULTIPART_PARSER_STATE_ERROR;
+					return length;
+				}
+
+				p = q + 2;
+				m_state = MULTIPART_PARSER_STATE_HEADERS;
+				m_headerBytes = 0;
+				m_partName.clear();
+				m_partFileName.clear();
+				m_partContentType.clear();
+				m_partIsFile = false;
+				break;
+			}
+
+			// read the part's headers until a blank line is read
+			case MULTIPART_PARSER_STATE_HEADERS: {
+				const char *lineEnd = findLineEnd(p, end);
+				if(lineEnd == NULL) {
+					if(m_headerBytes + (size_t)(end - p) > MAX_PART_HEADER_SIZE)
+						m_state = MULTIPART_PARSER_STATE_ERROR;
+					return (size_t)(p - data);
+				}
+
+				m_headerBytes += (size_t)(lineEnd - p) + 2;
+				if(m_headerBytes > MAX_PART_HEADER_SIZE) {
+					m_state = MULTIPART_PARSER_STATE_ERROR;
+					return length;
+				}
+
+				if(lineEnd == p) {
+					if(beginPart() == false) {
+						m_state = MULTIPART_PARSER_STATE_ERROR;
+						return length;
+					}
+					m_state = MULTIPART_PARSER_STATE_DATA;
+				} else {
+					parsePartHeader(string(p, (size_t)(lineEnd - p)));
+				}
+
+				p = lineEnd + 2;
+				break;
+			}
+		}
+	}
+
+	return (size_t)(p - data);
+}
+
+static string
+unquote(const string &s)
+{
+	if(s.length() < 2 || s[0] != '"' || s[s.length() - 1] != '"')
+		return s;
+
+	string t;
+	for(size_t i = 1; i < s.length() - 1; ++i) {
+		if(s[i] == '\\' && i + 1 < s.length() - 1)
+			++i;
+		t += s[i];
+	}
+
+	return t;
+}
+
+static vector <string>
+splitParameters(const string &s)
+{
+	// split on semicolons that aren't within quotes
+	vector <string> v;
+	string param;
+	bool quoted = false;
+
+	for(size_t i = 0; i < s.length(); ++i) {
+		char c = s[i];
+		if(c == '"') {
+			quoted = !quoted;
+		} else if(c == '\\' && quoted && i + 1 < s.length()) {
+			param += c;
+			c = s[++i];
+		} else if(c == ';' && !quoted) {
+			v.push_back(String::trim(param));
+			param.clear();
+			continue;
+		}
+
+		param += c;
+	}
+
+	v.push_back(String::trim(param));
+	return v;
+}
+
+void
+MultipartParser::parsePartHeader(const string &line)
+{
+	size_t tmp = line.find(':');
+	if(tmp == string::npos)
+		return;
+
+	string name = String::toLower(String::trim(line.substr(0, tmp)));
+	string value = String::trim(line.substr(tmp + 1));
+
+	if(name == "content-type") {
+		m_partContentType = value;
+	} else if(name == "content-disposition") {
+		vector <string> params = splitParameters(value);
+		for(unsigned int i = 1; i < params.size(); ++i) {
+			tmp = params[i].find('=');
+			if(tmp == string::npos)
+				continue;
+
+			string paramName = String::toLower(String::trim(params[i].substr(0, tmp)));
+			string paramValue = unquote(String::trim(params[i].substr(tmp + 1)));
+			if(paramName == "name") {
+				m_partName = String::toLower(paramValue);
+			} else if(paramName == "filename") {
+				m_partFileName = paramValue;
+				m_partIsFile = true;
+			}
+		}
+	}
+}
+
+bool
+MultipartParser::createPartFile(const string &fileName)
+{
+	m_partFile = new HttpRequestFileImpl(m_partName, fileName, m_partContentType);
+	m_files.push_back(m_partFile);
+
+	return m_partFile->create(m_uploadDirectory);
+}
+
+bool
+MultipartParser::beginPart()
+{
+	if(++m_partCount > MAX_PARTS)
+		return false;
+
+	m_partValue.clear();
+	m_partFile = NULL;
+
+	// files are written straight to disk; a file input
+	// that was left empty has no file name and is ignored
+	if(m_partIsFile && m_partFileName.length() != 0)
+		return createPartFile(m_partFileName);
+
+	return true;
+}
+
+bool
+MultipartParser::partDataRead(const char *data, size_t length)
+{
+	if(m_partFile != NULL)
+		return m_partFile->write(data, length);
+
+	if(m_partIsFile || m_partName.length() == 0)
+		return true;
+
+	// move a field to disk once it's too large to keep in memory
+	if(m_partValue.length() + length > m_memoryThreshold) {
+		if(createPartFile(string()) == false)
+			return false;
+		if(m_partFile->write(m_partValue.data(), m_partValue.length()) == false)
+			return false;
+
+		m_partValue.clear();
+		return m_partFile->write(data, length);
+	}
+
+	m_partValue.append(data, length);
+	return true;
+}
+
+void
+MultipartParser::endPart()
+{
+	if(m_partFile != NULL) {
+		m_partFile->close();
+		m_partFile = NULL;
+	} else if(m_partIsFile == false && m_partName.length() != 0) {
+		m_fields.insert(make_pair(m_partName, m_partValue));
+	}
+
+	m_partValue.clear();
+}
+
+bool
+MultipartParser::parse(const char *data, size_t length)
+{
+	if(m_state == MULTIPART_PARSER_STATE_ERROR)
+		return false;
+
+	// parse the data in place unless there's buffered
+	// data from before that it has to be joined to
+	if(m_buffer.length() == 0) {
+		size_t n = process(data, length);
+		m_buffer.assign(data + n, length - n);
+	} else {
+		m_buffer.append(data, length);
+		size_t n = process(m_buffer.data(), m_buffer.length());
+		m_buffer.erase(0, n);
+	}
+
+	return (m_state != MULTIPART_PARSER_STATE_ERROR);
+}
+
+bool
+MultipartParser::finish()
+{
+	m_buffer.clear();
+
+	// a body that ends without a final delimiter is incomplete
+	if(m_partFile != NULL) {
+		m_partFile->close();
+		m_partFile = NULL;
+	}
+
+	return (m_state == MULTIPART_PARSER_STATE_EPILOGUE);
+}
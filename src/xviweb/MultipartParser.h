@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MULTIPARTPARSER_H__
+#define __MULTIPARTPARSER_H__
+
+#include <map>
+#include <string>
+#include "HttpRequestFileImpl.h"
+
+enum MultipartParserState
+{
+	MULTIPART_PARSER_STATE_PREAMBLE = 0,
+	MULTIPART_PARSER_STATE_DELIMITER_END,
+	MULTIPART_PARSER_STATE_HEADERS,
+	MULTIPART_PARSER_STATE_DATA,
+	MULTIPART_PARSER_STATE_EPILOGUE,
+	MULTIPART_PARSER_STATE_ERROR
+};
+
+// parses a multipart/form-data body as it arrives; fields are kept
+// in memory up to a threshold, and files (and fields larger than the
+// threshold) are written to temporary files as they're read
+class MultipartParser
+{
+	private:
+		MultipartParserState m_state;
+		std::string m_delimiter;
+		size_t m_skip[256];
+		std::string m_buffer;
+
+		std::string m_uploadDirectory;
+		size_t m_memoryThreshold;
+		std::map<std::string, std::string> &m_fields;
+		HttpRequestFileList &m_files;
+
+		unsigned int m_partCount;
+		size_t m_headerBytes;
+		std::string m_partName;
+		std::string m_partFileName;
+		std::string m_partContentType;
+		bool m_partIsFile;
+		std::string m_partValue;
+		HttpRequestFileImpl *m_partFile;
+
+		const char *findDelimiter(const char *p, const char *end) const;
+		const char *findPartialDelimiter(const char *p, const char *end) const;
+		size_t process(const char *data, size_t length);
+		void parsePartHeader(const std::string &line);
+		bool beginPart();
+		bool createPartFile(const std::string &fileName);
+		bool partDataRead(const char *data, size_t length);
+		void endPart();
+
+	public:
+		MultipartParser(const std::string &boundary, const std::string &uploadDirectory, size_t memoryThreshold, std::map<std::string, std::string> &fields, HttpRequestFileList &files);
+		virtual ~MultipartParser();
+
+		static bool getBoundary(const std::string &contentType, std::string *boundary);
+
+		bool parse(const char *data, size_t length);
+		bool finish();
+};
+
+#endif /* __MULTIPARTPARSER_H__ */
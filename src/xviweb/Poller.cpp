@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <unistd.h>
+#include "FileReadPool.h"
+#include "Poller.h"
+#include "SharedBuffer.h"
+
+using namespace std;
+
+#ifdef __linux__
+
+Poller::Poller()
+{
+	m_fd = epoll_create(1024);
+	if(m_fd == -1)
+		throw "epoll_create() failed";
+
+	m_epollEvents.resize(256);
+	m_fileReadPool = NULL;
+}
+
+Poller::Poller(bool /*system*/)
+{
+	m_fd = -1;
+	m_fileReadPool = NULL;
+}
+
+Poller::~Poller()
+{
+	delete m_fileReadPool;
+	for(unsigned int i = 0; i < m_readBuffers.size(); ++i)
+		m_readBuffers[i]->release();
+
+	if(m_fd != -1)
+		close(m_fd);
+}
+
+static uint32_t
+toEpollEvents(int events)
+{
+	uint32_t epollEvents = 0;
+	if(events & POLLER_EVENT_READ)
+		epollEvents |= EPOLLIN;
+	if(events & POLLER_EVENT_WRITE)
+		epollEvents |= EPOLLOUT;
+
+	return epollEvents;
+}
+
+void
+Poller::add(int fd, int events)
+{
+	struct epoll_event event;
+	event.events = toEpollEvents(events);
+	event.data.u64 = 0;
+	event.data.fd = fd;
+
+	if(epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+		throw "epoll_ctl() failed";
+}
+
+void
+Poller::modify(int fd, int events)
+{
+	struct epoll_event event;
+	event.events = toEpollEvents(events);
+	event.data.u64 = 0;
+	event.data.fd = fd;
+
+	if(epoll_ctl(m_fd, EPOLL_CTL_MOD, fd, &event) == -1)
+		throw "epoll_ctl() failed";
+}
+
+void
+Poller::remove(int fd)
+{
+	struct epoll_event event;
+	epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, &event);
+	removed(fd);
+}
+
+int
+Poller::wait(long timeout)
+{
+	m_events.clear();
+	for(unsigned int i = 0; i < m_readBuffers.size(); ++i)
+		m_readBuffers[i]->release();
+	m_readBuffers.clear();
+
+	int count = epoll_wait(m_fd, &m_epollEvents[0], (int)m_epollEvents.size(), (int)timeout);
+	if(count <= 0)
+		return 0;
+
+	// errors and hangups are reported as readable so that
+	// they're noticed when the descriptor is read from
+	for(int i = 0; i < count; ++i) {
+		uint32_t epollEvents = m_epollEvents[i].events;
+		if(m_fileReadPool != NULL && m_epollEvents[i].data.fd == m_fileReadPool->getFileDescriptor()) {
+			addFileReads();
+			continue;
+		}
+
+		PollerEvent event;
+		event.fd = m_epollEvents[i].data.fd;
+		event.events = 0;
+		if(epollEvents & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			event.events |= POLLER_EVENT_READ;
+		if(epollEvents & EPOLLOUT)
+			event.events |= POLLER_EVENT_WRITE;
+		m_events.push_back(event);
+	}
+
+	// make room for more events if this wait filled the buffer
+	if(count == (int)m_epollEvents.size())
+		m_epollEvents.resize(m_epollEvents.size() * 2);
+
+	return (int)m_events.size();
+}
+
+#else
+
+Poller::Poller()
+{
+	m_fileReadPool = NULL;
+}
+
+Poller::Poller(bool /*system*/)
+{
+	m_fileReadPool = NULL;
+}
+
+Poller::~Poller()
+{
+	delete m_fileReadPool;
+	for(unsigned int i = 0; i < m_readBuffers.size(); ++i)
+		m_readBuffers[i]->release();
+}
+
+static short
+toPollEvents(int events)
+{
+	short pollEvents = 0;
+	if(events & POLLER_EVENT_READ)
+		pollEvents |= POLLIN;
+	if(events & POLLER_EVENT_WRITE)
+		pollEvents |= POLLOUT;
+
+	return pollEvents;
+}
+
+void
+Poller::add(int fd, int events)
+{
+	if((int)m_indexes.size() <= fd)
+		m_indexes.resize(fd + 1, -1);
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = toPollEvents(events);
+	pfd.revents = 0;
+
+	m_indexes[fd] = (int)m_pollfds.size();
+	m_pollfds.push_back(pfd);
+}
+
+void
+Poller::modify(int fd, int events)
+{
+	m_pollfds[m_indexes[fd]].events = toPollEvents(events);
+}
+
+void
+Poller::remove(int fd)
+{
+	if(fd >= (int)m_indexes.size() || m_indexes[fd] == -1)
+		return;
+
+	// move the last descriptor into the removed one's place
+	int index = m_indexes[fd];
+	m_pollfds[index] = m_pollfds.back();
+	m_indexes[m_pollfds[index].fd] = index;
+	m_pollfds.pop_back();
+	m_indexes[fd] = -1;
+	removed(fd);
+}
+
+int
+Poller::wait(long timeout)
+{
+	m_events.clear();
+	for(unsigned int i = 0; i < m_readBuffers.size(); ++i)
+		m_readBuffers[i]->release();
+	m_readBuffers.clear();
+
+	if(poll(&m_pollfds[0], (nfds_t)m_pollfds.size(), (int)timeout) <= 0)
+		return 0;
+
+	for(unsigned int i = 0; i < m_pollfds.size(); ++i) {
+		short revents = m_pollfds[i].revents;
+		if(revents == 0)
+			continue;
+		if(m_fileReadPool != NULL && m_pollfds[i].fd == m_fileReadPool->getFileDescriptor()) {
+			addFileReads();
+			continue;
+		}
+
+		PollerEvent event;
+		event.fd = m_pollfds[i].fd;
+		event.events = 0;
+		if(revents & (POLLIN | POLLERR | POLLHUP))
+			event.events |= POLLER_EVENT_READ;
+		if(revents & POLLOUT)
+			event.events |= POLLER_EVENT_WRITE;
+		m_events.push_back(event);
+	}
+
+	return (int)m_events.size();
+}
+
+#endif
+
+void
+Poller::addListener(int fd)
+{
+	add(fd, POLLER_EVENT_READ);
+}
+
+void
+Poller::addReceiver(int fd, int events)
+{
+	add(fd, events);
+}
+
+bool
+Poller::isAsynchronous() const
+{
+	return false;
+}
+
+void
+Poller::send(int /*fd*/, const struct iovec * /*buffers*/, SharedBuffer *const * /*owners*/, int /*count*/)
+{
+	throw "Poller can't send";
+}
+
+void
+Poller::readFile(int fd, int fileFd, SharedBuffer *buffer, char *data, uint64_t offset, size_t length)
+{
+	if(m_fileReadPool == NULL)
+		throw "Poller can't read files";
+
+	if((int)m_generations.size() <= fd)
+		m_generations.resize(fd + 1, 0);
+	m_fileReadPool->read(fd, m_generations[fd], fileFd, buffer, data, offset, length);
+}
+
+bool
+Poller::readsFiles() const
+{
+	return (m_fileReadPool != NULL);
+}
+
+void
+Poller::startFileReads(unsigned int threadCount)
+{
+	if(m_fileReadPool != NULL)
+		return;
+
+	m_fileReadPool = new FileReadPool(threadCount);
+	add(m_fileReadPool->getFileDescriptor(), POLLER_EVENT_READ);
+}
+
+void
+Poller::removed(int fd)
+{
+	if(fd < (int)m_generations.size())
+		++m_generations[fd];
+}
+
+// reports the reads the pool's completed as events; the
+// buffers are kept until the next wait, so that one that's
+// reported can't be replaced by a new one at the same address
+void
+Poller::addFileReads()
+{
+	vector <FileRead> reads;
+	m_fileReadPool->collect(reads);
+
+	for(unsigned int i = 0; i < reads.size(); ++i) {
+		const FileRead &read = reads[i];
+		m_readBuffers.push_back(read.buffer);
+		if(read.generation != m_generations[read.fd])
+			continue;
+
+		PollerEvent event;
+		event.fd = read.fd;
+		event.events = POLLER_EVENT_FILE_READ;
+		event.result = read.result;
+		event.data = NULL;
+		event.buffer = read.buffer;
+		m_events.push_back(event);
+	}
+}
+
+const PollerEvent &
+Poller::getEvent(int index) const
+{
+	return m_events[index];
+}
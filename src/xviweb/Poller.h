@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __POLLER_H__
+#define __POLLER_H__
+
+#include <vector>
+#include <stdint.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+class FileReadPool;
+class SharedBuffer;
+
+enum PollerEventType
+{
+	POLLER_EVENT_READ = 1,
+	POLLER_EVENT_WRITE = 2,
+
+	// completions of what an asynchronous poller does for the
+	// descriptor; each is reported as an event of its own
+	POLLER_EVENT_RECEIVED = 4,
+	POLLER_EVENT_SENT = 8,
+	POLLER_EVENT_FILE_READ = 16,
+	POLLER_EVENT_ACCEPTED = 32
+};
+
+class PollerEvent
+{
+	public:
+		int fd;
+		int events;
+
+		// for completions: the number of bytes received, sent or
+		// read (0 for a received end of input, or a negated errno)
+		// or the accepted descriptor; the data received and the
+		// buffer read into are valid until the next wait
+		int result;
+		const char *data;
+		SharedBuffer *buffer;
+};
+
+// waits for events on a set of file descriptors; uses epoll
+// where it's available and falls back to poll elsewhere
+class Poller
+{
+	protected:
+		std::vector <PollerEvent> m_events;
+
+		// for pollers that don't wait with epoll or poll
+		Poller(bool system);
+
+	private:
+#ifdef __linux__
+		int m_fd;
+		std::vector <struct epoll_event> m_epollEvents;
+#else
+		std::vector <struct pollfd> m_pollfds;
+		std::vector <int> m_indexes;
+#endif
+
+		// reads that complete for descriptors that have been
+		// removed since (see startFileReads) are dropped
+		FileReadPool *m_fileReadPool;
+		std::vector <unsigned int> m_generations;
+		std::vector <SharedBuffer *> m_readBuffers;
+
+		void removed(int fd);
+		void addFileReads();
+
+	public:
+		Poller();
+		virtual ~Poller();
+
+		virtual void add(int fd, int events);
+		virtual void modify(int fd, int events);
+		virtual void remove(int fd);
+
+		// listening sockets are waited on to be readable, unless the
+		// poller accepts connections itself (POLLER_EVENT_ACCEPTED)
+		virtual void addListener(int fd);
+
+		// a socket added to receive from may have what's readable
+		// received for it and reported as POLLER_EVENT_RECEIVED
+		virtual void addReceiver(int fd, int events);
+
+		// an asynchronous poller also sends and reads files for
+		// descriptors, reporting the completions to them; the
+		// buffers are kept until then, and the data of each has
+		// to stay as it is
+		virtual bool isAsynchronous() const;
+		virtual void send(int fd, const struct iovec *buffers, SharedBuffer *const *owners, int count);
+		virtual void readFile(int fd, int fileFd, SharedBuffer *buffer, char *data, uint64_t offset, size_t length);
+
+		// a poller that isn't asynchronous can still read files with
+		// a pool of threads, reporting them like an asynchronous one
+		virtual bool readsFiles() const;
+		void startFileReads(unsigned int threadCount);
+
+		virtual int wait(long timeout);
+		const PollerEvent &getEvent(int index) const;
+};
+
+#endif /* __POLLER_H__ */
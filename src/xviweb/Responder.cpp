@@ -42,6 +42,36 @@ ResponderContext::getResponseInterval() const
 	return 50;
 }
 
+void
+ResponderContext::requestBodyRead(const char * /*data*/, size_t /*length*/)
+{
+}
+
+void
+ResponderContext::requestBodyEnded()
+{
+}
+
+bool
+ResponderContext::isReadyForRequestBody() const
+{
+	return true;
+}
+
+ResponderCachePolicy::ResponderCachePolicy()
+{
+	maxAge = 0;
+	staleTime = 0;
+	maxWaitTime = 0;
+}
+
+ResponderRoute::ResponderRoute(const string &routePath, const string &routeMethod, const string &routeHost)
+{
+	path = routePath;
+	method = routeMethod;
+	host = routeHost;
+}
+
 Responder::Responder()
 {
 }
@@ -54,3 +84,20 @@ void
 Responder::addOption(const string & /*option*/, const string & /*value*/)
 {
 }
+
+bool
+Responder::streamsRequestBody(const HttpRequest * /*request*/) const
+{
+	return false;
+}
+
+bool
+Responder::getCachePolicy(const HttpRequest * /*request*/, ResponderCachePolicy * /*policy*/) const
+{
+	return false;
+}
+
+void
+Responder::getRoutes(vector <ResponderRoute> * /*routes*/) const
+{
+}
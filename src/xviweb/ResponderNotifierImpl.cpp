@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "ResponderNotifierImpl.h"
+
+ResponderNotifierImpl::ResponderNotifierImpl()
+{
+#ifdef __linux__
+	m_readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_readFd == -1)
+		throw "eventfd() failed";
+	m_writeFd = m_readFd;
+#else
+	int fds[2];
+	if(pipe(fds) == -1)
+		throw "pipe() failed";
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	m_readFd = fds[0];
+	m_writeFd = fds[1];
+#endif
+
+	m_refCount = 1;
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+ResponderNotifierImpl::~ResponderNotifierImpl()
+{
+	detach();
+	pthread_mutex_destroy(&m_mutex);
+}
+
+int
+ResponderNotifierImpl::getFileDescriptor() const
+{
+	return m_readFd;
+}
+
+void
+ResponderNotifierImpl::clearNotifications()
+{
+	// an eventfd is cleared by a single read; a pipe is
+	// read from until it's empty
+	char buffer[64];
+	while(read(m_readFd, buffer, sizeof(buffer)) > 0 && m_readFd != m_writeFd)
+		;
+}
+
+void
+ResponderNotifierImpl::detach()
+{
+	pthread_mutex_lock(&m_mutex);
+	if(m_readFd != -1) {
+		if(m_writeFd != m_readFd)
+			close(m_writeFd);
+		close(m_readFd);
+		m_readFd = -1;
+		m_writeFd = -1;
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void
+ResponderNotifierImpl::notify()
+{
+	// the descriptor is only written to while the mutex is held so
+	// that it can't be closed and reused by another thread meanwhile
+	pthread_mutex_lock(&m_mutex);
+	if(m_writeFd != -1) {
+		uint64_t value = 1;
+		ssize_t result = write(m_writeFd, &value, (m_readFd == m_writeFd) ? sizeof(value) : 1);
+		(void)result;
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void
+ResponderNotifierImpl::retain()
+{
+	__sync_add_and_fetch(&m_refCount, 1);
+}
+
+void
+ResponderNotifierImpl::release()
+{
+	if(__sync_sub_and_fetch(&m_refCount, 1) == 0)
+		delete this;
+}
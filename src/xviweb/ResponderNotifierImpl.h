@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RESPONDERNOTIFIERIMPL_H__
+#define __RESPONDERNOTIFIERIMPL_H__
+
+#include <pthread.h>
+#include <xviweb/ResponderNotifier.h>
+
+class ResponderNotifierImpl : public ResponderNotifier
+{
+	private:
+		int m_readFd;
+		int m_writeFd;
+		int m_refCount;
+		pthread_mutex_t m_mutex;
+
+		ResponderNotifierImpl(const ResponderNotifierImpl &);
+		ResponderNotifierImpl &operator=(const ResponderNotifierImpl &);
+
+	protected:
+		~ResponderNotifierImpl();
+
+	public:
+		ResponderNotifierImpl();
+
+		int getFileDescriptor() const;
+		void clearNotifications();
+		void detach();
+
+		void notify();
+
+		void retain();
+		void release();
+};
+
+#endif /* __RESPONDERNOTIFIERIMPL_H__ */
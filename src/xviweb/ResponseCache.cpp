@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <xviweb/String.h>
+#include "ResponseCache.h"
+#include "Util.h"
+
+using namespace std;
+
+// headers that describe the connection a response was sent on,
+// or that are set again for each response sent from the cache
+static bool
+isUncachedHeader(const string &headerName)
+{
+	string name = String::toLower(headerName);
+	return (name == "connection" || name == "keep-alive" || name == "transfer-encoding" ||
+	        name == "trailer" || name == "content-length" || name == "age");
+}
+
+static string
+getValue(const HttpResponseMap &map, const string &name)
+{
+	HttpResponseMap::const_iterator iter = map.find(name);
+	return (iter != map.end()) ? iter->second : string("");
+}
+
+static string
+getPrimaryKey(const HttpRequest *request, const ResponderCachePolicy &policy)
+{
+	string key = String::toLower(request->getHeaderValue("Host")) + "\n" + request->getPath() + "\n";
+	if(policy.queryParameters.empty())
+		return key + request->getQueryString();
+
+	for(unsigned int i = 0; i < policy.queryParameters.size(); ++i)
+		key += policy.queryParameters[i] + "=" + request->getQueryStringValue(policy.queryParameters[i]) + "&";
+	return key;
+}
+
+ResponseCacheVariants::ResponseCacheVariants()
+{
+	entryCount = 0;
+}
+
+ResponseCacheWaiter::ResponseCacheWaiter(ResponseCache *cache, ResponseCacheFlight *flight, Responder *responder,
+                                         HttpResponseImpl *response, const ResponderCachePolicy &policy, long currentTime)
+ : m_policy(policy)
+{
+	m_cache = cache;
+	m_flight = NULL;
+	m_responder = responder;
+	m_response = response;
+	m_timeoutTime = currentTime + policy.maxWaitTime;
+	wait(flight, currentTime);
+}
+
+ResponseCacheWaiter::~ResponseCacheWaiter()
+{
+	if(m_flight != NULL) {
+		vector <ResponseCacheWaiter *> &waiters = m_flight->waiters;
+		waiters.erase(remove(waiters.begin(), waiters.end(), this), waiters.end());
+	}
+}
+
+void
+ResponseCacheWaiter::wait(ResponseCacheFlight *flight, long currentTime)
+{
+	m_flight = flight;
+	m_flight->waiters.push_back(this);
+	m_response->sleep();
+	m_response->wakeAfter(m_timeoutTime - currentTime);
+}
+
+void
+ResponseCacheWaiter::flightEnded()
+{
+	m_flight = NULL;
+	m_response->wake();
+}
+
+ResponderContext *
+ResponseCacheWaiter::continueResponse(const HttpRequest *request, HttpResponse * /*response*/)
+{
+	long currentTime = getMilliseconds();
+	if(m_flight != NULL && currentTime < m_timeoutTime) {
+		m_response->sleep();
+		m_response->wakeAfter(m_timeoutTime - currentTime);
+		return this;
+	}
+
+	// send the response that was stored, wait for another request
+	// that's taken over getting it, or get it from the responder
+	if(m_flight == NULL) {
+		ResponseCacheFill *fill = NULL;
+		ResponseCacheFlight *flight = NULL;
+		ResponseCacheEntry *entry = m_cache->lookup(request, m_policy, currentTime,
+		                                            (request->getVerb() == "GET") ? &fill : NULL,
+		                                            (currentTime < m_timeoutTime) ? &flight : NULL);
+		if(entry != NULL) {
+			m_response->sendCachedResponse(entry->buffer, entry->headLength, (currentTime - entry->storeTime) / 1000);
+			return NULL;
+		}
+		if(flight != NULL) {
+			wait(flight, currentTime);
+			return this;
+		}
+		if(fill != NULL)
+			m_response->startCapture(fill, m_cache->getMaxEntrySize());
+	} else {
+		vector <ResponseCacheWaiter *> &waiters = m_flight->waiters;
+		waiters.erase(remove(waiters.begin(), waiters.end(), this), waiters.end());
+		m_flight = NULL;
+	}
+
+	return m_responder->respond(request, m_response);
+}
+
+ResponseCache::ResponseCache()
+{
+	m_maxSize = 16 * 1024 * 1024;
+	m_size = 0;
+}
+
+ResponseCache::~ResponseCache()
+{
+	while(m_lru.empty() == false)
+		removeEntry(m_lru.back());
+
+	ResponseCacheFlightMap::iterator iter = m_flights.begin();
+	while(iter != m_flights.end()) {
+		delete iter->second;
+		++iter;
+	}
+}
+
+void
+ResponseCache::setMaxSize(size_t maxSize)
+{
+	m_maxSize = maxSize;
+	while(m_size > m_maxSize && m_lru.empty() == false)
+		removeEntry(m_lru.back());
+}
+
+// no single response can take up more than
+// an eighth of the cache
+size_t
+ResponseCache::getMaxEntrySize() const
+{
+	return m_maxSize / 8;
+}
+
+size_t
+ResponseCache::getEntrySize(const ResponseCacheEntry *entry)
+{
+	return sizeof(ResponseCacheEntry) + entry->key.length() + entry->primaryKey.length() +
+	       entry->buffer->getLength();
+}
+
+void
+ResponseCache::removeEntry(ResponseCacheEntry *entry)
+{
+	m_size -= getEntrySize(entry);
+	m_entries.erase(entry->key);
+	m_lru.erase(entry->lruIter);
+
+	ResponseCacheVariantsMap::iterator iter = m_variants.find(entry->primaryKey);
+	if(iter != m_variants.end() && --iter->second.entryCount == 0)
+		m_variants.erase(iter);
+
+	// the buffer may still be queued on connections
+	entry->buffer->release();
+	delete entry;
+}
+
+ResponseCacheEntry *
+ResponseCache::lookup(const HttpRequest *request, const ResponderCachePolicy &policy,
+                      long currentTime, ResponseCacheFill **fill, ResponseCacheFlight **flight)
+{
+	if(fill != NULL)
+		*fill = NULL;
+	if(flight != NULL)
+		*flight = NULL;
+	if(m_maxSize == 0)
+		return NULL;
+
+	// the entries for the request are told
+	// apart by the headers they vary on
+	string primaryKey = getPrimaryKey(request, policy);
+	string key = primaryKey;
+	ResponseCacheVariantsMap::const_iterator variants = m_variants.find(primaryKey);
+	if(variants != m_variants.end()) {
+		const vector <string> &varyHeaders = variants->second.varyHeaders;
+		for(unsigned int i = 0; i < varyHeaders.size(); ++i)
+			key += "\n" + varyHeaders[i] + ": " + request->getHeaderValue(varyHeaders[i]);
+	}
+
+	ResponseCacheEntryMap::iterator iter = m_entries.find(key);
+	ResponseCacheEntry *entry = (iter != m_entries.end()) ? iter->second : NULL;
+	if(entry != NULL && currentTime >= entry->staleTime) {
+		removeEntry(entry);
+		entry = NULL;
+	}
+
+	// a stale entry is sent unless this request
+	// can be the one that refreshes it
+	bool refresh = false;
+	if(entry != NULL) {
+		if(currentTime < entry->freshTime || fill == NULL || m_refreshing.find(key) != m_refreshing.end()) {
+			m_lru.splice(m_lru.begin(), m_lru, entry->lruIter);
+			return entry;
+		}
+
+		refresh = true;
+	}
+
+	// a request for a response that's already being
+	// gotten can wait for it if the policy allows
+	ResponseCacheFlightMap::iterator flightIter = m_flights.find(key);
+	if(flightIter != m_flights.end()) {
+		if(flight != NULL && policy.maxWaitTime > 0)
+			*flight = flightIter->second;
+		return NULL;
+	}
+
+	if(fill != NULL) {
+		if(refresh)
+			m_refreshing.insert(key);
+
+		ResponseCacheFill *newFill = new ResponseCacheFill();
+		newFill->key = key;
+		newFill->primaryKey = primaryKey;
+		newFill->refresh = refresh;
+		newFill->flight = new ResponseCacheFlight();
+		m_flights.insert(make_pair(key, newFill->flight));
+		newFill->maxAge = policy.maxAge;
+		newFill->staleTime = policy.staleTime;
+
+		vector <string> headerNames = request->getHeaderNames();
+		for(unsigned int i = 0; i < headerNames.size(); ++i)
+			newFill->requestHeaders[headerNames[i]] = request->getHeaderValue(headerNames[i]);
+
+		*fill = newFill;
+	}
+
+	return NULL;
+}
+
+void
+ResponseCache::store(ResponseCacheFill *fill, const HttpResponseImpl *response, long currentTime)
+{
+	if(fill->refresh)
+		m_refreshing.erase(fill->key);
+
+	// the waiting requests are woken once the response
+	// has been stored, or to call the responder themselves
+	m_flights.erase(fill->key);
+	ResponseCacheFlight *flight = fill->flight;
+	fill->flight = NULL;
+
+	storeResponse(fill, response, currentTime);
+	delete fill;
+
+	for(unsigned int i = 0; i < flight->waiters.size(); ++i)
+		flight->waiters[i]->flightEnded();
+	delete flight;
+}
+
+void
+ResponseCache::storeResponse(const ResponseCacheFill *fill, const HttpResponseImpl *response, long currentTime)
+{
+	if(response->isCaptureComplete() == false || m_maxSize == 0)
+		return;
+
+	// key the entry on the request headers it varies on
+	vector <string> varyHeaders = String::split(response->getHeaderValue("Vary"), ",");
+	for(unsigned int i = 0; i < varyHeaders.size(); ++i)
+		varyHeaders[i] = String::toLower(String::trim(varyHeaders[i]));
+	varyHeaders.erase(remove(varyHeaders.begin(), varyHeaders.end(), string()), varyHeaders.end());
+	sort(varyHeaders.begin(), varyHeaders.end());
+	varyHeaders.erase(unique(varyHeaders.begin(), varyHeaders.end()), varyHeaders.end());
+
+	string key = fill->primaryKey;
+	for(unsigned int i = 0; i < varyHeaders.size(); ++i)
+		key += "\n" + varyHeaders[i] + ": " + getValue(fill->requestHeaders, varyHeaders[i]);
+
+	// serialize the status line and headers, which are
+	// followed by per-response headers when it's sent
+	const string &body = response->getCapturedBody();
+	string head = "HTTP/1.1 " + String::fromInt(response->getStatusCode()) + " " + response->getStatusMessage() + "\r\n";
+	const HttpResponseMap &headers = response->getHeaders();
+	HttpResponseMap::const_iterator iter = headers.begin();
+	while(iter != headers.end()) {
+		if(isUncachedHeader(iter->first) == false)
+			head += iter->first + ": " + iter->second + "\r\n";
+		++iter;
+	}
+	head += "Content-Length: " + String::fromUInt((unsigned int)body.length()) + "\r\n";
+
+	if(head.length() + body.length() > getMaxEntrySize())
+		return;
+
+	ResponseCacheEntryMap::iterator existing = m_entries.find(key);
+	if(existing != m_entries.end())
+		removeEntry(existing->second);
+
+	// entries stored under different Vary headers
+	// can no longer be found and are left to expire
+	ResponseCacheVariants &variants = m_variants[fill->primaryKey];
+	variants.varyHeaders = varyHeaders;
+	++variants.entryCount;
+
+	ResponseCacheEntry *entry = new ResponseCacheEntry();
+	entry->key = key;
+	entry->primaryKey = fill->primaryKey;
+	entry->buffer = new SharedBuffer(head);
+	entry->buffer->append(body.data(), body.length());
+	entry->headLength = head.length();
+	entry->storeTime = currentTime;
+	entry->freshTime = currentTime + fill->maxAge;
+	entry->staleTime = entry->freshTime + fill->staleTime;
+	m_lru.push_front(entry);
+	entry->lruIter = m_lru.begin();
+	m_entries.insert(make_pair(key, entry));
+	m_size += getEntrySize(entry);
+
+	while(m_size > m_maxSize && m_lru.empty() == false)
+		removeEntry(m_lru.back());
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RESPONSECACHE_H__
+#define __RESPONSECACHE_H__
+
+#include <list>
+#include <map>
+#include <set>
+#include <xviweb/Responder.h>
+#include "HttpResponseImpl.h"
+#include "SharedBuffer.h"
+
+class ResponseCache;
+class ResponseCacheEntry;
+class ResponseCacheWaiter;
+
+typedef std::list<ResponseCacheEntry *> ResponseCacheList;
+
+class ResponseCacheEntry
+{
+	public:
+		std::string key;
+		std::string primaryKey;
+
+		// the status line and headers followed by the body
+		SharedBuffer *buffer;
+		size_t headLength;
+
+		long storeTime;
+		long freshTime;
+		long staleTime;
+		ResponseCacheList::iterator lruIter;
+};
+
+typedef std::map<std::string, ResponseCacheEntry *> ResponseCacheEntryMap;
+
+// the request headers that the responses to a request select
+// on (from their Vary headers), and how many entries there are
+class ResponseCacheVariants
+{
+	public:
+		std::vector <std::string> varyHeaders;
+		unsigned int entryCount;
+
+		ResponseCacheVariants();
+};
+
+typedef std::map<std::string, ResponseCacheVariants> ResponseCacheVariantsMap;
+
+// the requests waiting for a response that's being
+// gotten from the responder for another request
+class ResponseCacheFlight
+{
+	public:
+		std::vector <ResponseCacheWaiter *> waiters;
+};
+
+typedef std::map<std::string, ResponseCacheFlight *> ResponseCacheFlightMap;
+
+// what's needed to store the response to a request that wasn't
+// sent from the cache, since the request is gone by then
+class ResponseCacheFill
+{
+	public:
+		std::string key;
+		std::string primaryKey;
+		bool refresh;
+		ResponseCacheFlight *flight;
+		HttpResponseMap requestHeaders;
+		long maxAge;
+		long staleTime;
+};
+
+// the context of a request waiting for the response to an identical
+// one; once that response is stored it's sent from the cache, and
+// if it isn't stored or takes too long the responder is called
+class ResponseCacheWaiter : public ResponderContext
+{
+	private:
+		ResponseCache *m_cache;
+		ResponseCacheFlight *m_flight;
+		Responder *m_responder;
+		HttpResponseImpl *m_response;
+		ResponderCachePolicy m_policy;
+		long m_timeoutTime;
+
+		void wait(ResponseCacheFlight *flight, long currentTime);
+
+	public:
+		ResponseCacheWaiter(ResponseCache *cache, ResponseCacheFlight *flight, Responder *responder,
+		                    HttpResponseImpl *response, const ResponderCachePolicy &policy, long currentTime);
+		~ResponseCacheWaiter();
+
+		void flightEnded();
+
+		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
+};
+
+// keeps complete responses of responders that allow it, up to a
+// number of bytes, and evicts the least recently used ones first.
+// a stale entry is refreshed by the first request to find it,
+// and is sent to the others until it's been refreshed
+class ResponseCache
+{
+	private:
+		size_t m_maxSize;
+		size_t m_size;
+
+		ResponseCacheEntryMap m_entries;
+		ResponseCacheList m_lru;
+		ResponseCacheVariantsMap m_variants;
+		std::set <std::string> m_refreshing;
+		ResponseCacheFlightMap m_flights;
+
+		static size_t getEntrySize(const ResponseCacheEntry *entry);
+		void removeEntry(ResponseCacheEntry *entry);
+		void storeResponse(const ResponseCacheFill *fill, const HttpResponseImpl *response, long currentTime);
+
+	public:
+		ResponseCache();
+		~ResponseCache();
+
+		void setMaxSize(size_t maxSize);
+		size_t getMaxEntrySize() const;
+
+		// returns the entry to send for the request, or NULL if there
+		// isn't one. then, if asked for, the flight the request can
+		// wait on is returned if its response is already being
+		// gotten, or else a fill to capture its response with
+		ResponseCacheEntry *lookup(const HttpRequest *request, const ResponderCachePolicy &policy, long currentTime,
+		                           ResponseCacheFill **fill, ResponseCacheFlight **flight);
+
+		// stores the response if it was completely captured, wakes
+		// the requests waiting for it and deletes the fill
+		void store(ResponseCacheFill *fill, const HttpResponseImpl *response, long currentTime);
+};
+
+#endif /* __RESPONSECACHE_H__ */
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef XVIWEB_ZLIB
+#include <zlib.h>
+#endif
+#ifdef XVIWEB_ZSTD
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif
+#include <xviweb/String.h>
+#include "ResponseCompressor.h"
+
+using namespace std;
+
+// how many streams of each encoding a thread keeps for later
+// responses, and how much is output by a compressor at a time
+#define RESPONSE_COMPRESSOR_POOL_SIZE 16
+#define RESPONSE_COMPRESSOR_OUTPUT_SIZE 16384
+
+// the Zstandard window is kept small, since each stream has one,
+// unless a dictionary needs more to be referred to; clients only
+// have to accept windows of up to 8 MB (1 << 23)
+#define RESPONSE_COMPRESSOR_ZSTD_WINDOW_LOG 19
+#define RESPONSE_COMPRESSOR_ZSTD_MAX_WINDOW_LOG 23
+
+class ResponseCompressorStream
+{
+	public:
+		int level;
+#ifdef XVIWEB_ZLIB
+		z_stream zstream;
+#endif
+#ifdef XVIWEB_ZSTD
+		ZSTD_CCtx *cctx;
+#endif
+};
+
+typedef vector<ResponseCompressorStream *> ResponseCompressorPool;
+static __thread ResponseCompressorPool *s_pools[RESPONSE_ENCODING_COUNT];
+
+ResponseDictionary::ResponseDictionary(const string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		throw "unable to open the dictionary";
+
+	char buffer[65536];
+	ssize_t result;
+	while((result = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(result == -1 && errno == EINTR)
+			continue;
+		if(result == -1) {
+			close(fd);
+			throw "unable to read the dictionary";
+		}
+
+		m_data.append(buffer, (size_t)result);
+	}
+	close(fd);
+
+	if(m_data.length() == 0)
+		throw "the dictionary is empty";
+
+	// clients name the dictionary by its hash,
+	// as a structured field byte sequence
+	sha256(m_data.data(), m_data.length(), m_hash);
+	m_hashValue = ":" + String::base64Encode((const char *)m_hash, sizeof(m_hash)) + ":";
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+ResponseDictionary::~ResponseDictionary()
+{
+#ifdef XVIWEB_ZSTD
+	map<int, ZSTD_CDict *>::iterator iter;
+	for(iter = m_compressionDictionaries.begin(); iter != m_compressionDictionaries.end(); ++iter)
+		ZSTD_freeCDict(iter->second);
+#endif
+
+	pthread_mutex_destroy(&m_mutex);
+}
+
+const string &
+ResponseDictionary::getData() const
+{
+	return m_data;
+}
+
+const uint8_t *
+ResponseDictionary::getHash() const
+{
+	return m_hash;
+}
+
+bool
+ResponseDictionary::isAvailable(const string &availableDictionary) const
+{
+	return (String::trim(availableDictionary) == m_hashValue);
+}
+
+#ifdef XVIWEB_ZSTD
+// the Zstandard window needed to refer to the dictionary
+static int
+getZstdWindowLog(const ResponseDictionary *dictionary)
+{
+	int windowLog = RESPONSE_COMPRESSOR_ZSTD_WINDOW_LOG;
+	while(dictionary != NULL && windowLog < RESPONSE_COMPRESSOR_ZSTD_MAX_WINDOW_LOG &&
+	      ((size_t)1 << windowLog) < dictionary->getData().length() * 2)
+		++windowLog;
+
+	return windowLog;
+}
+#endif
+
+// the dictionary is prepared once for each level rather than for
+// every response; one that can't be is remembered as such, and
+// responses then use the dictionary as a prefix
+struct ZSTD_CDict_s *
+ResponseDictionary::getCompressionDictionary(int level) const
+{
+#ifdef XVIWEB_ZSTD
+	pthread_mutex_lock(&m_mutex);
+	map<int, ZSTD_CDict *>::const_iterator iter = m_compressionDictionaries.find(level);
+	if(iter != m_compressionDictionaries.end()) {
+		ZSTD_CDict *cdict = iter->second;
+		pthread_mutex_unlock(&m_mutex);
+		return cdict;
+	}
+
+	ZSTD_CDict *cdict = NULL;
+	ZSTD_CCtx_params *params = ZSTD_createCCtxParams();
+	if(params != NULL) {
+		ZSTD_CCtxParams_setParameter(params, ZSTD_c_compressionLevel, level);
+		ZSTD_CCtxParams_setParameter(params, ZSTD_c_windowLog, getZstdWindowLog(this));
+		cdict = ZSTD_createCDict_advanced2(m_data.data(), m_data.length(), ZSTD_dlm_byRef,
+		                                   ZSTD_dct_rawContent, params, ZSTD_defaultCMem);
+		ZSTD_freeCCtxParams(params);
+	}
+
+	m_compressionDictionaries.insert(make_pair(level, cdict));
+	pthread_mutex_unlock(&m_mutex);
+	return cdict;
+#else
+	(void)level;
+	return NULL;
+#endif
+}
+
+ResponseCompressor::ResponseCompressor(ResponseEncoding encoding, int level,
+                                       const ResponseDictionary *dictionary)
+{
+	if(isSupported(encoding) == false || (encoding == RESPONSE_ENCODING_DCZ && dictionary == NULL))
+		throw "the encoding isn't supported";
+
+	m_encoding = encoding;
+	m_dictionary = (encoding == RESPONSE_ENCODING_DCZ) ? dictionary : NULL;
+	m_started = false;
+
+	ResponseCompressorPool *&pool = s_pools[encoding];
+	if(pool == NULL)
+		pool = new ResponseCompressorPool();
+
+	if(pool->empty() == false) {
+		m_stream = pool->back();
+		pool->pop_back();
+	} else {
+		m_stream = new ResponseCompressorStream();
+		m_stream->level = level;
+
+		if(encoding == RESPONSE_ENCODING_GZIP || encoding == RESPONSE_ENCODING_DEFLATE) {
+#ifdef XVIWEB_ZLIB
+			// a window of 15 bits plus 16 makes a gzip stream
+			// rather than a zlib one, which "deflate" means
+			memset(&m_stream->zstream, 0, sizeof(m_stream->zstream));
+			int windowBits = (encoding == RESPONSE_ENCODING_GZIP) ? 15 + 16 : 15;
+			if(deflateInit2(&m_stream->zstream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+				delete m_stream;
+				throw "deflateInit2() failed";
+			}
+#endif
+		} else {
+#ifdef XVIWEB_ZSTD
+			m_stream->cctx = ZSTD_createCCtx();
+			if(m_stream->cctx == NULL) {
+				delete m_stream;
+				throw "ZSTD_createCCtx() failed";
+			}
+#endif
+		}
+	}
+
+	// a stream that's been reset only needs its parameters
+	// set to be used again; Zstandard's are reset along with it
+	if(encoding == RESPONSE_ENCODING_GZIP || encoding == RESPONSE_ENCODING_DEFLATE) {
+#ifdef XVIWEB_ZLIB
+		if(m_stream->level != level && deflateParams(&m_stream->zstream, level, Z_DEFAULT_STRATEGY) == Z_OK)
+			m_stream->level = level;
+#endif
+	} else {
+#ifdef XVIWEB_ZSTD
+		ZSTD_CCtx_setParameter(m_stream->cctx, ZSTD_c_compressionLevel, level);
+		ZSTD_CCtx_setParameter(m_stream->cctx, ZSTD_c_windowLog, getZstdWindowLog(m_dictionary));
+		if(m_dictionary != NULL) {
+			ZSTD_CDict *cdict = m_dictionary->getCompressionDictionary(level);
+			if(cdict != NULL)
+				ZSTD_CCtx_refCDict(m_stream->cctx, cdict);
+			else
+				ZSTD_CCtx_refPrefix(m_stream->cctx, m_dictionary->getData().data(), m_dictionary->getData().length());
+		}
+		m_stream->level = level;
+#endif
+	}
+}
+
+ResponseCompressor::~ResponseCompressor()
+{
+	ResponseCompressorPool *pool = s_pools[m_encoding];
+	bool pooled = (pool->size() < RESPONSE_COMPRESSOR_POOL_SIZE);
+
+	if(m_encoding == RESPONSE_ENCODING_GZIP || m_encoding == RESPONSE_ENCODING_DEFLATE) {
+#ifdef XVIWEB_ZLIB
+		if(pooled && deflateReset(&m_stream->zstream) == Z_OK) {
+			pool->push_back(m_stream);
+			return;
+		}
+
+		deflateEnd(&m_stream->zstream);
+#endif
+	} else {
+#ifdef XVIWEB_ZSTD
+		if(pooled && ZSTD_isError(ZSTD_CCtx_reset(m_stream->cctx, ZSTD_reset_session_and_parameters)) == 0) {
+			pool->push_back(m_stream);
+			return;
+		}
+
+		ZSTD_freeCCtx(m_stream->cctx);
+#endif
+	}
+
+	(void)pooled;
+	delete m_stream;
+}
+
+bool
+ResponseCompressor::isSupported(ResponseEncoding encoding)
+{
+	switch(encoding) {
+#ifdef XVIWEB_ZSTD
+		case RESPONSE_ENCODING_DCZ:
+		case RESPONSE_ENCODING_ZSTD:
+			return true;
+#endif
+#ifdef XVIWEB_ZLIB
+		case RESPONSE_ENCODING_GZIP:
+		case RESPONSE_ENCODING_DEFLATE:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+const char *
+ResponseCompressor::getName(ResponseEncoding encoding)
+{
+	switch(encoding) {
+		case RESPONSE_ENCODING_DCZ:
+			return "dcz";
+		case RESPONSE_ENCODING_ZSTD:
+			return "zstd";
+		case RESPONSE_ENCODING_GZIP:
+			return "gzip";
+		case RESPONSE_ENCODING_DEFLATE:
+			return "deflate";
+		default:
+			return "";
+	}
+}
+
+bool
+ResponseCompressor::isCompressible(const string &contentType)
+{
+	string type = String::toLower(String::trim(String::split(contentType, ";")[0]));
+	if(type == "text/event-stream")
+		return false;
+	if(type.compare(0, 5, "text/") == 0)
+		return true;
+
+	return (type == "application/javascript" || type == "application/json" ||
+	        type == "application/xml" || type == "application/wasm" || type == "image/svg+xml" ||
+	        type == "image/x-icon" || String::endsWith(type, "+json") || String::endsWith(type, "+xml"));
+}
+
+ResponseEncoding
+ResponseCompressor::getEncoding() const
+{
+	return m_encoding;
+}
+
+void
+ResponseCompressor::compress(const char *data, size_t length, ResponseCompressorFlush flush, string *output)
+{
+	// a dcz body starts with the hash of its dictionary,
+	// in what Zstandard decoders take as a skippable frame
+	if(m_started == false && m_encoding == RESPONSE_ENCODING_DCZ) {
+		static const char magic[8] = { 0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00 };
+		output->append(magic, sizeof(magic));
+		output->append((const char *)m_dictionary->getHash(), SHA256_DIGEST_LENGTH);
+	}
+	m_started = true;
+
+	if(m_encoding == RESPONSE_ENCODING_GZIP || m_encoding == RESPONSE_ENCODING_DEFLATE) {
+#ifdef XVIWEB_ZLIB
+		z_stream *zstream = &m_stream->zstream;
+		int mode = Z_NO_FLUSH;
+		if(flush == RESPONSE_COMPRESSOR_SYNC_FLUSH)
+			mode = Z_SYNC_FLUSH;
+		else if(flush == RESPONSE_COMPRESSOR_FINISH)
+			mode = Z_FINISH;
+
+		// deflate's done with the input once it
+		// leaves some of the output buffer unused
+		zstream->next_in = (Bytef *)data;
+		zstream->avail_in = (uInt)length;
+		do {
+			size_t offset = output->length();
+			output->resize(offset + RESPONSE_COMPRESSOR_OUTPUT_SIZE);
+			zstream->next_out = (Bytef *)&(*output)[offset];
+			zstream->avail_out = RESPONSE_COMPRESSOR_OUTPUT_SIZE;
+
+			int result = deflate(zstream, mode);
+			output->resize(offset + RESPONSE_COMPRESSOR_OUTPUT_SIZE - zstream->avail_out);
+			if(result == Z_STREAM_ERROR)
+				throw "deflate() failed";
+		} while(zstream->avail_out == 0);
+#endif
+	} else {
+#ifdef XVIWEB_ZSTD
+		ZSTD_EndDirective mode = ZSTD_e_continue;
+		if(flush == RESPONSE_COMPRESSOR_SYNC_FLUSH)
+			mode = ZSTD_e_flush;
+		else if(flush == RESPONSE_COMPRESSOR_FINISH)
+			mode = ZSTD_e_end;
+
+		// flushing is done once nothing's left to be
+		// output; otherwise, once the input's consumed
+		ZSTD_inBuffer input = { data, length, 0 };
+		size_t remaining;
+		do {
+			size_t offset = output->length();
+			output->resize(offset + RESPONSE_COMPRESSOR_OUTPUT_SIZE);
+			ZSTD_outBuffer buffer = { &(*output)[offset], RESPONSE_COMPRESSOR_OUTPUT_SIZE, 0 };
+
+			remaining = ZSTD_compressStream2(m_stream->cctx, &buffer, &input, mode);
+			output->resize(offset + buffer.pos);
+			if(ZSTD_isError(remaining))
+				throw "ZSTD_compressStream2() failed";
+		} while((mode == ZSTD_e_continue) ? (input.pos < input.size) : (remaining != 0));
+#endif
+	}
+
+#if !defined(XVIWEB_ZLIB) && !defined(XVIWEB_ZSTD)
+	(void)data;
+	(void)length;
+	(void)flush;
+#endif
+}
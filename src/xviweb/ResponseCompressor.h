@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RESPONSECOMPRESSOR_H__
+#define __RESPONSECOMPRESSOR_H__
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <pthread.h>
+#include "Sha256.h"
+
+// the encodings that responses can be compressed in
+// as they're sent, from the most to the least preferred
+enum ResponseEncoding
+{
+	// Zstandard with a dictionary that the client has, as
+	// compression dictionary transport (RFC 9842) describes
+	RESPONSE_ENCODING_DCZ,
+	RESPONSE_ENCODING_ZSTD,
+	RESPONSE_ENCODING_GZIP,
+	RESPONSE_ENCODING_DEFLATE,
+	RESPONSE_ENCODING_COUNT
+};
+
+enum ResponseCompressorFlush
+{
+	// output may be held back to be compressed with what follows
+	RESPONSE_COMPRESSOR_NO_FLUSH,
+
+	// everything so far is output, so the client can decompress it
+	RESPONSE_COMPRESSOR_SYNC_FLUSH,
+
+	// everything is output and the stream is ended
+	RESPONSE_COMPRESSOR_FINISH
+};
+
+class ResponseCompressorStream;
+struct ZSTD_CDict_s;
+
+// a dictionary that responses are compressed with for clients that
+// say they have it, by giving its hash in their Available-Dictionary
+// header; it's used as raw content, as the clients use it
+class ResponseDictionary
+{
+	private:
+		std::string m_data;
+		uint8_t m_hash[SHA256_DIGEST_LENGTH];
+		std::string m_hashValue;
+
+		// the dictionary as Zstandard prepares it for each level
+		// it's used at, which every thread's compressors share
+		mutable std::map <int, struct ZSTD_CDict_s *> m_compressionDictionaries;
+		mutable pthread_mutex_t m_mutex;
+
+		ResponseDictionary(const ResponseDictionary &);
+		ResponseDictionary &operator=(const ResponseDictionary &);
+
+	public:
+		ResponseDictionary(const std::string &path);
+		~ResponseDictionary();
+
+		const std::string &getData() const;
+		const uint8_t *getHash() const;
+
+		// returns null if the dictionary can't be prepared
+		// (or the server was built without Zstandard)
+		struct ZSTD_CDict_s *getCompressionDictionary(int level) const;
+
+		// returns true if the value of an Available-Dictionary
+		// header is this dictionary's hash
+		bool isAvailable(const std::string &availableDictionary) const;
+};
+
+// compresses a response's body as it's sent; the streams that hold
+// the compressor's state are kept by each thread once their
+// responses have ended, to be reset and used by later ones
+class ResponseCompressor
+{
+	private:
+		ResponseEncoding m_encoding;
+		ResponseCompressorStream *m_stream;
+		const ResponseDictionary *m_dictionary;
+		bool m_started;
+
+		ResponseCompressor(const ResponseCompressor &);
+		ResponseCompressor &operator=(const ResponseCompressor &);
+
+	public:
+		// responses in the dcz encoding need a dictionary
+		ResponseCompressor(ResponseEncoding encoding, int level,
+		                   const ResponseDictionary *dictionary = NULL);
+		~ResponseCompressor();
+
+		// returns false if the server wasn't built with the
+		// library that the encoding needs
+		static bool isSupported(ResponseEncoding encoding);
+
+		// the name used for the encoding in HTTP headers
+		static const char *getName(ResponseEncoding encoding);
+
+		// returns true if bodies of the given type are worth
+		// compressing; images and archives already are, and event
+		// streams are sent to each client as they're published
+		static bool isCompressible(const std::string &contentType);
+
+		ResponseEncoding getEncoding() const;
+
+		// compresses the data, appending what's
+		// output to the end of the string
+		void compress(const char *data, size_t length, ResponseCompressorFlush flush, std::string *output);
+};
+
+#endif /* __RESPONSECOMPRESSOR_H__ */
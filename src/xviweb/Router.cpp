@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xviweb/String.h>
+#include "Router.h"
+
+using namespace std;
+
+RouterNode::RouterNode()
+{
+	parameterChild = NULL;
+}
+
+RouterNode::~RouterNode()
+{
+	for(unsigned int i = 0; i < children.size(); ++i)
+		delete children[i];
+	delete parameterChild;
+}
+
+Router::Router()
+{
+	m_root = new RouterNode();
+}
+
+Router::~Router()
+{
+	clear();
+	delete m_root;
+}
+
+void
+Router::clear()
+{
+	delete m_root;
+	m_root = new RouterNode();
+
+	RouterHostMap::iterator iter = m_hostRoots.begin();
+	while(iter != m_hostRoots.end()) {
+		delete iter->second;
+		++iter;
+	}
+	m_hostRoots.clear();
+
+	m_unroutedResponders.clear();
+}
+
+void
+Router::build(const vector <Responder *> &responders)
+{
+	clear();
+
+	for(unsigned int i = 0; i < responders.size(); ++i) {
+		vector <ResponderRoute> routes;
+		responders[i]->getRoutes(&routes);
+		if(routes.size() == 0) {
+			m_unroutedResponders.push_back(responders[i]);
+			continue;
+		}
+
+		for(unsigned int j = 0; j < routes.size(); ++j)
+			addRoute(routes[j], responders[i]);
+	}
+}
+
+// returns true if a ':' or '*' at the given position of
+// a route path begins a parameter rather than being text
+static bool
+isParameterStart(const string &path, size_t pos)
+{
+	return (path[pos] == '*' || (path[pos] == ':' && path[pos - 1] == '/'));
+}
+
+void
+Router::addRoute(const ResponderRoute &route, Responder *responder)
+{
+	const string &path = route.path;
+	if(path.length() == 0 || path[0] != '/')
+		throw "Responder route paths must begin with /";
+
+	RouterEntry entry;
+	entry.method = route.method;
+	entry.responder = responder;
+
+	RouterNode *node;
+	if(route.host.length() != 0) {
+		string host = String::toLower(route.host);
+		RouterHostMap::iterator iter = m_hostRoots.find(host);
+		if(iter == m_hostRoots.end())
+			iter = m_hostRoots.insert(make_pair(host, new RouterNode())).first;
+		node = iter->second;
+	} else {
+		node = m_root;
+	}
+
+	size_t pos = 0;
+	while(pos < path.length()) {
+		if(path[pos] == '*') {
+			// the rest of the path is the wildcard's name
+			string name = path.substr(pos + 1);
+			if(node->wildcardEntries.size() != 0 && node->wildcardName != name)
+				throw "Responder routes have different names for the same wildcard";
+			node->wildcardName = name;
+			node->wildcardEntries.push_back(entry);
+			return;
+		}
+
+		if(path[pos] == ':' && path[pos - 1] == '/') {
+			size_t end = path.find('/', pos);
+			if(end == string::npos)
+				end = path.length();
+			string name = path.substr(pos + 1, end - pos - 1);
+
+			if(node->parameterChild == NULL) {
+				node->parameterChild = new RouterNode();
+				node->parameterName = name;
+			} else if(node->parameterName != name) {
+				throw "Responder routes have different names for the same path parameter";
+			}
+
+			node = node->parameterChild;
+			pos = end;
+			continue;
+		}
+
+		// find the text up to the next parameter
+		size_t end = pos + 1;
+		while(end < path.length() && !isParameterStart(path, end))
+			++end;
+		string text = path.substr(pos, end - pos);
+
+		RouterNode *child = NULL;
+		unsigned int i;
+		for(i = 0; i < node->children.size(); ++i) {
+			if(node->children[i]->text[0] == text[0]) {
+				child = node->children[i];
+				break;
+			}
+		}
+
+		if(child == NULL) {
+			child = new RouterNode();
+			child->text = text;
+			node->children.push_back(child);
+			node = child;
+			pos = end;
+			continue;
+		}
+
+		// split the child where its text differs from the route's
+		size_t length = 1;
+		while(length < child->text.length() && length < text.length() && child->text[length] == text[length])
+			++length;
+		if(length < child->text.length()) {
+			RouterNode *split = new RouterNode();
+			split->text = child->text.substr(0, length);
+			child->text.erase(0, length);
+			split->children.push_back(child);
+			node->children[i] = split;
+			child = split;
+		}
+
+		node = child;
+		pos += length;
+	}
+
+	node->entries.push_back(entry);
+}
+
+static const RouterEntry *
+findEntry(const RouterEntryList &entries, const string &method)
+{
+	for(unsigned int i = 0; i < entries.size(); ++i) {
+		const string &entryMethod = entries[i].method;
+		if(entryMethod.length() == 0 || entryMethod == method || (entryMethod == "GET" && method == "HEAD"))
+			return &entries[i];
+	}
+
+	return NULL;
+}
+
+// finds the route for the path following the given position; text
+// matches take priority over parameters, and parameters over wildcards
+static const RouterEntry *
+findRoute(const RouterNode *node, const string &path, size_t pos, const string &method, RouterParameterList &parameters)
+{
+	if(pos == path.length()) {
+		const RouterEntry *entry = findEntry(node->entries, method);
+		if(entry != NULL)
+			return entry;
+	} else {
+		for(unsigned int i = 0; i < node->children.size(); ++i) {
+			const RouterNode *child = node->children[i];
+			if(child->text[0] == path[pos]) {
+				if(path.compare(pos, child->text.length(), child->text) == 0) {
+					const RouterEntry *entry = findRoute(child, path, pos + child->text.length(), method, parameters);
+					if(entry != NULL)
+						return entry;
+				}
+				break;
+			}
+		}
+
+		if(node->parameterChild != NULL) {
+			size_t end = path.find('/', pos);
+			if(end == string::npos)
+				end = path.length();
+			if(end > pos) {
+				parameters.push_back(make_pair(node->parameterName, path.substr(pos, end - pos)));
+				const RouterEntry *entry = findRoute(node->parameterChild, path, end, method, parameters);
+				if(entry != NULL)
+					return entry;
+				parameters.pop_back();
+			}
+		}
+	}
+
+	if(node->wildcardEntries.size() != 0) {
+		const RouterEntry *entry = findEntry(node->wildcardEntries, method);
+		if(entry != NULL) {
+			parameters.push_back(make_pair(node->wildcardName, path.substr(pos)));
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+Responder *
+Router::route(HttpRequestImpl *request) const
+{
+	string path = request->getPath();
+	string method = request->getVerb();
+	RouterParameterList parameters;
+	const RouterEntry *entry = NULL;
+
+	// routes for the request's host take priority
+	if(m_hostRoots.size() != 0) {
+		RouterHostMap::const_iterator iter = m_hostRoots.find(String::toLower(request->getHeaderValue("Host")));
+		if(iter != m_hostRoots.end())
+			entry = findRoute(iter->second, path, 0, method, parameters);
+	}
+	if(entry == NULL)
+		entry = findRoute(m_root, path, 0, method, parameters);
+
+	if(entry != NULL) {
+		for(unsigned int i = 0; i < parameters.size(); ++i)
+			request->setPathParameter(parameters[i].first, parameters[i].second);
+		return entry->responder;
+	}
+
+	for(unsigned int i = 0; i < m_unroutedResponders.size(); ++i) {
+		if(m_unroutedResponders[i]->matchesRequest(request))
+			return m_unroutedResponders[i];
+	}
+
+	return NULL;
+}
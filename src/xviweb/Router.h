@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+#include <map>
+#include <vector>
+#include <xviweb/Responder.h>
+#include "HttpRequestImpl.h"
+
+class RouterEntry
+{
+	public:
+		std::string method;
+		Responder *responder;
+};
+
+typedef std::vector<RouterEntry> RouterEntryList;
+typedef std::vector<std::pair<std::string, std::string> > RouterParameterList;
+
+// a node of a radix tree of route paths; the text of a node's path
+// follows that of its parent, and its children's text begins with
+// different characters
+class RouterNode
+{
+	public:
+		std::string text;
+		std::vector <RouterNode *> children;
+
+		// a child matching any one path segment, and
+		// the routes matching the rest of the path
+		RouterNode *parameterChild;
+		std::string parameterName;
+		RouterEntryList wildcardEntries;
+		std::string wildcardName;
+
+		// the routes whose paths end at the node
+		RouterEntryList entries;
+
+		RouterNode();
+		~RouterNode();
+};
+
+typedef std::map<std::string, RouterNode *> RouterHostMap;
+
+// finds the responder for a request from the responders' routes,
+// falling back to the responders without routes in turn, so that
+// finding it takes about as long no matter how many are loaded
+class Router
+{
+	private:
+		RouterNode *m_root;
+		RouterHostMap m_hostRoots;
+		std::vector <Responder *> m_unroutedResponders;
+
+		Router(const Router &);
+		Router &operator=(const Router &);
+
+		void addRoute(const ResponderRoute &route, Responder *responder);
+
+	public:
+		Router();
+		~Router();
+
+		void clear();
+
+		// responders earlier in the list take priority
+		void build(const std::vector <Responder *> &responders);
+
+		// returns the responder for the request, or null if there's
+		// none, and sets the request's path parameters
+		Responder *route(HttpRequestImpl *request) const;
+};
+
+#endif /* __ROUTER_H__ */
@@ -24,19 +24,30 @@
  */
 
 #include <iostream>
+#include <cerrno>
 #include <cstring>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
-#include <poll.h>
 #include <fcntl.h>
 #include <xviweb/String.h>
+#include "HttpClientImpl.h"
+#include "IoRingPoller.h"
 #include "Server.h"
 #include "Util.h"
 
 using namespace std;
 
+// connections that aren't sending a response are closed once
+// they haven't been read from for this many milliseconds
+#define SERVER_IDLE_TIMEOUT 10000
+
+// accepting connections is paused for this many milliseconds
+// when it fails, unless a connection is closed sooner
+#define SERVER_ACCEPT_PAUSE 100
+
 ServerConnection::ServerConnection(HttpConnection *connectionValue,
                                    HttpResponseImpl *responseValue,
                                    ResponderContext *contextValue)
@@ -44,18 +55,87 @@ ServerConnection::ServerConnection(HttpConnection *connectionValue,
 	connection = connectionValue;
 	response = responseValue;
 	context = contextValue;
-	wakeupTime = 0;
+	responder = NULL;
+	wakeupTime = -1;
+	timerTime = -1;
+	pollEvents = 0;
+	notifierFd = -1;
+	inputTime = 0;
+	requestTime = 0;
+	clientEntry = NULL;
+	removed = false;
+	session = NULL;
+	parent = NULL;
+}
+
+ServerStatistics::ServerStatistics()
+{
+	acceptedConnections = 0;
+	acceptQueueOverflows = 0;
+	maxAcceptQueueLength = 0;
+	fullAcceptBatches = 0;
+	acceptErrors = 0;
+	rejectedConnections = 0;
+	shedRequests = 0;
+	rejectedClientConnections = 0;
+	limitedRequests = 0;
+	http2Connections = 0;
+	http2Streams = 0;
+}
+
+static SharedBuffer *
+buildPrebuiltResponse(const string &status, const string &body, size_t *headLength)
+{
+	string head = "HTTP/1.1 " + status + "\r\n";
+	head += "Content-Type: text/plain\r\n";
+	head += "Content-Length: " + String::fromInt((int)body.length()) + "\r\n";
+	head += "Retry-After: 1\r\n";
+	head += "Connection: close\r\n\r\n";
+
+	*headLength = head.length();
+	return new SharedBuffer(head + body);
 }
 
 Server::Server()
  : m_address("127.0.0.1"), m_port(8080)
 {
 	m_fd = -1;
+	m_tlsFd = -1;
+	m_tlsPort = 0;
+	m_ioUring = false;
+	m_fileReadThreads = 4;
+	m_listenBacklog = SOMAXCONN;
+	m_acceptBatchSize = 64;
+	m_maxConnections = 0;
+	m_connectionCount = 0;
+	m_acceptResumeTime = 0;
+	m_poller = NULL;
+	m_pollTime = 0;
+	m_maxHeaderSize = 8 * 1024;
+	m_maxBodySize = 1024 * 1024;
+	m_uploadDirectory = "/tmp";
+	m_uploadMemoryThreshold = 64 * 1024;
+	m_maxOutputSize = 64 * 1024;
+	m_maxConcurrentStreams = 100;
+	m_compressionLevel = 6;
+	m_compressionMinSize = 1024;
+
+	// the responses to requests that are turned away are built
+	// once, so that turning them away costs as little as possible
+	m_overloadResponse = buildPrebuiltResponse("503 Service Unavailable", "The server is too busy to handle your request. Please try again later.\n", &m_overloadHeadLength);
+	m_rateLimitResponse = buildPrebuiltResponse("429 Too Many Requests", "You have made too many requests. Please try again later.\n", &m_rateLimitHeadLength);
 }
 
 Server::~Server()
 {
 	stop();
+	m_overloadResponse->release();
+	m_rateLimitResponse->release();
+
+	for(ServerVHostDictionaryMap::iterator iter = m_compressionDictionaries.begin(); iter != m_compressionDictionaries.end(); ++iter) {
+		for(ServerDictionaryMap::iterator dictionaryIter = iter->second.begin(); dictionaryIter != iter->second.end(); ++dictionaryIter)
+			delete dictionaryIter->second;
+	}
 }
 
 const Address &
@@ -82,6 +162,97 @@ Server::setPort(unsigned short port)
 	m_port = port;
 }
 
+unsigned short
+Server::getTlsPort() const
+{
+	return m_tlsPort;
+}
+
+void
+Server::setTlsPort(unsigned short tlsPort)
+{
+	m_tlsPort = tlsPort;
+}
+
+void
+Server::setTlsCertificate(const string &certificateFile, const string &keyFile)
+{
+	m_tlsContext.setCertificate(certificateFile, keyFile);
+}
+
+void
+Server::addVHostCertificate(const string &hostname, const string &certificateFile, const string &keyFile)
+{
+	m_tlsContext.addHostCertificate(hostname, certificateFile, keyFile);
+}
+
+void
+Server::setIoUring(bool ioUring)
+{
+	m_ioUring = ioUring;
+}
+
+void
+Server::setFileReadThreads(unsigned int fileReadThreads)
+{
+	m_fileReadThreads = fileReadThreads;
+}
+
+void
+Server::setListenBacklog(int listenBacklog)
+{
+	m_listenBacklog = listenBacklog;
+}
+
+void
+Server::setAcceptBatchSize(unsigned int acceptBatchSize)
+{
+	m_acceptBatchSize = (acceptBatchSize != 0) ? acceptBatchSize : 1;
+}
+
+void
+Server::setMaxConnections(unsigned int maxConnections)
+{
+	m_maxConnections = maxConnections;
+}
+
+void
+Server::setMaxClientConnections(unsigned int maxClientConnections)
+{
+	m_clientLimiter.setMaxConnections(maxClientConnections);
+}
+
+void
+Server::setClientRequestRate(long clientRequestRate, long clientRequestBurst)
+{
+	m_clientLimiter.setRequestRate(clientRequestRate);
+	m_clientLimiter.setRequestBurst(clientRequestBurst);
+}
+
+void
+Server::setClientTableSize(unsigned int clientTableSize)
+{
+	m_clientLimiter.setTableSize(clientTableSize);
+}
+
+void
+Server::setOverloadTarget(long overloadTarget)
+{
+	m_loadShedder.setTarget(overloadTarget);
+}
+
+void
+Server::setOverloadInterval(long overloadInterval)
+{
+	m_loadShedder.setInterval(overloadInterval);
+}
+
+void
+Server::addExemptPath(const string &path)
+{
+	m_exemptPaths.insert(path);
+}
+
 void
 Server::setDefaultRoot(const string &root)
 {
@@ -94,262 +265,1420 @@ Server::addVHost(const string &hostname, const string &root)
 	m_vhostMap.insert(make_pair(String::toLower(hostname), root));
 }
 
+void
+Server::setMaxHeaderSize(unsigned int maxHeaderSize)
+{
+	m_maxHeaderSize = maxHeaderSize;
+}
+
+void
+Server::setMaxBodySize(uint64_t maxBodySize)
+{
+	m_maxBodySize = maxBodySize;
+}
+
+void
+Server::setUploadDirectory(const string &uploadDirectory)
+{
+	m_uploadDirectory = uploadDirectory;
+}
+
+void
+Server::setUploadMemoryThreshold(size_t uploadMemoryThreshold)
+{
+	m_uploadMemoryThreshold = uploadMemoryThreshold;
+}
+
+void
+Server::setMaxOutputSize(size_t maxOutputSize)
+{
+	m_maxOutputSize = maxOutputSize;
+}
+
+void
+Server::setMaxConcurrentStreams(unsigned int maxConcurrentStreams)
+{
+	m_maxConcurrentStreams = maxConcurrentStreams;
+}
+
+void
+Server::setResponseCacheSize(size_t responseCacheSize)
+{
+	m_responseCache.setMaxSize(responseCacheSize);
+}
+
+void
+Server::setCompressionLevel(int compressionLevel)
+{
+	m_compressionLevel = compressionLevel;
+}
+
+void
+Server::setVHostCompressionLevel(const string &hostname, int compressionLevel)
+{
+	m_vhostCompressionLevels[String::toLower(hostname)] = compressionLevel;
+}
+
+void
+Server::setCompressionMinSize(size_t compressionMinSize)
+{
+	m_compressionMinSize = compressionMinSize;
+}
+
+void
+Server::addCompressionDictionary(const string &hostname, const string &pathPrefix, const string &path)
+{
+	if(ResponseCompressor::isSupported(RESPONSE_ENCODING_DCZ) == false)
+		throw "the server was built without Zstandard compression";
+
+	ResponseDictionary *dictionary = new ResponseDictionary(path);
+	ResponseDictionary *&entry = m_compressionDictionaries[String::toLower(hostname)][pathPrefix];
+	delete entry;
+	entry = dictionary;
+}
+
+// returns the dictionary with the longest prefix of the path,
+// preferring the vhost's own dictionaries to the global ones
+const ResponseDictionary *
+Server::findCompressionDictionary(const string &host, const string &path) const
+{
+	const ResponseDictionary *dictionary = NULL;
+	ServerVHostDictionaryMap::const_iterator iter = m_compressionDictionaries.find(host);
+	if(iter == m_compressionDictionaries.end() && host.length() != 0)
+		return findCompressionDictionary("", path);
+	if(iter == m_compressionDictionaries.end())
+		return NULL;
+
+	size_t prefixLength = 0;
+	for(ServerDictionaryMap::const_iterator dictionaryIter = iter->second.begin(); dictionaryIter != iter->second.end(); ++dictionaryIter) {
+		const string &prefix = dictionaryIter->first;
+		if((dictionary == NULL || prefix.length() > prefixLength) && path.compare(0, prefix.length(), prefix) == 0) {
+			dictionary = dictionaryIter->second;
+			prefixLength = prefix.length();
+		}
+	}
+
+	if(dictionary == NULL && host.length() != 0)
+		return findCompressionDictionary("", path);
+	return dictionary;
+}
+
+const ServerStatistics &
+Server::getStatistics() const
+{
+	return m_statistics;
+}
+
 void
 Server::attachResponder(Responder *responder)
 {
 	m_responders.insert(m_responders.begin(), responder);
+
+	// responders are usually attached before the server
+	// starts, which is when the router is built
+	if(m_fd != -1)
+		m_router.build(m_responders);
 }
 
 void
-Server::start()
+Server::addEventSource(ServerEventSource *source)
 {
-	if(m_fd != -1)
-		throw "Server already started";
+	m_eventSources.push_back(source);
+}
+
+void
+Server::removeEventSource(ServerEventSource *source)
+{
+	for(unsigned int i = 0; i < m_eventSources.size(); ++i) {
+		if(m_eventSources[i] == source) {
+			m_eventSources.erase(m_eventSources.begin() + i);
+			break;
+		}
+	}
+
+	for(unsigned int i = 0; i < m_sourceDescriptors.size(); ++i) {
+		if(m_sourceDescriptors[i] == source)
+			unwatchDescriptor((int)i);
+	}
+}
+
+void
+Server::watchDescriptor(int fd, int events, ServerEventSource *source)
+{
+	if((int)m_sourceDescriptors.size() <= fd)
+		m_sourceDescriptors.resize(fd + 1, NULL);
+
+	if(m_sourceDescriptors[fd] == NULL)
+		m_poller->add(fd, events);
+	else
+		m_poller->modify(fd, events);
+	m_sourceDescriptors[fd] = source;
+}
+
+void
+Server::unwatchDescriptor(int fd)
+{
+	if(fd >= (int)m_sourceDescriptors.size() || m_sourceDescriptors[fd] == NULL)
+		return;
+
+	m_poller->remove(fd);
+	m_sourceDescriptors[fd] = NULL;
+}
+
+// returns a nonblocking socket listening on the
+// server's address and the given port
+int
+Server::createListeningSocket(unsigned short port)
+{
+	int fd;
 
 	if(m_address.getType() == ADDRESS_TYPE_IPV4) {
 		// create IPv4 socket
-		m_fd = socket(AF_INET, SOCK_STREAM, 0);
-		if(m_fd == -1)
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd == -1)
 			throw "socket() failed";
 
 		int value = 1;
-		setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
 
 		struct sockaddr_in sin;
 		bzero(&sin, sizeof(sin));
 		sin.sin_family = AF_INET;
-		sin.sin_port = htons(m_port);
+		sin.sin_port = htons(port);
 		memcpy(&sin.sin_addr, m_address.getAddress(), 4);
 		socklen_t len = sizeof(sin);
 
-		if(bind(m_fd, (struct sockaddr *)&sin, len) == -1) {
-			close(m_fd);
+		if(bind(fd, (struct sockaddr *)&sin, len) == -1) {
+			close(fd);
 			throw "bind() failed";
 		}
 	} else {
 		// create IPv6 socket
-		m_fd = socket(AF_INET6, SOCK_STREAM, 0);
-		if(m_fd == -1)
+		fd = socket(AF_INET6, SOCK_STREAM, 0);
+		if(fd == -1)
 			throw "socket() failed";
 
 		int value = 1;
-		setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
 
 		struct sockaddr_in6 sin;
 		bzero(&sin, sizeof(sin));
 		sin.sin6_family = AF_INET6;
-		sin.sin6_port = htons(m_port);
+		sin.sin6_port = htons(port);
 		memcpy(&sin.sin6_addr, m_address.getAddress(), 16);
 		socklen_t len = sizeof(sin);
 
-		if(bind(m_fd, (struct sockaddr *)&sin, len) == -1) {
-			close(m_fd);
+		if(bind(fd, (struct sockaddr *)&sin, len) == -1) {
+			close(fd);
 			throw "bind() failed";
 		}
 	}
 
-	if(listen(m_fd, 0) == -1) {
-		close(m_fd);
+	if(listen(fd, m_listenBacklog) == -1) {
+		close(fd);
 		throw "listen() failed";
 	}
+
+	// connections are accepted until there are none left
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
 }
 
-HttpConnection *
-Server::acceptHttpConnection()
+void
+Server::start()
 {
-	int fd;
-	uint8_t address[16];
-	AddressType type;
-	unsigned short port;
+	if(m_fd != -1)
+		throw "Server already started";
 
-	if(m_address.getType() == ADDRESS_TYPE_IPV4) {
-		// accept IPv4 connection
-		struct sockaddr_in sin;
-		bzero(&sin, sizeof(sin));
-		socklen_t len = sizeof(sin);
+	// an invalid route stops the server from starting
+	m_router.build(m_responders);
 
-		fd = accept(m_fd, (struct sockaddr *)&sin, &len);
-		if(fd == -1)
-			throw "accept() failed";
+	if(m_tlsPort != 0 && m_tlsContext.hasCertificate() == false)
+		throw "A TLS port requires a certificate";
+	m_tlsContext.setHttp2(m_maxConcurrentStreams != 0);
 
-		memcpy(address, &sin.sin_addr, 4);
-		type = ADDRESS_TYPE_IPV4;
-		port = ntohs(sin.sin_port);
-	} else {
-		// accept IPv6 connection
-		struct sockaddr_in6 sin;
-		bzero(&sin, sizeof(sin));
-		socklen_t len = sizeof(sin);
+	m_fd = createListeningSocket(m_port);
+	try {
+		if(m_tlsPort != 0)
+			m_tlsFd = createListeningSocket(m_tlsPort);
 
-		fd = accept(m_fd, (struct sockaddr *)&sin, &len);
-		if(fd == -1)
-			throw "accept() failed";
+		m_poller = createPoller();
+		m_poller->addListener(m_fd);
+		if(m_tlsFd != -1)
+			m_poller->addListener(m_tlsFd);
+	} catch(const char *) {
+		delete m_poller;
+		m_poller = NULL;
+		close(m_fd);
+		m_fd = -1;
+		if(m_tlsFd != -1) {
+			close(m_tlsFd);
+			m_tlsFd = -1;
+		}
+		throw;
+	}
 
-		memcpy(address, &sin.sin6_addr, 4);
-		type = ADDRESS_TYPE_IPV6;
-		port = ntohs(sin.sin6_port);
+	// responders' outbound requests are handled by the server's loop
+	HttpClientImpl::getInstance()->attach(this);
+}
+
+// falls back to the default poller if io_uring can't be used, which
+// reads files with a pool of threads so that the server doesn't
+// wait for the disk while other connections are waiting
+Poller *
+Server::createPoller()
+{
+	if(m_ioUring) {
+#ifdef XVIWEB_IO_URING
+		try {
+			Poller *poller = new IoRingPoller();
+			cout << "Using io_uring for I/O" << endl;
+			return poller;
+		} catch(const char *ex) {
+			cerr << "Unable to use io_uring (" << ex << "), falling back to epoll" << endl;
+		}
+#else
+		cerr << "This build doesn't support io_uring" << endl;
+#endif
 	}
 
-	// make the socket nonblocking
-	if(fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
-		close(fd);
-		throw "fcntl() failed";
+	Poller *poller = new Poller();
+	if(m_fileReadThreads != 0) {
+		try {
+			poller->startFileReads(m_fileReadThreads);
+		} catch(const char *ex) {
+			cerr << "Unable to start reading files with threads (" << ex << ")" << endl;
+		}
 	}
 
-	return new HttpConnection(fd, Address(address, type), port);
+	return poller;
 }
 
+// accepts connections waiting on the bound socket, up
+// to the maximum number that are accepted at once
 void
-Server::processRequest(ServerConnection *conn)
+Server::acceptConnections(int listenFd)
 {
-	// create HttpResponse for the connection
-	conn->response = new HttpResponseImpl(conn->connection);
+#ifdef TCP_INFO
+	// for a listening socket, the kernel reports the length of its
+	// queue as the unacknowledged count and its limit as the sacked
+	// count; the queue holds one more than the limit when it's full
+	struct tcp_info info;
+	socklen_t length = sizeof(info);
+	if(getsockopt(listenFd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0) {
+		if(info.tcpi_unacked > info.tcpi_sacked)
+			++m_statistics.acceptQueueOverflows;
+		if(info.tcpi_unacked > m_statistics.maxAcceptQueueLength)
+			m_statistics.maxAcceptQueueLength = info.tcpi_unacked;
+	}
+#endif
 
-	// set the request's vhost root
-	HttpRequestImpl *request = conn->connection->getRequest();
-	ServerMap::const_iterator iter = m_vhostMap.find(String::toLower(request->getHeaderValue("Host")));
-	if(iter != m_vhostMap.end()) {
-		request->setVHostRoot(iter->second);
-	} else {
-		// no vhost found for the given host; use the
-		// default root if one is set, otherwise end
-		// the response
-		if(m_defaultRoot.length() != 0) {
-			request->setVHostRoot(m_defaultRoot);
-		} else {
-			string message = "Your request could not be processed because there is no virtual host associated with " + request->getHeaderValue("Host") + ".";
-			conn->response->sendErrorResponse(500, "No Virtual Host", message.c_str());
+	for(unsigned int i = 0; i < m_acceptBatchSize; ++i) {
+		HttpConnection *connection = acceptHttpConnection(listenFd);
+		if(connection == NULL)
 			return;
-		}
-	}
 
-	// loop through responders and stop when
-	// one matches the request
-	unsigned int i;
-	for(i = 0; i < m_responders.size(); ++i) {
-		Responder *responder = m_responders[i];
-		if(responder->matchesRequest(conn->connection->getRequest())) {
-			// respond to the request
-			conn->context = responder->respond(conn->connection->getRequest(), conn->response);
-			if(conn->context != NULL)
-				conn->wakeupTime = getMilliseconds() + conn->context->getResponseInterval();
-			break;
-		}
+		admitConnection(connection, listenFd);
 	}
 
-	// just end the response if no responders handled it
-	if(i == m_responders.size())
-		conn->response->sendErrorResponse(500, "No Responder", "Your request could not be processed because there is no module loaded that is capable of handing the request.");
+	++m_statistics.fullAcceptBatches;
 }
 
+// handles a connection accepted by the poller, given
+// its descriptor or the error accepting it (-errno)
 void
-Server::cycle()
+Server::acceptConnection(int listenFd, int fd)
 {
-	long currentTime = getMilliseconds();
-	long sleepTime = 1000;
+	// connections reset while in the queue are skipped
+	if(fd < 0) {
+		if(fd != -ECONNABORTED && fd != -EINTR)
+			pauseAccepting(-fd);
+		return;
+	}
 
-	// process connections
-	for(unsigned int i = 0; i < m_connections.size(); ++i) {
-		ServerConnection *sconn = &(m_connections[i]);
-		HttpConnection *conn = sconn->connection;
-
-		HttpConnectionState state = conn->getState();
-		bool done = (state == HTTP_CONNECTION_STATE_DONE) ||
-		            (state != HTTP_CONNECTION_STATE_SENDING_RESPONSE &&
-		             conn->getMillisecondsSinceLastRead() > 10000);
-
-		// remove connections in the done state or continue
-		// responses for ones that have associated contexts
-		if(done) {
-			delete conn;
-			if(sconn->response != NULL)
-				delete sconn->response;
-			if(sconn->context != NULL)
-				delete sconn->context;
-			m_connections.erase(m_connections.begin() + (i--));
-		} else if(sconn->context != NULL) {
-			if(sconn->wakeupTime <= currentTime) {
-				// continue the context's response; it may return
-				// a pointer to itself, a pointer to a new context,
-				// or null if it's done
-				sconn->context = sconn->context->continueResponse(conn->getRequest(), sconn->response);
-				if(sconn->context != NULL)
-					sconn->wakeupTime = currentTime + sconn->context->getResponseInterval();
-			} else {
-				long timeDiff = sconn->wakeupTime - currentTime;
-				if(timeDiff < sleepTime)
-					sleepTime = timeDiff;
-			}
-		}
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	if(getpeername(fd, (struct sockaddr *)&address, &length) == -1) {
+		close(fd);
+		return;
 	}
 
-	// create pollfd array
-	nfds_t bsIndex = (nfds_t)m_connections.size();
-	nfds_t nfds = bsIndex + 1;
-	struct pollfd *fds = new struct pollfd[nfds];
+	admitConnection(createHttpConnection(fd, (struct sockaddr *)&address), listenFd);
+}
 
-	// add each connection to fds
-	for(unsigned int i = 0; i < m_connections.size(); ++i) {
-		fds[i].fd = m_connections[i].connection->getFileDescriptor();
-		fds[i].events = POLLIN;
-		fds[i].revents = 0;
+void
+Server::admitConnection(HttpConnection *connection, int listenFd)
+{
+	++m_statistics.acceptedConnections;
+	if(m_maxConnections != 0 && m_connectionCount >= m_maxConnections) {
+		rejectConnection(connection);
+		return;
 	}
 
-	// add the bound socket to fds
-	fds[bsIndex].fd = m_fd;
-	fds[bsIndex].events = POLLIN;
-	fds[bsIndex].revents = 0;
+	// clients with as many connections as they're
+	// allowed are just disconnected
+	ClientLimiterEntry *clientEntry = NULL;
+	if(m_clientLimiter.isEnabled() &&
+	   m_clientLimiter.connectionOpened(connection->getAddress(), getMilliseconds(), &clientEntry) == false) {
+		delete connection;
+		++m_statistics.rejectedClientConnections;
+		return;
+	}
 
-	// poll bound socket and connection sockets
-	if(poll(fds, nfds, sleepTime) > 0) {
-		// handle connections to the bound socket
-		if(fds[bsIndex].revents & POLLIN) {
-			HttpConnection *conn = acceptHttpConnection();
-			m_connections.push_back(ServerConnection(conn));
+	// connections to the TLS port start with a handshake
+	if(listenFd == m_tlsFd) {
+		SSL *ssl = m_tlsContext.createSession(connection->getFileDescriptor());
+		if(ssl == NULL) {
+			m_clientLimiter.connectionClosed(clientEntry);
+			delete connection;
+			return;
 		}
+		connection->startTls(ssl);
+	}
+
+	addConnection(connection, clientEntry);
+}
 
-		// read from connections
-		for(unsigned int i = 0; i < m_connections.size(); ++i) {
-			if((fds[i].revents & POLLIN) == 0)
-				continue;
-
-			// read from the connection
-			HttpConnection *conn = m_connections[i].connection;
-			conn->doRead();
-
-			switch(conn->getState()) {
-				default:
-					break;
-				case HTTP_CONNECTION_STATE_RECEIVED_REQUEST:
-					// full request received
-					processRequest(&m_connections[i]);
-					break;
+// sends the overload response to a connection that's over the limit
+// on connections and closes it, rather than leaving the client to
+// wait; it's only sent if it fits in the socket's buffer
+void
+Server::rejectConnection(HttpConnection *connection)
+{
+	send(connection->getFileDescriptor(), m_overloadResponse->getData(), m_overloadResponse->getLength(), 0);
+	delete connection;
+	++m_statistics.rejectedConnections;
+}
+
+// accepts a connection as a nonblocking descriptor that's closed
+// on exec, or returns -1 with errno set to EAGAIN if there's none
+static int
+acceptSocket(int fd, struct sockaddr *address, socklen_t *length)
+{
+	for(;;) {
+#ifdef __linux__
+		int clientFd = accept4(fd, address, length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		int clientFd = accept(fd, address, length);
+		if(clientFd != -1) {
+			if(fcntl(clientFd, F_SETFL, O_NONBLOCK) == -1) {
+				int error = errno;
+				close(clientFd);
+				errno = error;
+				return -1;
 			}
+			fcntl(clientFd, F_SETFD, FD_CLOEXEC);
+		}
+#endif
+		if(clientFd != -1)
+			return clientFd;
+
+		// connections reset while in the queue are skipped
+		if(errno != EINTR && errno != ECONNABORTED) {
+			if(errno == EWOULDBLOCK)
+				errno = EAGAIN;
+			return -1;
 		}
 	}
+}
+
+// returns null if there are no connections waiting,
+// or if accepting one failed and has been paused
+HttpConnection *
+Server::acceptHttpConnection(int listenFd)
+{
+	struct sockaddr_storage address;
+	bzero(&address, sizeof(address));
+	socklen_t length = sizeof(address);
+
+	int fd = acceptSocket(listenFd, (struct sockaddr *)&address, &length);
+	if(fd == -1) {
+		if(errno != EAGAIN)
+			pauseAccepting(errno);
+		return NULL;
+	}
 
-	delete [] fds;
+	return createHttpConnection(fd, (struct sockaddr *)&address);
 }
 
+// accepting usually fails for a lack of descriptors (EMFILE or
+// ENFILE) or memory, and would keep failing if the connections
+// waiting were tried again right away, so the bound sockets
+// aren't waited on until there may be more to spare
 void
-Server::stop()
+Server::pauseAccepting(int error)
 {
-	if(m_fd == -1)
+	++m_statistics.acceptErrors;
+	if(m_acceptResumeTime != 0)
 		return;
 
-	// close bound socket
-	close(m_fd);
-	m_fd = -1;
+	cerr << "Unable to accept connections (" << strerror(error) << "), pausing" << endl;
+	m_poller->remove(m_fd);
+	if(m_tlsFd != -1)
+		m_poller->remove(m_tlsFd);
+	m_acceptResumeTime = getMilliseconds() + SERVER_ACCEPT_PAUSE;
+}
 
-	// delete all connection data
-	for(unsigned int i = 0; i < m_connections.size(); ++i) {
-		if(m_connections[i].context != NULL)
-			delete m_connections[i].context;
-		if(m_connections[i].response != NULL)
-			delete m_connections[i].response;
-		if(m_connections[i].connection != NULL)
-			delete m_connections[i].connection;
-	}
+void
+Server::resumeAccepting()
+{
+	if(m_acceptResumeTime == 0)
+		return;
+
+	m_acceptResumeTime = 0;
+	m_poller->addListener(m_fd);
+	if(m_tlsFd != -1)
+		m_poller->addListener(m_tlsFd);
+}
+
+HttpConnection *
+Server::createHttpConnection(int fd, const struct sockaddr *address)
+{
+	uint8_t addressData[16];
+	AddressType type;
+	unsigned short port;
+
+	if(address->sa_family == AF_INET) {
+		const struct sockaddr_in *sin = (const struct sockaddr_in *)address;
+		memcpy(addressData, &sin->sin_addr, 4);
+		type = ADDRESS_TYPE_IPV4;
+		port = ntohs(sin->sin_port);
+	} else {
+		const struct sockaddr_in6 *sin = (const struct sockaddr_in6 *)address;
+		memcpy(addressData, &sin->sin6_addr, 16);
+		type = ADDRESS_TYPE_IPV6;
+		port = ntohs(sin->sin6_port);
+	}
+
+	HttpConnection *conn = new HttpConnection(fd, Address(addressData, type), port);
+	conn->setMaxHeaderSize(m_maxHeaderSize);
+	conn->setMaxBodySize(m_maxBodySize);
+	conn->setUploadDirectory(m_uploadDirectory);
+	conn->setUploadMemoryThreshold(m_uploadMemoryThreshold);
+	conn->setMaxOutputSize(m_maxOutputSize);
+	return conn;
+}
+
+void
+Server::addConnection(HttpConnection *connection, ClientLimiterEntry *clientEntry)
+{
+	ServerConnection *conn = new ServerConnection(connection);
+	conn->clientEntry = clientEntry;
+
+	// an asynchronous poller sends and reads files for the
+	// connection, and receives from it if it isn't secure;
+	// others may still read files for it
+	int fd = connection->getFileDescriptor();
+	if(m_poller->isAsynchronous() || m_poller->readsFiles())
+		connection->setPoller(m_poller);
+	if(connection->isSecure())
+		m_poller->add(fd, POLLER_EVENT_READ);
+	else
+		m_poller->addReceiver(fd, POLLER_EVENT_READ);
+	conn->pollEvents = POLLER_EVENT_READ;
+	setDescriptor(fd, conn);
+	++m_connectionCount;
+
+	updateConnection(conn);
+}
+
+void
+Server::removeConnection(ServerConnection *conn)
+{
+	// connections are deleted at the end of the cycle,
+	// since there may still be events pending for them
+	if(conn->removed)
+		return;
+
+	conn->removed = true;
+	setTimer(conn, -1);
+	m_removedConnections.push_back(conn);
+
+	// a connection's streams go with it
+	ServerStreamMap::iterator iter;
+	for(iter = conn->streams.begin(); iter != conn->streams.end(); ++iter)
+		removeConnection(iter->second);
+}
+
+void
+Server::deleteConnection(ServerConnection *conn)
+{
+	// a stream is handed back to its session, which deletes it
+	// once what's left of it has been sent; what the session
+	// sends in its place (e.g. a reset) is sent right away
+	if(conn->parent != NULL) {
+		ServerConnection *parent = conn->parent;
+		if(conn->context != NULL)
+			delete conn->context;
+		if(conn->response != NULL)
+			deleteResponse(conn);
+		parent->streams.erase(conn->connection->getStreamId());
+		parent->session->releaseStream((Http2Stream *)conn->connection);
+		delete conn;
+
+		updateConnection(parent);
+		return;
+	}
+
+	while(conn->streams.empty() == false)
+		deleteConnection(conn->streams.begin()->second);
+	delete conn->session;
+
+	int fd = conn->connection->getFileDescriptor();
+	m_poller->remove(fd);
+	m_descriptors[fd] = NULL;
+
+	if(conn->context != NULL)
+		delete conn->context;
+	if(conn->response != NULL)
+		deleteResponse(conn);
+	delete conn->connection;
+	m_clientLimiter.connectionClosed(conn->clientEntry);
+	delete conn;
+	--m_connectionCount;
+
+	// the closed connection's descriptor can be used for another
+	resumeAccepting();
+}
+
+void
+Server::deleteRemovedConnections()
+{
+	// streams are deleted before the connections carrying them,
+	// which may be removed as their streams are deleted
+	for(unsigned int i = 0; i < m_removedConnections.size(); ++i) {
+		if(m_removedConnections[i]->parent != NULL)
+			deleteConnection(m_removedConnections[i]);
+	}
+	for(unsigned int i = 0; i < m_removedConnections.size(); ++i) {
+		if(m_removedConnections[i]->parent == NULL)
+			deleteConnection(m_removedConnections[i]);
+	}
+
+	m_removedConnections.clear();
+}
+
+void
+Server::deleteResponse(ServerConnection *conn)
+{
+	unwatchDescriptors(conn);
+
+	// cache the response if it was captured for the cache
+	ResponseCacheFill *cacheFill = conn->response->getCacheFill();
+	if(cacheFill != NULL)
+		m_responseCache.store(cacheFill, conn->response, getMilliseconds());
+
+	// stop waiting on the response's notifier
+	if(conn->notifierFd != -1) {
+		m_poller->remove(conn->notifierFd);
+		m_descriptors[conn->notifierFd] = NULL;
+		conn->notifierFd = -1;
+	}
+
+	delete conn->response;
+	conn->response = NULL;
+}
+
+void
+Server::setDescriptor(int fd, ServerConnection *conn)
+{
+	if((int)m_descriptors.size() <= fd)
+		m_descriptors.resize(fd + 1, NULL);
+
+	m_descriptors[fd] = conn;
+}
+
+void
+Server::setTimer(ServerConnection *conn, long timerTime)
+{
+	if(conn->timerTime == timerTime)
+		return;
+
+	if(conn->timerTime != -1)
+		m_timers.erase(make_pair(conn->timerTime, conn));
+
+	conn->timerTime = timerTime;
+	if(timerTime != -1)
+		m_timers.insert(make_pair(timerTime, conn));
+}
+
+void
+Server::watchDescriptors(ServerConnection *conn)
+{
+	// wait on the descriptors that the context is waiting on,
+	// unless another connection is already using one of them
+	const HttpResponseDescriptorList &descriptors = conn->response->getDescriptors();
+	for(unsigned int i = 0; i < descriptors.size(); ++i) {
+		int fd = descriptors[i].first;
+		if(fd < 0 || (fd < (int)m_descriptors.size() && m_descriptors[fd] != NULL))
+			continue;
+
+		try {
+			m_poller->add(fd, descriptors[i].second);
+		} catch(const char *ex) {
+			cerr << conn->connection->toString() << ": Unable to wait on descriptor " << fd << ": " << ex << endl;
+			continue;
+		}
+
+		setDescriptor(fd, conn);
+		conn->descriptors.push_back(descriptors[i]);
+	}
+}
+
+void
+Server::unwatchDescriptors(ServerConnection *conn)
+{
+	// a descriptor that has since been closed may already be
+	// in use by another connection, which keeps its own entry
+	for(unsigned int i = 0; i < conn->descriptors.size(); ++i) {
+		int fd = conn->descriptors[i].first;
+		if(m_descriptors[fd] == conn) {
+			m_poller->remove(fd);
+			m_descriptors[fd] = NULL;
+		}
+	}
+
+	conn->descriptors.clear();
+}
+
+// connections only time out while waiting for the client;
+// once a request has been read, they're waiting for its response,
+// upgraded connections are left to their protocol's handler, and
+// HTTP/2 connections are idle while they have no streams
+static bool
+isWaitingForClient(const ServerConnection *conn)
+{
+	if(conn->session != NULL)
+		return conn->streams.empty();
+
+	HttpConnectionState state = conn->connection->getState();
+	return (state != HTTP_CONNECTION_STATE_RECEIVED_REQUEST &&
+	        state != HTTP_CONNECTION_STATE_SENDING_RESPONSE &&
+	        state != HTTP_CONNECTION_STATE_UPGRADED);
+}
+
+void
+Server::updateConnection(ServerConnection *conn)
+{
+	if(conn->removed)
+		return;
+
+	// a stream's output is sent by the connection carrying it
+	if(conn->parent != NULL) {
+		updateStream(conn);
+		updateConnection(conn->parent);
+		return;
+	}
+
+	if(conn->session != NULL)
+		updateSession(conn);
+
+	// connections that are done are kept until their output is sent
+	HttpConnection *connection = conn->connection;
+	HttpConnectionState state = connection->getState();
+	size_t outputSize = connection->getOutputSize();
+	if(state == HTTP_CONNECTION_STATE_DONE && outputSize == 0) {
+		removeConnection(conn);
+		return;
+	}
+
+	// set the connection's timer for its context's
+	// wakeup time or for when it will become idle;
+	// like responses being sent, output waiting to
+	// be sent to a slow client doesn't time out
+	long timerTime = -1;
+	if(conn->context != NULL)
+		timerTime = conn->wakeupTime;
+	if(isWaitingForClient(conn) && outputSize == 0) {
+		long idleTime = getMilliseconds() - connection->getMillisecondsSinceLastRead() + SERVER_IDLE_TIMEOUT;
+		if(timerTime == -1 || idleTime < timerTime)
+			timerTime = idleTime;
+	}
+
+	setTimer(conn, timerTime);
+
+	// stop reading requests while the output queue or the
+	// input buffer is full, and wait for the socket to be writable while there's
+	// output waiting for it or when the context has asked
+	// to be woken then; output waiting for the poller to
+	// send it or for a file to be read wakes the context
+	// once it's done instead
+	int events = 0;
+	if(state != HTTP_CONNECTION_STATE_DONE && connection->getOutputCapacity() != 0 &&
+	   connection->isInputFull() == false)
+		events |= POLLER_EVENT_READ;
+	if(connection->isWaitingToSend() || connection->isWaitingForWritable() ||
+	   (conn->context != NULL && conn->response->isWaitingForWritable() && outputSize == 0))
+		events |= POLLER_EVENT_WRITE;
+
+	if(events != conn->pollEvents) {
+		m_poller->modify(connection->getFileDescriptor(), events);
+		conn->pollEvents = events;
+	}
+
+	updateWaits(conn);
+}
+
+// sets a stream's timer, or hands it back to its session
+// once its response has ended
+void
+Server::updateStream(ServerConnection *conn)
+{
+	if(conn->removed)
+		return;
+
+	HttpConnection *connection = conn->connection;
+	if(connection->getState() == HTTP_CONNECTION_STATE_DONE) {
+		removeConnection(conn);
+		return;
+	}
+
+	long timerTime = -1;
+	if(conn->context != NULL)
+		timerTime = conn->wakeupTime;
+	if(isWaitingForClient(conn)) {
+		long idleTime = getMilliseconds() - connection->getMillisecondsSinceLastRead() + SERVER_IDLE_TIMEOUT;
+		if(timerTime == -1 || idleTime < timerTime)
+			timerTime = idleTime;
+	}
+
+	setTimer(conn, timerTime);
+	updateWaits(conn);
+}
+
+// sends what an HTTP/2 connection's streams have ready, and wakes
+// the contexts waiting for their stream's output to be sent; they're
+// woken once half of it has been, so that a stream with a higher
+// priority doesn't run out of output while others' is being sent
+void
+Server::updateSession(ServerConnection *conn)
+{
+	Http2Session *session = conn->session;
+	session->flush();
+
+	ServerStreamMap::iterator iter;
+	for(iter = conn->streams.begin(); iter != conn->streams.end(); ++iter) {
+		ServerConnection *streamConn = iter->second;
+		if(session->isClosed())
+			removeConnection(streamConn);
+		else if(streamConn->context != NULL && streamConn->response->isWaitingForWritable() &&
+		        streamConn->connection->getOutputSize() <= streamConn->connection->getOutputCapacity())
+			streamConn->response->wake();
+	}
+}
+
+void
+Server::updateWaits(ServerConnection *conn)
+{
+	// wait on the descriptors that the context armed; they're
+	// normally armed while it runs, and taken off the poller
+	// before it runs again
+	if(conn->response != NULL && conn->context != NULL &&
+	   conn->descriptors != conn->response->getDescriptors()) {
+		unwatchDescriptors(conn);
+		watchDescriptors(conn);
+	}
+
+	// wait on the response's notifier once it has one
+	if(conn->response != NULL && conn->notifierFd == -1) {
+		int notifierFd = conn->response->getNotifierFileDescriptor();
+		if(notifierFd != -1) {
+			m_poller->add(notifierFd, POLLER_EVENT_READ);
+			setDescriptor(notifierFd, conn);
+			conn->notifierFd = notifierFd;
+		}
+	}
+}
+
+void
+Server::processConnection(ServerConnection *conn)
+{
+	HttpConnection *connection = conn->connection;
+
+	if(connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_PREFACE)
+		startSession(conn);
+	if(conn->session != NULL) {
+		processSession(conn);
+		return;
+	}
+
+	if(connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_HEADERS)
+		processRequestHeaders(conn, conn->inputTime);
+	if(connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_REQUEST)
+		processRequest(conn);
+
+	processNextRequest(conn);
+}
+// switches a connection that started with the HTTP/2 preface
+// to HTTP/2, or closes it if HTTP/2 is disabled
+void
+Server::startSession(ServerConnection *conn)
+{
+	HttpConnection *connection = conn->connection;
+	if(m_maxConcurrentStreams == 0) {
+		connection->abort();
+		return;
+	}
+
+	conn->session = new Http2Session(connection, m_maxConcurrentStreams, m_maxHeaderSize);
+	connection->upgrade(conn->session);
+	connection->processInput();
+	++m_statistics.http2Connections;
+}
+
+// handles the streams an HTTP/2 connection's client has opened,
+// and wakes or stops the responses to those it's sent more of
+void
+Server::processSession(ServerConnection *conn)
+{
+	Http2Session *session = conn->session;
+	Http2Stream *stream;
+	while((stream = session->getOpenedStream()) != NULL) {
+		if(stream->isReset())
+			session->releaseStream(stream);
+		else
+			addStream(conn, stream);
+	}
+
+	// streams that have been read from are handled like
+	// connections that have: their request is responded to
+	// once it's been received, and contexts waiting for
+	// events are woken as the body is read
+	ServerStreamMap::iterator iter;
+	for(iter = conn->streams.begin(); iter != conn->streams.end(); ++iter) {
+		ServerConnection *streamConn = iter->second;
+		stream = (Http2Stream *)streamConn->connection;
+		if(session->isClosed() || stream->isReset()) {
+			removeConnection(streamConn);
+			continue;
+		}
+		if(stream->wasInputRead() == false)
+			continue;
+
+		if(stream->getState() == HTTP_CONNECTION_STATE_RECEIVED_REQUEST)
+			processRequest(streamConn);
+		else if(streamConn->context != NULL && streamConn->response->isWaitingForEvents())
+			streamConn->response->wake();
+		updateStream(streamConn);
+	}
+}
+
+// handles a stream's request like a connection's own
+void
+Server::addStream(ServerConnection *conn, Http2Stream *stream)
+{
+	ServerConnection *streamConn = new ServerConnection(stream);
+	streamConn->parent = conn;
+	streamConn->clientEntry = conn->clientEntry;
+	streamConn->inputTime = conn->inputTime;
+	conn->streams.insert(make_pair(stream->getStreamId(), streamConn));
+	++m_statistics.http2Streams;
+
+	// input read along with the headers is handled here
+	stream->wasInputRead();
+	if(stream->getState() == HTTP_CONNECTION_STATE_RECEIVED_HEADERS)
+		processRequestHeaders(streamConn, streamConn->inputTime);
+	if(stream->getState() == HTTP_CONNECTION_STATE_RECEIVED_REQUEST)
+		processRequest(streamConn);
+	updateStream(streamConn);
+}
+
+void
+Server::processRequestHeaders(ServerConnection *conn, long requestTime)
+{
+	HttpConnection *connection = conn->connection;
+	HttpRequestImpl *request = connection->getRequest();
+	conn->requestTime = requestTime;
+
+	// create HttpResponse for the connection
+	conn->response = new HttpResponseImpl(connection, &m_wakeList);
+
+	// requests for exempt paths (e.g. health checks) are
+	// handled even when the server or client is over its limit
+	if(m_exemptPaths.find(request->getPath()) == m_exemptPaths.end() &&
+	   (shedRequest(conn) || limitRequest(conn)))
+		return;
+
+	// set the request's vhost root
+	string host = String::toLower(request->getHeaderValue("Host"));
+	ServerMap::const_iterator iter = m_vhostMap.find(host);
+	if(iter != m_vhostMap.end()) {
+		request->setVHostRoot(iter->second);
+	} else {
+		// no vhost found for the given host; use the
+		// default root if one is set, otherwise end
+		// the response
+		if(m_defaultRoot.length() != 0) {
+			request->setVHostRoot(m_defaultRoot);
+		} else {
+			string message = "Your request could not be processed because there is no virtual host associated with " + request->getHeaderValue("Host") + ".";
+			conn->response->sendErrorResponse(500, "No Virtual Host", message.c_str());
+			return;
+		}
+	}
+
+	ServerLevelMap::const_iterator levelIter = m_vhostCompressionLevels.find(host);
+	int compressionLevel = (levelIter != m_vhostCompressionLevels.end()) ? levelIter->second : m_compressionLevel;
+	const ResponseDictionary *dictionary = NULL;
+	if(m_compressionDictionaries.empty() == false)
+		dictionary = findCompressionDictionary(host, request->getPath());
+	conn->response->setCompression(compressionLevel, m_compressionMinSize, dictionary, &m_flushList);
+
+	// find the responder whose route the request matches,
+	// or the first responder without routes that matches it
+	conn->responder = m_router.route(request);
+
+	// just end the response if no responders handled it
+	if(conn->responder == NULL) {
+		conn->response->sendErrorResponse(500, "No Responder", "Your request could not be processed because there is no module loaded that is capable of handing the request.");
+		return;
+	}
+
+	if(respondFromCache(conn))
+		return;
+
+	// a responder that streams the request body responds
+	// right away, and the body is passed to its context
+	if(conn->responder->streamsRequestBody(request))
+		processRequest(conn);
+
+	if(connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_HEADERS) {
+		connection->readBody(conn->context);
+		connection->processInput();
+
+		// body data that arrived along with the headers
+		// wakes a context that's waiting for events
+		if(conn->context != NULL && conn->response->isWaitingForEvents())
+			continueResponse(conn);
+	}
+}
+
+// sends the overload response to a request that waited too long to
+// be handled since it arrived, and returns true if it did
+bool
+Server::shedRequest(ServerConnection *conn)
+{
+	long currentTime = getMilliseconds();
+	if(m_loadShedder.shouldShed(currentTime - conn->requestTime, currentTime) == false)
+		return false;
+
+	conn->response->sendPrebuiltResponse(m_overloadResponse, m_overloadHeadLength);
+	++m_statistics.shedRequests;
+	return true;
+}
+
+// sends the rate limit response to a request from a client that's
+// made too many requests, and returns true if it did
+bool
+Server::limitRequest(ServerConnection *conn)
+{
+	if(m_clientLimiter.requestReceived(conn->clientEntry, getMilliseconds()))
+		return false;
+
+	conn->response->sendPrebuiltResponse(m_rateLimitResponse, m_rateLimitHeadLength);
+	++m_statistics.limitedRequests;
+	return true;
+}
+
+// sends the response to a request from the cache if its responder
+// allows it, has it wait for the response to an identical request,
+// or has its response captured so that it can be cached; returns
+// true if the responder isn't to be called
+bool
+Server::respondFromCache(ServerConnection *conn)
+{
+	// requests with credentials are never
+	// answered with a shared response
+	HttpRequestImpl *request = conn->connection->getRequest();
+	string verb = request->getVerb();
+	if((verb != "GET" && verb != "HEAD") || request->getHeaderValue("Authorization").length() != 0)
+		return false;
+
+	ResponderCachePolicy policy;
+	if(conn->responder->getCachePolicy(request, &policy) == false || policy.maxAge <= 0)
+		return false;
+
+	// only the responses to GET requests have bodies to cache,
+	// and requests with bodies of their own don't wait
+	long currentTime = getMilliseconds();
+	ResponseCacheFill *fill = NULL;
+	ResponseCacheFlight *flight = NULL;
+	ResponseCacheEntry *entry = m_responseCache.lookup(request, policy, currentTime,
+	                                                   (verb == "GET") ? &fill : NULL,
+	                                                   conn->connection->hasBody() ? NULL : &flight);
+	if(entry != NULL) {
+		conn->responder = NULL;
+		conn->response->sendCachedResponse(entry->buffer, entry->headLength, (currentTime - entry->storeTime) / 1000);
+		return true;
+	}
+
+	if(flight != NULL) {
+		conn->context = new ResponseCacheWaiter(&m_responseCache, flight, conn->responder, conn->response, policy, currentTime);
+		conn->responder = NULL;
+		scheduleContext(conn);
+
+		// there's no body to read, so this just
+		// marks the request as received
+		conn->connection->readBody(conn->context);
+		return true;
+	}
+
+	if(fill != NULL)
+		conn->response->startCapture(fill, m_responseCache.getMaxEntrySize());
+	return false;
+}
+
+void
+Server::processRequest(ServerConnection *conn)
+{
+	// the responder is only called once per request
+	Responder *responder = conn->responder;
+	if(responder == NULL)
+		return;
+	conn->responder = NULL;
+
+	// respond to the request
+	conn->context = responder->respond(conn->connection->getRequest(), conn->response);
+	if(conn->context != NULL)
+		scheduleContext(conn);
+}
+
+void
+Server::processNextRequest(ServerConnection *conn)
+{
+	// once the response on a persistent connection has ended,
+	// release it and handle any request pipelined behind it
+	while(conn->context == NULL && conn->response != NULL &&
+	      conn->connection->getState() == HTTP_CONNECTION_STATE_AWAITING_REQUEST) {
+		deleteResponse(conn);
+		conn->responder = NULL;
+
+		// a request that was waiting behind the last one is
+		// considered to arrive now, as it couldn't be handled
+		// sooner however busy the server was
+		conn->connection->processInput();
+		if(conn->connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_HEADERS)
+			processRequestHeaders(conn, getMilliseconds());
+		if(conn->connection->getState() == HTTP_CONNECTION_STATE_RECEIVED_REQUEST)
+			processRequest(conn);
+	}
+}
+
+void
+Server::scheduleContext(ServerConnection *conn)
+{
+	// contexts that haven't asked to be woken
+	// by any events are polled at their interval
+	if(conn->response->isWaitingForEvents())
+		conn->wakeupTime = conn->response->getWakeupTime();
+	else
+		conn->wakeupTime = getMilliseconds() + conn->context->getResponseInterval();
+}
+
+void
+Server::continueResponse(ServerConnection *conn)
+{
+	HttpConnection *connection = conn->connection;
+
+	// continue the context's response; it may return
+	// a pointer to itself, a pointer to a new context,
+	// or null if it's done, and the server deletes it
+	// once it's been replaced
+	ResponderContext *context = conn->context;
+	unwatchDescriptors(conn);
+	conn->response->clearWakeups();
+	conn->context = context->continueResponse(connection->getRequest(), conn->response);
+	if(conn->context != context)
+		delete context;
+	if(connection->isReadingBody())
+		connection->setBodyContext(conn->context);
+
+	// the body that was held while the context wasn't ready for
+	// it is passed along once it is, waking the context again
+	if(conn->context != NULL) {
+		scheduleContext(conn);
+		if(connection->resumeBody() && conn->response->isWaitingForEvents())
+			conn->response->wake();
+	} else {
+		processNextRequest(conn);
+	}
+}
+
+void
+Server::timerExpired(ServerConnection *conn, long currentTime)
+{
+	if(conn->context != NULL && conn->wakeupTime != -1 && conn->wakeupTime <= currentTime) {
+		conn->wakeupTime = -1;
+		continueResponse(conn);
+	}
+
+	// close connections that have been idle for too long;
+	// HTTP/2 clients are told that the connection is closing
+	HttpConnection *connection = conn->connection;
+	if(isWaitingForClient(conn) && connection->getOutputSize() == 0 &&
+	   connection->getMillisecondsSinceLastRead() >= SERVER_IDLE_TIMEOUT) {
+		if(conn->session != NULL && conn->session->isClosed() == false)
+			conn->session->close();
+		else
+			removeConnection(conn);
+	}
+}
+
+void
+Server::processWakeups()
+{
+	// contexts woken while handling these are
+	// handled the next time this is called
+	HttpResponseWakeList wakeList;
+	wakeList.swap(m_wakeList);
+
+	for(unsigned int i = 0; i < wakeList.size(); ++i) {
+		int fd = wakeList[i].first;
+		if(fd >= (int)m_descriptors.size())
+			continue;
+
+		// streams are found through their connection
+		ServerConnection *conn = m_descriptors[fd];
+		if(conn != NULL && wakeList[i].second != 0) {
+			ServerStreamMap::iterator iter = conn->streams.find(wakeList[i].second);
+			conn = (iter != conn->streams.end()) ? iter->second : NULL;
+		}
+
+		// the response may have ended since it was woken
+		if(conn == NULL || conn->removed || conn->connection->getFileDescriptor() != fd ||
+		   conn->response == NULL || conn->response->isWoken() == false)
+			continue;
+
+		conn->response->clearWoken();
+		if(conn->context != NULL)
+			continueResponse(conn);
+		updateConnection(conn);
+	}
+}
+
+void
+Server::processFlushes()
+{
+	HttpResponseWakeList flushList;
+	flushList.swap(m_flushList);
+
+	for(unsigned int i = 0; i < flushList.size(); ++i) {
+		int fd = flushList[i].first;
+		if(fd >= (int)m_descriptors.size())
+			continue;
+
+		ServerConnection *conn = m_descriptors[fd];
+		if(conn != NULL && flushList[i].second != 0) {
+			ServerStreamMap::iterator iter = conn->streams.find(flushList[i].second);
+			conn = (iter != conn->streams.end()) ? iter->second : NULL;
+		}
+
+		// a response that's ended has nothing left to flush
+		if(conn == NULL || conn->removed || conn->connection->getFileDescriptor() != fd ||
+		   conn->response == NULL)
+			continue;
+
+		conn->response->flush();
+		updateConnection(conn);
+	}
+}
+
+void
+Server::processEventSourceTimers(long currentTime)
+{
+	// sources may be removed while their timers are handled
+	vector <ServerEventSource *> sources = m_eventSources;
+	for(unsigned int i = 0; i < sources.size(); ++i) {
+		long timerTime = sources[i]->getTimerTime();
+		if(timerTime != -1 && timerTime <= currentTime)
+			sources[i]->timerExpired(currentTime);
+	}
+}
+
+void
+Server::cycle()
+{
+	long currentTime = getMilliseconds();
+
+	// handle the timers that have expired; timers that
+	// are set again while doing so wait for the next cycle
+	vector <ServerConnection *> expired;
+	ServerTimerSet::iterator iter = m_timers.begin();
+	while(iter != m_timers.end() && iter->first <= currentTime) {
+		expired.push_back(iter->second);
+		++iter;
+	}
+
+	for(unsigned int i = 0; i < expired.size(); ++i) {
+		ServerConnection *conn = expired[i];
+		setTimer(conn, -1);
+		timerExpired(conn, currentTime);
+		updateConnection(conn);
+	}
+
+	processEventSourceTimers(currentTime);
+	processWakeups();
+	processFlushes();
+	deleteRemovedConnections();
+	if(m_acceptResumeTime != 0 && m_acceptResumeTime <= currentTime)
+		resumeAccepting();
+
+	// wait for events until the next timer expires,
+	// or just check for them if contexts were woken
+	long sleepTime = 1000;
+	if(!m_wakeList.empty()) {
+		sleepTime = 0;
+	} else if(!m_timers.empty()) {
+		long timeDiff = m_timers.begin()->first - getMilliseconds();
+		if(timeDiff < sleepTime)
+			sleepTime = (timeDiff > 0) ? timeDiff : 0;
+	}
+
+	if(m_acceptResumeTime != 0) {
+		long timeDiff = m_acceptResumeTime - getMilliseconds();
+		if(timeDiff < sleepTime)
+			sleepTime = (timeDiff > 0) ? timeDiff : 0;
+	}
+
+	for(unsigned int i = 0; i < m_eventSources.size() && sleepTime != 0; ++i) {
+		long timerTime = m_eventSources[i]->getTimerTime();
+		if(timerTime == -1)
+			continue;
+
+		long timeDiff = timerTime - getMilliseconds();
+		if(timeDiff < sleepTime)
+			sleepTime = (timeDiff > 0) ? timeDiff : 0;
+	}
+
+	long waitTime = getMilliseconds();
+	int count = m_poller->wait(sleepTime);
+
+	// input found by a poll that didn't have to wait for it arrived
+	// while the server was busy, at some point after the previous poll
+	// (connections are read until they have no input left), so that's
+	// when it's considered to have started waiting to be handled
+	long pollTime = getMilliseconds();
+	long eventTime = (pollTime > waitTime || m_pollTime == 0) ? pollTime : m_pollTime;
+	m_pollTime = pollTime;
+	for(int i = 0; i < count; ++i) {
+		const PollerEvent &event = m_poller->getEvent(i);
+
+		// handle connections to the bound socket; ones already
+		// accepted by the poller are kept if accepting's paused
+		if(event.fd == m_fd || event.fd == m_tlsFd) {
+			if(event.events & POLLER_EVENT_ACCEPTED)
+				acceptConnection(event.fd, event.result);
+			else if(m_acceptResumeTime == 0)
+				acceptConnections(event.fd);
+			continue;
+		}
+
+		// hand events on an event source's descriptors to it
+		if(event.fd < (int)m_sourceDescriptors.size() && m_sourceDescriptors[event.fd] != NULL) {
+			m_sourceDescriptors[event.fd]->descriptorReady(event.fd, event.events);
+			continue;
+		}
+
+		if(event.fd >= (int)m_descriptors.size())
+			continue;
+		ServerConnection *conn = m_descriptors[event.fd];
+		if(conn == NULL || conn->removed)
+			continue;
+
+		if(event.fd == conn->notifierFd) {
+			// wake the context whose notifier was notified
+			conn->response->clearNotifications();
+			if(conn->context != NULL)
+				continueResponse(conn);
+		} else if(event.fd != conn->connection->getFileDescriptor()) {
+			// wake the context waiting on one of its own descriptors
+			if(conn->context != NULL)
+				continueResponse(conn);
+		} else {
+			// complete what the poller's sent or read for
+			// the connection, which goes on to send what's
+			// been waiting for it
+			if(event.events & POLLER_EVENT_SENT)
+				conn->connection->outputSent(event.result);
+			if(event.events & POLLER_EVENT_FILE_READ)
+				conn->connection->fileRead(event.buffer, event.result);
+
+			// send queued output and wake a context
+			// that's waiting for it to be sent; errors
+			// on connections that are done are noticed
+			// by trying to send what they have left
+			if((event.events & (POLLER_EVENT_WRITE | POLLER_EVENT_SENT | POLLER_EVENT_FILE_READ)) ||
+			   conn->connection->getState() == HTTP_CONNECTION_STATE_DONE) {
+				conn->connection->flushOutput();
+				if(conn->context != NULL && conn->response->isWaitingForWritable() &&
+				   conn->connection->getOutputSize() == 0)
+					continueResponse(conn);
+			}
+
+			if((event.events & (POLLER_EVENT_READ | POLLER_EVENT_RECEIVED)) &&
+			   conn->connection->getState() != HTTP_CONNECTION_STATE_DONE) {
+				// contexts waiting for events are
+				// also woken as the request body is read
+				bool readingBody = (conn->context != NULL && conn->connection->isReadingBody());
+
+				// read from the connection, or take what the
+				// poller's received from it, and handle the
+				// request once it's been received
+				conn->inputTime = eventTime;
+				if(event.events & POLLER_EVENT_RECEIVED)
+					conn->connection->inputReceived(event.data, event.result);
+				else
+					conn->connection->doRead();
+				processConnection(conn);
+
+				if(readingBody && conn->context != NULL && conn->response->isWaitingForEvents() &&
+				   conn->connection->getState() != HTTP_CONNECTION_STATE_DONE)
+					continueResponse(conn);
+			}
+		}
+
+		updateConnection(conn);
+	}
+
+	processWakeups();
+	processFlushes();
+	deleteRemovedConnections();
+}
+
+void
+Server::stop()
+{
+	if(m_fd == -1)
+		return;
+
+	// close bound sockets
+	m_acceptResumeTime = 0;
+	close(m_fd);
+	m_fd = -1;
+	if(m_tlsFd != -1) {
+		close(m_tlsFd);
+		m_tlsFd = -1;
+	}
+
+	// delete all connection data
+	for(unsigned int i = 0; i < m_descriptors.size(); ++i) {
+		ServerConnection *conn = m_descriptors[i];
+		if(conn != NULL && conn->connection->getFileDescriptor() == (int)i)
+			deleteConnection(conn);
+	}
+
+	m_descriptors.clear();
+	m_removedConnections.clear();
+	m_timers.clear();
+
+	// event sources stop once the server does
+	vector <ServerEventSource *> sources;
+	sources.swap(m_eventSources);
+	for(unsigned int i = 0; i < sources.size(); ++i)
+		sources[i]->detached();
+	m_sourceDescriptors.clear();
 
-	m_connections.clear();
+	delete m_poller;
+	m_poller = NULL;
 }
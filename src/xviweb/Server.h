@@ -27,12 +27,28 @@
 #define __SERVER_H__
 
 #include <map>
+#include <set>
 #include <vector>
 #include <xviweb/Responder.h>
+#include "ClientLimiter.h"
+#include "Http2Session.h"
 #include "HttpConnection.h"
 #include "HttpResponseImpl.h"
+#include "LoadShedder.h"
+#include "Poller.h"
+#include "ResponseCache.h"
+#include "Router.h"
+#include "TlsContext.h"
 
 typedef std::map<std::string, std::string> ServerMap;
+typedef std::map<std::string, int> ServerLevelMap;
+
+// compression dictionaries by path prefix, and those by vhost
+typedef std::map<std::string, ResponseDictionary *> ServerDictionaryMap;
+typedef std::map<std::string, ServerDictionaryMap> ServerVHostDictionaryMap;
+
+class ServerConnection;
+typedef std::map<uint32_t, ServerConnection *> ServerStreamMap;
 
 class ServerConnection
 {
@@ -40,26 +56,200 @@ class ServerConnection
 		HttpConnection *connection;
 		HttpResponseImpl *response;
 		ResponderContext *context;
+		Responder *responder;
 		long wakeupTime;
+		long timerTime;
+		int pollEvents;
+		int notifierFd;
+
+		// when the server found the input that's been read, and
+		// when the request being handled arrived: when the input
+		// that completed its headers was found, or when the server
+		// got to it if it was pipelined behind another
+		long inputTime;
+		long requestTime;
+
+		// the client's entry in the server's client limiter
+		ClientLimiterEntry *clientEntry;
+		HttpResponseDescriptorList descriptors;
+		bool removed;
+
+		// an HTTP/2 connection's session and the connections
+		// for its streams, each of which has it as its parent
+		Http2Session *session;
+		ServerConnection *parent;
+		ServerStreamMap streams;
 
 		ServerConnection(HttpConnection *connectionValue, HttpResponseImpl *responseValue = NULL, ResponderContext *contextValue = NULL);
 };
 
+typedef std::set<std::pair<long, ServerConnection *> > ServerTimerSet;
+
+// counts of things the server has done since it started
+class ServerStatistics
+{
+	public:
+		uint64_t acceptedConnections;
+
+		// times the listening socket's queue was full when the
+		// server went to accept from it, meaning connections may
+		// have been refused, and the longest the queue has been
+		uint64_t acceptQueueOverflows;
+		unsigned int maxAcceptQueueLength;
+
+		// times the server accepted as many connections as it's
+		// allowed to at once, leaving some in the queue
+		uint64_t fullAcceptBatches;
+
+		// times accepting a connection failed, e.g. for a lack of
+		// descriptors or memory, which pauses accepting for a while
+		uint64_t acceptErrors;
+
+		// connections turned away because there were too many, and
+		// requests turned away because they waited too long
+		uint64_t rejectedConnections;
+		uint64_t shedRequests;
+
+		// connections and requests turned away because
+		// their client had too many or made too many
+		uint64_t rejectedClientConnections;
+		uint64_t limitedRequests;
+
+		uint64_t http2Connections;
+		uint64_t http2Streams;
+
+		ServerStatistics();
+};
+
+// something other than a client connection (e.g. the outbound HTTP
+// client) that has the server wait on its descriptors and timer
+class ServerEventSource
+{
+	public:
+		virtual ~ServerEventSource() {}
+
+		virtual void descriptorReady(int fd, int events) = 0;
+
+		// returns the time its timer expires, or -1 if it has none
+		virtual long getTimerTime() const = 0;
+		virtual void timerExpired(long currentTime) = 0;
+
+		// called when the server stops
+		virtual void detached() = 0;
+};
+
 class Server
 {
 	private:
 		int m_fd;
 		Address m_address;
 		unsigned short m_port;
+		int m_listenBacklog;
+
+		// connections to the TLS port are encrypted with
+		// the certificate of the vhost the client asks for
+		int m_tlsFd;
+		unsigned short m_tlsPort;
+		TlsContext m_tlsContext;
+		bool m_ioUring;
+		unsigned int m_fileReadThreads;
+		unsigned int m_acceptBatchSize;
+		unsigned int m_maxConnections;
+		unsigned int m_connectionCount;
+
+		// when accepting fails, the bound sockets aren't waited on
+		// until a connection is closed or this time (0 if they are)
+		long m_acceptResumeTime;
 
 		std::string m_defaultRoot;
 		ServerMap m_vhostMap;
 
+		unsigned int m_maxHeaderSize;
+		uint64_t m_maxBodySize;
+		std::string m_uploadDirectory;
+		size_t m_uploadMemoryThreshold;
+		size_t m_maxOutputSize;
+		unsigned int m_maxConcurrentStreams;
+
+		// vhosts may compress responses at levels of their own
+		int m_compressionLevel;
+		size_t m_compressionMinSize;
+		ServerLevelMap m_vhostCompressionLevels;
+
+		// those with dictionaries are compressed with them for clients
+		// that have them; the global ones are under the empty hostname
+		ServerVHostDictionaryMap m_compressionDictionaries;
+		const ResponseDictionary *findCompressionDictionary(const std::string &host, const std::string &path) const;
+
 		std::vector <Responder *> m_responders;
-		std::vector <ServerConnection> m_connections;
+		Router m_router;
+		ResponseCache m_responseCache;
+		ServerStatistics m_statistics;
 
-		HttpConnection *acceptHttpConnection();
+		// requests for the exempt paths (e.g. health checks)
+		// are never shed or limited
+		LoadShedder m_loadShedder;
+		std::set<std::string> m_exemptPaths;
+		SharedBuffer *m_overloadResponse;
+		size_t m_overloadHeadLength;
+
+		ClientLimiter m_clientLimiter;
+		SharedBuffer *m_rateLimitResponse;
+		size_t m_rateLimitHeadLength;
+
+		// connections are indexed by the descriptors they're
+		// waiting on, which includes their notifiers' descriptors
+		Poller *m_poller;
+		long m_pollTime;
+		std::vector <ServerConnection *> m_descriptors;
+		std::vector <ServerConnection *> m_removedConnections;
+		ServerTimerSet m_timers;
+		HttpResponseWakeList m_wakeList;
+		HttpResponseWakeList m_flushList;
+
+		std::vector <ServerEventSource *> m_eventSources;
+		std::vector <ServerEventSource *> m_sourceDescriptors;
+
+		int createListeningSocket(unsigned short port);
+		Poller *createPoller();
+		void acceptConnections(int listenFd);
+		void acceptConnection(int listenFd, int fd);
+		void admitConnection(HttpConnection *connection, int listenFd);
+		void rejectConnection(HttpConnection *connection);
+		HttpConnection *acceptHttpConnection(int listenFd);
+		void pauseAccepting(int error);
+		void resumeAccepting();
+		HttpConnection *createHttpConnection(int fd, const struct sockaddr *address);
+		void addConnection(HttpConnection *connection, ClientLimiterEntry *clientEntry);
+		void removeConnection(ServerConnection *conn);
+		void deleteConnection(ServerConnection *conn);
+		void deleteRemovedConnections();
+		void deleteResponse(ServerConnection *conn);
+		void setDescriptor(int fd, ServerConnection *conn);
+		void setTimer(ServerConnection *conn, long timerTime);
+		void watchDescriptors(ServerConnection *conn);
+		void unwatchDescriptors(ServerConnection *conn);
+		void updateConnection(ServerConnection *conn);
+		void updateStream(ServerConnection *conn);
+		void updateSession(ServerConnection *conn);
+		void updateWaits(ServerConnection *conn);
+
+		void processConnection(ServerConnection *conn);
+		void startSession(ServerConnection *conn);
+		void processSession(ServerConnection *conn);
+		void addStream(ServerConnection *conn, Http2Stream *stream);
+		void processRequestHeaders(ServerConnection *conn, long requestTime);
+		bool shedRequest(ServerConnection *conn);
+		bool limitRequest(ServerConnection *conn);
+		bool respondFromCache(ServerConnection *conn);
 		void processRequest(ServerConnection *conn);
+		void processNextRequest(ServerConnection *conn);
+		void scheduleContext(ServerConnection *conn);
+		void continueResponse(ServerConnection *conn);
+		void timerExpired(ServerConnection *conn, long currentTime);
+		void processWakeups();
+		void processFlushes();
+		void processEventSourceTimers(long currentTime);
 
 	public:
 		Server();
@@ -71,11 +261,67 @@ class Server
 		unsigned short getPort() const;
 		void setPort(unsigned short port);
 
+		unsigned short getTlsPort() const;
+		void setTlsPort(unsigned short tlsPort);
+		void setTlsCertificate(const std::string &certificateFile, const std::string &keyFile);
+		void addVHostCertificate(const std::string &hostname, const std::string &certificateFile, const std::string &keyFile);
+
+		// io_uring is used for I/O where the kernel supports it
+		void setIoUring(bool ioUring);
+
+		// files are otherwise read by a pool of threads, or by
+		// the server's thread if the count is 0
+		void setFileReadThreads(unsigned int fileReadThreads);
+
+		void setListenBacklog(int listenBacklog);
+		void setAcceptBatchSize(unsigned int acceptBatchSize);
+		void setMaxConnections(unsigned int maxConnections);
+
+		// limits on each client (by IPv4 address or IPv6 /64), which
+		// are kept for up to clientTableSize clients at once
+		void setMaxClientConnections(unsigned int maxClientConnections);
+		void setClientRequestRate(long clientRequestRate, long clientRequestBurst);
+		void setClientTableSize(unsigned int clientTableSize);
+
+		void setOverloadTarget(long overloadTarget);
+		void setOverloadInterval(long overloadInterval);
+		void addExemptPath(const std::string &path);
+
 		void setDefaultRoot(const std::string &root);
 		void addVHost(const std::string &hostname, const std::string &root);
 
+		void setMaxHeaderSize(unsigned int maxHeaderSize);
+		void setMaxBodySize(uint64_t maxBodySize);
+		void setUploadDirectory(const std::string &uploadDirectory);
+		void setUploadMemoryThreshold(size_t uploadMemoryThreshold);
+		void setMaxOutputSize(size_t maxOutputSize);
+
+		// HTTP/2 is disabled if the limit on streams is 0
+		void setMaxConcurrentStreams(unsigned int maxConcurrentStreams);
+		void setResponseCacheSize(size_t responseCacheSize);
+
+		// bodies of compressible types are compressed at the given
+		// level (0 to disable compression) unless they're shorter
+		// than the minimum size
+		void setCompressionLevel(int compressionLevel);
+		void setVHostCompressionLevel(const std::string &hostname, int compressionLevel);
+		void setCompressionMinSize(size_t compressionMinSize);
+
+		// responses to requests for paths under the prefix, on the
+		// vhost or any vhost if the hostname is empty, are compressed
+		// with the dictionary in the file for clients that have it;
+		// throws an exception if the file can't be read
+		void addCompressionDictionary(const std::string &hostname, const std::string &pathPrefix, const std::string &path);
+
+		const ServerStatistics &getStatistics() const;
+
 		void attachResponder(Responder *responder);
 
+		void addEventSource(ServerEventSource *source);
+		void removeEventSource(ServerEventSource *source);
+		void watchDescriptor(int fd, int events, ServerEventSource *source);
+		void unwatchDescriptor(int fd);
+
 		void start();
 		void cycle();
 		void stop();
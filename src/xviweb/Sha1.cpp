@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include "Sha1.h"
+
+static inline uint32_t
+rotateLeft(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+static void
+sha1Block(uint32_t state[5], const uint8_t block[64])
+{
+	uint32_t w[80];
+	for(int i = 0; i < 16; ++i) {
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+		       ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+	}
+	for(int i = 16; i < 80; ++i)
+		w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for(int i = 0; i < 80; ++i) {
+		uint32_t f, k;
+		if(i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		} else if(i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if(i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+
+		uint32_t tmp = rotateLeft(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rotateLeft(b, 30);
+		b = a;
+		a = tmp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void
+sha1(const void *data, size_t length, uint8_t digest[SHA1_DIGEST_LENGTH])
+{
+	uint32_t state[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+	// process the complete blocks directly
+	const uint8_t *p = (const uint8_t *)data;
+	size_t remaining = length;
+	while(remaining >= 64) {
+		sha1Block(state, p);
+		p += 64;
+		remaining -= 64;
+	}
+
+	// pad the last block(s) with a one bit, zeros,
+	// and the message length in bits
+	uint8_t block[128];
+	memset(block, 0, sizeof(block));
+	memcpy(block, p, remaining);
+	block[remaining] = 0x80;
+
+	size_t blockLength = (remaining < 56) ? 64 : 128;
+	uint64_t bits = (uint64_t)length * 8;
+	for(int i = 0; i < 8; ++i)
+		block[blockLength - 1 - i] = (uint8_t)(bits >> (i * 8));
+
+	sha1Block(state, block);
+	if(blockLength == 128)
+		sha1Block(state, block + 64);
+
+	for(int i = 0; i < 5; ++i) {
+		digest[i * 4] = (uint8_t)(state[i] >> 24);
+		digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+		digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+		digest[i * 4 + 3] = (uint8_t)state[i];
+	}
+}
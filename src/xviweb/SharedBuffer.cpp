@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SharedBuffer.h"
+
+using namespace std;
+
+SharedBuffer::SharedBuffer()
+{
+	m_refCount = 1;
+}
+
+SharedBuffer::SharedBuffer(const string &data)
+ : m_data(data)
+{
+	m_refCount = 1;
+}
+
+SharedBuffer::~SharedBuffer()
+{
+}
+
+const char *
+SharedBuffer::getData() const
+{
+	return m_data.data();
+}
+
+size_t
+SharedBuffer::getLength() const
+{
+	return m_data.length();
+}
+
+bool
+SharedBuffer::isShared() const
+{
+	return (m_refCount > 1);
+}
+
+void
+SharedBuffer::append(const char *data, size_t length)
+{
+	m_data.append(data, length);
+}
+
+char *
+SharedBuffer::extend(size_t length)
+{
+	size_t offset = m_data.length();
+	m_data.resize(offset + length);
+	return &m_data[offset];
+}
+
+void
+SharedBuffer::retain()
+{
+	++m_refCount;
+}
+
+void
+SharedBuffer::release()
+{
+	if(--m_refCount == 0)
+		delete this;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SHAREDBUFFER_H__
+#define __SHAREDBUFFER_H__
+
+#include <string>
+
+// a reference counted buffer that can be queued for
+// sending on any number of connections without copying;
+// it's only used from the server's thread
+class SharedBuffer
+{
+	private:
+		std::string m_data;
+		int m_refCount;
+
+		SharedBuffer(const SharedBuffer &);
+		SharedBuffer &operator=(const SharedBuffer &);
+
+		~SharedBuffer();
+
+	public:
+		SharedBuffer();
+		SharedBuffer(const std::string &data);
+
+		const char *getData() const;
+		size_t getLength() const;
+		bool isShared() const;
+
+		// data may only be appended while the buffer isn't shared;
+		// space can be appended for data that's written into it
+		void append(const char *data, size_t length);
+		char *extend(size_t length);
+
+		void retain();
+		void release();
+};
+
+#endif /* __SHAREDBUFFER_H__ */
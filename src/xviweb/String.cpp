@@ -24,6 +24,7 @@
  */
 
 #include <sstream>
+#include <cstdlib>
 #include <xviweb/String.h>
 
 using namespace std;
@@ -46,6 +47,15 @@ String::fromUInt(unsigned int n)
 	return stream.str();
 }
 
+string
+String::fromUInt64(uint64_t n)
+{
+	stringstream stream;
+	stream << n;
+
+	return stream.str();
+}
+
 string
 String::hexFromUInt(unsigned int n)
 {
@@ -88,6 +98,16 @@ String::toUInt(const string &s)
 	return n;
 }
 
+uint64_t
+String::toUInt64(const string &s)
+{
+	uint64_t n = 0;
+	stringstream stream(s);
+	stream >> n;
+
+	return n;
+}
+
 unsigned int
 String::hexToUInt(const string &s, size_t index, size_t length)
 {
@@ -328,3 +348,71 @@ String::split(const string &s, const string &delimiter)
 	v.push_back(s.substr(start));
 	return v;
 }
+
+bool
+String::containsToken(const string &list, const string &token)
+{
+	// compares each item of a comma-separated list
+	// (e.g. a Connection header) ignoring case
+	vector <string> tokens = split(toLower(list), ",");
+	for(unsigned int i = 0; i < tokens.size(); ++i) {
+		if(trim(tokens[i]) == toLower(token))
+			return true;
+	}
+
+	return false;
+}
+
+bool
+String::acceptsToken(const string &list, const string &token)
+{
+	// looks for the token in a list of tokens with qualities
+	// (e.g. an Accept-Encoding header), where a quality of
+	// zero refuses it; the token's own item outweighs a *
+	vector <string> items = split(toLower(list), ",");
+	string lowerToken = toLower(token);
+	bool accepted = false;
+	for(unsigned int i = 0; i < items.size(); ++i) {
+		vector <string> parameters = split(items[i], ";");
+		string name = trim(parameters[0]);
+		if(name != lowerToken && name != "*")
+			continue;
+
+		bool refused = false;
+		for(unsigned int j = 1; j < parameters.size(); ++j) {
+			string parameter = trim(parameters[j]);
+			if(parameter.length() > 2 && parameter[0] == 'q' && parameter[1] == '=')
+				refused = (strtod(parameter.c_str() + 2, NULL) <= 0.0);
+		}
+
+		if(name == lowerToken)
+			return (refused == false);
+		accepted = (refused == false);
+	}
+
+	return accepted;
+}
+
+string
+String::base64Encode(const char *data, size_t length)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const unsigned char *p = (const unsigned char *)data;
+
+	string s;
+	s.reserve(((length + 2) / 3) * 4);
+	for(size_t i = 0; i < length; i += 3) {
+		unsigned int n = (unsigned int)p[i] << 16;
+		if(i + 1 < length)
+			n |= (unsigned int)p[i + 1] << 8;
+		if(i + 2 < length)
+			n |= (unsigned int)p[i + 2];
+
+		s += alphabet[(n >> 18) & 63];
+		s += alphabet[(n >> 12) & 63];
+		s += (i + 1 < length) ? alphabet[(n >> 6) & 63] : '=';
+		s += (i + 2 < length) ? alphabet[n & 63] : '=';
+	}
+
+	return s;
+}
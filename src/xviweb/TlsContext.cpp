@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#ifdef XVIWEB_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+#include <xviweb/String.h>
+#include "TlsContext.h"
+
+using namespace std;
+
+TlsContext::TlsContext()
+{
+	m_defaultContext = NULL;
+	m_http2 = false;
+}
+
+TlsContext::~TlsContext()
+{
+#ifdef XVIWEB_TLS
+	TlsContextMap::iterator iter = m_hostContexts.begin();
+	while(iter != m_hostContexts.end()) {
+		SSL_CTX_free(iter->second);
+		++iter;
+	}
+
+	if(m_defaultContext != NULL)
+		SSL_CTX_free(m_defaultContext);
+#endif
+}
+
+bool
+TlsContext::isSupported()
+{
+#ifdef XVIWEB_TLS
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef XVIWEB_TLS
+SSL_CTX *
+TlsContext::createContext(const string &certificateFile, const string &keyFile)
+{
+	SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+	if(ctx == NULL)
+		throw "SSL_CTX_new() failed";
+
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+	if(SSL_CTX_use_certificate_chain_file(ctx, certificateFile.c_str()) != 1 ||
+	   SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+	   SSL_CTX_check_private_key(ctx) != 1) {
+		ERR_clear_error();
+		SSL_CTX_free(ctx);
+		throw "Unable to load TLS certificate or key";
+	}
+
+	// writes are retried from the connection's output queue,
+	// which may have been moved or grown in the meantime
+	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+	// sessions are resumed from the cache by their IDs, or from
+	// the tickets (encrypted with a key made for the process)
+	// that clients are given, without a full handshake
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, 20 * 1024);
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"xviweb", 6);
+	SSL_CTX_set_timeout(ctx, 3600);
+
+	SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_RENEGOTIATION);
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+	return ctx;
+}
+
+// switches a session to the certificate of the host the client asked for
+int
+TlsContext::selectCertificate(SSL *ssl, int * /*alert*/, void *arg)
+{
+	TlsContext *context = (TlsContext *)arg;
+	const char *hostname = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+	if(hostname == NULL)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	TlsContextMap::const_iterator iter = context->m_hostContexts.find(String::toLower(hostname));
+	if(iter == context->m_hostContexts.end())
+		return SSL_TLSEXT_ERR_NOACK;
+
+	SSL_set_SSL_CTX(ssl, iter->second);
+	return SSL_TLSEXT_ERR_OK;
+}
+
+// picks HTTP/2 if the client offers it and it's enabled, or else
+// HTTP/1.1; clients that offer neither are left to send HTTP/1.x
+int
+TlsContext::selectProtocol(SSL * /*ssl*/, const unsigned char **out, unsigned char *outLength,
+                           const unsigned char *in, unsigned int inLength, void *arg)
+{
+	TlsContext *context = (TlsContext *)arg;
+	const unsigned char *http11 = NULL;
+
+	unsigned int i = 0;
+	while(i < inLength && i + 1 + in[i] <= inLength) {
+		unsigned int length = in[i];
+		const unsigned char *protocol = in + i + 1;
+		if(context->m_http2 && length == 2 && memcmp(protocol, "h2", 2) == 0) {
+			*out = protocol;
+			*outLength = (unsigned char)length;
+			return SSL_TLSEXT_ERR_OK;
+		}
+		if(length == 8 && memcmp(protocol, "http/1.1", 8) == 0)
+			http11 = protocol;
+
+		i += 1 + length;
+	}
+
+	if(http11 == NULL)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	*out = http11;
+	*outLength = 8;
+	return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
+void
+TlsContext::setCertificate(const string &certificateFile, const string &keyFile)
+{
+#ifdef XVIWEB_TLS
+	SSL_CTX *ctx = createContext(certificateFile, keyFile);
+	if(m_defaultContext != NULL)
+		SSL_CTX_free(m_defaultContext);
+	m_defaultContext = ctx;
+
+	// sessions stay in the default context's cache (and are
+	// resumed with its ticket keys) whichever certificate is used
+	SSL_CTX_set_tlsext_servername_callback(m_defaultContext, selectCertificate);
+	SSL_CTX_set_tlsext_servername_arg(m_defaultContext, this);
+	SSL_CTX_set_alpn_select_cb(m_defaultContext, selectProtocol, this);
+#else
+	(void)certificateFile;
+	(void)keyFile;
+	throw "TLS isn't supported by this build";
+#endif
+}
+
+void
+TlsContext::addHostCertificate(const string &hostname, const string &certificateFile, const string &keyFile)
+{
+#ifdef XVIWEB_TLS
+	SSL_CTX *ctx = createContext(certificateFile, keyFile);
+	SSL_CTX_set_alpn_select_cb(ctx, selectProtocol, this);
+	string key = String::toLower(hostname);
+	TlsContextMap::iterator iter = m_hostContexts.find(key);
+	if(iter != m_hostContexts.end()) {
+		SSL_CTX_free(iter->second);
+		iter->second = ctx;
+	} else {
+		m_hostContexts.insert(make_pair(key, ctx));
+	}
+#else
+	(void)hostname;
+	(void)certificateFile;
+	(void)keyFile;
+	throw "TLS isn't supported by this build";
+#endif
+}
+
+bool
+TlsContext::hasCertificate() const
+{
+	return (m_defaultContext != NULL);
+}
+
+void
+TlsContext::setHttp2(bool http2)
+{
+	m_http2 = http2;
+}
+
+SSL *
+TlsContext::createSession(int fd)
+{
+#ifdef XVIWEB_TLS
+	if(m_defaultContext == NULL)
+		return NULL;
+
+	SSL *ssl = SSL_new(m_defaultContext);
+	if(ssl == NULL)
+		return NULL;
+
+	if(SSL_set_fd(ssl, fd) != 1) {
+		SSL_free(ssl);
+		return NULL;
+	}
+
+	SSL_set_accept_state(ssl);
+	return ssl;
+#else
+	(void)fd;
+	return NULL;
+#endif
+}
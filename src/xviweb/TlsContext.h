@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TLSCONTEXT_H__
+#define __TLSCONTEXT_H__
+
+#include <map>
+#include <string>
+
+// declared as OpenSSL declares them, so that
+// this can be included without OpenSSL's headers
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+
+typedef std::map<std::string, SSL_CTX *> TlsContextMap;
+
+// the certificates of the server's TLS listener: a default one and
+// ones for particular hosts, picked by the host name the client asks
+// for (SNI); sessions are resumed from the server's session cache or
+// from session tickets, and records are sent by the kernel when it
+// supports it (kTLS); the protocol is negotiated with ALPN
+class TlsContext
+{
+	private:
+		SSL_CTX *m_defaultContext;
+		TlsContextMap m_hostContexts;
+		bool m_http2;
+
+		TlsContext(const TlsContext &);
+		TlsContext &operator=(const TlsContext &);
+
+		static SSL_CTX *createContext(const std::string &certificateFile, const std::string &keyFile);
+		static int selectCertificate(SSL *ssl, int *alert, void *arg);
+		static int selectProtocol(SSL *ssl, const unsigned char **out, unsigned char *outLength, const unsigned char *in, unsigned int inLength, void *arg);
+
+	public:
+		TlsContext();
+		~TlsContext();
+
+		static bool isSupported();
+
+		void setCertificate(const std::string &certificateFile, const std::string &keyFile);
+		void addHostCertificate(const std::string &hostname, const std::string &certificateFile, const std::string &keyFile);
+		bool hasCertificate() const;
+
+		// whether clients can pick HTTP/2 rather than HTTP/1.1
+		void setHttp2(bool http2);
+
+		// returns a session for a connection accepted on the
+		// given descriptor, or null if one couldn't be created
+		SSL *createSession(int fd);
+};
+
+#endif /* __TLSCONTEXT_H__ */
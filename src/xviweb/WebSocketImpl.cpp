@@ -0,0 +1,625 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <xviweb/String.h>
+#include "WebSocketImpl.h"
+#include "Sha1.h"
+#include "Util.h"
+
+using namespace std;
+
+static const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// unmasks (or masks) a payload in place; the mask repeats
+// every four bytes, so it's applied to as many bytes at a
+// time as the processor allows before finishing bytewise
+static void
+unmask(char *data, size_t length, const uint8_t mask[4])
+{
+	size_t i = 0;
+	uint32_t key;
+	memcpy(&key, mask, 4);
+
+#ifdef __AVX2__
+	__m256i key256 = _mm256_set1_epi32((int)key);
+	for(; i + 32 <= length; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+		_mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v, key256));
+	}
+#endif
+
+#ifdef __SSE2__
+	__m128i key128 = _mm_set1_epi32((int)key);
+	for(; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+		_mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v, key128));
+	}
+#else
+	uint64_t key64 = ((uint64_t)key << 32) | key;
+	for(; i + 8 <= length; i += 8) {
+		uint64_t v;
+		memcpy(&v, data + i, 8);
+		v ^= key64;
+		memcpy(data + i, &v, 8);
+	}
+#endif
+
+	// i is a multiple of four here
+	for(; i < length; ++i)
+		data[i] ^= (char)mask[i & 3];
+}
+
+static bool
+isValidUtf8(const char *data, size_t length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	size_t i = 0;
+	while(i < length) {
+		// skip over ASCII eight bytes at a time
+		if(i + 8 <= length) {
+			uint64_t v;
+			memcpy(&v, p + i, 8);
+			if((v & 0x8080808080808080ULL) == 0) {
+				i += 8;
+				continue;
+			}
+		}
+
+		uint8_t c = p[i];
+		if(c < 0x80) {
+			++i;
+			continue;
+		}
+
+		// determine the sequence's length and the range of
+		// its second byte, which rules out overlong forms,
+		// surrogates, and code points past U+10FFFF
+		size_t n;
+		uint8_t low = 0x80, high = 0xbf;
+		if(c >= 0xc2 && c <= 0xdf) {
+			n = 2;
+		} else if(c >= 0xe0 && c <= 0xef) {
+			n = 3;
+			if(c == 0xe0)
+				low = 0xa0;
+			else if(c == 0xed)
+				high = 0x9f;
+		} else if(c >= 0xf0 && c <= 0xf4) {
+			n = 4;
+			if(c == 0xf0)
+				low = 0x90;
+			else if(c == 0xf4)
+				high = 0x8f;
+		} else {
+			return false;
+		}
+
+		if(i + n > length || p[i + 1] < low || p[i + 1] > high)
+			return false;
+		for(size_t j = 2; j < n; ++j) {
+			if((p[i + j] & 0xc0) != 0x80)
+				return false;
+		}
+
+		i += n;
+	}
+
+	return true;
+}
+
+static bool
+isValidCloseCode(unsigned short code)
+{
+	if(code >= 3000 && code <= 4999)
+		return true;
+
+	return ((code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014));
+}
+
+WebSocketHandler::WebSocketHandler()
+{
+}
+
+WebSocketHandler::~WebSocketHandler()
+{
+}
+
+void
+WebSocketHandler::opened(WebSocket * /*socket*/)
+{
+}
+
+void
+WebSocketHandler::writable(WebSocket * /*socket*/)
+{
+}
+
+void
+WebSocketHandler::closed(WebSocket * /*socket*/, unsigned short /*code*/, const string & /*reason*/)
+{
+}
+
+WebSocketResponder::WebSocketResponder()
+{
+	m_maxMessageSize = WEBSOCKET_DEFAULT_MAX_MESSAGE_SIZE;
+}
+
+WebSocketResponder::~WebSocketResponder()
+{
+}
+
+void
+WebSocketResponder::addOption(const string &option, const string &value)
+{
+	if(option == "maxMessageSize")
+		setMaxMessageSize((size_t)String::toUInt(value));
+}
+
+size_t
+WebSocketResponder::getMaxMessageSize() const
+{
+	return m_maxMessageSize;
+}
+
+void
+WebSocketResponder::setMaxMessageSize(size_t maxMessageSize)
+{
+	m_maxMessageSize = (maxMessageSize != 0) ? maxMessageSize : WEBSOCKET_DEFAULT_MAX_MESSAGE_SIZE;
+}
+
+ResponderContext *
+WebSocketResponder::respond(const HttpRequest *request, HttpResponse *response)
+{
+	// make sure that the request is a valid upgrade
+	if(request->getVerb() != "GET" || request->getVersion() != "HTTP/1.1" ||
+	   String::containsToken(request->getHeaderValue("Upgrade"), "websocket") == false ||
+	   String::containsToken(request->getHeaderValue("Connection"), "upgrade") == false) {
+		response->sendErrorResponse(400, "Bad Request", "The request is not a valid WebSocket upgrade.");
+		return NULL;
+	}
+
+	if(String::trim(request->getHeaderValue("Sec-WebSocket-Version")) != "13") {
+		response->setHeaderValue("Sec-WebSocket-Version", "13");
+		response->sendErrorResponse(426, "Upgrade Required", "The requested WebSocket version is not supported.");
+		return NULL;
+	}
+
+	// the key is sixteen base64-encoded bytes
+	string key = String::trim(request->getHeaderValue("Sec-WebSocket-Key"));
+	if(key.length() != 24 || String::endsWith(key, "==") == false) {
+		response->sendErrorResponse(400, "Bad Request", "The request's WebSocket key is not valid.");
+		return NULL;
+	}
+
+	WebSocketHandler *handler = createHandler(request);
+	if(handler == NULL) {
+		response->sendErrorResponse(403, "Forbidden", "The WebSocket connection was refused.");
+		return NULL;
+	}
+
+	// accept the upgrade; the handshake response is sent
+	// directly, since the connection stops being HTTP
+	uint8_t digest[SHA1_DIGEST_LENGTH];
+	string accept = key + WEBSOCKET_GUID;
+	sha1(accept.data(), accept.length(), digest);
+
+	HttpResponseImpl *responseImpl = static_cast<HttpResponseImpl *>(response);
+	HttpConnection *conn = responseImpl->getConnection();
+	conn->sendString("HTTP/1.1 101 Switching Protocols\r\n"
+	                 "Upgrade: websocket\r\n"
+	                 "Connection: Upgrade\r\n"
+	                 "Sec-WebSocket-Accept: " + String::base64Encode((const char *)digest, sizeof(digest)) + "\r\n\r\n");
+
+	WebSocketImpl *socket = new WebSocketImpl(responseImpl, request, handler, m_maxMessageSize);
+	conn->upgrade(socket);
+	handler->opened(socket);
+
+	// frames may have arrived along with the request
+	conn->processInput();
+	response->sleep();
+	return socket;
+}
+
+WebSocketImpl::WebSocketImpl(HttpResponseImpl *response, const HttpRequest *request,
+                             WebSocketHandler *handler, size_t maxMessageSize)
+{
+	m_conn = response->getConnection();
+	m_response = response;
+	m_request = request;
+	m_handler = handler;
+	m_maxMessageSize = maxMessageSize;
+	m_fragmented = false;
+	m_messageBinary = false;
+	m_closeSent = false;
+	m_closeTime = -1;
+	m_closedNotified = false;
+	m_wakeWhenWritable = false;
+}
+
+WebSocketImpl::~WebSocketImpl()
+{
+	// the connection closed without a closing handshake
+	notifyClosed(WEBSOCKET_CLOSE_ABNORMAL, "");
+	delete m_handler;
+}
+
+const HttpRequest *
+WebSocketImpl::getRequest() const
+{
+	return m_request;
+}
+
+bool
+WebSocketImpl::isOpen() const
+{
+	return (m_closeSent == false && m_conn->getState() == HTTP_CONNECTION_STATE_UPGRADED);
+}
+
+void
+WebSocketImpl::sendFrame(WebSocketOpcode opcode, const char *data, size_t length)
+{
+	// frames sent by the server are never masked or
+	// fragmented; the payload is sent without copying it
+	uint8_t header[10];
+	size_t headerLength;
+	header[0] = 0x80 | (uint8_t)opcode;
+	if(length < 126) {
+		header[1] = (uint8_t)length;
+		headerLength = 2;
+	} else if(length <= 0xffff) {
+		header[1] = 126;
+		header[2] = (uint8_t)(length >> 8);
+		header[3] = (uint8_t)length;
+		headerLength = 4;
+	} else {
+		header[1] = 127;
+		for(int i = 0; i < 8; ++i)
+			header[9 - i] = (uint8_t)((uint64_t)length >> (i * 8));
+		headerLength = 10;
+	}
+
+	struct iovec buffers[2];
+	buffers[0].iov_base = header;
+	buffers[0].iov_len = headerLength;
+	buffers[1].iov_base = (void *)data;
+	buffers[1].iov_len = length;
+	m_conn->sendBuffers(buffers, (length != 0) ? 2 : 1);
+}
+
+void
+WebSocketImpl::sendClose(unsigned short code, const string &reason)
+{
+	string payload;
+	payload += (char)(code >> 8);
+	payload += (char)(code & 0xff);
+	payload += reason.substr(0, 123);
+
+	sendFrame(WEBSOCKET_OPCODE_CLOSE, payload.data(), payload.length());
+	m_closeSent = true;
+}
+
+void
+WebSocketImpl::sendText(const string &text)
+{
+	sendText(text.data(), text.length());
+}
+
+void
+WebSocketImpl::sendText(const char *text, size_t length)
+{
+	if(isOpen())
+		sendFrame(WEBSOCKET_OPCODE_TEXT, text, length);
+}
+
+void
+WebSocketImpl::sendBinary(const char *data, size_t length)
+{
+	if(isOpen())
+		sendFrame(WEBSOCKET_OPCODE_BINARY, data, length);
+}
+
+void
+WebSocketImpl::sendPing(const char *data, size_t length)
+{
+	if(isOpen())
+		sendFrame(WEBSOCKET_OPCODE_PING, data, (length > 125) ? 125 : length);
+}
+
+void
+WebSocketImpl::close(unsigned short code, const string &reason)
+{
+	if(isOpen() == false)
+		return;
+
+	// wait a while for the client's reply; the context
+	// is woken so that it sleeps until the timeout, since
+	// this may be called while a message is being handled
+	sendClose(code, reason);
+	m_closeTime = getMilliseconds() + WEBSOCKET_CLOSE_TIMEOUT;
+	m_response->wake();
+}
+
+size_t
+WebSocketImpl::getSendCapacity() const
+{
+	return m_response->getSendCapacity();
+}
+
+void
+WebSocketImpl::wakeWhenWritable()
+{
+	m_wakeWhenWritable = true;
+	m_response->wakeWhenWritable();
+}
+
+void
+WebSocketImpl::notifyClosed(unsigned short code, const string &reason)
+{
+	if(m_closedNotified)
+		return;
+
+	m_closedNotified = true;
+	m_handler->closed(this, code, reason);
+}
+
+void
+WebSocketImpl::finish()
+{
+	// the connection is closed once the
+	// output that's queued has been sent
+	m_conn->endUpgrade();
+}
+
+void
+WebSocketImpl::fail(unsigned short code)
+{
+	cerr << m_conn->toString() << ": Closing WebSocket connection with status " << code << endl;
+
+	if(m_closeSent == false)
+		sendClose(code, "");
+	notifyClosed(code, "");
+	finish();
+}
+
+void
+WebSocketImpl::messageReceived(const char *data, size_t length, bool binary)
+{
+	if(binary == false && isValidUtf8(data, length) == false) {
+		fail(WEBSOCKET_CLOSE_INVALID_DATA);
+		return;
+	}
+
+	// messages that arrive after the server has
+	// started to close the connection are dropped
+	if(m_closeSent == false)
+		m_handler->messageReceived(this, data, length, binary);
+}
+
+void
+WebSocketImpl::closeReceived(const char *data, size_t length)
+{
+	// the payload, if any, is a status code and a reason
+	unsigned short code = 1005;
+	string reason;
+	if(length == 1) {
+		fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+		return;
+	} else if(length >= 2) {
+		code = (unsigned short)(((uint8_t)data[0] << 8) | (uint8_t)data[1]);
+		if(isValidCloseCode(code) == false) {
+			fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+			return;
+		}
+		if(isValidUtf8(data + 2, length - 2) == false) {
+			fail(WEBSOCKET_CLOSE_INVALID_DATA);
+			return;
+		}
+
+		reason.assign(data + 2, length - 2);
+	}
+
+	// reply to a close that the client started
+	// with the same status code
+	if(m_closeSent == false) {
+		if(length >= 2)
+			sendClose(code, "");
+		else
+			sendFrame(WEBSOCKET_OPCODE_CLOSE, "", 0);
+		m_closeSent = true;
+	}
+
+	notifyClosed(code, reason);
+	finish();
+}
+
+void
+WebSocketImpl::frameReceived(WebSocketOpcode opcode, bool fin, const char *data, size_t length)
+{
+	switch(opcode) {
+		case WEBSOCKET_OPCODE_TEXT:
+		case WEBSOCKET_OPCODE_BINARY:
+			if(m_fragmented) {
+				fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+				break;
+			}
+
+			// unfragmented messages are passed along
+			// straight from the connection's buffer
+			if(fin) {
+				messageReceived(data, length, (opcode == WEBSOCKET_OPCODE_BINARY));
+			} else {
+				m_message.assign(data, length);
+				m_fragmented = true;
+				m_messageBinary = (opcode == WEBSOCKET_OPCODE_BINARY);
+			}
+			break;
+
+		case WEBSOCKET_OPCODE_CONTINUATION:
+			if(m_fragmented == false) {
+				fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+				break;
+			}
+
+			m_message.append(data, length);
+			if(fin) {
+				string message;
+				message.swap(m_message);
+				m_fragmented = false;
+				messageReceived(message.data(), message.length(), m_messageBinary);
+			}
+			break;
+
+		case WEBSOCKET_OPCODE_CLOSE:
+			closeReceived(data, length);
+			break;
+
+		case WEBSOCKET_OPCODE_PING:
+			if(m_closeSent == false)
+				sendFrame(WEBSOCKET_OPCODE_PONG, data, length);
+			break;
+
+		case WEBSOCKET_OPCODE_PONG:
+			break;
+	}
+}
+
+size_t
+WebSocketImpl::upgradedDataRead(char *data, size_t length)
+{
+	// handle every complete frame that's been read; a frame
+	// that's only been partly read is left in the buffer
+	size_t consumed = 0;
+	while(m_conn->getState() == HTTP_CONNECTION_STATE_UPGRADED) {
+		const uint8_t *p = (const uint8_t *)data + consumed;
+		size_t available = length - consumed;
+		if(available < 2)
+			break;
+
+		bool fin = (p[0] & 0x80) != 0;
+		unsigned int opcode = p[0] & 0x0f;
+		uint64_t payloadLength = p[1] & 0x7f;
+		size_t headerLength = 2;
+
+		// clients must mask their frames, and
+		// no extensions have been negotiated
+		if((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0) {
+			fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+			break;
+		}
+
+		bool control = (opcode & 0x8) != 0;
+		if(control) {
+			// control frames can't be fragmented or long
+			if(opcode > WEBSOCKET_OPCODE_PONG || fin == false || payloadLength > 125) {
+				fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+				break;
+			}
+		} else if(opcode > WEBSOCKET_OPCODE_BINARY) {
+			fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+			break;
+		}
+
+		if(payloadLength == 126) {
+			if(available < 4)
+				break;
+			payloadLength = ((uint64_t)p[2] << 8) | p[3];
+			headerLength = 4;
+		} else if(payloadLength == 127) {
+			if(available < 10)
+				break;
+			// the most significant bit of a 64-bit length must be 0
+			if((p[2] & 0x80) != 0) {
+				fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+				break;
+			}
+
+			payloadLength = 0;
+			for(int i = 0; i < 8; ++i)
+				payloadLength = (payloadLength << 8) | p[2 + i];
+			headerLength = 10;
+		}
+
+		// refuse messages that are too big before
+		// waiting for all of their data to be read
+		uint64_t messageLength = payloadLength + (m_fragmented ? m_message.length() : 0);
+		if(control == false && messageLength > m_maxMessageSize) {
+			fail(WEBSOCKET_CLOSE_MESSAGE_TOO_BIG);
+			break;
+		}
+
+		headerLength += 4;
+		if(available < headerLength || available - headerLength < payloadLength)
+			break;
+
+		char *payload = data + consumed + headerLength;
+		unmask(payload, (size_t)payloadLength, p + headerLength - 4);
+		consumed += headerLength + (size_t)payloadLength;
+
+		frameReceived((WebSocketOpcode)opcode, fin, payload, (size_t)payloadLength);
+	}
+
+	return consumed;
+}
+
+ResponderContext *
+WebSocketImpl::continueResponse(const HttpRequest * /*request*/, HttpResponse * /*response*/)
+{
+	if(m_conn->getState() != HTTP_CONNECTION_STATE_UPGRADED)
+		return NULL;
+
+	// close the connection if the client hasn't
+	// replied to a close before the timeout
+	long currentTime = getMilliseconds();
+	if(m_closeSent && currentTime >= m_closeTime) {
+		notifyClosed(WEBSOCKET_CLOSE_ABNORMAL, "");
+		finish();
+		return NULL;
+	}
+
+	if(m_wakeWhenWritable && m_conn->getOutputSize() == 0) {
+		m_wakeWhenWritable = false;
+		m_handler->writable(this);
+		if(m_conn->getState() != HTTP_CONNECTION_STATE_UPGRADED)
+			return NULL;
+	}
+
+	// sleep until the next event; the handler may
+	// have started to close the connection
+	m_response->sleep();
+	if(m_wakeWhenWritable)
+		m_response->wakeWhenWritable();
+	if(m_closeSent)
+		m_response->wakeAfter(m_closeTime - getMilliseconds());
+	return this;
+}
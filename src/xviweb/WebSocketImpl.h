@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __WEBSOCKETIMPL_H__
+#define __WEBSOCKETIMPL_H__
+
+#include <xviweb/WebSocket.h>
+#include "HttpResponseImpl.h"
+
+// the number of milliseconds to wait for the client to
+// reply to a close frame before closing the connection
+#define WEBSOCKET_CLOSE_TIMEOUT 5000
+
+enum WebSocketOpcode
+{
+	WEBSOCKET_OPCODE_CONTINUATION = 0x0,
+	WEBSOCKET_OPCODE_TEXT = 0x1,
+	WEBSOCKET_OPCODE_BINARY = 0x2,
+	WEBSOCKET_OPCODE_CLOSE = 0x8,
+	WEBSOCKET_OPCODE_PING = 0x9,
+	WEBSOCKET_OPCODE_PONG = 0xa
+};
+
+// the server's end of a WebSocket connection; it decodes the
+// frames read by the connection in place, and is the context
+// of the upgraded response so that it can wait for the
+// connection to become writable or for the close to time out
+class WebSocketImpl : public WebSocket, public ResponderContext, public HttpConnectionUpgrade
+{
+	private:
+		HttpConnection *m_conn;
+		HttpResponseImpl *m_response;
+		const HttpRequest *m_request;
+		WebSocketHandler *m_handler;
+		size_t m_maxMessageSize;
+
+		// the payload of a fragmented message
+		std::string m_message;
+		bool m_fragmented;
+		bool m_messageBinary;
+
+		bool m_closeSent;
+		long m_closeTime;
+		bool m_closedNotified;
+		bool m_wakeWhenWritable;
+
+		void sendFrame(WebSocketOpcode opcode, const char *data, size_t length);
+		void sendClose(unsigned short code, const std::string &reason);
+		void frameReceived(WebSocketOpcode opcode, bool fin, const char *data, size_t length);
+		void closeReceived(const char *data, size_t length);
+		void messageReceived(const char *data, size_t length, bool binary);
+		void fail(unsigned short code);
+		void notifyClosed(unsigned short code, const std::string &reason);
+		void finish();
+
+	public:
+		WebSocketImpl(HttpResponseImpl *response, const HttpRequest *request, WebSocketHandler *handler, size_t maxMessageSize);
+		~WebSocketImpl();
+
+		const HttpRequest *getRequest() const;
+		bool isOpen() const;
+
+		void sendText(const std::string &text);
+		void sendText(const char *text, size_t length);
+		void sendBinary(const char *data, size_t length);
+		void sendPing(const char *data, size_t length);
+		void close(unsigned short code, const std::string &reason);
+
+		size_t getSendCapacity() const;
+		void wakeWhenWritable();
+
+		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
+		size_t upgradedDataRead(char *data, size_t length);
+};
+
+#endif /* __WEBSOCKETIMPL_H__ */
@@ -37,6 +37,7 @@
 using namespace std;
 
 bool g_running = true;
+bool g_showStatistics = false;
 
 static void
 interrupt(int /*param*/)
@@ -44,6 +45,28 @@ interrupt(int /*param*/)
 	g_running = false;
 }
 
+static void
+requestStatistics(int /*param*/)
+{
+	g_showStatistics = true;
+}
+
+static void
+showStatistics(ostream &stream, const ServerStatistics &statistics)
+{
+	stream << "Accepted connections: " << statistics.acceptedConnections << endl;
+	stream << "Accept queue overflows: " << statistics.acceptQueueOverflows << endl;
+	stream << "Longest accept queue: " << statistics.maxAcceptQueueLength << endl;
+	stream << "Full accept batches: " << statistics.fullAcceptBatches << endl;
+	stream << "Accept errors: " << statistics.acceptErrors << endl;
+	stream << "Rejected connections: " << statistics.rejectedConnections << endl;
+	stream << "Shed requests: " << statistics.shedRequests << endl;
+	stream << "Rejected client connections: " << statistics.rejectedClientConnections << endl;
+	stream << "Rate limited requests: " << statistics.limitedRequests << endl;
+	stream << "HTTP/2 connections: " << statistics.http2Connections << endl;
+	stream << "HTTP/2 streams: " << statistics.http2Streams << endl;
+}
+
 static void
 showOptionDescription(ostream &stream, const string &option,
                       const string &desc)
@@ -88,8 +111,36 @@ showUsageMessage(ostream &stream, const char *executableName)
 	stream << "Options:" << endl;
 	showOptionDescription(stream, "--address <address>", "Sets the address that the server binds to.\nThe default value is 127.0.0.1.");
 	showOptionDescription(stream, "--port <port>", "Sets the port that the server binds to.\nThe default value is 8080.");
+	showOptionDescription(stream, "--tlsPort <port>", "Sets a port that the server accepts TLS connections\non, using the certificate set with --tlsCertificate.");
+	showOptionDescription(stream, "--tlsCertificate <cert> <key>", "Sets the TLS certificate chain and private key files\n(in PEM format) used when no vhost certificate\nmatches the host the client asks for.");
+	showOptionDescription(stream, "--addVHostCertificate <hostname> <cert> <key>", "Adds a TLS certificate chain and private key used for\nconnections that ask for the given host.");
+	showOptionDescription(stream, "--listenBacklog <count>", "Sets how many connections can wait to be accepted.\nThe default value is SOMAXCONN.");
+	showOptionDescription(stream, "--acceptBatchSize <count>", "Sets how many waiting connections are accepted at\nonce. The default value is 64.");
+	showOptionDescription(stream, "--ioUring", "Uses io_uring for network and file I/O where the\nkernel supports it, falling back to epoll otherwise.");
+	showOptionDescription(stream, "--fileReadThreads <count>", "Sets how many threads read files when io_uring isn't\nused, or 0 to read them in the server's thread. The\ndefault value is 4.");
+	showOptionDescription(stream, "--maxConnections <count>", "Sets how many connections are handled at once, or 0\nfor no limit; connections over the limit are sent a\n503 response. The default value is 0.");
+	showOptionDescription(stream, "--overloadTarget <ms>", "Sets how long requests can wait to be handled before\nthe server is considered overloaded and sends them a\n503 response, or 0 to never do so. The default value\nis 50.");
+	showOptionDescription(stream, "--overloadInterval <ms>", "Sets how long requests must have waited longer than\nthe overload target for the server to be considered\noverloaded. The default value is 500.");
+	showOptionDescription(stream, "--maxClientConnections <count>", "Sets how many connections each client (by IPv4\naddress or IPv6 /64 network) can have, or 0 for no\nlimit. The default value is 0.");
+	showOptionDescription(stream, "--clientRequestRate <rate> <burst>", "Sets how many requests per second each client can\nmake, and how many at once, or 0 for no limit; other\nrequests are sent a 429 response. The default value\nis 0.");
+	showOptionDescription(stream, "--clientTableSize <count>", "Sets how many clients are kept track of for the\nclient limits. The default value is 16384.");
+	showOptionDescription(stream, "--exemptPath <path>", "Adds a path (e.g. a health check) whose requests are\nhandled even when the server is overloaded or their\nclient has made too many requests.");
 	showOptionDescription(stream, "--defaultRoot <root>", "Sets the default root directory.");
 	showOptionDescription(stream, "--addVHost <hostname> <root>", "Adds a virtual host with the given hostname and root directory.");
+	showOptionDescription(stream, "--maxHeaderSize <bytes>", "Sets the maximum size of a request's headers.\nThe default value is 8192.");
+	showOptionDescription(stream, "--maxBodySize <bytes>", "Sets the maximum size of a request's body, or 0 for\nno limit. The default value is 1048576.");
+	showOptionDescription(stream, "--uploadDirectory <dir>", "Sets the directory where uploaded files are stored\nwhile a request is handled. The default value is /tmp.");
+	showOptionDescription(stream, "--uploadMemoryThreshold <bytes>", "Sets the size above which an uploaded form field is\nstored on disk. The default value is 65536.");
+	showOptionDescription(stream, "--maxOutputSize <bytes>", "Sets how much output is queued for a connection\nbefore responses are asked to wait for it to be sent.\nThe default value is 65536.");
+	showOptionDescription(stream, "--maxConcurrentStreams <count>", "Sets how many streams an HTTP/2 client can have open\nat once, or 0 to disable HTTP/2. The default value\nis 100.");
+	showOptionDescription(stream, "--responseCacheSize <bytes>", "Sets how much memory is used to cache the responses\nof responders that allow it, or 0 to disable caching.\nThe default value is 16777216.");
+	showOptionDescription(stream, "--compressionLevel <level>", "Sets the level (1 to 9) that response bodies of\ncompressible types are compressed at when the client\naccepts zstd, gzip or deflate, or 0 to disable\ncompression. The default value is 6.");
+	showOptionDescription(stream, "--vhostCompressionLevel <hostname> <level>", "Sets the compression level of a virtual host.");
+	showOptionDescription(stream, "--compressionMinSize <bytes>", "Sets the size below which response bodies of known\nlength aren't compressed. The default value is 1024.");
+	showOptionDescription(stream, "--compressionDictionary <path prefix> <file>", "Compresses responses to requests for paths under the\nprefix with the dictionary in the file (made with\nxviweb-dictionary), for clients that have it and\naccept dcz.");
+	showOptionDescription(stream, "--vhostCompressionDictionary <hostname> <path prefix> <file>", "Sets a compression dictionary for a virtual host's\npaths under the prefix.");
+	showOptionDescription(stream, "--loadResponder <path>", "Loads a responder module.");
+	showOptionDescription(stream, "--responderOption <option> <value>", "Sets an option of the responder module that was\nloaded last.");
 	showOptionDescription(stream, "--help", "Show this help message.");
 	showOptionDescription(stream, "--version", "Show version information.");
 }
@@ -151,6 +202,174 @@ main(int argc, char *argv[])
 			continue;
 		}
 
+		// set the TLS port
+		if(strcmp(argv[i], "--tlsPort") == 0) {
+			if(missingParameters(argv[0], "--tlsPort", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setTlsPort((unsigned short)atoi(argv[++i]));
+			continue;
+		}
+
+		// set the default TLS certificate
+		if(strcmp(argv[i], "--tlsCertificate") == 0) {
+			if(missingParameters(argv[0], "--tlsCertificate", argc, i, 2)) {
+				delete server;
+				return 1;
+			}
+
+			const char *certificate = argv[++i];
+			const char *key = argv[++i];
+			try {
+				server->setTlsCertificate(certificate, key);
+			} catch(const char *ex) {
+				cerr << "Error loading " << certificate << ": " << ex << endl;
+				delete server;
+				return 1;
+			}
+			continue;
+		}
+
+		// add a vhost's TLS certificate
+		if(strcmp(argv[i], "--addVHostCertificate") == 0) {
+			if(missingParameters(argv[0], "--addVHostCertificate", argc, i, 3)) {
+				delete server;
+				return 1;
+			}
+
+			const char *hostname = argv[++i];
+			const char *certificate = argv[++i];
+			const char *key = argv[++i];
+			try {
+				server->addVHostCertificate(hostname, certificate, key);
+			} catch(const char *ex) {
+				cerr << "Error loading " << certificate << ": " << ex << endl;
+				delete server;
+				return 1;
+			}
+			continue;
+		}
+
+		// set the length of the listening socket's queue
+		if(strcmp(argv[i], "--listenBacklog") == 0) {
+			if(missingParameters(argv[0], "--listenBacklog", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setListenBacklog(atoi(argv[++i]));
+			continue;
+		}
+
+		// set how many connections are accepted at once
+		if(strcmp(argv[i], "--acceptBatchSize") == 0) {
+			if(missingParameters(argv[0], "--acceptBatchSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setAcceptBatchSize((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// use io_uring for I/O
+		if(strcmp(argv[i], "--ioUring") == 0) {
+			server->setIoUring(true);
+			continue;
+		}
+
+		// set how many threads read files
+		if(strcmp(argv[i], "--fileReadThreads") == 0) {
+			if(missingParameters(argv[0], "--fileReadThreads", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setFileReadThreads((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// set the maximum number of connections
+		if(strcmp(argv[i], "--maxConnections") == 0) {
+			if(missingParameters(argv[0], "--maxConnections", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxConnections((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// set how long requests can wait before they're shed
+		if(strcmp(argv[i], "--overloadTarget") == 0) {
+			if(missingParameters(argv[0], "--overloadTarget", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setOverloadTarget(atol(argv[++i]));
+			continue;
+		}
+
+		// set how long the overload target must be exceeded
+		if(strcmp(argv[i], "--overloadInterval") == 0) {
+			if(missingParameters(argv[0], "--overloadInterval", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setOverloadInterval(atol(argv[++i]));
+			continue;
+		}
+
+		// set how many connections each client can have
+		if(strcmp(argv[i], "--maxClientConnections") == 0) {
+			if(missingParameters(argv[0], "--maxClientConnections", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxClientConnections((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// set each client's request rate
+		if(strcmp(argv[i], "--clientRequestRate") == 0) {
+			if(missingParameters(argv[0], "--clientRequestRate", argc, i, 2)) {
+				delete server;
+				return 1;
+			}
+
+			long rate = atol(argv[++i]);
+			long burst = atol(argv[++i]);
+			server->setClientRequestRate(rate, burst);
+			continue;
+		}
+
+		// set how many clients are kept track of
+		if(strcmp(argv[i], "--clientTableSize") == 0) {
+			if(missingParameters(argv[0], "--clientTableSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setClientTableSize((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// add a path whose requests are never shed or limited
+		if(strcmp(argv[i], "--exemptPath") == 0) {
+			if(missingParameters(argv[0], "--exemptPath", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->addExemptPath(argv[++i]);
+			continue;
+		}
+
 		// set the default root directory
 		if(strcmp(argv[i], "--defaultRoot") == 0) {
 			if(missingParameters(argv[0], "--defaultRoot", argc, i, 1)) {
@@ -175,6 +394,135 @@ main(int argc, char *argv[])
 			continue;
 		}
 
+		// set the maximum request header size
+		if(strcmp(argv[i], "--maxHeaderSize") == 0) {
+			if(missingParameters(argv[0], "--maxHeaderSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxHeaderSize((unsigned int)atoi(argv[++i]));
+			continue;
+		}
+
+		// set the maximum request body size
+		if(strcmp(argv[i], "--maxBodySize") == 0) {
+			if(missingParameters(argv[0], "--maxBodySize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxBodySize((uint64_t)strtoull(argv[++i], NULL, 10));
+			continue;
+		}
+
+		// set the upload directory
+		if(strcmp(argv[i], "--uploadDirectory") == 0) {
+			if(missingParameters(argv[0], "--uploadDirectory", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setUploadDirectory(argv[++i]);
+			continue;
+		}
+
+		// set the size at which form fields are stored on disk
+		if(strcmp(argv[i], "--uploadMemoryThreshold") == 0) {
+			if(missingParameters(argv[0], "--uploadMemoryThreshold", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setUploadMemoryThreshold((size_t)strtoull(argv[++i], NULL, 10));
+			continue;
+		}
+
+		// set the size of each connection's output queue
+		if(strcmp(argv[i], "--maxOutputSize") == 0) {
+			if(missingParameters(argv[0], "--maxOutputSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxOutputSize((size_t)strtoull(argv[++i], NULL, 10));
+			continue;
+		}
+
+		// set the limit on each HTTP/2 connection's streams
+		if(strcmp(argv[i], "--maxConcurrentStreams") == 0) {
+			if(missingParameters(argv[0], "--maxConcurrentStreams", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setMaxConcurrentStreams((unsigned int)strtoul(argv[++i], NULL, 10));
+			continue;
+		}
+
+		// set the size of the response cache
+		if(strcmp(argv[i], "--responseCacheSize") == 0) {
+			if(missingParameters(argv[0], "--responseCacheSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setResponseCacheSize((size_t)strtoull(argv[++i], NULL, 10));
+			continue;
+		}
+
+		// set how responses are compressed
+		if(strcmp(argv[i], "--compressionLevel") == 0) {
+			if(missingParameters(argv[0], "--compressionLevel", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setCompressionLevel(atoi(argv[++i]));
+			continue;
+		}
+
+		if(strcmp(argv[i], "--vhostCompressionLevel") == 0) {
+			if(missingParameters(argv[0], "--vhostCompressionLevel", argc, i, 2)) {
+				delete server;
+				return 1;
+			}
+
+			const char *hostname = argv[++i];
+			server->setVHostCompressionLevel(hostname, atoi(argv[++i]));
+			continue;
+		}
+
+		if(strcmp(argv[i], "--compressionMinSize") == 0) {
+			if(missingParameters(argv[0], "--compressionMinSize", argc, i, 1)) {
+				delete server;
+				return 1;
+			}
+
+			server->setCompressionMinSize((size_t)strtoull(argv[++i], NULL, 10));
+			continue;
+		}
+
+		if(strcmp(argv[i], "--compressionDictionary") == 0 || strcmp(argv[i], "--vhostCompressionDictionary") == 0) {
+			bool vhost = (strcmp(argv[i], "--vhostCompressionDictionary") == 0);
+			if(missingParameters(argv[0], argv[i], argc, i, vhost ? 3 : 2)) {
+				delete server;
+				return 1;
+			}
+
+			const char *hostname = vhost ? argv[++i] : "";
+			const char *pathPrefix = argv[++i];
+			const char *dictionary = argv[++i];
+			try {
+				server->addCompressionDictionary(hostname, pathPrefix, dictionary);
+			} catch(const char *ex) {
+				cerr << "Error loading " << dictionary << ": " << ex << endl;
+				delete server;
+				return 1;
+			}
+			continue;
+		}
+
 		// load responder
 		if(strcmp(argv[i], "--loadResponder") == 0) {
 			if(missingParameters(argv[0], "--loadResponder", argc, i, 1)) {
@@ -193,12 +541,32 @@ main(int argc, char *argv[])
 			continue;
 		}
 
+		// pass an option to the last responder loaded
+		if(strcmp(argv[i], "--responderOption") == 0) {
+			if(missingParameters(argv[0], "--responderOption", argc, i, 2)) {
+				delete server;
+				return 1;
+			}
+
+			const char *option = argv[++i];
+			const char *value = argv[++i];
+			if(modules.size() == 0) {
+				cerr << "No responder loaded for option " << option << endl;
+				continue;
+			}
+
+			modules.back()->getResponder()->addOption(option, value);
+			continue;
+		}
+
 		cerr << "Unknown option: " << argv[i] << endl << endl;
 		showUsageMessage(cerr, argv[0]);
 		return 1;
 	}
 
 	signal(SIGINT, interrupt);
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGUSR1, requestStatistics);
 
 	// attach responders to the server
 	for(unsigned int i = 0; i < modules.size(); ++i)
@@ -219,6 +587,8 @@ main(int argc, char *argv[])
 	}
 
 	cout << "Listening for connections at " << server->getAddress().toString() << " port " << server->getPort() << endl;
+	if(server->getTlsPort() != 0)
+		cout << "Listening for TLS connections at " << server->getAddress().toString() << " port " << server->getTlsPort() << endl;
 
 	while(g_running) {
 		try {
@@ -226,9 +596,16 @@ main(int argc, char *argv[])
 		} catch(const char *ex) {
 			cerr << "Error during cycle: " << ex << endl;
 		}
+
+		// SIGUSR1 shows the server's statistics
+		if(g_showStatistics) {
+			g_showStatistics = false;
+			showStatistics(cout, server->getStatistics());
+		}
 	}
 
 	cout << endl << "Stopping server..." << endl;
+	showStatistics(cout, server->getStatistics());
 	delete server;
 
 	// delete responder modules